@@ -378,6 +378,18 @@ Database::keep_alive()
     internal->keep_alive();
 }
 
+void
+Database::preload(Xapian::termcount top_terms, size_t max_rate) const
+{
+    internal->preload(top_terms, max_rate);
+}
+
+void
+Database::lease_revision(unsigned duration) const
+{
+    internal->lease_revision(duration);
+}
+
 string
 Database::get_description() const
 {
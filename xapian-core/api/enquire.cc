@@ -39,6 +39,7 @@
 #include "xapian/rset.h"
 #include "xapian/weight.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -195,6 +196,24 @@ Enquire::set_time_limit(double time_limit)
     internal->time_limit = time_limit;
 }
 
+void
+Enquire::set_document_prefetch(doccount n_docs)
+{
+    internal->document_prefetch = n_docs;
+}
+
+void
+Enquire::set_hedge_delay(double delay)
+{
+    internal->hedge_delay = delay;
+}
+
+void
+Enquire::set_shard_timeout(double timeout)
+{
+    internal->shard_timeout = timeout;
+}
+
 MSet
 Enquire::get_mset(doccount first,
 		  doccount maxitems,
@@ -306,6 +325,7 @@ Enquire::Internal::get_mset(doccount first,
 		    sort_by,
 		    sort_val_reverse,
 		    time_limit,
+		    shard_timeout,
 		    matchspies);
 
     MSet mset = match.get_mset(first,
@@ -324,6 +344,8 @@ Enquire::Internal::get_mset(doccount first,
 			       sort_by,
 			       sort_val_reverse,
 			       time_limit,
+			       document_prefetch,
+			       hedge_delay,
 			       matchspies);
 
     if (first_orig != first && mset.internal.get()) {
@@ -332,6 +354,12 @@ Enquire::Internal::get_mset(doccount first,
 
     mset.internal->set_enquire(this);
 
+    if (!match.get_missing_shards().empty()) {
+	vector<Xapian::doccount> missing = match.get_missing_shards();
+	sort(missing.begin(), missing.end());
+	mset.internal->set_missing_shards(std::move(missing));
+    }
+
     if (!mset.internal->get_stats()) {
 	mset.internal->set_stats(stats.release());
     }
@@ -79,6 +79,12 @@ class Enquire::Internal : public Xapian::Internal::intrusive_base {
 
     double time_limit = 0.0;
 
+    doccount document_prefetch = 0;
+
+    double hedge_delay = 0.0;
+
+    double shard_timeout = 0.0;
+
     enum { EXPAND_TRAD, EXPAND_BO1 } eweight = EXPAND_TRAD;
 
     double expand_k = 1.0;
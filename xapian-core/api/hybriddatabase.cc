@@ -0,0 +1,242 @@
+/** @file hybriddatabase.cc
+ * @brief A glass database plus an in-memory segment of recent changes
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include <xapian/database.h>
+
+#include "backends/databaseinternal.h"
+#include "debuglog.h"
+#include "parseint.h"
+#include <xapian/constants.h>
+#include <xapian/document.h>
+#include <xapian/error.h>
+#include <xapian/postingiterator.h>
+
+#include <cstdlib>
+#include <set>
+#include <string>
+
+using namespace std;
+
+namespace Xapian {
+
+class HybridDatabase::Internal : public Xapian::Internal::intrusive_base {
+    /// Path of the glass database.
+    string path;
+
+    /// The glass database, which we write to when committing.
+    WritableDatabase wdb;
+
+    /** The glass database at the revision we last committed.
+     *
+     *  Documents which have been replaced or deleted since are masked.
+     */
+    Database base;
+
+    /// The in-memory segment.
+    WritableDatabase delta;
+
+    /// Unique terms of documents to delete from wdb when committing.
+    set<string> deleted_terms;
+
+    /// The number of changes since the last commit.
+    doccount change_count = 0;
+
+    /// If change_count reaches this threshold we automatically commit.
+    doccount flush_threshold = 0;
+
+    /// Open the glass segment afresh and start a new in-memory segment.
+    void open_segments() {
+	base = Database(path);
+	delta = WritableDatabase(string(), DB_BACKEND_INMEMORY);
+    }
+
+    /// Mask any documents in the glass segment indexed by @a unique_term.
+    void mask_base_documents(const string& unique_term) {
+	for (auto i = base.postlist_begin(unique_term);
+	     i != base.postlist_end(unique_term); ++i) {
+	    base.internal->mask_document(*i);
+	}
+	deleted_terms.insert(unique_term);
+    }
+
+    /// Count a change, committing if we've reached the threshold.
+    void count_change() {
+	if (++change_count >= flush_threshold) commit();
+    }
+
+  public:
+    Internal(const string& path_, int flags)
+	: path(path_)
+    {
+	int backend = flags & DB_BACKEND_MASK_;
+	if (backend != 0 && backend != DB_BACKEND_GLASS) {
+	    throw InvalidArgumentError("HybridDatabase only supports the glass "
+				       "backend");
+	}
+	wdb = WritableDatabase(path, flags);
+	const char* p = getenv("XAPIAN_FLUSH_THRESHOLD");
+	if (p && *p) {
+	    if (!parse_unsigned(p, flush_threshold)) {
+		throw InvalidArgumentError("XAPIAN_FLUSH_THRESHOLD must be a "
+					   "non-negative integer");
+	    }
+	}
+	if (flush_threshold == 0)
+	    flush_threshold = 10000;
+	open_segments();
+    }
+
+    ~Internal() {
+	try {
+	    commit();
+	} catch (...) {
+	    // We can't safely throw exceptions from a destructor in case an
+	    // exception is already active and causing us to be destroyed.
+	}
+    }
+
+    void add_document(const Document& document) {
+	delta.add_document(document);
+	count_change();
+    }
+
+    void replace_document(const string& unique_term,
+			  const Document& document) {
+	if (unique_term.empty())
+	    throw InvalidArgumentError("Empty termnames are invalid");
+	mask_base_documents(unique_term);
+	delta.delete_document(unique_term);
+	delta.add_document(document);
+	count_change();
+    }
+
+    void delete_document(const string& unique_term) {
+	if (unique_term.empty())
+	    throw InvalidArgumentError("Empty termnames are invalid");
+	mask_base_documents(unique_term);
+	delta.delete_document(unique_term);
+	count_change();
+    }
+
+    Database get_database() const {
+	Database db;
+	db.add_database(base);
+	db.add_database(delta);
+	return db;
+    }
+
+    void commit() {
+	if (change_count == 0) return;
+	// Use a transaction so a failure part way through doesn't leave some
+	// of the changes pending in wdb.
+	wdb.begin_transaction();
+	try {
+	    for (auto&& term : deleted_terms) {
+		wdb.delete_document(term);
+	    }
+	    for (auto i = delta.postlist_begin(string());
+		 i != delta.postlist_end(string()); ++i) {
+		wdb.add_document(delta.get_document(*i));
+	    }
+	} catch (...) {
+	    // Leave the in-memory segment as it is so the caller can retry.
+	    wdb.cancel_transaction();
+	    throw;
+	}
+	wdb.commit_transaction();
+	deleted_terms.clear();
+	change_count = 0;
+	// Existing Database objects from get_database() keep the old segments
+	// until the glass revision they're reading is overwritten.
+	open_segments();
+    }
+
+    string get_description() const {
+	string desc = "HybridDatabase(";
+	desc += path;
+	desc += ')';
+	return desc;
+    }
+};
+
+HybridDatabase::HybridDatabase(const HybridDatabase&) = default;
+
+HybridDatabase&
+HybridDatabase::operator=(const HybridDatabase&) = default;
+
+HybridDatabase::HybridDatabase(HybridDatabase&&) = default;
+
+HybridDatabase&
+HybridDatabase::operator=(HybridDatabase&&) = default;
+
+HybridDatabase::HybridDatabase(const string& path, int flags)
+    : internal(new HybridDatabase::Internal(path, flags))
+{
+    LOGCALL_CTOR(API, "HybridDatabase", path | flags);
+}
+
+HybridDatabase::~HybridDatabase()
+{
+    LOGCALL_DTOR(API, "HybridDatabase");
+}
+
+void
+HybridDatabase::add_document(const Document& document)
+{
+    LOGCALL_VOID(API, "HybridDatabase::add_document", document);
+    internal->add_document(document);
+}
+
+void
+HybridDatabase::replace_document(const string& unique_term,
+				 const Document& document)
+{
+    LOGCALL_VOID(API, "HybridDatabase::replace_document", unique_term | document);
+    internal->replace_document(unique_term, document);
+}
+
+void
+HybridDatabase::delete_document(const string& unique_term)
+{
+    LOGCALL_VOID(API, "HybridDatabase::delete_document", unique_term);
+    internal->delete_document(unique_term);
+}
+
+Database
+HybridDatabase::get_database() const
+{
+    return internal->get_database();
+}
+
+void
+HybridDatabase::commit()
+{
+    LOGCALL_VOID(API, "HybridDatabase::commit", NO_ARGS);
+    internal->commit();
+}
+
+string
+HybridDatabase::get_description() const
+{
+    return internal->get_description();
+}
+
+}
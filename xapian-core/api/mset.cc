@@ -30,6 +30,7 @@
 #include "serialise-double.h"
 #include "str.h"
 #include "unicode/description_append.h"
+#include "xapian/error.h"
 
 #include <algorithm>
 #include <cfloat>
@@ -167,6 +168,27 @@ MSet::get_max_attained() const
     return internal->max_attained;
 }
 
+vector<Xapian::doccount>
+MSet::get_missing_shards() const
+{
+    return internal->missing_shards;
+}
+
+string
+MSet::serialise() const
+{
+    return internal->serialise();
+}
+
+MSet
+MSet::unserialise(const string& serialised)
+{
+    MSet mset;
+    const char* p = serialised.data();
+    mset.internal->unserialise(p, p + serialised.size());
+    return mset;
+}
+
 double
 MSet::get_max_possible() const
 {
@@ -210,7 +232,10 @@ MSet::Internal::get_document(Xapian::doccount index) const
 	msg += str(items.size());
 	throw Xapian::RangeError(msg);
     }
-    Assert(enquire.get());
+    if (rare(enquire.get() == NULL)) {
+	throw Xapian::InvalidOperationError("MSet has no Enquire object to "
+					    "fetch documents with");
+    }
     return enquire->get_document(items[index].get_docid());
 }
 
@@ -226,7 +251,7 @@ MSet::Internal::fetch(Xapian::doccount first_, Xapian::doccount last) const
     if (first_ <= last) {
 	Xapian::doccount n = last - first_;
 	for (Xapian::doccount i = 0; i <= n; ++i) {
-	    enquire->request_document(items[i].get_docid());
+	    enquire->request_document(items[first_ + i].get_docid());
 	}
     }
 }
@@ -317,10 +342,87 @@ MSet::Internal::merge_stats(const Internal* o, bool collapsing)
     }
 }
 
+/// Flags in the serialised form of an MSet saying which optional parts follow.
+enum {
+    MSET_HAS_SORT_KEYS = 1,
+    MSET_HAS_COLLAPSE_KEYS = 2,
+    MSET_HAS_COLLAPSE_COUNTS = 4,
+    MSET_HAS_MISSING_SHARDS = 8
+};
+
+/// Append @a section to @a result, preceded by its length.
+static inline void
+append_section(string& result, const string& section)
+{
+    pack_uint(result, section.size());
+    result += section;
+}
+
+/** Locate a section written by append_section().
+ *
+ *  @param p	Pointer to a pointer to the serialised data, which is advanced
+ *		past the section.
+ *  @param p_end	Pointer to the end of the serialised data.
+ *
+ *  @return	Pointer to the start of the section's contents.
+ */
+static const char*
+find_section(const char** p, const char* p_end)
+{
+    size_t len;
+    if (!unpack_uint(p, p_end, &len)) {
+	unpack_throw_serialisation_error(*p);
+    }
+    if (size_t(p_end - *p) < len) {
+	unpack_throw_serialisation_error(NULL);
+    }
+    const char* start = *p;
+    *p += len;
+    return start;
+}
+
+/** Unpack the next key from a section of key lengths and a section of keys.
+ *
+ *  @param lens	Pointer to a pointer to the next key length.
+ *  @param keys	Pointer to a pointer to the next key.
+ *  @param keys_end	Pointer to the end of the section of keys.
+ *  @param key	String to set to the key.
+ */
+static void
+unpack_key(const char** lens, const char** keys, const char* keys_end,
+	   string& key)
+{
+    size_t len;
+    // The section of lengths is followed by the section of keys so we can
+    // use keys_end to bound the read of the length.
+    if (!unpack_uint(lens, keys_end, &len)) {
+	unpack_throw_serialisation_error(*lens);
+    }
+    if (size_t(keys_end - *keys) < len) {
+	unpack_throw_serialisation_error(NULL);
+    }
+    key.assign(*keys, len);
+    *keys += len;
+}
+
 string
 MSet::Internal::serialise() const
 {
     string result;
+    serialise(result);
+    return result;
+}
+
+void
+MSet::Internal::serialise(string& result) const
+{
+    // The items are stored column by column rather than item by item.  The
+    // weights are fixed width, and each other column is preceded by its
+    // length in bytes so that unserialise() can read all the columns in a
+    // single pass without having to build any temporary structures.  Columns
+    // which would only contain default values are omitted entirely, which is
+    // the common case for sort keys, collapse keys and collapse counts.
+    result.reserve(result.size() + 64 + items.size() * 12);
 
     result += serialise_double(max_possible);
     result += serialise_double(max_attained);
@@ -342,24 +444,80 @@ MSet::Internal::serialise() const
     pack_uint(result, uncollapsed_upper_bound);
 
     pack_uint(result, items.size());
+
+    unsigned flags = 0;
+    for (auto&& item : items) {
+	if (!item.get_sort_key().empty())
+	    flags |= MSET_HAS_SORT_KEYS;
+	if (!item.get_collapse_key().empty())
+	    flags |= MSET_HAS_COLLAPSE_KEYS;
+	if (item.get_collapse_count() != 0)
+	    flags |= MSET_HAS_COLLAPSE_COUNTS;
+    }
+    if (!missing_shards.empty())
+	flags |= MSET_HAS_MISSING_SHARDS;
+    result += char(flags);
+
     for (auto&& item : items) {
 	result += serialise_double(item.get_weight());
-	pack_uint(result, item.get_docid());
-	pack_string(result, item.get_sort_key());
-	pack_string(result, item.get_collapse_key());
-	pack_uint(result, item.get_collapse_count());
+    }
+
+    string section;
+    for (auto&& item : items) {
+	pack_uint(section, item.get_docid());
+    }
+    append_section(result, section);
+
+    if (flags & MSET_HAS_COLLAPSE_COUNTS) {
+	section.resize(0);
+	for (auto&& item : items) {
+	    pack_uint(section, item.get_collapse_count());
+	}
+	append_section(result, section);
+    }
+
+    if (flags & MSET_HAS_SORT_KEYS) {
+	section.resize(0);
+	for (auto&& item : items) {
+	    pack_uint(section, item.get_sort_key().size());
+	}
+	append_section(result, section);
+	section.resize(0);
+	for (auto&& item : items) {
+	    section += item.get_sort_key();
+	}
+	append_section(result, section);
+    }
+
+    if (flags & MSET_HAS_COLLAPSE_KEYS) {
+	section.resize(0);
+	for (auto&& item : items) {
+	    pack_uint(section, item.get_collapse_key().size());
+	}
+	append_section(result, section);
+	section.resize(0);
+	for (auto&& item : items) {
+	    section += item.get_collapse_key();
+	}
+	append_section(result, section);
+    }
+
+    if (flags & MSET_HAS_MISSING_SHARDS) {
+	pack_uint(result, missing_shards.size());
+	for (auto shard : missing_shards) {
+	    pack_uint(result, shard);
+	}
     }
 
     if (stats)
 	result += serialise_stats(*stats);
-
-    return result;
 }
 
 void
 MSet::Internal::unserialise(const char * p, const char * p_end)
 {
     items.clear();
+    missing_shards.clear();
 
     max_possible = unserialise_double(&p, p_end);
     max_attained = unserialise_double(&p, p_end);
@@ -377,24 +535,88 @@ MSet::Internal::unserialise(const char * p, const char * p_end)
 	!unpack_uint(&p, p_end, &msize)) {
 	unpack_throw_serialisation_error(p);
     }
-    while (msize-- > 0) {
-	double wt = unserialise_double(&p, p_end);
+    if (p == p_end) {
+	unpack_throw_serialisation_error(NULL);
+    }
+    unsigned flags = static_cast<unsigned char>(*p++);
+
+    // Each item needs at least 8 bytes for its weight, so check msize is
+    // sane before we use it to reserve space.
+    if (size_t(p_end - p) / 8 < msize) {
+	unpack_throw_serialisation_error(NULL);
+    }
+    const char* weights = p;
+    p += msize * 8;
+
+    const char* docids = find_section(&p, p_end);
+    const char* docids_end = p;
+
+    const char* counts = NULL;
+    const char* counts_end = NULL;
+    if (flags & MSET_HAS_COLLAPSE_COUNTS) {
+	counts = find_section(&p, p_end);
+	counts_end = p;
+    }
+
+    const char* sort_key_lens = NULL;
+    const char* sort_keys = NULL;
+    const char* sort_keys_end = NULL;
+    if (flags & MSET_HAS_SORT_KEYS) {
+	sort_key_lens = find_section(&p, p_end);
+	sort_keys = find_section(&p, p_end);
+	sort_keys_end = p;
+    }
+
+    const char* key_lens = NULL;
+    const char* keys = NULL;
+    const char* keys_end = NULL;
+    if (flags & MSET_HAS_COLLAPSE_KEYS) {
+	key_lens = find_section(&p, p_end);
+	keys = find_section(&p, p_end);
+	keys_end = p;
+    }
+
+    items.reserve(msize);
+    for (size_t i = 0; i != msize; ++i) {
+	double wt = unserialise_double(&weights, p_end);
 	Xapian::docid did;
+	if (!unpack_uint(&docids, docids_end, &did)) {
+	    unpack_throw_serialisation_error(docids);
+	}
+	Xapian::doccount collapse_cnt = 0;
+	if (counts && !unpack_uint(&counts, counts_end, &collapse_cnt)) {
+	    unpack_throw_serialisation_error(counts);
+	}
 	string sort_key, key;
-	Xapian::doccount collapse_cnt;
-	if (!unpack_uint(&p, p_end, &did) ||
-	    !unpack_string(&p, p_end, sort_key) ||
-	    !unpack_string(&p, p_end, key) ||
-	    !unpack_uint(&p, p_end, &collapse_cnt)) {
-	    unpack_throw_serialisation_error(p);
+	if (sort_keys) {
+	    unpack_key(&sort_key_lens, &sort_keys, sort_keys_end, sort_key);
+	}
+	if (keys) {
+	    unpack_key(&key_lens, &keys, keys_end, key);
 	}
 	items.emplace_back(wt, did, std::move(key), collapse_cnt,
 			   std::move(sort_key));
     }
 
+    if (flags & MSET_HAS_MISSING_SHARDS) {
+	size_t n_shards;
+	if (!unpack_uint(&p, p_end, &n_shards)) {
+	    unpack_throw_serialisation_error(p);
+	}
+	while (n_shards--) {
+	    Xapian::doccount shard;
+	    if (!unpack_uint(&p, p_end, &shard)) {
+		unpack_throw_serialisation_error(p);
+	    }
+	    missing_shards.push_back(shard);
+	}
+    }
+
     if (p != p_end) {
 	stats.reset(new Xapian::Weight::Internal());
 	unserialise_stats(string(p, p_end - p), *stats);
+    } else {
+	stats.reset();
     }
 }
 
@@ -83,6 +83,9 @@ class MSet::Internal : public Xapian::Internal::intrusive_base {
     /// Scale factor to convert weights to percentages.
     double percent_scale_factor = 0;
 
+    /// Indices of any shards left out of the match, in ascending order.
+    std::vector<Xapian::doccount> missing_shards;
+
   public:
     Internal() {}
 
@@ -111,6 +114,10 @@ class MSet::Internal : public Xapian::Internal::intrusive_base {
 
     void set_first(Xapian::doccount first_) { first = first_; }
 
+    void set_missing_shards(std::vector<Xapian::doccount> shards) {
+	missing_shards = std::move(shards);
+    }
+
     void set_enquire(const Xapian::Enquire::Internal* enquire_) {
 	enquire = enquire_;
     }
@@ -146,6 +153,12 @@ class MSet::Internal : public Xapian::Internal::intrusive_base {
      */
     std::string serialise() const;
 
+    /** Serialise this object.
+     *
+     *  @param result	String to append the serialisation of this object to.
+     */
+    void serialise(std::string& result) const;
+
     /** Unserialise a serialised Xapian::MSet::Internal object.
      *
      *  @param p	Pointer to the start of the string to unserialise.
@@ -1193,7 +1193,8 @@ QueryValueRange::postlist(QueryOptimiser *qopt, double factor) const
 	// slot.  If this value is set for all documents, we can replace it
 	// with the MatchAll postlist, which is especially efficient if
 	// there are no gaps in the docids.
-	if (begin <= lb && db.get_value_freq(slot) == db.get_doccount()) {
+	if (begin <= lb && db.get_value_freq(slot) == db.get_doccount() &&
+	    db.freqs_are_exact()) {
 	    RETURN(db.open_post_list(string()));
 	}
 	RETURN(new ValueGePostList(&db, slot, begin));
@@ -1257,7 +1258,8 @@ QueryValueLE::postlist(QueryOptimiser *qopt, double factor) const
 	// set for all documents, we can replace it with the MatchAll
 	// postlist, which is especially efficient if there are no gaps in
 	// the docids.
-	if (db.get_value_freq(slot) == db.get_doccount()) {
+	if (db.get_value_freq(slot) == db.get_doccount() &&
+	    db.freqs_are_exact()) {
 	    RETURN(db.open_post_list(string()));
 	}
     }
@@ -1320,7 +1322,8 @@ QueryValueGE::postlist(QueryOptimiser *qopt, double factor) const
 	// set for all documents, we can replace it with the MatchAll
 	// postlist, which is especially efficient if there are no gaps in
 	// the docids.
-	if (db.get_value_freq(slot) == db.get_doccount()) {
+	if (db.get_value_freq(slot) == db.get_doccount() &&
+	    db.freqs_are_exact()) {
 	    RETURN(db.open_post_list(string()));
 	}
     }
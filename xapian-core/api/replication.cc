@@ -32,23 +32,30 @@
 #include "backends/databaseinternal.h"
 #include "backends/databasereplicator.h"
 #include "debuglog.h"
+#include "fd.h"
 #include "filetests.h"
 #include "fileutils.h"
+#include "internaltypes.h"
 #include "io_utils.h"
 #include "omassert.h"
 #include "pack.h"
+#include "posixy_wrapper.h"
 #include "realtime.h"
 #include "net/remoteconnection.h"
 #include "replicationprotocol.h"
 #include "safesysstat.h"
 #include "safeunistd.h"
 #include "str.h"
+#include "stringutils.h"
 #include "unicode/description_append.h"
 
 #include <cerrno>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <type_traits>
+
+#include <zlib.h>
 
 using namespace std;
 using namespace Xapian;
@@ -58,6 +65,10 @@ using namespace Xapian;
 "# Automatically generated by Xapian::DatabaseReplica v" XAPIAN_VERSION ".\n" \
 "# Do not manually edit - replication operations may regenerate this file.\n"
 
+// The file in a partially copied offline database which records how far the
+// copy has got.
+#define COPY_PROGRESS_FILE "copyprogress"
+
 [[noreturn]]
 static void
 throw_connection_closed_unexpectedly()
@@ -68,9 +79,10 @@ throw_connection_closed_unexpectedly()
 void
 DatabaseMaster::write_changesets_to_fd(int fd,
 				       const string & start_revision,
-				       ReplicationInfo * info) const
+				       ReplicationInfo * info,
+				       int compression) const
 {
-    LOGCALL_VOID(REPLICA, "DatabaseMaster::write_changesets_to_fd", fd | start_revision | info);
+    LOGCALL_VOID(REPLICA, "DatabaseMaster::write_changesets_to_fd", fd | start_revision | info | compression);
     if (info != NULL)
 	info->clear();
     Database db;
@@ -106,7 +118,8 @@ DatabaseMaster::write_changesets_to_fd(int fd,
 	revision.assign(ptr, end - ptr);
     }
 
-    db.internal->write_changesets_to_fd(fd, revision, need_whole_db, info);
+    db.internal->write_changesets_to_fd(fd, revision, need_whole_db, info,
+					compression);
 }
 
 string
@@ -186,8 +199,37 @@ class DatabaseReplica::Internal : public Xapian::Internal::intrusive_base {
     void remove_offline_db();
 
     /** Apply a set of DB copy messages from the connection.
+     *
+     *  @return true if the whole database was received, false if the copy
+     *		was cut short (in which case what was received is kept so the
+     *		copy can be resumed).
+     */
+    bool apply_db_copy(double end_time);
+
+    /** Receive a file in a DB copy sent as checksummed chunks.
+     *
+     *  Progress is recorded after each chunk so that the copy can be resumed
+     *  if the connection is lost.
      */
-    void apply_db_copy(double end_time);
+    void receive_file_chunks(const string & filename,
+			     const string & filepath,
+			     double end_time);
+
+    /// Return the path of the file recording the progress of a DB copy.
+    string get_copy_progress_path() const {
+	string p = get_replica_path(live_id ^ 1);
+	p += "/" COPY_PROGRESS_FILE;
+	return p;
+    }
+
+    /** Return the state of the partial DB copy in the offline database.
+     *
+     *  Returns an empty string if there isn't one.
+     */
+    string get_copy_progress() const;
+
+    /// Record that @a offset bytes of @a filename have been received.
+    void save_copy_progress(const string & filename, off_t offset) const;
 
     /** Check that a message type is as expected.
      *
@@ -335,6 +377,12 @@ DatabaseReplica::Internal::Internal(const string & path_)
 	    // auto-heal from this condition.  Instance seen in the wild was
 	    // that the replica had all files truncated to size 0.
 	    live_db_corrupt = true;
+	} catch (const Xapian::DatabaseOpeningError &) {
+	    // A corrupt live database is removed as soon as a full copy to
+	    // heal it starts, so if that copy was interrupted the stub points
+	    // to a database which is no longer there.  Treat that the same way
+	    // so the copy can be resumed.
+	    live_db_corrupt = true;
 	}
 	// FIXME: simplify all this?
 	ifstream stub(stub_path.c_str());
@@ -354,7 +402,15 @@ DatabaseReplica::Internal::get_revision_info() const
 {
     LOGCALL(REPLICA, string, "DatabaseReplica::Internal::get_revision_info", NO_ARGS);
     if (live_db_corrupt) {
-	RETURN(string());
+	// We need a full copy, but if we have part of one the master can
+	// send the rest.  Even if we don't, we still need to tell the master
+	// we can receive the copy in chunks so that it can be resumed if
+	// it's cut short.
+	string buf;
+	pack_string(buf, string());
+	pack_uint(buf, 0u);
+	pack_string(buf, get_copy_progress());
+	RETURN(buf);
     }
 
     switch (live_db.internal->size()) {
@@ -373,9 +429,58 @@ DatabaseReplica::Internal::get_revision_info() const
     string buf;
     pack_string(buf, live_db.get_uuid());
     pack_uint(buf, live_db.get_revision());
+    // Tell the master about any partial copy, so it can send the rest.  This
+    // also tells it that we can receive a copy in chunks.
+    pack_string(buf, get_copy_progress());
     RETURN(buf);
 }
 
+string
+DatabaseReplica::Internal::get_copy_progress() const
+{
+    string progress;
+    string progress_path = get_copy_progress_path();
+    FD fd(posixy_open(progress_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd >= 0) {
+	char buf[4096];
+	size_t n = io_read(fd, buf, sizeof(buf));
+	progress.assign(buf, n);
+    }
+    return progress;
+}
+
+void
+DatabaseReplica::Internal::save_copy_progress(const string & filename,
+					      off_t offset) const
+{
+    string progress;
+    pack_string(progress, offline_uuid);
+    pack_string(progress, offline_revision);
+    pack_string(progress, filename);
+    pack_uint_last(progress, std::make_unsigned<off_t>::type(offset));
+
+    string progress_path = get_copy_progress_path();
+    string tmp_path = progress_path;
+    tmp_path += ".tmp";
+    {
+	FD fd(posixy_open(tmp_path.c_str(),
+			  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+	if (fd < 0) {
+	    string msg = "Couldn't create ";
+	    msg += tmp_path;
+	    throw DatabaseError(msg, errno);
+	}
+	io_write(fd, progress.data(), progress.size());
+	io_sync(fd);
+    }
+    if (!io_tmp_rename(tmp_path, progress_path)) {
+	string msg = tmp_path;
+	msg += ": Failed to rename to ";
+	msg += progress_path;
+	throw DatabaseError(msg, errno);
+    }
+}
+
 void
 DatabaseReplica::Internal::remove_offline_db()
 {
@@ -384,22 +489,12 @@ DatabaseReplica::Internal::remove_offline_db()
     have_offline_db = false;
 }
 
-void
+bool
 DatabaseReplica::Internal::apply_db_copy(double end_time)
 {
     have_offline_db = true;
     last_live_changeset_time = 0;
     string offline_path = get_replica_path(live_id ^ 1);
-    // If there's already an offline database, discard it.  This happens if one
-    // copy of the database was sent, but further updates were needed before it
-    // could be made live, and the remote end was then unable to send those
-    // updates (probably due to not having changesets available, or the remote
-    // database being replaced by a new database).
-    removedir(offline_path);
-    if (mkdir(offline_path.c_str(), 0777)) {
-	throw Xapian::DatabaseError("Cannot make directory '" +
-				    offline_path + "'", errno);
-    }
 
     {
 	string buf;
@@ -413,12 +508,30 @@ DatabaseReplica::Internal::apply_db_copy(double end_time)
 	offline_revision.assign(ptr, end - ptr);
     }
 
+    // If there's already an offline database, discard it, unless it's a
+    // partial copy of the same revision of the same database, which the
+    // master is now resuming.  An offline database is left if one copy of the
+    // database was sent, but further updates were needed before it could be
+    // made live, and the remote end was then unable to send those updates
+    // (probably due to not having changesets available, or the remote
+    // database being replaced by a new database).
+    string copy_state;
+    pack_string(copy_state, offline_uuid);
+    pack_string(copy_state, offline_revision);
+    if (!startswith(get_copy_progress(), copy_state)) {
+	removedir(offline_path);
+	if (mkdir(offline_path.c_str(), 0777)) {
+	    throw Xapian::DatabaseError("Cannot make directory '" +
+					offline_path + "'", errno);
+	}
+    }
+
     // Now, read the files for the database from the connection and create it.
     while (true) {
 	string filename;
 	int type = conn->sniff_next_message_type(end_time);
 	if (type < 0 || type == REPL_REPLY_FAIL)
-	    return;
+	    return false;
 	if (type == REPL_REPLY_DB_FOOTER)
 	    break;
 
@@ -433,9 +546,13 @@ DatabaseReplica::Internal::apply_db_copy(double end_time)
 
 	type = conn->sniff_next_message_type(end_time);
 	if (type < 0 || type == REPL_REPLY_FAIL)
-	    return;
+	    return false;
 
 	string filepath = offline_path + "/" + filename;
+	if (type == REPL_REPLY_DB_FILECHUNK) {
+	    receive_file_chunks(filename, filepath, end_time);
+	    continue;
+	}
 	type = conn->receive_file(filepath, end_time);
 	if (type < 0)
 	    throw_connection_closed_unexpectedly();
@@ -444,6 +561,58 @@ DatabaseReplica::Internal::apply_db_copy(double end_time)
     int type = conn->get_message(offline_needed_revision, end_time);
     check_message_type(type, REPL_REPLY_DB_FOOTER);
     need_copy_next = false;
+    // The copy is complete, so there's nothing left to resume.
+    (void)io_unlink(get_copy_progress_path());
+    return true;
+}
+
+void
+DatabaseReplica::Internal::receive_file_chunks(const string & filename,
+					       const string & filepath,
+					       double end_time)
+{
+    FD fd(posixy_open(filepath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666));
+    if (fd < 0) {
+	string msg = "Couldn't open ";
+	msg += filepath;
+	msg += " to write";
+	throw DatabaseError(msg, errno);
+    }
+
+    bool first_chunk = true;
+    string buf;
+    while (conn->sniff_next_message_type(end_time) == REPL_REPLY_DB_FILECHUNK) {
+	if (conn->get_message(buf, end_time) < 0)
+	    throw_connection_closed_unexpectedly();
+	const char * ptr = buf.data();
+	const char * end = ptr + buf.size();
+	std::make_unsigned<off_t>::type offset;
+	uint4 checksum;
+	if (!unpack_uint(&ptr, end, &offset) ||
+	    !unpack_uint(&ptr, end, &checksum)) {
+	    unpack_throw_serialisation_error(ptr);
+	}
+	size_t len = end - ptr;
+	uLong actual = crc32(0L, reinterpret_cast<const Bytef*>(ptr),
+			     uInt(len));
+	if (uint4(actual) != checksum) {
+	    throw NetworkError("Checksum mismatch in chunk of " + filename +
+			       " at offset " + str(offset));
+	}
+
+	if (first_chunk) {
+	    // The master sends the file from where our copy of it got to (or
+	    // from the start) - discard anything after that.
+	    if (ftruncate(fd, off_t(offset)) < 0) {
+		throw DatabaseError("Couldn't truncate " + filepath, errno);
+	    }
+	    first_chunk = false;
+	}
+	if (len) io_write_block(fd, ptr, len, 0, off_t(offset));
+	// The data must be on disk before we record that we have it.
+	io_sync(fd);
+	save_copy_progress(filename, off_t(offset + len));
+    }
 }
 
 void
@@ -520,9 +689,20 @@ DatabaseReplica::Internal::apply_next_changeset(ReplicationInfo * info,
 		RETURN(false);
 	    }
 	    case REPL_REPLY_DB_HEADER:
+		if (live_db_corrupt) {
+		    // Nothing can read the live database, so there's no point
+		    // keeping it until the copy is made live - removing it now
+		    // means we don't need room for two copies.
+		    removedir(get_replica_path(live_id));
+		}
 		// Apply the copy - remove offline db in case of any error.
 		try {
-		    apply_db_copy(0.0);
+		    if (!apply_db_copy(0.0)) {
+			// The copy was cut short.  Keep what we received so
+			// the copy can be resumed, but it isn't usable yet.
+			have_offline_db = false;
+			break;
+		    }
 		    if (info != NULL)
 			++(info->fullcopy_count);
 		    string replica_uuid;
@@ -542,7 +722,12 @@ DatabaseReplica::Internal::apply_next_changeset(ReplicationInfo * info,
 			need_copy_next = true;
 		    }
 		} catch (...) {
-		    remove_offline_db();
+		    if (file_exists(get_copy_progress_path())) {
+			// Keep the partial copy so it can be resumed.
+			have_offline_db = false;
+		    } else {
+			remove_offline_db();
+		    }
 		    throw;
 		}
 		if (possibly_make_offline_live()) {
@@ -97,10 +97,14 @@ class XAPIAN_VISIBILITY_DEFAULT DatabaseMaster {
      *  @param info     If non-NULL, the supplied structure will be updated
      *                  to reflect the changes written to the file
      *                  descriptor.
+     *
+     *  @param compression  Compression algorithm to use for large messages
+     *                  (a compression_type value), or -1 for none.
      */
     void write_changesets_to_fd(int fd,
 				const std::string & start_revision,
-				ReplicationInfo * info) const;
+				ReplicationInfo * info,
+				int compression = -1) const;
 
     /// Return a string describing this object.
     std::string get_description() const;
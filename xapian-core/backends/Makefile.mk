@@ -6,10 +6,12 @@ noinst_HEADERS +=\
 	backends/databasehelpers.h\
 	backends/databaseinternal.h\
 	backends/databasereplicator.h\
+	backends/docidmask.h\
 	backends/documentinternal.h\
 	backends/empty_database.h\
 	backends/flint_lock.h\
 	backends/leafpostlist.h\
+	backends/maskpostlist.h\
 	backends/multi.h\
 	backends/positionlist.h\
 	backends/postlist.h\
@@ -45,7 +47,8 @@ endif
 if BUILD_BACKEND_GLASS
 lib_src +=\
 	backends/contiguousalldocspostlist.cc\
-	backends/flint_lock.cc
+	backends/flint_lock.cc\
+	backends/maskpostlist.cc
 else
 if BUILD_BACKEND_HONEY
 lib_src +=\
@@ -58,6 +58,24 @@ Database::Internal::keep_alive()
     // No-op except for remote databases.
 }
 
+void
+Database::Internal::preload(termcount, size_t) const
+{
+    // No-op by default.
+}
+
+void
+Database::Internal::lease_revision(unsigned) const
+{
+    throw Xapian::UnimplementedError("This backend doesn't implement revision leases");
+}
+
+void
+Database::Internal::mask_document(docid)
+{
+    throw Xapian::UnimplementedError("This backend doesn't support masking documents");
+}
+
 void
 Database::Internal::readahead_for_query(const Xapian::Query &) const
 {
@@ -380,7 +398,8 @@ Database::Internal::request_document(Xapian::docid) const
 }
 
 void
-Database::Internal::write_changesets_to_fd(int, const string&, bool, ReplicationInfo*)
+Database::Internal::write_changesets_to_fd(int, const string&, bool,
+					   ReplicationInfo*, int)
 {
     throw Xapian::UnimplementedError("This backend doesn't provide changesets");
 }
@@ -128,6 +128,32 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 
     virtual void keep_alive();
 
+    /** Read the parts of the database searches most need into cache.
+     *
+     *  @param top_terms	Number of terms to read the postlists of.
+     *  @param max_rate	Maximum bytes per second to read, or 0 for no limit.
+     */
+    virtual void preload(termcount top_terms, size_t max_rate) const;
+
+    /** Stop the current revision being overwritten.
+     *
+     *  @param duration	Length of the lease in seconds, or 0 to release it.
+     */
+    virtual void lease_revision(unsigned duration) const;
+
+    /** Hide a document from this database object.
+     *
+     *  The database itself isn't modified - the document is just skipped by
+     *  postlists and value streams opened from this object, and can't be
+     *  fetched from it.  Term frequencies may still count masked documents.
+     *
+     *  Masked docids refer to the current revision, so once a document has
+     *  been masked, reopen() won't move to a newer revision.
+     *
+     *  @param did	The document to mask.
+     */
+    virtual void mask_document(docid did);
+
     virtual void readahead_for_query(const Query& query) const;
 
     virtual doccount get_doccount() const = 0;
@@ -167,6 +193,15 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
      */
     virtual doccount get_value_freq(valueno slot) const = 0;
 
+    /** Are term and value frequencies exact?
+     *
+     *  If documents are hidden without updating the statistics (e.g. by
+     *  mask_document() or by tombstones in glass) the frequencies are only
+     *  upper bounds, so a frequency equal to the document count doesn't mean
+     *  that every document matches.
+     */
+    virtual bool freqs_are_exact() const { return true; }
+
     /** Get a lower bound on the values stored in the given value slot.
      *
      *  If the lower bound isn't available for the given database type,
@@ -416,11 +451,16 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
      *
      *  This call may reopen the database, leaving it pointing to a more
      *  recent version of the database.
+     *
+     *  @param compression	Compression algorithm to use for large
+     *				messages (a compression_type value), or -1
+     *				for none.
      */
     virtual void write_changesets_to_fd(int fd,
 					const std::string& start_revision,
 					bool need_whole_db,
-					ReplicationInfo* info);
+					ReplicationInfo* info,
+					int compression);
 
     /// Get revision number of database (if meaningful).
     virtual Xapian::rev get_revision() const;
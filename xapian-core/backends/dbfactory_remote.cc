@@ -22,6 +22,8 @@
 
 #include <xapian/dbfactory.h>
 
+#include "backends/backends.h"
+#include "backends/remote/remote-database.h"
 #include "debuglog.h"
 #include "net/progclient.h"
 #include "net/remotetcpclient.h"
@@ -52,6 +54,55 @@ Remote::open_writable(const string &host, unsigned int port,
 						flags)));
 }
 
+Database
+Remote::open_pooled(const string& host, unsigned int port, unsigned timeout_,
+		    unsigned connect_timeout)
+{
+    LOGCALL_STATIC(API, Database, "Remote::open_pooled", host | port | timeout_ | connect_timeout);
+    RETURN(Database(RemoteTcpClient::open_pooled(host, port, timeout_ * 1e-3,
+						 connect_timeout * 1e-3)));
+}
+
+void
+Remote::keep_pool_alive(unsigned timeout_)
+{
+    LOGCALL_STATIC_VOID(API, "Remote::keep_pool_alive", timeout_);
+    RemoteTcpClient::keep_pool_alive(timeout_ * 1e-3);
+}
+
+void
+Remote::clear_pool()
+{
+    LOGCALL_STATIC_VOID(API, "Remote::clear_pool", NO_ARGS);
+    RemoteTcpClient::clear_pool();
+}
+
+void
+Remote::set_pool_size(unsigned max_idle)
+{
+    LOGCALL_STATIC_VOID(API, "Remote::set_pool_size", max_idle);
+    RemoteTcpClient::set_pool_size(max_idle);
+}
+
+/// Return @a db as a RemoteDatabase, or throw if it isn't one.
+static RemoteDatabase*
+as_remote_database(const Database& db)
+{
+    Database::Internal* internal = db.internal.get();
+    if (internal->size() != 1 ||
+	internal->get_backend_info(NULL) != BACKEND_REMOTE) {
+	throw InvalidArgumentError("Expected a single remote database");
+    }
+    return static_cast<RemoteDatabase*>(internal);
+}
+
+void
+Remote::add_replica(const Database& db, const Database& replica)
+{
+    LOGCALL_STATIC_VOID(API, "Remote::add_replica", db | replica);
+    as_remote_database(db)->add_replica(as_remote_database(replica));
+}
+
 Database
 Remote::open(const string &program, const string &args,
 	     unsigned timeout_)
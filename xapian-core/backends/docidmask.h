@@ -0,0 +1,121 @@
+/** @file docidmask.h
+ * @brief Set of document ids to hide
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_DOCIDMASK_H
+#define XAPIAN_INCLUDED_DOCIDMASK_H
+
+#include "omassert.h"
+#include "xapian/types.h"
+
+#include <string>
+
+/** Set of document ids to hide, stored as a bitmap.
+ *
+ *  Testing whether a docid is in the set is O(1), so postlists can cheaply
+ *  skip over masked documents.
+ */
+class DocidMask {
+    /// Bit (did - 1) is set if did is masked.
+    std::string bits;
+
+    /// The number of docids in the mask.
+    Xapian::doccount count = 0;
+
+  public:
+    /// Is the mask empty?
+    bool empty() const { return count == 0; }
+
+    /// Return the number of docids in the mask.
+    Xapian::doccount size() const { return count; }
+
+    /// Is @a did in the mask?
+    bool contains(Xapian::docid did) const {
+	Assert(did != 0);
+	size_t i = (did - 1) >> 3;
+	return i < bits.size() &&
+	       (static_cast<unsigned char>(bits[i]) >> ((did - 1) & 7)) & 1;
+    }
+
+    /** Add @a did to the mask.
+     *
+     *  @return false if @a did was already in the mask.
+     */
+    bool add(Xapian::docid did) {
+	Assert(did != 0);
+	size_t i = (did - 1) >> 3;
+	if (i >= bits.size()) bits.resize(i + 1);
+	unsigned char bit = 1 << ((did - 1) & 7);
+	if (static_cast<unsigned char>(bits[i]) & bit) return false;
+	bits[i] = char(static_cast<unsigned char>(bits[i]) | bit);
+	++count;
+	return true;
+    }
+
+    /** Remove @a did from the mask.
+     *
+     *  @return false if @a did wasn't in the mask.
+     */
+    bool remove(Xapian::docid did) {
+	Assert(did != 0);
+	size_t i = (did - 1) >> 3;
+	if (i >= bits.size()) return false;
+	unsigned char bit = 1 << ((did - 1) & 7);
+	if (!(static_cast<unsigned char>(bits[i]) & bit)) return false;
+	bits[i] = char(static_cast<unsigned char>(bits[i]) & ~bit);
+	--count;
+	return true;
+    }
+
+    /** Return @a len bytes of the bitmap starting at byte @a offset.
+     *
+     *  Trailing zero bytes are omitted, so an empty string is returned if
+     *  none of the corresponding docids are in the mask.
+     */
+    std::string get_bytes(size_t offset, size_t len) const {
+	if (offset >= bits.size()) return std::string();
+	std::string result(bits, offset, len);
+	size_t n = result.find_last_not_of('\0');
+	result.resize(n == std::string::npos ? 0 : n + 1);
+	return result;
+    }
+
+    /// Add the docids in bitmap @a bytes, which starts at byte @a offset.
+    void add_bytes(size_t offset, const std::string & bytes) {
+	if (offset + bytes.size() > bits.size())
+	    bits.resize(offset + bytes.size());
+	for (size_t i = 0; i != bytes.size(); ++i) {
+	    unsigned char old_byte = bits[offset + i];
+	    unsigned char added = static_cast<unsigned char>(bytes[i]) & ~old_byte;
+	    bits[offset + i] = char(old_byte | added);
+	    // Count the bits we've just set.
+	    while (added) {
+		added &= added - 1;
+		++count;
+	    }
+	}
+    }
+
+    /// Remove all docids from the mask.
+    void clear() {
+	bits.resize(0);
+	count = 0;
+    }
+};
+
+#endif // XAPIAN_INCLUDED_DOCIDMASK_H
@@ -243,7 +243,8 @@ void
 EmptyDatabase::write_changesets_to_fd(int,
 				      const std::string&,
 				      bool,
-				      Xapian::ReplicationInfo*)
+				      Xapian::ReplicationInfo*,
+				      int)
 {
     throw Xapian::InvalidOperationError("write_changesets_to_fd() with "
 					"no subdatabases");
@@ -97,7 +97,8 @@ class EmptyDatabase : public Xapian::Database::Internal {
     void write_changesets_to_fd(int fd,
 				const std::string& start_revision,
 				bool need_whole_db,
-				Xapian::ReplicationInfo* info);
+				Xapian::ReplicationInfo* info,
+				int compression);
 
     void invalidate_doc_object(Xapian::Document::Internal* obj) const;
 
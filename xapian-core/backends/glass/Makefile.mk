@@ -11,6 +11,7 @@ noinst_HEADERS +=\
 	backends/glass/glass_database.h\
 	backends/glass/glass_databasereplicator.h\
 	backends/glass/glass_dbcheck.h\
+	backends/glass/glass_doclog.h\
 	backends/glass/glass_defs.h\
 	backends/glass/glass_docdata.h\
 	backends/glass/glass_document.h\
@@ -40,6 +41,7 @@ lib_src +=\
 	backends/glass/glass_cursor.cc\
 	backends/glass/glass_database.cc\
 	backends/glass/glass_dbcheck.cc\
+	backends/glass/glass_doclog.cc\
 	backends/glass/glass_document.cc\
 	backends/glass/glass_freelist.cc\
 	backends/glass/glass_inverter.cc\
@@ -52,6 +52,20 @@ GlassChanges::~GlassChanges()
     }
 }
 
+glass_revision_number_t
+GlassChanges::get_max_changesets()
+{
+    glass_revision_number_t result = 0;
+    const char *p = getenv("XAPIAN_MAX_CHANGESETS");
+    if (p && *p) {
+	if (!parse_unsigned(p, result)) {
+	    throw Xapian::InvalidArgumentError("XAPIAN_MAX_CHANGESETS must be "
+					       "a non-negative integer");
+	}
+    }
+    return result;
+}
+
 GlassChanges *
 GlassChanges::start(glass_revision_number_t old_rev,
 		    glass_revision_number_t rev,
@@ -63,15 +77,7 @@ GlassChanges::start(glass_revision_number_t old_rev,
     }
 
     // Always check max_changesets for modification since last revision.
-    const char *p = getenv("XAPIAN_MAX_CHANGESETS");
-    if (p && *p) {
-	if (!parse_unsigned(p, max_changesets)) {
-	    throw Xapian::InvalidArgumentError("XAPIAN_MAX_CHANGESETS must be "
-					       "a non-negative integer");
-	}
-    } else {
-	max_changesets = 0;
-    }
+    max_changesets = get_max_changesets();
 
     if (max_changesets == 0)
 	return NULL;
@@ -112,6 +118,28 @@ GlassChanges::write_block(const char * p, size_t len)
     io_write(changes_fd, p, len);
 }
 
+void
+GlassChanges::write_table_block(unsigned char chunk_type, uint4 n,
+				const char * p, size_t block_size)
+{
+    size_t compressed_size = block_size;
+    const char * compressed = comp_stream.compress(p, &compressed_size);
+
+    string buf;
+    if (compressed) chunk_type |= CHANGES_BLOCK_COMPRESSED;
+    buf += char(chunk_type);
+    // Write the block number to the file
+    pack_uint(buf, n);
+    if (compressed) {
+	pack_uint(buf, compressed_size);
+	buf.append(compressed, compressed_size);
+	write_block(buf);
+    } else {
+	write_block(buf);
+	write_block(p, block_size);
+    }
+}
+
 void
 GlassChanges::commit(glass_revision_number_t new_rev, int flags)
 {
@@ -237,8 +265,9 @@ GlassChanges::check(const string & changes_file)
 	    }
 	    continue;
 	}
+	bool compressed = (v & CHANGES_BLOCK_COMPRESSED);
 	unsigned table = (v & 0x7);
-	v >>= 3;
+	v = (v >> 3) & 0x7;
 	if (table > 5)
 	    throw Xapian::DatabaseError("Changes file - bad table code");
 	// Changed block.
@@ -249,14 +278,21 @@ GlassChanges::check(const string & changes_file)
 	if (!unpack_uint(&p, end, &block_number))
 	    throw Xapian::DatabaseError("Changes file - bad block number");
 
-	// Parse information from the start of the block.
-	//
-	// Although the revision number is aligned within the block, the block
-	// data may not be aligned to a word boundary here.
-	uint4 block_rev = unaligned_read4(reinterpret_cast<const uint8_t*>(p));
-	(void)block_rev; // FIXME: Sanity check value.
-	unsigned level = static_cast<unsigned char>(p[4]);
-	(void)level; // FIXME: Sanity check value.
+	if (compressed) {
+	    if (!unpack_uint(&p, end, &block_size) || block_size == 0)
+		throw Xapian::DatabaseError("Changes file - bad compressed "
+					    "block size");
+	} else {
+	    // Parse information from the start of the block.
+	    //
+	    // Although the revision number is aligned within the block, the
+	    // block data may not be aligned to a word boundary here.
+	    uint4 block_rev =
+		unaligned_read4(reinterpret_cast<const uint8_t*>(p));
+	    (void)block_rev; // FIXME: Sanity check value.
+	    unsigned level = static_cast<unsigned char>(p[4]);
+	    (void)level; // FIXME: Sanity check value.
+	}
 
 	// Skip over the block content.
 	if (block_size <= unsigned(end - p)) {
@@ -23,6 +23,9 @@
 #define XAPIAN_INCLUDED_GLASS_CHANGES_H
 
 #include "glass_defs.h"
+#include "internaltypes.h"
+#include "common/compression_stream.h"
+
 #include <string>
 
 class GlassChanges {
@@ -46,6 +49,9 @@ class GlassChanges {
      */
     glass_revision_number_t oldest_changeset;
 
+    /// Used to compress the blocks written to the changeset.
+    CompressionStream comp_stream;
+
   public:
     explicit GlassChanges(const std::string & db_dir)
 	: changes_fd(-1),
@@ -54,6 +60,12 @@ class GlassChanges {
 
     ~GlassChanges();
 
+    /** The number of changesets to keep.
+     *
+     *  This is read from the XAPIAN_MAX_CHANGESETS environment variable.
+     */
+    static glass_revision_number_t get_max_changesets();
+
     GlassChanges * start(glass_revision_number_t old_rev,
 			 glass_revision_number_t rev,
 			 int flags);
@@ -64,6 +76,19 @@ class GlassChanges {
 	write_block(s.data(), s.size());
     }
 
+    /** Write a changed table block to the changeset.
+     *
+     *  The block is compressed if that makes it smaller, in which case
+     *  CHANGES_BLOCK_COMPRESSED is set in the chunk type.
+     *
+     *  @param chunk_type	The table code and block size code.
+     *  @param n		The block number.
+     *  @param p		The block data.
+     *  @param block_size	The size of the block.
+     */
+    void write_table_block(unsigned char chunk_type, uint4 n,
+			   const char * p, size_t block_size);
+
     void set_oldest_changeset(glass_revision_number_t rev) {
 	oldest_changeset = rev;
     }
@@ -36,12 +36,15 @@
 #include "backends/flint_lock.h"
 #include "glass_database.h"
 #include "glass_defs.h"
+#include "glass_docdata.h"
 #include "glass_table.h"
 #include "glass_cursor.h"
+#include "glass_values.h"
 #include "glass_version.h"
 #include "filetests.h"
 #include "internaltypes.h"
 #include "pack.h"
+#include "backends/docidmask.h"
 #include "backends/valuestats.h"
 
 #include "../byte_length_strings.h"
@@ -77,86 +80,215 @@ is_doclenchunk_key(const string & key)
     return key.size() > 1 && key[0] == '\0' && key[1] == '\xe0';
 }
 
+static inline bool
+is_tombstone_key(const string & key)
+{
+    return key.size() > 1 && key[0] == '\0' && key[1] == '\xe8';
+}
+
+/// Unpack the slot and first docid from a value chunk key.
+static void
+unpack_valuechunk_key(const string & key,
+		      Xapian::valueno & slot, Xapian::docid & did)
+{
+    const char * p = key.data();
+    const char * end = p + key.length();
+    p += 2;
+    if (!unpack_uint(&p, end, &slot))
+	throw Xapian::DatabaseCorruptError("bad value key");
+    if (!unpack_uint_preserving_sort(&p, end, &did))
+	throw Xapian::DatabaseCorruptError("bad value key");
+}
+
 class PostlistCursor : private GlassCursor {
     Xapian::docid offset;
 
+    /** Remove masked documents from the current posting list chunk.
+     *
+     *  Also sets tf and cf from the remaining entries (unless this is a
+     *  document length chunk).
+     *
+     *  @return false if no entries remain.
+     */
+    bool filter_chunk(bool doclens) {
+	const char * p = tag.data();
+	const char * end = p + tag.size();
+	bool is_last;
+	Xapian::docid increase_to_last;
+	if (!unpack_bool(&p, end, &is_last) ||
+	    !unpack_uint(&p, end, &increase_to_last)) {
+	    throw Xapian::DatabaseCorruptError("Bad postlist chunk");
+	}
+	string entries;
+	Xapian::docid did = firstdid;
+	Xapian::docid new_firstdid = 0, prev_did = 0;
+	tf = cf = 0;
+	while (true) {
+	    Xapian::termcount wdf;
+	    if (!unpack_uint(&p, end, &wdf))
+		throw Xapian::DatabaseCorruptError("Bad postlist chunk");
+	    if (!mask->contains(did)) {
+		if (new_firstdid == 0) {
+		    new_firstdid = did;
+		} else {
+		    pack_uint(entries, did - prev_did - 1);
+		}
+		pack_uint(entries, wdf);
+		prev_did = did;
+		if (!doclens) {
+		    ++tf;
+		    cf += wdf;
+		}
+	    }
+	    if (p == end) break;
+	    Xapian::docid did_increase;
+	    if (!unpack_uint(&p, end, &did_increase))
+		throw Xapian::DatabaseCorruptError("Bad postlist chunk");
+	    did += did_increase + 1;
+	}
+	if (new_firstdid == 0) return false;
+
+	tag.resize(0);
+	pack_bool(tag, is_last);
+	pack_uint(tag, prev_did - new_firstdid);
+	tag += entries;
+	firstdid = new_firstdid;
+	return true;
+    }
+
+    /** Remove masked documents from the current value chunk.
+     *
+     *  @return false if no entries remain.
+     */
+    bool filter_value_chunk(Xapian::docid & did) {
+	string new_tag;
+	Xapian::docid new_did = 0, prev_did = 0;
+	Glass::ValueChunkReader reader(tag.data(), tag.size(), did);
+	for ( ; !reader.at_end(); reader.next()) {
+	    Xapian::docid value_did = reader.get_docid();
+	    if (mask->contains(value_did)) continue;
+	    if (new_did == 0) {
+		new_did = value_did;
+	    } else {
+		pack_uint(new_tag, value_did - prev_did - 1);
+	    }
+	    pack_string(new_tag, reader.get_value());
+	    prev_did = value_did;
+	}
+	if (new_did == 0) return false;
+	swap(tag, new_tag);
+	did = new_did;
+	return true;
+    }
+
+    /// Count the values in masked documents for each slot.
+    void count_masked_values(const GlassTable *in) {
+	GlassCursor cursor(in);
+	(void)cursor.find_entry_ge(string("\0\xd8", 2));
+	while (!cursor.after_end() && is_valuechunk_key(cursor.current_key)) {
+	    Xapian::valueno slot;
+	    Xapian::docid did;
+	    unpack_valuechunk_key(cursor.current_key, slot, did);
+	    cursor.read_tag();
+	    const string & chunk = cursor.current_tag;
+	    Glass::ValueChunkReader reader(chunk.data(), chunk.size(), did);
+	    for ( ; !reader.at_end(); reader.next()) {
+		if (mask->contains(reader.get_docid()))
+		    ++masked_value_freqs[slot];
+	    }
+	    cursor.next();
+	}
+    }
+
   public:
     string key, tag;
     Xapian::docid firstdid;
     Xapian::termcount tf, cf;
 
-    PostlistCursor(const GlassTable *in, Xapian::docid offset_)
-	: GlassCursor(in), offset(offset_), firstdid(0)
+    /// Documents to leave out of the output (or NULL for none).
+    const DocidMask * mask;
+
+    /// The number of values in masked documents for each slot.
+    map<Xapian::valueno, Xapian::doccount> masked_value_freqs;
+
+    PostlistCursor(const GlassTable *in, Xapian::docid offset_,
+		   const DocidMask * mask_)
+	: GlassCursor(in), offset(offset_), firstdid(0), mask(mask_)
     {
+	if (mask) count_masked_values(in);
 	rewind();
 	next();
     }
 
     bool next() {
-	if (!GlassCursor::next()) return false;
-	// We put all chunks into the non-initial chunk form here, then fix up
-	// the first chunk for each term in the merged database as we merge.
-	read_tag();
-	key = current_key;
-	tag = current_tag;
-	tf = cf = 0;
-	if (is_user_metadata_key(key)) return true;
-	if (is_valuestats_key(key)) return true;
-	if (is_valuechunk_key(key)) {
-	    const char * p = key.data();
-	    const char * end = p + key.length();
-	    p += 2;
-	    Xapian::valueno slot;
-	    if (!unpack_uint(&p, end, &slot))
-		throw Xapian::DatabaseCorruptError("bad value key");
-	    Xapian::docid did;
-	    if (!unpack_uint_preserving_sort(&p, end, &did))
-		throw Xapian::DatabaseCorruptError("bad value key");
-	    did += offset;
-
-	    key.assign("\0\xd8", 2);
-	    pack_uint(key, slot);
-	    pack_uint_preserving_sort(key, did);
-	    return true;
-	}
+	while (GlassCursor::next()) {
+	    // We put all chunks into the non-initial chunk form here, then fix
+	    // up the first chunk for each term in the merged database as we
+	    // merge.
+	    read_tag();
+	    key = current_key;
+	    tag = current_tag;
+	    tf = cf = 0;
+	    if (is_user_metadata_key(key)) return true;
+	    if (is_valuestats_key(key)) return true;
+	    if (is_valuechunk_key(key)) {
+		Xapian::valueno slot;
+		Xapian::docid did;
+		unpack_valuechunk_key(key, slot, did);
+		if (mask && !filter_value_chunk(did)) continue;
+		did += offset;
 
-	// Adjust key if this is *NOT* an initial chunk.
-	// key is: pack_string_preserving_sort(key, tname)
-	// plus optionally: pack_uint_preserving_sort(key, did)
-	const char * d = key.data();
-	const char * e = d + key.size();
-	if (is_doclenchunk_key(key)) {
-	    d += 2;
-	} else {
-	    string tname;
-	    if (!unpack_string_preserving_sort(&d, e, tname))
-		throw Xapian::DatabaseCorruptError("Bad postlist key");
-	}
+		key.assign("\0\xd8", 2);
+		pack_uint(key, slot);
+		pack_uint_preserving_sort(key, did);
+		return true;
+	    }
+	    if (is_tombstone_key(key)) {
+		// Tombstoned documents are left out of the output.
+		continue;
+	    }
 
-	if (d == e) {
-	    // This is an initial chunk for a term, so adjust tag header.
-	    d = tag.data();
-	    e = d + tag.size();
-	    if (!unpack_uint(&d, e, &tf) ||
-		!unpack_uint(&d, e, &cf) ||
-		!unpack_uint(&d, e, &firstdid)) {
-		throw Xapian::DatabaseCorruptError("Bad postlist key");
+	    // Adjust key if this is *NOT* an initial chunk.
+	    // key is: pack_string_preserving_sort(key, tname)
+	    // plus optionally: pack_uint_preserving_sort(key, did)
+	    const char * d = key.data();
+	    const char * e = d + key.size();
+	    bool doclens = is_doclenchunk_key(key);
+	    if (doclens) {
+		d += 2;
+	    } else {
+		string tname;
+		if (!unpack_string_preserving_sort(&d, e, tname))
+		    throw Xapian::DatabaseCorruptError("Bad postlist key");
 	    }
-	    ++firstdid;
-	    tag.erase(0, d - tag.data());
-	} else {
-	    // Not an initial chunk, so adjust key.
-	    size_t tmp = d - key.data();
-	    if (!unpack_uint_preserving_sort(&d, e, &firstdid) || d != e)
-		throw Xapian::DatabaseCorruptError("Bad postlist key");
-	    if (is_doclenchunk_key(key)) {
-		key.erase(tmp);
+
+	    if (d == e) {
+		// This is an initial chunk for a term, so adjust tag header.
+		d = tag.data();
+		e = d + tag.size();
+		if (!unpack_uint(&d, e, &tf) ||
+		    !unpack_uint(&d, e, &cf) ||
+		    !unpack_uint(&d, e, &firstdid)) {
+		    throw Xapian::DatabaseCorruptError("Bad postlist key");
+		}
+		++firstdid;
+		tag.erase(0, d - tag.data());
 	    } else {
-		key.erase(tmp - 1);
+		// Not an initial chunk, so adjust key.
+		size_t tmp = d - key.data();
+		if (!unpack_uint_preserving_sort(&d, e, &firstdid) || d != e)
+		    throw Xapian::DatabaseCorruptError("Bad postlist key");
+		if (doclens) {
+		    key.erase(tmp);
+		} else {
+		    key.erase(tmp - 1);
+		}
 	    }
+	    if (mask && !filter_chunk(doclens)) continue;
+	    firstdid += offset;
+	    return true;
 	}
-	firstdid += offset;
-	return true;
+	return false;
     }
 };
 
@@ -188,18 +320,19 @@ encode_valuestats(Xapian::doccount freq,
 static void
 merge_postlists(Xapian::Compactor * compactor,
 		GlassTable * out, vector<Xapian::docid>::const_iterator offset,
+		vector<const DocidMask*>::const_iterator mask,
 		vector<const GlassTable*>::const_iterator b,
 		vector<const GlassTable*>::const_iterator e)
 {
     priority_queue<PostlistCursor *, vector<PostlistCursor *>, PostlistCursorGt> pq;
-    for ( ; b != e; ++b, ++offset) {
+    for ( ; b != e; ++b, ++offset, ++mask) {
 	const GlassTable *in = *b;
 	if (in->empty()) {
 	    // Skip empty tables.
 	    continue;
 	}
 
-	pq.push(new PostlistCursor(in, *offset));
+	pq.push(new PostlistCursor(in, *offset, *mask));
     }
 
     string last_key;
@@ -298,7 +431,20 @@ merge_postlists(Xapian::Compactor * compactor,
 	    } else {
 		u.assign(pos, len);
 	    }
-	    if (freq == 0) {
+	    if (cur->mask) {
+		// Don't count values in documents being left out.  The bounds
+		// may no longer be tight, but they're still valid.
+		pos = key.data() + 2;
+		end = key.data() + key.size();
+		Xapian::valueno slot;
+		if (!unpack_uint_last(&pos, end, &slot))
+		    throw Xapian::DatabaseCorruptError("Bad value stats key");
+		auto i = cur->masked_value_freqs.find(slot);
+		if (i != cur->masked_value_freqs.end()) f -= i->second;
+	    }
+	    if (f == 0) {
+		// All the values for this slot are in masked documents.
+	    } else if (freq == 0) {
 		freq = f;
 		lbound = l;
 		ubound = u;
@@ -388,7 +534,15 @@ merge_postlists(Xapian::Compactor * compactor,
 }
 
 struct MergeCursor : public GlassCursor {
-    explicit MergeCursor(const GlassTable *in) : GlassCursor(in) {
+    /** Can tags be copied to the output without decompressing them?
+     *
+     *  Only if both tables use the same compression algorithm.
+     */
+    bool keep_compressed;
+
+    MergeCursor(const GlassTable *in, const GlassTable *out)
+	: GlassCursor(in),
+	  keep_compressed(in->get_compressor() == out->get_compressor()) {
 	rewind();
 	next();
     }
@@ -412,7 +566,7 @@ merge_spellings(GlassTable * out,
     for ( ; b != e; ++b) {
 	const GlassTable *in = *b;
 	if (!in->empty()) {
-	    pq.push(new MergeCursor(in));
+	    pq.push(new MergeCursor(in, out));
 	}
     }
 
@@ -424,7 +578,7 @@ merge_spellings(GlassTable * out,
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
-	    bool compressed = cur->read_tag(true);
+	    bool compressed = cur->read_tag(cur->keep_compressed);
 	    out->add(key, cur->current_tag, compressed);
 	    if (cur->next()) {
 		pq.push(cur);
@@ -521,7 +675,7 @@ merge_synonyms(GlassTable * out,
     for ( ; b != e; ++b) {
 	const GlassTable *in = *b;
 	if (!in->empty()) {
-	    pq.push(new MergeCursor(in));
+	    pq.push(new MergeCursor(in, out));
 	}
     }
 
@@ -533,7 +687,7 @@ merge_synonyms(GlassTable * out,
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
-	    bool compressed = cur->read_tag(true);
+	    bool compressed = cur->read_tag(cur->keep_compressed);
 	    out->add(key, cur->current_tag, compressed);
 	    if (cur->next()) {
 		pq.push(cur);
@@ -597,7 +751,8 @@ static void
 multimerge_postlists(Xapian::Compactor * compactor,
 		     GlassTable * out, const char * tmpdir,
 		     vector<const GlassTable *> tmp,
-		     vector<Xapian::docid> off)
+		     vector<Xapian::docid> off,
+		     vector<const DocidMask*> masks)
 {
     unsigned int c = 0;
     while (tmp.size() > 3) {
@@ -605,6 +760,8 @@ multimerge_postlists(Xapian::Compactor * compactor,
 	tmpout.reserve(tmp.size() / 2);
 	vector<Xapian::docid> newoff;
 	newoff.resize(tmp.size() / 2);
+	// Masked documents are left out by the first pass.
+	vector<const DocidMask*> newmasks(tmp.size() / 2, NULL);
 	for (unsigned int i = 0, j; i < tmp.size(); i = j) {
 	    j = i + 2;
 	    if (j == tmp.size() - 1) ++j;
@@ -626,7 +783,7 @@ multimerge_postlists(Xapian::Compactor * compactor,
 	    tmptab->create_and_open(flags, root_info);
 
 	    merge_postlists(compactor, tmptab, off.begin() + i,
-			    tmp.begin() + i, tmp.begin() + j);
+			    masks.begin() + i, tmp.begin() + i, tmp.begin() + j);
 	    if (c > 0) {
 		for (unsigned int k = i; k < j; ++k) {
 		    unlink(tmp[k]->get_path().c_str());
@@ -641,9 +798,11 @@ multimerge_postlists(Xapian::Compactor * compactor,
 	}
 	swap(tmp, tmpout);
 	swap(off, newoff);
+	swap(masks, newmasks);
 	++c;
     }
-    merge_postlists(compactor, out, off.begin(), tmp.begin(), tmp.end());
+    merge_postlists(compactor, out, off.begin(), masks.begin(),
+		    tmp.begin(), tmp.end());
     if (c > 0) {
 	for (size_t k = 0; k < tmp.size(); ++k) {
 	    unlink(tmp[k]->get_path().c_str());
@@ -656,33 +815,40 @@ multimerge_postlists(Xapian::Compactor * compactor,
 class PositionCursor : private GlassCursor {
     Xapian::docid offset;
 
+    /// Documents to leave out of the output (or NULL for none).
+    const DocidMask * mask;
+
   public:
     string key;
     Xapian::docid firstdid;
 
-    PositionCursor(const GlassTable *in, Xapian::docid offset_)
-	: GlassCursor(in), offset(offset_), firstdid(0) {
+    PositionCursor(const GlassTable *in, Xapian::docid offset_,
+		   const DocidMask * mask_)
+	: GlassCursor(in), offset(offset_), mask(mask_), firstdid(0) {
 	rewind();
 	next();
     }
 
     bool next() {
-	if (!GlassCursor::next()) return false;
-	read_tag();
-	const char * d = current_key.data();
-	const char * e = d + current_key.size();
-	string term;
-	Xapian::docid did;
-	if (!unpack_string_preserving_sort(&d, e, term) ||
-	    !unpack_uint_preserving_sort(&d, e, &did) ||
-	    d != e) {
-	    throw Xapian::DatabaseCorruptError("Bad position key");
-	}
+	while (GlassCursor::next()) {
+	    const char * d = current_key.data();
+	    const char * e = d + current_key.size();
+	    string term;
+	    Xapian::docid did;
+	    if (!unpack_string_preserving_sort(&d, e, term) ||
+		!unpack_uint_preserving_sort(&d, e, &did) ||
+		d != e) {
+		throw Xapian::DatabaseCorruptError("Bad position key");
+	    }
+	    if (mask && mask->contains(did)) continue;
+	    read_tag();
 
-	key.resize(0);
-	pack_string_preserving_sort(key, term);
-	pack_uint_preserving_sort(key, did + offset);
-	return true;
+	    key.resize(0);
+	    pack_string_preserving_sort(key, term);
+	    pack_uint_preserving_sort(key, did + offset);
+	    return true;
+	}
+	return false;
     }
 
     const string & get_tag() const {
@@ -701,7 +867,8 @@ class PositionCursorGt {
 
 static void
 merge_positions(GlassTable *out, const vector<const GlassTable*> & inputs,
-		const vector<Xapian::docid> & offset)
+		const vector<Xapian::docid> & offset,
+		const vector<const DocidMask*> & masks)
 {
     priority_queue<PositionCursor *, vector<PositionCursor *>, PositionCursorGt> pq;
     for (size_t i = 0; i < inputs.size(); ++i) {
@@ -711,7 +878,7 @@ merge_positions(GlassTable *out, const vector<const GlassTable*> & inputs,
 	    continue;
 	}
 
-	pq.push(new PositionCursor(in, offset[i]));
+	pq.push(new PositionCursor(in, offset[i], masks[i]));
     }
 
     while (!pq.empty()) {
@@ -728,10 +895,12 @@ merge_positions(GlassTable *out, const vector<const GlassTable*> & inputs,
 
 static void
 merge_docid_keyed(GlassTable *out, const vector<const GlassTable*> & inputs,
-		  const vector<Xapian::docid> & offset)
+		  const vector<Xapian::docid> & offset,
+		  const vector<const DocidMask*> & masks)
 {
     for (size_t i = 0; i < inputs.size(); ++i) {
 	Xapian::docid off = offset[i];
+	const DocidMask * mask = masks[i];
 
 	const GlassTable * in = inputs[i];
 	if (in->empty()) continue;
@@ -739,10 +908,21 @@ merge_docid_keyed(GlassTable *out, const vector<const GlassTable*> & inputs,
 	GlassCursor cur(in);
 	cur.rewind();
 
+	// We can only copy compressed tags as-is if the output uses the same
+	// compression algorithm and neither uses a dictionary.
+	bool keep_compressed = (in->get_compressor() == out->get_compressor() &&
+				!in->has_dictionary() &&
+				!out->has_dictionary());
+
 	string key;
 	while (cur.next()) {
+	    if (in->has_dictionary() &&
+		cur.current_key == GlassDocDataTable::dictionary_key()) {
+		// The output has its own dictionary, if it needs one.
+		continue;
+	    }
 	    // Adjust the key if this isn't the first database.
-	    if (off) {
+	    if (off || mask) {
 		Xapian::docid did;
 		const char * d = cur.current_key.data();
 		const char * e = d + cur.current_key.size();
@@ -751,6 +931,8 @@ merge_docid_keyed(GlassTable *out, const vector<const GlassTable*> & inputs,
 		    msg += inputs[i]->get_path();
 		    throw Xapian::DatabaseCorruptError(msg);
 		}
+		// Leave out masked documents.
+		if (mask && mask->contains(did)) continue;
 		did += off;
 		key.resize(0);
 		pack_uint_preserving_sort(key, did);
@@ -762,12 +944,62 @@ merge_docid_keyed(GlassTable *out, const vector<const GlassTable*> & inputs,
 	    } else {
 		key = cur.current_key;
 	    }
-	    bool compressed = cur.read_tag(true);
+	    bool compressed = cur.read_tag(keep_compressed);
 	    out->add(key, cur.current_tag, compressed);
 	}
     }
 }
 
+/** Build a compression dictionary from a sample of the document data.
+ *
+ *  We sample documents spread evenly through the docid range of each input
+ *  (rather than just the first few) since the nature of the data may vary.
+ */
+static string
+train_docdata_dictionary(const vector<const GlassTable*>& inputs,
+			 const vector<const Xapian::Database::Internal*>& sources,
+			 compression_type compressor)
+{
+    // Aim to sample about this many documents in total, but stop once we
+    // have this much sample data.
+    const Xapian::totallength SAMPLE_DOCS = 2000;
+    const size_t SAMPLE_BYTES = 512 * 1024;
+
+    Xapian::totallength total_docids = 0;
+    for (auto src : sources) {
+	total_docids += src->get_lastdocid();
+    }
+    if (total_docids == 0) return string();
+
+    vector<string> samples;
+    size_t sample_bytes = 0;
+    for (size_t i = 0; i != inputs.size(); ++i) {
+	const GlassTable * in = inputs[i];
+	if (in->empty()) continue;
+	Xapian::docid last_docid = sources[i]->get_lastdocid();
+	Xapian::totallength n = SAMPLE_DOCS * last_docid / total_docids;
+	if (n == 0) n = 1;
+	GlassCursor cur(in);
+	string prev_key;
+	for (Xapian::totallength j = 0; j != n; ++j) {
+	    Xapian::docid did = 1 + Xapian::docid(last_docid * j / n);
+	    (void)cur.find_entry_ge(GlassDocDataTable::make_key(did));
+	    if (cur.after_end()) break;
+	    // Document data is only stored if non-empty, so we may end up on
+	    // the same entry as last time.
+	    if (cur.current_key == prev_key) continue;
+	    prev_key = cur.current_key;
+	    cur.read_tag();
+	    samples.push_back(cur.current_tag);
+	    sample_bytes += cur.current_tag.size();
+	    if (sample_bytes >= SAMPLE_BYTES) {
+		return CompressionStream::train_dictionary(compressor, samples);
+	    }
+	}
+    }
+    return CompressionStream::train_dictionary(compressor, samples);
+}
+
 }
 
 using namespace GlassCompact;
@@ -855,9 +1087,19 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
     }
 
     version_file_out->create(block_size);
+    // Tombstoned (or otherwise masked) documents are left out of the output.
+    vector<const DocidMask*> masks;
+    masks.reserve(sources.size());
     for (size_t i = 0; i != sources.size(); ++i) {
 	auto db = static_cast<const GlassDatabase*>(sources[i]);
 	version_file_out->merge_stats(db->version_file);
+	if (db->docid_mask.empty()) {
+	    masks.push_back(NULL);
+	} else {
+	    version_file_out->delete_documents(db->docid_mask.size(),
+					       db->masked_length);
+	    masks.push_back(&db->docid_mask);
+	}
     }
 
     string fl_serialised;
@@ -985,6 +1227,10 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 	}
 	tabs.push_back(out);
 	RootInfo * root_info = version_file_out->root_to_set(t->type);
+	if (root_info->get_compress_min()) {
+	    // Use the same compression algorithm as the first input.
+	    root_info->set_compressor(inputs[0]->get_compressor());
+	}
 	if (single_file) {
 	    root_info->set_free_list(fl_serialised);
 	    out->open(FLAGS, version_file_out->get_root(t->type), version_file_out->get_revision());
@@ -995,14 +1241,36 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 	out->set_full_compaction(compaction != compactor->STANDARD);
 	if (compaction == compactor->FULLER) out->set_max_item_size(1);
 
+	if (t->type == Glass::DOCDATA && root_info->get_compress_min()) {
+	    // Build a dictionary if asked to, or to keep using one if any of
+	    // the inputs already do.
+	    bool use_dictionary =
+		(flags & Xapian::DBCOMPACT_DOCDATA_DICTIONARY);
+	    for (auto in : inputs) {
+		if (in->has_dictionary()) use_dictionary = true;
+	    }
+	    if (use_dictionary) {
+		string dictionary =
+		    train_docdata_dictionary(inputs, sources,
+					     root_info->get_compressor());
+		if (!dictionary.empty()) {
+		    // Store the dictionary before we start using it, so that it
+		    // is compressed without reference to itself.
+		    out->add(GlassDocDataTable::dictionary_key(), dictionary);
+		    out->set_dictionary(dictionary);
+		    root_info->set_dictionary(true);
+		}
+	    }
+	}
+
 	switch (t->type) {
 	    case Glass::POSTLIST: {
 		if (multipass && inputs.size() > 3) {
 		    multimerge_postlists(compactor, out, destdir,
-					 inputs, offset);
+					 inputs, offset, masks);
 		} else {
 		    merge_postlists(compactor, out, offset.begin(),
-				    inputs.begin(), inputs.end());
+				    masks.begin(), inputs.begin(), inputs.end());
 		}
 		break;
 	    }
@@ -1013,11 +1281,11 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 		merge_synonyms(out, inputs.begin(), inputs.end());
 		break;
 	    case Glass::POSITION:
-		merge_positions(out, inputs, offset);
+		merge_positions(out, inputs, offset, masks);
 		break;
 	    default:
 		// DocData, Termlist
-		merge_docid_keyed(out, inputs, offset);
+		merge_docid_keyed(out, inputs, offset, masks);
 		break;
 	}
 
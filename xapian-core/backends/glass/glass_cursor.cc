@@ -51,13 +51,22 @@ hex_display_encode(const string & input)
 
 #define DIR_START        11
 
+/** Maximum number of leaf blocks to preread ahead of a cursor.
+ *
+ *  The number we preread doubles up to this each time the cursor steps onto
+ *  a new leaf block or jumps to one we preread.
+ */
+#define GLASS_READAHEAD_MAX_LEAVES 32
+
 GlassCursor::GlassCursor(const GlassTable *B_, const Glass::Cursor * C_)
 	: is_positioned(false),
 	  is_after_end(false),
 	  tag_status(UNREAD),
 	  B(B_),
 	  version(B_->cursor_version),
-	  level(B_->level)
+	  level(B_->level),
+	  readahead_count(0),
+	  readahead_leaf(BLK_UNUSED)
 {
     B->cursor_created_since_last_modification = true;
     C = new Glass::Cursor[level + 1];
@@ -102,6 +111,28 @@ GlassCursor::~GlassCursor()
     delete [] C;
 }
 
+void
+GlassCursor::update_readahead(bool stepped)
+{
+    if (level == 0 || !is_positioned) return;
+    uint4 leaf = C[0].get_n();
+    if (leaf == readahead_leaf) return;
+    readahead_leaf = leaf;
+    if (!stepped && !B->readahead_covers(C, readahead_mark)) {
+	// We've jumped somewhere we didn't anticipate, so the access pattern
+	// looks random and readahead would probably just waste I/O.
+	readahead_count = 0;
+	readahead_mark.reset();
+	return;
+    }
+    if (readahead_count == 0) {
+	readahead_count = 1;
+    } else if (readahead_count < GLASS_READAHEAD_MAX_LEAVES) {
+	readahead_count *= 2;
+    }
+    B->readahead_leaves(C, readahead_count, readahead_mark);
+}
+
 bool
 GlassCursor::next()
 {
@@ -135,6 +166,7 @@ GlassCursor::next()
 
     get_key(&current_key);
     tag_status = UNREAD;
+    update_readahead(true);
 
     LOGLINE(DB, "Moved to entry: key=" << hex_display_encode(current_key));
     RETURN(true);
@@ -181,6 +213,7 @@ GlassCursor::find_entry(const string &key)
 	}
 	get_key(&current_key);
     }
+    update_readahead(false);
 
     LOGLINE(DB, "Found entry: key=" << hex_display_encode(current_key));
     RETURN(found);
@@ -270,6 +303,7 @@ GlassCursor::find_entry_ge(const string &key)
 	get_key(&current_key);
     }
     tag_status = UNREAD;
+    update_readahead(false);
 
     LOGLINE(DB, "Found entry: key=" << hex_display_encode(current_key));
     RETURN(found);
@@ -311,6 +345,7 @@ GlassCursor::read_tag(bool keep_compressed)
 	// We need to call B->next(...) after B->read_tag(...) so that the
 	// cursor ends up on the next key.
 	is_positioned = B->next(C, 0);
+	update_readahead(true);
 
 	LOGLINE(DB, "tag=" << hex_display_encode(current_tag));
     }
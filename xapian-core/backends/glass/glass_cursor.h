@@ -137,6 +137,26 @@ class Cursor {
     bool rewrite;
 };
 
+/** Records which leaf blocks GlassTable::readahead_leaves() has preread.
+ *
+ *  For a sequential table, @a first and @a last are block numbers and
+ *  @a parent is BLK_UNUSED.  Otherwise they are directory offsets of the
+ *  entries for the leaf blocks in branch block @a parent.
+ */
+struct ReadaheadMark {
+    uint4 parent;
+    uint4 first, last;
+
+    ReadaheadMark() { reset(); }
+
+    /// Forget what has been preread.
+    void reset() {
+	parent = BLK_UNUSED;
+	first = 1;
+	last = 0;
+    }
+};
+
 }
 
 class GlassTable;
@@ -186,6 +206,26 @@ class GlassCursor {
     /** The value of level in the Btree structure. */
     int level;
 
+    /** How many leaf blocks ahead to preread.
+     *
+     *  This grows while the cursor is moving through the table in order and
+     *  is reset to zero when it jumps elsewhere.
+     */
+    unsigned readahead_count;
+
+    /// The leaf block the cursor was on last time update_readahead() ran.
+    uint4 readahead_leaf;
+
+    /// Which leaf blocks we've already preread.
+    Glass::ReadaheadMark readahead_mark;
+
+    /** Adapt readahead to the cursor having moved.
+     *
+     *  @param stepped	true if the cursor moved by stepping to the next
+     *			item, false if it jumped to a key.
+     */
+    void update_readahead(bool stepped);
+
     /** Get the key.
      *
      *  The key of the item at the cursor is copied into key.
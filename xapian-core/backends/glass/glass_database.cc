@@ -49,6 +49,8 @@
 #include "glass_termlist.h"
 #include "glass_valuelist.h"
 #include "glass_values.h"
+#include "backends/maskpostlist.h"
+#include "compression_stream.h"
 #include "debuglog.h"
 #include "fd.h"
 #include "filetests.h"
@@ -59,6 +61,9 @@
 #include "api/replication.h"
 #include "replicationprotocol.h"
 #include "posixy_wrapper.h"
+#include "ratelimit.h"
+#include "safedirent.h"
+#include "safeunistd.h"
 #include "str.h"
 #include "stringutils.h"
 #include "backends/valuestats.h"
@@ -69,8 +74,14 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstdlib>
+#include <ctime>
+#include <functional>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
 
 using namespace std;
 using namespace Xapian;
@@ -187,6 +198,10 @@ GlassDatabase::GlassDatabase(int fd)
 GlassDatabase::~GlassDatabase()
 {
     LOGCALL_DTOR(DB, "GlassDatabase");
+    try {
+	release_lease();
+    } catch (...) {
+    }
 }
 
 bool
@@ -203,8 +218,28 @@ GlassDatabase::create_and_open_tables(int flags, unsigned int block_size)
     // The caller is expected to create the database directory if it doesn't
     // already exist.
 
+    compression_type compressor = COMPRESS_ZLIB;
+    switch (flags & Xapian::DB_COMPRESS_MASK_) {
+	case 0:
+	    break;
+	case Xapian::DB_COMPRESS_LZ4:
+	    compressor = COMPRESS_LZ4;
+	    break;
+	case Xapian::DB_COMPRESS_ZSTD:
+	    compressor = COMPRESS_ZSTD;
+	    break;
+	default:
+	    throw Xapian::InvalidArgumentError("Only one DB_COMPRESS_* flag "
+					       "may be specified");
+    }
+    if (!CompressionStream::supported(compressor)) {
+	string msg = CompressionStream::type_name(compressor);
+	msg += " compression support not enabled";
+	throw Xapian::FeatureUnavailableError(msg);
+    }
+
     GlassVersion &v = version_file;
-    v.create(block_size);
+    v.create(block_size, compressor);
 
     glass_revision_number_t rev = v.get_revision();
     const string& tmpfile = v.write(rev, flags);
@@ -260,6 +295,8 @@ GlassDatabase::open_tables(int flags)
 
     value_manager.reset();
 
+    read_tombstones();
+
     if (!readonly) {
 	changes.set_oldest_changeset(version_file.get_oldest_changeset());
 	glass_revision_number_t revision = version_file.get_revision();
@@ -271,6 +308,7 @@ GlassDatabase::open_tables(int flags)
 	synonym_table.set_changes(p);
 	spelling_table.set_changes(p);
 	docdata_table.set_changes(p);
+	apply_revision_leases();
     }
     return true;
 }
@@ -370,6 +408,8 @@ GlassDatabase::set_revision_number(int flags, glass_revision_number_t new_revisi
     }
 
     changes.commit(new_revision, flags);
+
+    apply_revision_leases();
 }
 
 void
@@ -381,12 +421,312 @@ GlassDatabase::request_document(Xapian::docid did) const
 void
 GlassDatabase::readahead_for_query(const Xapian::Query &query) const
 {
+    vector<string> keys;
     Xapian::TermIterator t;
     for (t = query.get_unique_terms_begin(); t != Xapian::TermIterator(); ++t) {
-	const string & term = *t;
-	if (!postlist_table.readahead_key(GlassPostListTable::make_key(term)))
-	    break;
+	keys.push_back(GlassPostListTable::make_key(*t));
+    }
+    postlist_table.readahead_keys(keys);
+}
+
+/// Read all the chunks of the postlist for @a term.
+static void
+preload_postlist(const GlassPostListTable & table, const string & term,
+		 RateLimit & limit)
+{
+    unique_ptr<GlassCursor> cursor(table.cursor_get());
+    if (!cursor || !cursor->find_entry(GlassPostListTable::make_key(term)))
+	return;
+    // Keys for the chunks after the first start with this.
+    string prefix = GlassPostListTable::make_key(term);
+    if (!term.empty()) prefix += '\0';
+    do {
+	cursor->read_tag();
+	limit.add(cursor->current_key.size() + cursor->current_tag.size());
+    } while (cursor->next() && startswith(cursor->current_key, prefix));
+}
+
+void
+GlassDatabase::preload(Xapian::termcount top_terms, size_t max_rate) const
+{
+    LOGCALL_VOID(DB, "GlassDatabase::preload", top_terms | max_rate);
+    RateLimit limit(max_rate);
+
+    postlist_table.preload_branches(limit);
+    position_table.preload_branches(limit);
+    termlist_table.preload_branches(limit);
+    synonym_table.preload_branches(limit);
+    spelling_table.preload_branches(limit);
+    docdata_table.preload_branches(limit);
+
+    // Document lengths are needed by almost every search.
+    preload_postlist(postlist_table, string(), limit);
+
+    if (top_terms == 0)
+	return;
+
+    // Find the top_terms terms with the highest termfreqs using a min-heap.
+    typedef pair<Xapian::doccount, string> freq_and_term;
+    vector<freq_and_term> top;
+    top.reserve(top_terms);
+    auto cmp = greater<freq_and_term>();
+    unique_ptr<TermList> t(open_allterms(string()));
+    while (t->next(), !t->at_end()) {
+	Xapian::doccount tf = t->get_termfreq();
+	if (top.size() < top_terms) {
+	    top.emplace_back(tf, t->get_termname());
+	    push_heap(top.begin(), top.end(), cmp);
+	} else if (tf > top.front().first) {
+	    pop_heap(top.begin(), top.end(), cmp);
+	    top.back() = freq_and_term(tf, t->get_termname());
+	    push_heap(top.begin(), top.end(), cmp);
+	}
+    }
+
+    // Read the postlists in key order, which is roughly disk order.
+    vector<string> terms;
+    terms.reserve(top.size());
+    for (auto&& i : top) {
+	terms.push_back(std::move(i.second));
+    }
+    sort(terms.begin(), terms.end());
+    for (auto&& term : terms) {
+	preload_postlist(postlist_table, term, limit);
+    }
+}
+
+/// Prefix of the names of revision lease files.
+#define LEASE_PREFIX "lease."
+
+/** Number of bytes of the tombstone bitmap to store in each chunk.
+ *
+ *  Each chunk covers 8 times this many docids.
+ */
+#define TOMBSTONE_CHUNK_SIZE 1024
+
+/** Key in the postlist table for the tombstone header.
+ *
+ *  The tag holds the total length of the tombstoned documents, and the chunks
+ *  of the bitmap follow under keys with this prefix.
+ */
+static const string TOMBSTONE_KEY("\0\xe8", 2);
+
+/// Generate the key for chunk @a chunk of the tombstone bitmap.
+static string
+make_tombstone_chunk_key(size_t chunk)
+{
+    string key = TOMBSTONE_KEY;
+    pack_uint_preserving_sort(key, chunk);
+    return key;
+}
+
+void
+GlassDatabase::read_tombstones()
+{
+    LOGCALL_VOID(DB, "GlassDatabase::read_tombstones", NO_ARGS);
+    docid_mask.clear();
+    masked_length = 0;
+
+    string tag;
+    if (!postlist_table.get_exact_entry(TOMBSTONE_KEY, tag)) return;
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    if (!unpack_uint_last(&p, end, &masked_length)) {
+	throw Xapian::DatabaseCorruptError("Bad tombstone header");
+    }
+
+    unique_ptr<GlassCursor> cursor(postlist_table.cursor_get());
+    (void)cursor->find_entry_ge(make_tombstone_chunk_key(0));
+    while (!cursor->after_end() &&
+	   startswith(cursor->current_key, TOMBSTONE_KEY)) {
+	p = cursor->current_key.data() + TOMBSTONE_KEY.size();
+	end = cursor->current_key.data() + cursor->current_key.size();
+	size_t chunk;
+	if (!unpack_uint_preserving_sort(&p, end, &chunk) || p != end) {
+	    throw Xapian::DatabaseCorruptError("Bad tombstone chunk key");
+	}
+	cursor->read_tag();
+	docid_mask.add_bytes(chunk * TOMBSTONE_CHUNK_SIZE, cursor->current_tag);
+	cursor->next();
+    }
+}
+
+void
+GlassDatabase::mask_document(Xapian::docid did)
+{
+    LOGCALL_VOID(DB, "GlassDatabase::mask_document", did);
+    Assert(did != 0);
+    if (!readonly) {
+	throw Xapian::InvalidOperationError("Can't mask documents in a "
+					    "writable database");
+    }
+    if (docid_mask.contains(did)) return;
+    // This will throw DocNotFoundError if the document doesn't exist.
+    Xapian::termcount doclen = get_doclength(did);
+    docid_mask.add(did);
+    masked_length += doclen;
+    caller_masked = true;
+}
+
+void
+GlassDatabase::throw_masked_document(Xapian::docid did)
+{
+    throw Xapian::DocNotFoundError("Document " + str(did) + " not found");
+}
+
+void
+GlassDatabase::lease_revision(unsigned duration) const
+{
+    LOGCALL_VOID(DB, "GlassDatabase::lease_revision", duration);
+    // A writer's own view of the database is never overwritten under it.
+    if (!readonly) return;
+    if (version_file.single_file()) {
+	throw Xapian::UnimplementedError("Revision leases aren't supported "
+					 "for single-file databases");
+    }
+    if (!postlist_table.is_open())
+	GlassTable::throw_database_closed();
+
+    if (duration == 0) {
+	release_lease();
+	return;
+    }
+
+    glass_revision_number_t rev = version_file.get_revision();
+    time_t now = time(NULL);
+    // If we're renewing an unexpired lease on this revision, writers will
+    // already be respecting it.
+    bool renewing = (!lease_path.empty() && lease_rev == rev &&
+		     now < lease_expiry);
+    time_t expiry = now + duration;
+
+    string lease;
+    pack_uint(lease, static_cast<unsigned long long>(expiry));
+    pack_uint(lease, rev);
+    for (unsigned i = Glass::POSTLIST; i != Glass::MAX_; ++i) {
+	auto table = static_cast<Glass::table_type>(i);
+	pack_string(lease, version_file.get_root(table).get_free_list());
+    }
+
+    if (lease_path.empty()) {
+	lease_path = db_dir;
+	lease_path += "/" LEASE_PREFIX;
+	lease_path += str(getpid());
+	lease_path += '.';
+	lease_path += str(static_cast<const void*>(this));
+    }
+    string tmp_path = lease_path;
+    tmp_path += ".tmp";
+    {
+	FD fd(posixy_open(tmp_path.c_str(),
+			  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+	if (fd < 0) {
+	    string msg = "Couldn't create ";
+	    msg += tmp_path;
+	    throw Xapian::DatabaseError(msg, errno);
+	}
+	io_write(fd, lease.data(), lease.size());
+    }
+    if (!io_tmp_rename(tmp_path, lease_path)) {
+	string msg = tmp_path;
+	msg += ": Failed to rename to ";
+	msg += lease_path;
+	throw Xapian::DatabaseError(msg, errno);
+    }
+    lease_rev = rev;
+    lease_expiry = expiry;
+
+    if (renewing) return;
+
+    // A writer only reads the leases when it starts a new revision, so if
+    // one has been committed since we opened this revision, the writer may
+    // already be reusing blocks from it.
+    GlassVersion latest(db_dir);
+    latest.read();
+    if (latest.get_revision() != rev) {
+	release_lease();
+	throw Xapian::DatabaseModifiedError("The revision being read has "
+					    "been discarded - you should "
+					    "call Xapian::Database::reopen() "
+					    "and retry the lease");
+    }
+}
+
+void
+GlassDatabase::release_lease() const
+{
+    if (lease_path.empty()) return;
+    (void)unlink(lease_path.c_str());
+    lease_path.resize(0);
+    lease_rev = 0;
+    lease_expiry = 0;
+}
+
+void
+GlassDatabase::apply_revision_leases()
+{
+    LOGCALL_VOID(DB, "GlassDatabase::apply_revision_leases", NO_ARGS);
+    if (db_dir.empty()) return;
+
+    glass_revision_number_t rev = version_file.get_revision();
+    glass_revision_number_t oldest_rev = 0;
+    string oldest;
+    bool have_lease = false;
+
+    DIR* dir = opendir(db_dir.c_str());
+    if (dir) {
+	time_t now = time(NULL);
+	while (struct dirent* entry = readdir(dir)) {
+	    string name(entry->d_name);
+	    if (!startswith(name, LEASE_PREFIX) || endswith(name, ".tmp"))
+		continue;
+	    string path = db_dir;
+	    path += '/';
+	    path += name;
+	    FD fd(posixy_open(path.c_str(), O_RDONLY | O_CLOEXEC));
+	    if (fd < 0) continue;
+	    char buf[4096];
+	    size_t n = io_read(fd, buf, sizeof(buf));
+	    const char* p = buf;
+	    const char* end = buf + n;
+	    unsigned long long expiry;
+	    glass_revision_number_t leased_rev;
+	    if (!unpack_uint(&p, end, &expiry) ||
+		!unpack_uint(&p, end, &leased_rev)) {
+		continue;
+	    }
+	    if (expiry <= static_cast<unsigned long long>(now)) {
+		// The reader didn't release this lease (probably because it
+		// died) so tidy up after it.
+		(void)unlink(path.c_str());
+		continue;
+	    }
+	    if (leased_rev > rev) continue;
+	    if (!have_lease || leased_rev < oldest_rev) {
+		oldest_rev = leased_rev;
+		oldest.assign(p, end - p);
+		have_lease = true;
+	    }
+	}
+	closedir(dir);
+    }
+
+    string fl[Glass::MAX_];
+    if (have_lease) {
+	const char* p = oldest.data();
+	const char* end = p + oldest.size();
+	for (auto&& s : fl) {
+	    if (!unpack_string(&p, end, s)) {
+		throw Xapian::DatabaseCorruptError("Bad revision lease file");
+	    }
+	}
     }
+    postlist_table.set_free_list_limit(fl[Glass::POSTLIST]);
+    docdata_table.set_free_list_limit(fl[Glass::DOCDATA]);
+    termlist_table.set_free_list_limit(fl[Glass::TERMLIST]);
+    position_table.set_free_list_limit(fl[Glass::POSITION]);
+    spelling_table.set_free_list_limit(fl[Glass::SPELLING]);
+    synonym_table.set_free_list_limit(fl[Glass::SYNONYM]);
 }
 
 bool
@@ -394,13 +734,21 @@ GlassDatabase::reopen()
 {
     LOGCALL(DB, bool, "GlassDatabase::reopen", NO_ARGS);
     if (!readonly) RETURN(false);
-    RETURN(open_tables(postlist_table.get_flags()));
+    // Masked docids refer to the revision we're reading.  Tombstones are
+    // reread along with the tables.
+    if (caller_masked) RETURN(false);
+    if (!open_tables(postlist_table.get_flags()))
+	RETURN(false);
+    // The lease was on the revision we were reading before.
+    release_lease();
+    RETURN(true);
 }
 
 void
 GlassDatabase::close()
 {
     LOGCALL_VOID(DB, "GlassDatabase::close", NO_ARGS);
+    release_lease();
     postlist_table.close(true);
     position_table.close(true);
     termlist_table.close(true);
@@ -431,43 +779,141 @@ GlassDatabase::get_database_write_lock(int flags, bool creating)
     }
 }
 
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+// The files sent for a whole database copy.  The tables which we want to be
+// cached best after the copy finishes are sent last.
+static const char copy_filenames[] =
+    "termlist." GLASS_TABLE_EXTENSION "\0"
+    "synonym." GLASS_TABLE_EXTENSION "\0"
+    "spelling." GLASS_TABLE_EXTENSION "\0"
+    "docdata." GLASS_TABLE_EXTENSION "\0"
+    "position." GLASS_TABLE_EXTENSION "\0"
+    "postlist." GLASS_TABLE_EXTENSION "\0"
+    "iamglass\0";
+
+/// Return true if @a filename is one of the files sent for a database copy.
+static bool
+is_copy_filename(const string & filename)
+{
+    const char * p = copy_filenames;
+    do {
+	size_t len = strlen(p);
+	if (filename.size() == len && memcmp(filename.data(), p, len) == 0)
+	    return true;
+	p += len + 1;
+    } while (*p);
+    return false;
+}
+
+/** Unpack the state of a replica's partial database copy.
+ *
+ *  This is the UUID and revision (packed as in the DB_HEADER message) of the
+ *  database being copied, the name of the file being received, and how much
+ *  of that file has been received.
+ *
+ *  @return true if @a copy_state was successfully unpacked.
+ */
+static bool
+unpack_copy_state(const string & copy_state,
+		  string & uuid,
+		  glass_revision_number_t & rev,
+		  string & filename,
+		  off_t & offset)
+{
+    const char * p = copy_state.data();
+    const char * end = p + copy_state.size();
+    string packed_rev;
+    std::make_unsigned<off_t>::type u_offset;
+    if (!unpack_string(&p, end, uuid) ||
+	!unpack_string(&p, end, packed_rev) ||
+	!unpack_string(&p, end, filename) ||
+	!unpack_uint_last(&p, end, &u_offset)) {
+	return false;
+    }
+    offset = off_t(u_offset);
+    p = packed_rev.data();
+    end = p + packed_rev.size();
+    return unpack_uint(&p, end, &rev) && p == end;
+}
+
+/** Send the contents of @a fd from @a offset as checksummed chunks.
+ *
+ *  At least one chunk is always sent, so the replica knows where the data
+ *  starts even if there's nothing after @a offset.
+ */
+static void
+send_file_chunks(RemoteConnection & conn, int fd, off_t offset,
+		 double end_time)
+{
+    unique_ptr<char[]> data(new char[REPL_DB_CHUNK_SIZE]);
+    string buf;
+    while (true) {
+	size_t n = io_pread(fd, data.get(), REPL_DB_CHUNK_SIZE, offset);
+	buf.resize(0);
+	pack_uint(buf, std::make_unsigned<off_t>::type(offset));
+	uLong checksum = crc32(0L, reinterpret_cast<const Bytef*>(data.get()),
+			       uInt(n));
+	pack_uint(buf, uint4(checksum));
+	buf.append(data.get(), n);
+	conn.send_message(REPL_REPLY_DB_FILECHUNK, buf, end_time);
+	if (n < REPL_DB_CHUNK_SIZE) break;
+	offset += n;
+    }
+}
+#endif
+
 void
-GlassDatabase::send_whole_database(RemoteConnection & conn, double end_time)
+GlassDatabase::send_whole_database(RemoteConnection & conn, double end_time,
+				   glass_revision_number_t rev,
+				   bool chunked,
+				   const string & resume_file,
+				   off_t resume_offset)
 {
-    LOGCALL_VOID(DB, "GlassDatabase::send_whole_database", conn | end_time);
+    LOGCALL_VOID(DB, "GlassDatabase::send_whole_database", conn | end_time | rev | chunked | resume_file | resume_offset);
 #ifdef XAPIAN_HAS_REMOTE_BACKEND
-    // Send the current revision number in the header.
+    // Send the revision number in the header.
     string buf;
     pack_string(buf, get_uuid());
-    pack_uint(buf, get_revision());
+    pack_uint(buf, rev);
     conn.send_message(REPL_REPLY_DB_HEADER, buf, end_time);
 
-    // Send all the tables.  The tables which we want to be cached best after
-    // the copy finishes are sent last.
-    static const char filenames[] =
-	"termlist." GLASS_TABLE_EXTENSION "\0"
-	"synonym." GLASS_TABLE_EXTENSION "\0"
-	"spelling." GLASS_TABLE_EXTENSION "\0"
-	"docdata." GLASS_TABLE_EXTENSION "\0"
-	"position." GLASS_TABLE_EXTENSION "\0"
-	"postlist." GLASS_TABLE_EXTENSION "\0"
-	"iamglass\0";
+    // Send all the tables.
+    bool skipping = !resume_file.empty();
     string filepath = db_dir;
     filepath += '/';
-    const char * p = filenames;
+    const char * p = copy_filenames;
     do {
 	size_t len = strlen(p);
+	off_t offset = 0;
+	if (skipping) {
+	    if (resume_file.size() != len ||
+		memcmp(resume_file.data(), p, len) != 0) {
+		// The replica already has this file.
+		p += len + 1;
+		continue;
+	    }
+	    skipping = false;
+	    offset = resume_offset;
+	}
 	filepath.replace(db_dir.size() + 1, string::npos, p, len);
 	FD fd(posixy_open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
 	if (fd >= 0) {
 	    conn.send_message(REPL_REPLY_DB_FILENAME, string(p, len), end_time);
-	    conn.send_file(REPL_REPLY_DB_FILEDATA, fd, end_time);
+	    if (chunked) {
+		send_file_chunks(conn, fd, offset, end_time);
+	    } else {
+		conn.send_file(REPL_REPLY_DB_FILEDATA, fd, end_time);
+	    }
 	}
 	p += len + 1;
     } while (*p);
 #else
     (void)conn;
     (void)end_time;
+    (void)rev;
+    (void)chunked;
+    (void)resume_file;
+    (void)resume_offset;
 #endif
 }
 
@@ -475,9 +921,10 @@ void
 GlassDatabase::write_changesets_to_fd(int fd,
 				      const string & revision,
 				      bool need_whole_db,
-				      ReplicationInfo * info)
+				      ReplicationInfo * info,
+				      int compression)
 {
-    LOGCALL_VOID(DB, "GlassDatabase::write_changesets_to_fd", fd | revision | need_whole_db | info);
+    LOGCALL_VOID(DB, "GlassDatabase::write_changesets_to_fd", fd | revision | need_whole_db | info | compression);
 #ifdef XAPIAN_HAS_REMOTE_BACKEND
     int whole_db_copies_left = MAX_DB_COPIES_PER_CONVERSATION;
     glass_revision_number_t start_rev_num = 0;
@@ -487,11 +934,21 @@ GlassDatabase::write_changesets_to_fd(int fd,
 
     const char * rev_ptr = revision.data();
     const char * rev_end = rev_ptr + revision.size();
+    // Replicas which can receive a copy in chunks follow the revision with
+    // the state of any partial copy they have (empty if none).
+    bool chunked = false;
+    string copy_state;
     if (!unpack_uint(&rev_ptr, rev_end, &start_rev_num)) {
 	need_whole_db = true;
+    } else if (rev_ptr != rev_end) {
+	if (!unpack_string(&rev_ptr, rev_end, copy_state)) {
+	    unpack_throw_serialisation_error(rev_ptr);
+	}
+	chunked = true;
     }
 
     RemoteConnection conn(-1, fd, string());
+    conn.set_compression(compression);
 
     // While the starting revision number is less than the latest revision
     // number, look for a changeset, and write it.
@@ -516,7 +973,32 @@ GlassDatabase::write_changesets_to_fd(int fd,
 	    start_rev_num = get_revision();
 	    start_uuid = get_uuid();
 
-	    send_whole_database(conn, 0.0);
+	    // If the replica has a partial copy of this database, we can send
+	    // the rest of it as long as we still have the changesets to bring
+	    // it up to date from the revision it was started at.
+	    string resume_file;
+	    off_t resume_offset = 0;
+	    if (!copy_state.empty()) {
+		string copy_uuid, copy_file;
+		glass_revision_number_t copy_rev_num;
+		off_t copy_offset;
+		if (unpack_copy_state(copy_state, copy_uuid, copy_rev_num,
+				      copy_file, copy_offset) &&
+		    copy_uuid == start_uuid &&
+		    copy_rev_num <= start_rev_num &&
+		    is_copy_filename(copy_file) &&
+		    (copy_rev_num == start_rev_num ||
+		     file_exists(db_dir + "/changes" + str(copy_rev_num)))) {
+		    start_rev_num = copy_rev_num;
+		    resume_file = copy_file;
+		    resume_offset = copy_offset;
+		}
+		// Only try to resume the first copy.
+		copy_state.clear();
+	    }
+
+	    send_whole_database(conn, 0.0, start_rev_num, chunked,
+				resume_file, resume_offset);
 	    if (info != NULL)
 		++(info->fullcopy_count);
 
@@ -599,6 +1081,7 @@ GlassDatabase::write_changesets_to_fd(int fd,
     (void)revision;
     (void)need_whole_db;
     (void)info;
+    (void)compression;
 #endif
 }
 
@@ -706,13 +1189,15 @@ GlassDatabase::cancel()
 
     Xapian::termcount ub = version_file.get_spelling_wordfreq_upper_bound();
     spelling_table.set_wordfreq_upper_bound(ub);
+
+    read_tombstones();
 }
 
 Xapian::doccount
 GlassDatabase::get_doccount() const
 {
     LOGCALL(DB, Xapian::doccount, "GlassDatabase::get_doccount", NO_ARGS);
-    RETURN(version_file.get_doccount());
+    RETURN(version_file.get_doccount() - docid_mask.size());
 }
 
 Xapian::docid
@@ -726,7 +1211,7 @@ Xapian::totallength
 GlassDatabase::get_total_length() const
 {
     LOGCALL(DB, Xapian::totallength, "GlassDatabase::get_total_length", NO_ARGS);
-    RETURN(version_file.get_total_doclen());
+    RETURN(version_file.get_total_doclen() - masked_length);
 }
 
 Xapian::termcount
@@ -734,6 +1219,7 @@ GlassDatabase::get_doclength(Xapian::docid did) const
 {
     LOGCALL(DB, Xapian::termcount, "GlassDatabase::get_doclength", did);
     Assert(did != 0);
+    check_not_masked(did);
     intrusive_ptr<const GlassDatabase> ptrtothis(this);
     RETURN(postlist_table.get_doclength(did, ptrtothis));
 }
@@ -743,6 +1229,7 @@ GlassDatabase::get_unique_terms(Xapian::docid did) const
 {
     LOGCALL(DB, Xapian::termcount, "GlassDatabase::get_unique_terms", did);
     Assert(did != 0);
+    check_not_masked(did);
     intrusive_ptr<const GlassDatabase> ptrtothis(this);
     RETURN(GlassTermList(ptrtothis, did).get_unique_terms());
 }
@@ -755,13 +1242,17 @@ GlassDatabase::get_freqs(const string & term,
     LOGCALL_VOID(DB, "GlassDatabase::get_freqs", term | termfreq_ptr | collfreq_ptr);
     Assert(!term.empty());
     postlist_table.get_freqs(term, termfreq_ptr, collfreq_ptr);
+    if (rare(!docid_mask.empty()) && termfreq_ptr) {
+	// We don't know how many masked documents the term occurs in.
+	*termfreq_ptr = min(*termfreq_ptr, get_doccount());
+    }
 }
 
 Xapian::doccount
 GlassDatabase::get_value_freq(Xapian::valueno slot) const
 {
     LOGCALL(DB, Xapian::doccount, "GlassDatabase::get_value_freq", slot);
-    RETURN(value_manager.get_value_freq(slot));
+    RETURN(min(value_manager.get_value_freq(slot), get_doccount()));
 }
 
 std::string
@@ -841,10 +1332,16 @@ GlassDatabase::open_leaf_post_list(const string& term, bool need_read_pos) const
 	if (version_file.get_last_docid() == doccount) {
 	    RETURN(new ContiguousAllDocsPostList(doccount));
 	}
-	RETURN(new GlassAllDocsPostList(ptrtothis, doccount));
+	LeafPostList* pl = new GlassAllDocsPostList(ptrtothis, doccount);
+	if (rare(!docid_mask.empty()))
+	    pl = new MaskPostList(term, pl, docid_mask, doccount);
+	RETURN(pl);
     }
 
-    RETURN(new GlassPostList(ptrtothis, term, true));
+    LeafPostList* pl = new GlassPostList(ptrtothis, term, true);
+    if (rare(!docid_mask.empty()))
+	pl = new MaskPostList(term, pl, docid_mask, get_doccount());
+    RETURN(pl);
 }
 
 ValueList *
@@ -852,7 +1349,10 @@ GlassDatabase::open_value_list(Xapian::valueno slot) const
 {
     LOGCALL(DB, ValueList *, "GlassDatabase::open_value_list", slot);
     intrusive_ptr<const GlassDatabase> ptrtothis(this);
-    RETURN(new GlassValueList(slot, ptrtothis));
+    ValueList* vl = new GlassValueList(slot, ptrtothis);
+    if (rare(!docid_mask.empty()))
+	vl = new MaskValueList(vl, docid_mask);
+    RETURN(vl);
 }
 
 TermList *
@@ -862,6 +1362,7 @@ GlassDatabase::open_term_list(Xapian::docid did) const
     Assert(did != 0);
     if (!termlist_table.is_open())
 	throw_termlist_table_close_exception();
+    check_not_masked(did);
     intrusive_ptr<const GlassDatabase> ptrtothis(this);
     RETURN(new GlassTermList(ptrtothis, did));
 }
@@ -877,6 +1378,7 @@ GlassDatabase::open_document(Xapian::docid did, bool lazy) const
 {
     LOGCALL(DB, Xapian::Document::Internal *, "GlassDatabase::open_document", did | lazy);
     Assert(did != 0);
+    check_not_masked(did);
     if (!lazy) {
 	// This will throw DocNotFoundError if the document doesn't exist.
 	(void)get_doclength(did);
@@ -1056,7 +1558,8 @@ GlassWritableDatabase::GlassWritableDatabase(const string &dir, int flags,
 	  change_count(0),
 	  flush_threshold(0),
 	  modify_shortcut_document(NULL),
-	  modify_shortcut_docid(0)
+	  modify_shortcut_docid(0),
+	  doclog(dir)
 {
     LOGCALL_CTOR(DB, "GlassWritableDatabase", dir | flags | block_size);
 
@@ -1069,12 +1572,55 @@ GlassWritableDatabase::GlassWritableDatabase(const string &dir, int flags,
     }
     if (flush_threshold == 0)
 	flush_threshold = 10000;
+
+    // Replaying creates objects which hold a reference to this database, so
+    // hold one ourselves to stop us being deleted when they're destroyed.
+    ++_refs;
+    try {
+	replay_doclog();
+    } catch (...) {
+	--_refs;
+	throw;
+    }
+    --_refs;
+    if (flags & Xapian::DB_DOCUMENT_LOG) {
+	doclog.start(version_file.get_uuid_string(),
+		     version_file.get_revision(), flags);
+    } else {
+	doclog.remove();
+    }
 }
 
 GlassWritableDatabase::~GlassWritableDatabase()
 {
     LOGCALL_DTOR(DB, "GlassWritableDatabase");
     dtor_called();
+    if (doclog.is_open() && !doclog.is_dirty()) {
+	// Everything logged has been committed.
+	try {
+	    doclog.remove();
+	} catch (...) {
+	}
+    }
+}
+
+void
+GlassWritableDatabase::replay_doclog()
+{
+    auto apply_change = [this](Xapian::docid did, const string * doc) {
+	if (doc) {
+	    replace_document(did, Xapian::Document::unserialise(*doc));
+	} else {
+	    try {
+		delete_document(did);
+	    } catch (const Xapian::DocNotFoundError &) {
+	    }
+	}
+    };
+    if (doclog.replay(version_file.get_uuid_string(),
+		      version_file.get_revision(), apply_change)) {
+	commit();
+    }
 }
 
 void
@@ -1105,6 +1651,7 @@ GlassWritableDatabase::flush_postlist_changes()
 	version_file.set_oldest_changeset(changes.get_oldest_changeset());
 	inverter.flush(postlist_table);
 	inverter.flush_pos_lists(position_table);
+	write_tombstones();
 
 	change_count = 0;
     } catch (...) {
@@ -1125,6 +1672,13 @@ GlassWritableDatabase::close()
 	// FIXME: if commit() throws, should we still close?
     }
     GlassDatabase::close();
+    if (doclog.is_open()) {
+	if (doclog.is_dirty()) {
+	    doclog.sync();
+	} else {
+	    doclog.remove();
+	}
+    }
 }
 
 void
@@ -1132,6 +1686,11 @@ GlassWritableDatabase::apply()
 {
     value_manager.set_value_stats(value_stats);
     GlassDatabase::apply();
+    if (doclog.is_open() && doclog.is_dirty()) {
+	// The logged changes are now committed, so start a new log.
+	doclog.restart(version_file.get_uuid_string(),
+		       version_file.get_revision());
+    }
 }
 
 Xapian::docid
@@ -1142,7 +1701,9 @@ GlassWritableDatabase::add_document(const Xapian::Document & document)
     if (version_file.get_last_docid() == GLASS_MAX_DOCID)
 	throw Xapian::DatabaseError("Run out of docids - you'll have to use copydatabase to eliminate any gaps before you can add more documents");
     // Use the next unused document ID.
-    RETURN(add_document_(version_file.get_next_docid(), document));
+    Xapian::docid did = version_file.get_next_docid();
+    doclog.log_replace(did, document);
+    RETURN(add_document_(did, document));
 }
 
 Xapian::docid
@@ -1198,15 +1759,80 @@ GlassWritableDatabase::add_document_(Xapian::docid did,
     RETURN(did);
 }
 
+void
+GlassWritableDatabase::add_tombstone(Xapian::docid did,
+				     Xapian::termcount doclen)
+{
+    docid_mask.add(did);
+    masked_length += doclen;
+    modified_tombstone_chunks.insert((did - 1) / (TOMBSTONE_CHUNK_SIZE * 8));
+}
+
+void
+GlassWritableDatabase::remove_tombstone(Xapian::docid did)
+{
+    docid_mask.remove(did);
+    masked_length -= get_doclength(did);
+    modified_tombstone_chunks.insert((did - 1) / (TOMBSTONE_CHUNK_SIZE * 8));
+}
+
+void
+GlassWritableDatabase::write_tombstones()
+{
+    if (modified_tombstone_chunks.empty()) return;
+    for (size_t chunk : modified_tombstone_chunks) {
+	string key = make_tombstone_chunk_key(chunk);
+	string bytes = docid_mask.get_bytes(chunk * TOMBSTONE_CHUNK_SIZE,
+					    TOMBSTONE_CHUNK_SIZE);
+	if (bytes.empty()) {
+	    postlist_table.del(key);
+	} else {
+	    postlist_table.add(key, bytes);
+	}
+    }
+    modified_tombstone_chunks.clear();
+
+    if (docid_mask.empty()) {
+	postlist_table.del(TOMBSTONE_KEY);
+    } else {
+	string tag;
+	pack_uint_last(tag, masked_length);
+	postlist_table.add(TOMBSTONE_KEY, tag);
+    }
+}
+
 void
 GlassWritableDatabase::delete_document(Xapian::docid did)
 {
     LOGCALL_VOID(DB, "GlassWritableDatabase::delete_document", did);
     Assert(did != 0);
 
+    // A tombstoned document has already been deleted.
+    check_not_masked(did);
+
+    if (postlist_table.get_flags() & Xapian::DB_TOMBSTONE_DELETES) {
+	// This will throw DocNotFoundError if the document doesn't exist.
+	Xapian::termcount doclen = get_doclength(did);
+
+	doclog.log_delete(did);
+
+	if (rare(modify_shortcut_docid == did)) {
+	    modify_shortcut_document = NULL;
+	    modify_shortcut_docid = 0;
+	}
+
+	// Just hide the document - it's removed from the tables when the
+	// database is compacted.
+	add_tombstone(did, doclen);
+	check_flush_threshold();
+	return;
+    }
+
     if (!termlist_table.is_open())
 	throw_termlist_table_close_exception();
 
+    doclog.log_delete(did);
+
     // Remove the document data.  If this fails, just propagate the exception since
     // the state should still be consistent.
     bool doc_really_existed = docdata_table.delete_document_data(did);
@@ -1269,7 +1895,15 @@ GlassWritableDatabase::replace_document(Xapian::docid did,
     LOGCALL_VOID(DB, "GlassWritableDatabase::replace_document", did | document);
     Assert(did != 0);
 
+    doclog.log_replace(did, document);
+
     try {
+	if (rare(docid_mask.contains(did))) {
+	    // The tombstoned document is still in the tables, so bring it back
+	    // and replace it below.
+	    remove_tombstone(did);
+	}
+
 	if (did > version_file.get_last_docid()) {
 	    version_file.set_last_docid(did);
 	    // If this docid is above the highwatermark, then we can't be
@@ -1437,6 +2071,7 @@ Xapian::termcount
 GlassWritableDatabase::get_doclength(Xapian::docid did) const
 {
     LOGCALL(DB, Xapian::termcount, "GlassWritableDatabase::get_doclength", did);
+    check_not_masked(did);
     Xapian::termcount doclen;
     if (inverter.get_doclength(did, doclen))
 	RETURN(doclen);
@@ -1453,6 +2088,7 @@ GlassWritableDatabase::get_unique_terms(Xapian::docid did) const
     // get_unique_terms() really ought to only count terms with wdf > 0, but
     // that's expensive to calculate on demand, so for now let's just ensure
     // unique_terms <= doclen.
+    check_not_masked(did);
     Xapian::termcount doclen;
     if (inverter.get_doclength(did, doclen)) {
 	intrusive_ptr<const GlassDatabase> ptrtothis(this);
@@ -1477,6 +2113,10 @@ GlassWritableDatabase::get_freqs(const string & term,
 	if (collfreq_ptr)
 	    *collfreq_ptr += cf_delta;
     }
+    if (rare(!docid_mask.empty()) && termfreq_ptr) {
+	// We don't know how many tombstoned documents the term occurs in.
+	*termfreq_ptr = min(*termfreq_ptr, get_doccount());
+    }
 }
 
 Xapian::doccount
@@ -1485,7 +2125,7 @@ GlassWritableDatabase::get_value_freq(Xapian::valueno slot) const
     LOGCALL(DB, Xapian::doccount, "GlassWritableDatabase::get_value_freq", slot);
     map<Xapian::valueno, ValueStats>::const_iterator i;
     i = value_stats.find(slot);
-    if (i != value_stats.end()) RETURN(i->second.freq);
+    if (i != value_stats.end()) RETURN(min(i->second.freq, get_doccount()));
     RETURN(GlassDatabase::get_value_freq(slot));
 }
 
@@ -1549,13 +2189,19 @@ GlassWritableDatabase::open_leaf_post_list(const string& term,
 	    RETURN(new ContiguousAllDocsPostList(doccount));
 	}
 	inverter.flush_doclengths(postlist_table);
-	RETURN(new GlassAllDocsPostList(ptrtothis, doccount));
+	LeafPostList* pl = new GlassAllDocsPostList(ptrtothis, doccount);
+	if (rare(!docid_mask.empty()))
+	    pl = new MaskPostList(term, pl, docid_mask, doccount);
+	RETURN(pl);
     }
 
     // Flush any buffered changes for this term's postlist so we can just
     // iterate from the flushed state.
     inverter.flush_post_list(postlist_table, term);
-    RETURN(new GlassPostList(ptrtothis, term, true));
+    LeafPostList* pl = new GlassPostList(ptrtothis, term, true);
+    if (rare(!docid_mask.empty()))
+	pl = new MaskPostList(term, pl, docid_mask, get_doccount());
+    RETURN(pl);
 }
 
 ValueList *
@@ -1634,7 +2280,29 @@ GlassWritableDatabase::cancel()
     GlassDatabase::cancel();
     inverter.clear();
     value_stats.clear();
+    modified_tombstone_chunks.clear();
     change_count = 0;
+    if (doclog.is_open() && doclog.is_dirty()) {
+	// The logged changes have been discarded.
+	doclog.restart(version_file.get_uuid_string(),
+		       version_file.get_revision());
+    }
+}
+
+void
+GlassWritableDatabase::begin_transaction(bool flushed)
+{
+    Database::Internal::begin_transaction(flushed);
+    doclog.begin_transaction();
+}
+
+void
+GlassWritableDatabase::end_transaction(bool do_commit)
+{
+    // Log the transaction's changes before committing them, so they're
+    // replayed if we die while committing.
+    if (transaction_active()) doclog.end_transaction(do_commit);
+    Database::Internal::end_transaction(do_commit);
 }
 
 void
@@ -29,6 +29,7 @@
 #include "backends/databaseinternal.h"
 #include "glass_changes.h"
 #include "glass_docdata.h"
+#include "glass_doclog.h"
 #include "glass_inverter.h"
 #include "glass_positionlist.h"
 #include "glass_postlist.h"
@@ -39,12 +40,15 @@
 #include "glass_version.h"
 #include "../flint_lock.h"
 #include "glass_defs.h"
+#include "backends/docidmask.h"
 #include "backends/valuestats.h"
 
 #include "xapian/compactor.h"
 #include "xapian/constants.h"
 
+#include <ctime>
 #include <map>
+#include <set>
 
 class GlassTermList;
 class GlassAllDocsPostList;
@@ -116,6 +120,51 @@ class GlassDatabase : public Xapian::Database::Internal {
     /// Replication changesets.
     GlassChanges changes;
 
+    /// Path of the lease file we hold, or empty if we don't hold a lease.
+    mutable std::string lease_path;
+
+    /// Revision which lease_path leases.
+    mutable glass_revision_number_t lease_rev = 0;
+
+    /// When the lease we hold expires (in seconds since the epoch).
+    mutable time_t lease_expiry = 0;
+
+    /// Remove the lease file we hold, if any.
+    void release_lease() const;
+
+    /** Documents hidden by tombstones or mask_document().
+     *
+     *  Tombstoned documents have been deleted, but are only removed from the
+     *  tables when the database is compacted.
+     */
+    DocidMask docid_mask;
+
+    /// Total length of the documents in docid_mask.
+    Xapian::totallength masked_length = 0;
+
+    /// Has mask_document() been called?
+    bool caller_masked = false;
+
+    /// Read the tombstoned documents into docid_mask.
+    void read_tombstones();
+
+    /// Throw DocNotFoundError if @a did has been masked.
+    void check_not_masked(Xapian::docid did) const {
+	if (rare(!docid_mask.empty()) && docid_mask.contains(did))
+	    throw_masked_document(did);
+    }
+
+    [[noreturn]]
+    static void throw_masked_document(Xapian::docid did);
+
+    /** Stop reusing blocks which a reader has leased.
+     *
+     *  Reads the lease files in the database directory (removing any which
+     *  have expired) and limits reuse of free blocks in each table so that
+     *  the oldest leased revision isn't overwritten.
+     */
+    void apply_revision_leases();
+
     /** Return true if a database exists at the path specified for this
      *  database.
      */
@@ -198,8 +247,20 @@ class GlassDatabase : public Xapian::Database::Internal {
     void cancel();
 
     /** Send a set of messages which transfer the whole database.
+     *
+     *  @param rev		The revision to report in the header.
+     *  @param chunked		Send the files as checksummed chunks (which
+     *				the replica can resume from) rather than
+     *				whole.
+     *  @param resume_file	If non-empty, skip the files sent before this
+     *				one, and send this one from @a resume_offset.
+     *  @param resume_offset	The offset to resume @a resume_file from.
      */
-    void send_whole_database(RemoteConnection & conn, double end_time);
+    void send_whole_database(RemoteConnection & conn, double end_time,
+			     glass_revision_number_t rev,
+			     bool chunked,
+			     const std::string & resume_file,
+			     off_t resume_offset);
 
     /** Get the revision stored in a changeset.
      */
@@ -290,7 +351,8 @@ class GlassDatabase : public Xapian::Database::Internal {
     void write_changesets_to_fd(int fd,
 				const string & start_revision,
 				bool need_whole_db,
-				Xapian::ReplicationInfo * info);
+				Xapian::ReplicationInfo * info,
+				int compression);
     /** Get the revision number which the tables are opened at.
      *
      *  @return the current revision number.
@@ -300,6 +362,10 @@ class GlassDatabase : public Xapian::Database::Internal {
 
     void request_document(Xapian::docid /*did*/) const;
     void readahead_for_query(const Xapian::Query &query) const;
+    void preload(Xapian::termcount top_terms, size_t max_rate) const;
+    void lease_revision(unsigned duration) const;
+    void mask_document(Xapian::docid did);
+    bool freqs_are_exact() const { return docid_mask.empty(); }
     //@}
 
     [[noreturn]]
@@ -362,6 +428,24 @@ class GlassWritableDatabase : public GlassDatabase {
      */
     mutable Xapian::docid modify_shortcut_docid;
 
+    /// Log of document changes since the last commit (if DB_DOCUMENT_LOG).
+    GlassDocLog doclog;
+
+    /// Chunks of the tombstone bitmap which have been modified.
+    std::set<size_t> modified_tombstone_chunks;
+
+    /// Tombstone document @a did, which has length @a doclen.
+    void add_tombstone(Xapian::docid did, Xapian::termcount doclen);
+
+    /// Remove the tombstone for document @a did.
+    void remove_tombstone(Xapian::docid did);
+
+    /// Write modified chunks of the tombstone bitmap to the postlist table.
+    void write_tombstones();
+
+    /// Replay any document changes left in the log by a writer which died.
+    void replay_doclog();
+
     /** Check if we should autoflush.
      *
      *  Called at the end of each document changing operation.
@@ -399,6 +483,9 @@ class GlassWritableDatabase : public GlassDatabase {
     void delete_document(Xapian::docid did);
     void replace_document(Xapian::docid did, const Xapian::Document & document);
 
+    void begin_transaction(bool flushed);
+    void end_transaction(bool do_commit);
+
     Xapian::Document::Internal * open_document(Xapian::docid did,
 					       bool lazy) const;
 
@@ -27,6 +27,7 @@
 #include "xapian/error.h"
 
 #include "../flint_lock.h"
+#include "glass_changes.h"
 #include "glass_defs.h"
 #include "glass_replicate_internal.h"
 #include "glass_version.h"
@@ -44,6 +45,7 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <memory>
 
 [[noreturn]]
 static void
@@ -55,6 +57,12 @@ throw_connection_closed_unexpectedly()
 using namespace std;
 using namespace Xapian;
 
+/** The most data to gather up in a run of changed blocks before writing it.
+ *
+ *  This bounds the memory used while applying a changeset.
+ */
+static const size_t MAX_PENDING_BLOCKS_SIZE = 1024 * 1024;
+
 static const char * dbnames =
 	"/postlist." GLASS_TABLE_EXTENSION "\0"
 	"/docdata." GLASS_TABLE_EXTENSION "\0\0"
@@ -63,16 +71,121 @@ static const char * dbnames =
 	"/spelling." GLASS_TABLE_EXTENSION "\0"
 	"/synonym." GLASS_TABLE_EXTENSION;
 
+/** Keep a copy of a changeset as it is applied.
+ *
+ *  This allows a replica to act as the master for other replicas.
+ */
+class ChangesetCopy {
+    /// The connection the changeset is being read from.
+    RemoteConnection& conn;
+
+    /// The path of the temporary file the changeset is copied to.
+    string tmp_path;
+
+    /// File descriptor for tmp_path, or -1 if we're not keeping a copy.
+    int fd = -1;
+
+  public:
+    ChangesetCopy(RemoteConnection& conn_, const string& db_dir)
+	: conn(conn_), tmp_path(db_dir)
+    {
+	tmp_path += "/changes.rtmp";
+	fd = posixy_open(tmp_path.c_str(),
+			 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+	    string msg = "Failed to open ";
+	    msg += tmp_path;
+	    throw DatabaseError(msg, errno);
+	}
+	conn.set_chunk_copy_fd(fd);
+    }
+
+    ~ChangesetCopy() {
+	if (fd >= 0) {
+	    conn.set_chunk_copy_fd(-1);
+	    (void)::close(fd);
+	    try {
+		(void)io_unlink(tmp_path);
+	    } catch (...) {
+		// We can't usefully report this from a destructor.
+	    }
+	}
+    }
+
+    /** Keep the copy of a changeset which has been applied.
+     *
+     *  @param db_dir	The database directory.
+     *  @param startrev	The start revision of the changeset.
+     *  @param endrev	The end revision of the changeset.
+     *  @param max_changesets	The number of changesets to keep.
+     */
+    void keep(const string& db_dir,
+	      glass_revision_number_t startrev,
+	      glass_revision_number_t endrev,
+	      glass_revision_number_t max_changesets) {
+	conn.set_chunk_copy_fd(-1);
+	io_sync(fd);
+	(void)::close(fd);
+	fd = -1;
+
+	string changes_file = db_dir;
+	changes_file += "/changes";
+	size_t stem_len = changes_file.size();
+	changes_file += str(startrev);
+	if (!io_tmp_rename(tmp_path, changes_file)) {
+	    string msg = tmp_path;
+	    msg += ": Failed to rename to ";
+	    msg += changes_file;
+	    throw DatabaseError(msg, errno);
+	}
+
+	// Remove changesets which are now too old to keep, stopping at the
+	// first which doesn't exist.
+	glass_revision_number_t rev = 0;
+	if (endrev > max_changesets) rev = endrev - max_changesets;
+	while (rev-- > 0) {
+	    changes_file.resize(stem_len);
+	    changes_file += str(rev);
+	    if (!io_unlink(changes_file)) break;
+	}
+    }
+};
+
 GlassDatabaseReplicator::GlassDatabaseReplicator(const string & db_dir_)
     : db_dir(db_dir_)
 {
     std::fill_n(fds, sizeof(fds) / sizeof(fds[0]), -1);
 }
 
+void
+GlassDatabaseReplicator::flush_blocks(Glass::table_type table) const
+{
+    PendingBlocks& run = pending[table];
+    if (run.data.empty()) return;
+
+    int fd = fds[table];
+    if (fd == -1) {
+	string db_path = db_dir;
+	db_path += dbnames + table * (11 + CONST_STRLEN(GLASS_TABLE_EXTENSION));
+	fd = posixy_open(db_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+	if (fd == -1) {
+	    string msg = "Failed to open ";
+	    msg += db_path;
+	    throw DatabaseError(msg, errno);
+	}
+	fds[table] = fd;
+    }
+
+    io_write_block(fd, run.data.data(), run.data.size(), 0,
+		   off_t(run.first) * run.block_size);
+    run.data.resize(0);
+}
+
 void
 GlassDatabaseReplicator::commit() const
 {
     for (size_t i = 0; i != Glass::MAX_; ++i) {
+	flush_blocks(static_cast<Glass::table_type>(i));
 	int fd = fds[i];
 	if (fd >= 0) {
 	    io_sync(fd);
@@ -143,6 +256,9 @@ GlassDatabaseReplicator::process_changeset_chunk_version(string & buf,
 	throw NetworkError("Unexpected end of changeset (6)");
     }
 
+    // The blocks the new version file refers to must be on disk first.
+    commit();
+
     // Write size bytes from start of buf to new version file.
     string tmpfile = db_dir;
     tmpfile += "/v.rtmp";
@@ -171,6 +287,7 @@ GlassDatabaseReplicator::process_changeset_chunk_version(string & buf,
 void
 GlassDatabaseReplicator::process_changeset_chunk_blocks(Glass::table_type table,
 							unsigned v,
+							bool compressed,
 							string & buf,
 							RemoteConnection & conn,
 							double end_time) const
@@ -187,30 +304,46 @@ GlassDatabaseReplicator::process_changeset_chunk_blocks(Glass::table_type table,
     if (!unpack_uint(&ptr, end, &block_number))
 	throw NetworkError("Invalid block number in changeset");
 
-    buf.erase(0, ptr - buf.data());
-
-    int fd = fds[table];
-    if (fd == -1) {
-	string db_path = db_dir;
-	db_path += dbnames + table * (11 + CONST_STRLEN(GLASS_TABLE_EXTENSION));
-	fd = posixy_open(db_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
-	if (fd == -1) {
-	    string msg = "Failed to open ";
-	    msg += db_path;
-	    throw DatabaseError(msg, errno);
-	}
-	fds[table] = fd;
+    size_t compressed_size = 0;
+    if (compressed) {
+	if (!unpack_uint(&ptr, end, &compressed_size) || compressed_size == 0)
+	    throw NetworkError("Invalid compressed block size in changeset");
     }
 
-    int res = conn.get_message_chunk(buf, changeset_blocksize, end_time);
+    buf.erase(0, ptr - buf.data());
+
+    size_t chunk_size = compressed ? compressed_size : changeset_blocksize;
+    int res = conn.get_message_chunk(buf, chunk_size, end_time);
     if (res <= 0) {
 	if (res < 0)
 	    throw_connection_closed_unexpectedly();
 	throw NetworkError("Unexpected end of changeset (4)");
     }
 
-    io_write_block(fd, buf.data(), changeset_blocksize, block_number);
-    buf.erase(0, changeset_blocksize);
+    // Add the block to the run pending for this table if it follows on from
+    // it, otherwise write out that run and start a new one.
+    PendingBlocks& run = pending[table];
+    if (run.data.empty() ||
+	run.block_size != changeset_blocksize ||
+	run.data.size() >= MAX_PENDING_BLOCKS_SIZE ||
+	block_number - run.first != run.data.size() / changeset_blocksize) {
+	flush_blocks(table);
+	run.first = block_number;
+	run.block_size = changeset_blocksize;
+    }
+
+    if (compressed) {
+	size_t old_size = run.data.size();
+	comp_stream.decompress_start();
+	if (!comp_stream.decompress_chunk(buf.data(), int(compressed_size),
+					  run.data) ||
+	    run.data.size() - old_size != changeset_blocksize) {
+	    throw NetworkError("Bad compressed block in changeset");
+	}
+    } else {
+	run.data.append(buf, 0, changeset_blocksize);
+    }
+    buf.erase(0, chunk_size);
 }
 
 string
@@ -233,6 +366,13 @@ GlassDatabaseReplicator::apply_changeset_from_conn(RemoteConnection & conn,
 	throw_connection_closed_unexpectedly();
     AssertEq(type, REPL_REPLY_CHANGESET);
 
+    // If XAPIAN_MAX_CHANGESETS is set, keep changesets as the master would
+    // so that other replicas can replicate from this one.
+    glass_revision_number_t max_changesets = GlassChanges::get_max_changesets();
+    unique_ptr<ChangesetCopy> changeset_copy;
+    if (max_changesets)
+	changeset_copy.reset(new ChangesetCopy(conn, db_dir));
+
     string buf;
     // Read enough to be certain that we've got the header part of the
     // changeset.
@@ -301,7 +441,8 @@ GlassDatabaseReplicator::apply_changeset_from_conn(RemoteConnection & conn,
 	//
 	// 11111111 - last chunk
 	// 11111110 - version file
-	// 00BBBTTT - table block:
+	// 0CBBBTTT - table block:
+	//   Compressed C=0..1 (CHANGES_BLOCK_COMPRESSED)
 	//   Block size = (GLASS_MIN_BLOCKSIZE<<BBB) BBB=0..5
 	//   Table TTT=0..(Glass::MAX_-1)
 	unsigned char chunk_type = *ptr++;
@@ -317,11 +458,15 @@ GlassDatabaseReplicator::apply_changeset_from_conn(RemoteConnection & conn,
 	if (table_code >= Glass::MAX_)
 	    throw NetworkError("Bad table code in changeset file");
 	Glass::table_type table = static_cast<Glass::table_type>(table_code);
-	unsigned char v = (chunk_type >> 3) & 0x0f;
+	unsigned char v = (chunk_type >> 3) & 0x07;
+	bool compressed = (chunk_type & CHANGES_BLOCK_COMPRESSED);
+	if (chunk_type & 0x80)
+	    throw NetworkError("Bad chunk type in changeset");
 
 	// Process the chunk
 	buf.erase(0, ptr - buf.data());
-	process_changeset_chunk_blocks(table, v, buf, conn, end_time);
+	process_changeset_chunk_blocks(table, v, compressed, buf, conn,
+				       end_time);
     }
 
     if (ptr != end)
@@ -332,6 +477,9 @@ GlassDatabaseReplicator::apply_changeset_from_conn(RemoteConnection & conn,
 
     commit();
 
+    if (changeset_copy)
+	changeset_copy->keep(db_dir, startrev, endrev, max_changesets);
+
     RETURN(buf);
 }
 
@@ -25,6 +25,7 @@
 
 #include "backends/databasereplicator.h"
 #include "glass_defs.h"
+#include "common/compression_stream.h"
 
 class GlassDatabaseReplicator : public Xapian::DatabaseReplicator {
     /** Path of database.
@@ -37,6 +38,31 @@ class GlassDatabaseReplicator : public Xapian::DatabaseReplicator {
      */
     mutable int fds[Glass::MAX_];
 
+    /// Used to decompress compressed blocks in changesets.
+    mutable CompressionStream comp_stream;
+
+    /** A run of changed blocks with consecutive block numbers.
+     *
+     *  Changed blocks are often consecutive, so we gather them up and write
+     *  each run with a single call rather than one per block.
+     */
+    struct PendingBlocks {
+	/// The block number of the first block in @a data.
+	uint4 first = 0;
+
+	/// The size of each block in @a data.
+	unsigned block_size = 0;
+
+	/// The contents of the blocks.
+	std::string data;
+    };
+
+    /// Blocks waiting to be written to each table.
+    mutable PendingBlocks pending[Glass::MAX_];
+
+    /// Write any blocks waiting to be written to @a table.
+    void flush_blocks(Glass::table_type table) const;
+
     /** Process a chunk which holds a version file.
      */
     void process_changeset_chunk_version(std::string & buf,
@@ -45,13 +71,22 @@ class GlassDatabaseReplicator : public Xapian::DatabaseReplicator {
 
     /** Process a chunk which holds a list of changed blocks in the
      *  database.
+     *
+     *  If @a compressed is true, the block was compressed with zlib.
      */
     void process_changeset_chunk_blocks(Glass::table_type table,
 					unsigned v,
+					bool compressed,
 					std::string & buf,
 					RemoteConnection & conn,
 					double end_time) const;
 
+    /** Write out pending blocks and sync all the tables we've written to.
+     *
+     *  This must be called before a new version file is installed, since
+     *  otherwise a crash could leave the version file referring to blocks
+     *  which never made it to disk.
+     */
     void commit() const;
 
   public:
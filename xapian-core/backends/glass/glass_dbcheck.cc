@@ -31,6 +31,7 @@
 #include "glass_check.h"
 #include "glass_cursor.h"
 #include "glass_defs.h"
+#include "glass_docdata.h"
 #include "glass_table.h"
 #include "glass_version.h"
 #include "pack.h"
@@ -124,6 +125,13 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		continue;
 	    }
 
+	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xe8') {
+		// Tombstone bitmap - the documents are still present in the
+		// tables until the database is compacted, so there's nothing
+		// to cross-check.
+		continue;
+	    }
+
 	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xe0') {
 		// doclen chunk
 		const char * pos, * end;
@@ -595,13 +603,27 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 	    }
 	}
     } else if (strcmp(tablename, "docdata") == 0) {
+	glass_tablesize_t num_entries = table->get_entry_count();
+	string dict_key = GlassDocDataTable::dictionary_key();
+	if (version_file.get_root(Glass::DOCDATA).get_dictionary()) {
+	    // The compression dictionary is stored under a reserved key.
+	    string dict;
+	    if (!table->get_exact_entry(dict_key, dict) || dict.empty()) {
+		if (out)
+		    *out << "Compression dictionary missing" << endl;
+		return errors + 1;
+	    }
+	    table->set_dictionary(dict);
+	    --num_entries;
+	}
+
 	// glass doesn't store a docdata entry if the document data is empty,
 	// so we can only check there aren't more docdata entries than
 	// documents.
 	Xapian::doccount doccount = version_file.get_doccount();
-	if (table->get_entry_count() > doccount) {
+	if (num_entries > doccount) {
 	    if (out)
-		*out << "More document data (" << table->get_entry_count()
+		*out << "More document data (" << num_entries
 		     << ") then documents (" << doccount << ")" << endl;
 	    ++errors;
 	}
@@ -610,6 +632,8 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 	for ( ; !cursor->after_end(); cursor->next()) {
 	    string & key = cursor->current_key;
 
+	    if (key == dict_key && table->has_dictionary()) continue;
+
 	    // Get docid from key.
 	    const char * pos = key.data();
 	    const char * end = pos + key.size();
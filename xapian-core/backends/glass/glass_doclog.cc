@@ -0,0 +1,318 @@
+/** @file glass_doclog.cc
+ * @brief Log of uncommitted document changes
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "glass_doclog.h"
+
+#include "fd.h"
+#include "io_utils.h"
+#include "pack.h"
+#include "parseint.h"
+#include "posixy_wrapper.h"
+#include "realtime.h"
+#include "stringutils.h"
+#include "xapian/constants.h"
+#include "xapian/document.h"
+#include "xapian/error.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <zlib.h>
+
+using namespace std;
+
+#define DOCLOG_MAGIC_STRING "xapian-glass-doclog 1\n"
+
+/// Record type for replacing (or adding) a document.
+#define DOCLOG_REPLACE 'R'
+
+/// Record type for deleting a document.
+#define DOCLOG_DELETE 'D'
+
+/// Record type for a transaction, which contains the records made during it.
+#define DOCLOG_TRANSACTION 'T'
+
+/// Default interval between syncing the log (in milliseconds).
+#define DOCLOG_SYNC_INTERVAL_DEFAULT 100
+
+/// Add the length and checksum to a record.
+static string
+frame_record(const string & record)
+{
+    string buf;
+    pack_uint(buf, record.size());
+    buf += record;
+    pack_uint(buf, uint4(crc32(0, reinterpret_cast<const Bytef*>(record.data()),
+			       uInt(record.size()))));
+    return buf;
+}
+
+/** Replay records.
+ *
+ *  @return false if an incomplete or corrupt record was found.
+ */
+static bool
+replay_records(const char * p, const char * end, bool & replayed,
+	       const function<void(Xapian::docid, const string *)> & apply)
+{
+    string doc;
+    while (p != end) {
+	size_t len;
+	uint4 crc;
+	if (!unpack_uint(&p, end, &len) || size_t(end - p) < len)
+	    return false;
+	const char * record = p;
+	p += len;
+	if (!unpack_uint(&p, end, &crc)) return false;
+	if (crc != uint4(crc32(0, reinterpret_cast<const Bytef*>(record),
+			       uInt(len)))) {
+	    return false;
+	}
+
+	const char * record_end = record + len;
+	if (record == record_end) return false;
+	char type = *record++;
+	if (type == DOCLOG_TRANSACTION) {
+	    if (!replay_records(record, record_end, replayed, apply))
+		return false;
+	    continue;
+	}
+	Xapian::docid did;
+	if (!unpack_uint(&record, record_end, &did)) return false;
+	if (type == DOCLOG_REPLACE) {
+	    doc.assign(record, record_end - record);
+	    apply(did, &doc);
+	} else if (type == DOCLOG_DELETE) {
+	    apply(did, NULL);
+	} else {
+	    return false;
+	}
+	replayed = true;
+    }
+    return true;
+}
+
+GlassDocLog::~GlassDocLog()
+{
+    if (fd >= 0) {
+	try {
+	    sync();
+	} catch (...) {
+	}
+	::close(fd);
+    }
+}
+
+double
+GlassDocLog::get_sync_interval()
+{
+    unsigned msecs = DOCLOG_SYNC_INTERVAL_DEFAULT;
+    const char *p = getenv("XAPIAN_DOCLOG_SYNC_INTERVAL");
+    if (p && *p) {
+	if (!parse_unsigned(p, msecs)) {
+	    throw Xapian::InvalidArgumentError("XAPIAN_DOCLOG_SYNC_INTERVAL "
+					       "must be a non-negative "
+					       "integer");
+	}
+    }
+    return msecs * 1e-3;
+}
+
+bool
+GlassDocLog::replay(const string & uuid, glass_revision_number_t rev,
+		    const function<void(Xapian::docid, const string *)> & apply)
+{
+    string log;
+    {
+	FD log_fd(posixy_open(path.c_str(), O_RDONLY | O_CLOEXEC));
+	if (log_fd < 0) {
+	    if (errno == ENOENT) return false;
+	    string message = "Couldn't open document log ";
+	    message += path;
+	    throw Xapian::DatabaseOpeningError(message, errno);
+	}
+	char buf[65536];
+	size_t n;
+	while ((n = io_read(log_fd, buf, sizeof(buf))) != 0) {
+	    log.append(buf, n);
+	}
+    }
+
+    const char * p = log.data();
+    const char * end = p + log.size();
+    const size_t magic_len = CONST_STRLEN(DOCLOG_MAGIC_STRING);
+    if (log.size() < magic_len ||
+	memcmp(p, DOCLOG_MAGIC_STRING, magic_len) != 0) {
+	// The writer died before the header was written.
+	return false;
+    }
+    p += magic_len;
+
+    string log_uuid;
+    glass_revision_number_t log_rev;
+    if (!unpack_string(&p, end, log_uuid) ||
+	!unpack_uint(&p, end, &log_rev)) {
+	return false;
+    }
+    if (log_uuid != uuid || log_rev != rev) {
+	// The logged changes have already been committed (or the database
+	// has been replaced since).
+	return false;
+    }
+
+    // If the writer died while writing a record, the rest of the log is
+    // ignored.
+    bool replayed = false;
+    (void)replay_records(p, end, replayed, apply);
+    return replayed;
+}
+
+void
+GlassDocLog::start(const string & uuid, glass_revision_number_t rev,
+		   int flags_)
+{
+    flags = flags_;
+    sync_interval = get_sync_interval();
+
+    string header(DOCLOG_MAGIC_STRING, CONST_STRLEN(DOCLOG_MAGIC_STRING));
+    pack_string(header, uuid);
+    pack_uint(header, rev);
+
+    string tmp_path = path;
+    tmp_path += ".tmp";
+    int new_fd = posixy_open(tmp_path.c_str(),
+			     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (new_fd < 0) {
+	string message = "Couldn't create document log ";
+	message += tmp_path;
+	throw Xapian::DatabaseError(message, errno);
+    }
+    try {
+	io_write(new_fd, header.data(), header.size());
+	if (!(flags & Xapian::DB_NO_SYNC) && !io_sync(new_fd)) {
+	    throw Xapian::DatabaseError("Couldn't sync document log", errno);
+	}
+    } catch (...) {
+	::close(new_fd);
+	io_unlink(tmp_path);
+	throw;
+    }
+    if (!io_tmp_rename(tmp_path, path)) {
+	int saved_errno = errno;
+	::close(new_fd);
+	string message = "Couldn't rename ";
+	message += tmp_path;
+	message += " to ";
+	message += path;
+	throw Xapian::DatabaseError(message, saved_errno);
+    }
+
+    if (fd >= 0) ::close(fd);
+    fd = new_fd;
+    dirty = false;
+    last_sync = RealTime::now();
+    sync_pending = false;
+    transaction_records.resize(0);
+}
+
+void
+GlassDocLog::remove()
+{
+    if (fd >= 0) {
+	::close(fd);
+	fd = -1;
+    }
+    if (unlink(path.c_str()) < 0 && errno != ENOENT) {
+	string message = "Couldn't remove document log ";
+	message += path;
+	throw Xapian::DatabaseError(message, errno);
+    }
+}
+
+void
+GlassDocLog::write_record(const string & record)
+{
+    string buf = frame_record(record);
+    if (in_transaction) {
+	transaction_records += buf;
+	return;
+    }
+
+    // Write the record straight away so it survives the process dying, but
+    // only sync every sync_interval seconds so that a burst of changes
+    // shares the cost of syncing.
+    io_write(fd, buf.data(), buf.size());
+    dirty = true;
+    if (flags & Xapian::DB_NO_SYNC) return;
+    sync_pending = true;
+    if (RealTime::now() - last_sync >= sync_interval) sync();
+}
+
+void
+GlassDocLog::sync()
+{
+    if (!sync_pending || fd < 0) return;
+    if (!io_sync(fd))
+	throw Xapian::DatabaseError("Couldn't sync document log", errno);
+    last_sync = RealTime::now();
+    sync_pending = false;
+}
+
+void
+GlassDocLog::log_replace(Xapian::docid did, const Xapian::Document & doc)
+{
+    if (fd < 0) return;
+    string record(1, DOCLOG_REPLACE);
+    pack_uint(record, did);
+    record += doc.serialise();
+    write_record(record);
+}
+
+void
+GlassDocLog::log_delete(Xapian::docid did)
+{
+    if (fd < 0) return;
+    string record(1, DOCLOG_DELETE);
+    pack_uint(record, did);
+    write_record(record);
+}
+
+void
+GlassDocLog::end_transaction(bool do_commit)
+{
+    in_transaction = false;
+    if (do_commit && fd >= 0 && !transaction_records.empty()) {
+	// Wrap the transaction's records in a single record so it's replayed
+	// all or nothing.
+	string record(1, DOCLOG_TRANSACTION);
+	record += transaction_records;
+	string buf = frame_record(record);
+	io_write(fd, buf.data(), buf.size());
+	dirty = true;
+	if (!(flags & Xapian::DB_NO_SYNC)) {
+	    sync_pending = true;
+	    sync();
+	}
+    }
+    transaction_records.resize(0);
+}
@@ -0,0 +1,161 @@
+/** @file glass_doclog.h
+ * @brief Log of uncommitted document changes
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_DOCLOG_H
+#define XAPIAN_INCLUDED_GLASS_DOCLOG_H
+
+#include "glass_defs.h"
+#include "xapian/types.h"
+
+#include <functional>
+#include <string>
+
+namespace Xapian {
+    class Document;
+}
+
+/** Log of document changes made since the last commit.
+ *
+ *  Each document added, replaced or deleted is appended to the log as it
+ *  happens, so if the writer dies before committing, the changes can be
+ *  replayed when the database is next opened for writing.  The log is
+ *  started afresh after each commit.
+ *
+ *  The log is synced when a record is written at least sync_interval seconds
+ *  after the last sync.  There's no timer, so records written since then
+ *  stay unsynced until the next change, transaction, commit or close.
+ */
+class GlassDocLog {
+    /// Path of the log file.
+    std::string path;
+
+    /// File descriptor of the log (or -1 if we aren't logging).
+    int fd = -1;
+
+    /// DB_* flags the database was opened with.
+    int flags = 0;
+
+    /// Have any records been written since the log was started?
+    bool dirty = false;
+
+    /// Are we in a transaction?
+    bool in_transaction = false;
+
+    /// Records written during the current transaction.
+    std::string transaction_records;
+
+    /// Seconds to wait between syncing the log.
+    double sync_interval = 0.0;
+
+    /// When we last synced the log.
+    double last_sync = 0.0;
+
+    /// Have records been written since we last synced the log?
+    bool sync_pending = false;
+
+    /// Append a record to the log.
+    void write_record(const std::string & record);
+
+  public:
+    explicit GlassDocLog(const std::string & db_dir)
+	: path(db_dir + "/doclog") { }
+
+    ~GlassDocLog();
+
+    /** How long to wait between syncing the log.
+     *
+     *  This is read from the XAPIAN_DOCLOG_SYNC_INTERVAL environment variable
+     *  (in milliseconds).
+     */
+    static double get_sync_interval();
+
+    /** Replay the changes in an existing log.
+     *
+     *  The log is only replayed if it was started after committing revision
+     *  @a rev of the database with UUID @a uuid.  Replay stops at the first
+     *  incomplete or corrupt record, since the writer may have died while
+     *  writing it.
+     *
+     *  @param uuid	The UUID of the database.
+     *  @param rev	The revision the database is at.
+     *  @param apply	Function to apply each change.  It's passed the
+     *			document ID and a pointer to the serialised document
+     *			to store there, or NULL to delete the document.
+     *
+     *  @return true if any changes were replayed.
+     */
+    bool replay(const std::string & uuid, glass_revision_number_t rev,
+		const std::function<void(Xapian::docid,
+					 const std::string *)> & apply);
+
+    /** Start a new, empty log.
+     *
+     *  Any existing log is atomically replaced.
+     *
+     *  @param uuid	The UUID of the database.
+     *  @param rev	The revision which has just been committed.
+     *  @param flags_	DB_* flags the database was opened with.
+     */
+    void start(const std::string & uuid, glass_revision_number_t rev,
+	       int flags_);
+
+    /** Start a new, empty log with the same flags as before.
+     *
+     *  @param uuid	The UUID of the database.
+     *  @param rev	The revision which has just been committed.
+     */
+    void restart(const std::string & uuid, glass_revision_number_t rev) {
+	start(uuid, rev, flags);
+    }
+
+    /// Remove the log file, if there is one.
+    void remove();
+
+    /// Are we logging changes?
+    bool is_open() const { return fd >= 0; }
+
+    /// Have any changes been logged since the log was started?
+    bool is_dirty() const { return dirty; }
+
+    /// Log that document @a did is being set to @a doc.
+    void log_replace(Xapian::docid did, const Xapian::Document & doc);
+
+    /// Log that document @a did is being deleted.
+    void log_delete(Xapian::docid did);
+
+    /// Sync any records which haven't been synced yet.
+    void sync();
+
+    /// Hold back records until the transaction is committed.
+    void begin_transaction() {
+	// Records from before the transaction would otherwise stay unsynced
+	// until it ends.
+	sync();
+	in_transaction = true;
+    }
+
+    /** End a transaction.
+     *
+     *  @param do_commit	If true, write out the records from the
+     *				transaction; if false, discard them.
+     */
+    void end_transaction(bool do_commit);
+};
+
+#endif // XAPIAN_INCLUDED_GLASS_DOCLOG_H
@@ -89,6 +89,11 @@ GlassFreeList::get_block(const GlassTable *B, uint4 block_size,
 	return first_unused_block++;
     }
 
+    if (have_limit && (fl_limit.c == 0 || fl == fl_limit)) {
+	// The remaining free blocks may be in use by a leased revision.
+	return first_unused_block++;
+    }
+
     if (p == 0) {
 	if (fl.n == UNUSED) {
 	    throw Xapian::DatabaseCorruptError("Freelist pointer invalid");
@@ -259,6 +264,20 @@ GlassFreeList::commit(const GlassTable * B, uint4 block_size)
     }
 }
 
+void
+GlassFreeList::set_limit(const string & fl_serialised)
+{
+    if (fl_serialised.empty()) {
+	have_limit = false;
+	return;
+    }
+    GlassFreeList leased;
+    if (!leased.unpack(fl_serialised))
+	throw Xapian::DatabaseCorruptError("Bad freelist in revision lease");
+    fl_limit = leased.fl_end;
+    have_limit = true;
+}
+
 GlassFreeListChecker::GlassFreeListChecker(const GlassFreeList & fl)
 {
     const unsigned BITS_PER_ELT = sizeof(elt_type) * 8;
@@ -81,6 +81,17 @@ class GlassFreeList {
 
     bool flw_appending;
 
+    /** Don't reuse free blocks from this point in the freelist on.
+     *
+     *  Only used if have_limit is true.  Blocks after this point may still
+     *  be in use by a revision which a reader has leased.  If fl_limit.c is
+     *  0, there was no freelist at all in that revision, so no free blocks
+     *  can be reused.
+     */
+    GlassFLCursor fl_limit;
+
+    bool have_limit;
+
   private:
     /// Current freelist block.
     uint8_t * p;
@@ -93,6 +104,7 @@ class GlassFreeList {
 	revision = 0;
 	first_unused_block = 0;
 	flw_appending = false;
+	have_limit = false;
 	p = pw = NULL;
     }
 
@@ -123,6 +135,14 @@ class GlassFreeList {
 
     void commit(const GlassTable * B, uint4 block_size);
 
+    /** Limit which free blocks can be reused.
+     *
+     *  @param fl_serialised	The serialised freelist from a revision which
+     *				mustn't be overwritten, or an empty string
+     *				for no limit.
+     */
+    void set_limit(const std::string & fl_serialised);
+
     void pack(std::string & buf) {
 	pack_uint(buf, revision);
 	pack_uint(buf, first_unused_block);
@@ -31,7 +31,13 @@
 // 2  - compressed changesets
 // 3  - store (block_size / GLASS_MIN_BLOCKSIZE)
 // 4  - reworked for switch from base files to version file
-#define CHANGES_VERSION 4u
+// 5  - changed blocks may be compressed
+#define CHANGES_VERSION 5u
+
+// Flag set in the chunk type of a changed block which has been compressed
+// with zlib.  The block number is followed by the compressed size (packed
+// with pack_uint()) and then the compressed data.
+#define CHANGES_BLOCK_COMPRESSED 0x40
 
 // Must be big enough to ensure that the start of the changeset (up to the new
 // revision number) will fit in this much space.
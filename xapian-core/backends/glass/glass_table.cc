@@ -49,10 +49,12 @@
 #include "filetests.h"
 #include "io_utils.h"
 #include "pack.h"
+#include "ratelimit.h"
 #include "wordaccess.h"
 
-#include <algorithm>  // for std::min()
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "xapian/constants.h"
 
@@ -256,13 +258,7 @@ GlassTable::write_block(uint4 n, const uint8_t * p, bool appending) const
 	return; // FIXME
     }
 
-    string buf;
-    buf += char(v);
-    // Write the block number to the file
-    pack_uint(buf, n);
-
-    changes_obj->write_block(buf);
-    changes_obj->write_block(reinterpret_cast<const char *>(p), block_size);
+    changes_obj->write_table_block(v, n, p_char, block_size);
 }
 
 /* A note on cursors:
@@ -1284,7 +1280,7 @@ GlassTable::add(const string &key, string tag, bool already_compressed)
 	    GlassTable::throw_database_closed();
 	}
 	RootInfo root_info;
-	root_info.init(block_size, compress_min);
+	root_info.init(block_size, compress_min, comp_stream.get_type());
 	do_open_to_write(&root_info);
     }
 
@@ -1424,6 +1420,29 @@ GlassTable::del(const string &key)
     RETURN(true);
 }
 
+uint4
+GlassTable::readahead_block_for_key(const string &key) const
+{
+    form_key(key);
+
+    // Descend the B-tree as far as we can using blocks we already have in
+    // the cursor, since reading any others would require actual reads that
+    // would likely hurt performance more than help.
+    int j = level;
+    const uint8_t * p = C[j].get_p();
+    int c = find_in_branch(p, kt, C[j].c);
+    uint4 n = BItem(p, c).block_given_by();
+    while (--j > 0 && n == C[j].get_n()) {
+	p = C[j].get_p();
+	c = find_in_branch(p, kt, C[j].c);
+	n = BItem(p, c).block_given_by();
+    }
+    // Don't preread if it's already in the cursor.
+    if (n == C[j].get_n())
+	return BLK_UNUSED;
+    return n;
+}
+
 bool
 GlassTable::readahead_key(const string &key) const
 {
@@ -1446,16 +1465,9 @@ GlassTable::readahead_key(const string &key) const
     if (level == 0)
 	RETURN(false);
 
-    form_key(key);
-
-    // We'll only readahead the first level, since descending the B-tree would
-    // require actual reads that would likely hurt performance more than help.
-    const uint8_t * p = C[level].get_p();
-    int c = find_in_branch(p, kt, C[level].c);
-    uint4 n = BItem(p, c).block_given_by();
-    // Don't preread if it's the block we last preread or already in the
-    // cursor.
-    if (n != last_readahead && n != C[level - 1].get_n()) {
+    uint4 n = readahead_block_for_key(key);
+    // Don't preread if it's the block we last preread.
+    if (n != BLK_UNUSED && n != last_readahead) {
 	last_readahead = n;
 	if (!io_readahead_block(handle, block_size, n, offset))
 	    RETURN(false);
@@ -1463,6 +1475,141 @@ GlassTable::readahead_key(const string &key) const
     RETURN(true);
 }
 
+bool
+GlassTable::readahead_keys(const vector<string> &keys) const
+{
+    LOGCALL(DB, bool, "GlassTable::readahead_keys", keys.size());
+
+    // See readahead_key() for the cases when handle < 0.
+    if (handle < 0)
+	RETURN(false);
+
+    // If the table only has one level, there are no branch blocks to preread.
+    if (level == 0)
+	RETURN(false);
+
+    vector<uint4> blocks;
+    blocks.reserve(keys.size());
+    for (const string & key : keys) {
+	Assert(!key.empty());
+	uint4 n = readahead_block_for_key(key);
+	if (n != BLK_UNUSED)
+	    blocks.push_back(n);
+    }
+    if (blocks.empty())
+	RETURN(true);
+
+    // Issue the hints in block order, merging runs of adjacent blocks into a
+    // single hint, so the OS sees one batch it can schedule efficiently
+    // rather than a request per key.
+    sort(blocks.begin(), blocks.end());
+    auto i = blocks.begin();
+    while (i != blocks.end()) {
+	uint4 first = *i;
+	uint4 last = first;
+	while (++i != blocks.end() && *i <= last + 1)
+	    last = *i;
+	if (!io_readahead_blocks(handle, block_size, first, last - first + 1,
+				 offset))
+	    RETURN(false);
+    }
+    last_readahead = blocks.back();
+    RETURN(true);
+}
+
+void
+GlassTable::readahead_leaves(const Glass::Cursor * C_, unsigned count,
+			     Glass::ReadaheadMark & mark) const
+{
+    LOGCALL_VOID(DB, "GlassTable::readahead_leaves", Literal("C_") | count | Literal("mark"));
+    if (handle < 0 || level == 0 || count == 0)
+	return;
+
+    if (sequential) {
+	// The leaf blocks are in key order on disk, so the blocks to preread
+	// are simply the ones following.
+	uint4 n = C_[0].get_n();
+	uint4 first = n + 1;
+	uint4 last = min(n + count, free_list.get_first_unused_block() - 1);
+	if (mark.parent == BLK_UNUSED &&
+	    mark.first <= first && mark.last >= first) {
+	    first = mark.last + 1;
+	} else {
+	    mark.parent = BLK_UNUSED;
+	    mark.first = first;
+	    mark.last = n;
+	}
+	if (first <= last &&
+	    io_readahead_blocks(handle, block_size, first, last - first + 1,
+				offset)) {
+	    mark.last = last;
+	}
+	return;
+    }
+
+    // Otherwise we can find the following leaf blocks from the branch block
+    // above, but only as far as the end of that branch block.
+    const uint8_t * p = C_[1].get_p();
+    uint4 parent = C_[1].get_n();
+    int c = C_[1].c;
+    int last = min(c + int(count) * D2, DIR_END(p) - D2);
+    if (mark.parent == parent &&
+	mark.first <= uint4(c + D2) && mark.last > uint4(c)) {
+	c = int(mark.last);
+    } else {
+	mark.parent = parent;
+	mark.first = c + D2;
+	mark.last = c;
+    }
+    for (c += D2; c <= last; c += D2) {
+	if (!io_readahead_block(handle, block_size, BItem(p, c).block_given_by(),
+				offset))
+	    return;
+	mark.last = c;
+    }
+}
+
+void
+GlassTable::preload_branches(RateLimit & limit) const
+{
+    LOGCALL_VOID(DB, "GlassTable::preload_branches", Literal("limit"));
+    // See readahead_key() for the cases when handle < 0.  If level is 0 or 1
+    // then the only branch block is the root, which we've already read.  If
+    // the table has been modified, some blocks may not be on disk yet.
+    if (handle < 0 || level <= 1 || Btree_modified)
+	return;
+
+    vector<uint8_t> buf(block_size * (level - 1));
+    preload_branch_children(C[level].get_p(), level, buf.data(), limit);
+}
+
+void
+GlassTable::preload_branch_children(const uint8_t * p, int j, uint8_t * buf,
+				    RateLimit & limit) const
+{
+    if (j <= 1)
+	return;
+    for (int c = DIR_START; c < DIR_END(p); c += D2) {
+	read_block(BItem(p, c).block_given_by(), buf);
+	limit.add(block_size);
+	preload_branch_children(buf, j - 1, buf + block_size, limit);
+    }
+}
+
+bool
+GlassTable::readahead_covers(const Glass::Cursor * C_,
+			     const Glass::ReadaheadMark & mark) const
+{
+    if (level == 0)
+	return false;
+    if (sequential) {
+	uint4 n = C_[0].get_n();
+	return mark.parent == BLK_UNUSED && mark.first <= n && n <= mark.last;
+    }
+    uint4 c = C_[1].c;
+    return mark.parent == C_[1].get_n() && mark.first <= c && c <= mark.last;
+}
+
 bool
 GlassTable::get_exact_entry(const string &key, string & tag) const
 {
@@ -1586,6 +1733,7 @@ GlassTable::basic_open(const RootInfo * root_info, glass_revision_number_t rev)
     }
 
     compress_min = root_info->get_compress_min();
+    comp_stream.set_type(root_info->get_compressor());
 
     /* kt holds constructed items as well as keys */
     kt = LeafItem_wr(zeroed_new(block_size));
@@ -1789,6 +1937,7 @@ GlassTable::create_and_open(int flags_, const RootInfo & root_info)
 	close();
 	(void)io_unlink(name + GLASS_TABLE_EXTENSION);
 	compress_min = root_info.get_compress_min();
+	comp_stream.set_type(root_info.get_compressor());
     } else {
 	// FIXME: it would be good to arrange that this works such that there's
 	// always a valid table in place if you run create_and_open() on an
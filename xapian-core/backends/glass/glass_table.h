@@ -41,6 +41,7 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 
 namespace Glass {
 
@@ -405,6 +406,7 @@ const int BTREE_CURSOR_LEVELS = 10;
 using Glass::RootInfo;
 
 class GlassChanges;
+class RateLimit;
 
 /** Class managing a Btree table in a Glass database.
  *
@@ -485,6 +487,38 @@ class GlassTable {
 
     bool readahead_key(const string &key) const;
 
+    /** Preread the blocks needed to look up several keys.
+     *
+     *  The blocks are hinted in block order with adjacent blocks merged, so
+     *  this is more efficient than calling readahead_key() for each key.
+     *
+     *  @return false if readahead isn't possible for this table.
+     */
+    bool readahead_keys(const std::vector<std::string> &keys) const;
+
+    /** Read all the branch blocks of the table.
+     *
+     *  This is useful to warm up the OS cache for the table.
+     *
+     *  @param limit	Used to limit the rate we read blocks at.
+     */
+    void preload_branches(RateLimit & limit) const;
+
+    /** Preread leaf blocks following the current one in cursor C_.
+     *
+     *  Blocks already recorded in @a mark aren't preread again.
+     *
+     *  @param C_	The cursor.
+     *  @param count	How many leaf blocks to preread.
+     *  @param mark	Which blocks have already been preread (updated).
+     */
+    void readahead_leaves(const Glass::Cursor * C_, unsigned count,
+			  Glass::ReadaheadMark & mark) const;
+
+    /// Check if the current leaf block of C_ is one recorded in @a mark.
+    bool readahead_covers(const Glass::Cursor * C_,
+			  const Glass::ReadaheadMark & mark) const;
+
     /** Determine whether the btree exists on disk.
      */
     bool exists() const;
@@ -688,6 +722,27 @@ class GlassTable {
 	return (item_count == 0);
     }
 
+    /// Return the algorithm used to compress tags in this table.
+    compression_type get_compressor() const {
+	return comp_stream.get_type();
+    }
+
+    /** Set the dictionary used to compress and decompress tags.
+     *
+     *  The dictionary isn't stored by this method - that's up to the
+     *  subclass or caller.
+     *
+     *  @param dict	The dictionary (empty for none).
+     */
+    void set_dictionary(const std::string& dict) {
+	comp_stream.set_dictionary(dict);
+    }
+
+    /// Return true if tags in this table are compressed with a dictionary.
+    bool has_dictionary() const {
+	return !comp_stream.get_dictionary().empty();
+    }
+
     /** Get a cursor for reading from the table.
      *
      *  The cursor is owned by the caller - it is the caller's
@@ -728,6 +783,16 @@ class GlassTable {
 	changes_obj = changes;
     }
 
+    /** Don't reuse blocks which are in use in a leased revision.
+     *
+     *  @param fl_serialised	The serialised freelist of this table from
+     *				the oldest leased revision, or an empty string
+     *				if there's no lease.
+     */
+    void set_free_list_limit(const std::string & fl_serialised) {
+	free_list.set_limit(fl_serialised);
+    }
+
     /// Throw an exception indicating that the database is closed.
     [[noreturn]]
     static void throw_database_closed();
@@ -884,6 +949,20 @@ class GlassTable {
 			      Glass::LeafItem item, int c);
     static int find_in_branch(const uint8_t * p, Glass::BItem item, int c);
 
+    /** Find the block to preread to look up key.
+     *
+     *  Returns BLK_UNUSED if the block needed is already in the cursor.
+     */
+    uint4 readahead_block_for_key(const string &key) const;
+
+    /** Read the children of branch block @a p at level @a j which are
+     *  themselves branch blocks, recursively.
+     *
+     *  @a buf must have space for j - 1 blocks.
+     */
+    void preload_branch_children(const uint8_t * p, int j, uint8_t * buf,
+				 RateLimit & limit) const;
+
     /** block_given_by(p, c) finds the item at block address p, directory
      *  offset c, and returns its tag value as an integer.
      */
@@ -901,6 +980,11 @@ class GlassTable {
     /** Minimum size tag to try compressing (0 for no compression). */
     uint4 compress_min;
 
+    /** Stream used to compress and decompress tags.
+     *
+     *  The compression algorithm is set from the RootInfo when the table is
+     *  opened.
+     */
     mutable CompressionStream comp_stream;
 
     /// If true, don't create the table until it's needed.
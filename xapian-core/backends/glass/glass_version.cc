@@ -50,7 +50,9 @@
 using namespace std;
 
 /// Glass format version (date of change):
-#define GLASS_FORMAT_VERSION DATE_TO_VERSION(2016,03,14)
+#define GLASS_FORMAT_VERSION DATE_TO_VERSION(2026,10,18)
+// 2026,10,18 1.5.0 compressor and dictionary flag in version file (only used
+//		    if not zlib or a dictionary is present)
 // 2016,03,14 1.3.5 compress_min in version file; partly eliminate component_of
 // 2015,12,24 1.3.4 2 bytes "components_of" per item eliminated, and much more
 // 2014,11,21 1.3.2 Brass renamed to Glass
@@ -62,12 +64,18 @@ using namespace std;
 #define VERSION_TO_MONTH(V) ((unsigned(V) >> 5) & 0x0f)
 #define VERSION_TO_DAY(V) (unsigned(V) & 0x1f)
 
+/** Previous glass format version.
+ *
+ *  We still write this version if all the tables use zlib without a
+ *  dictionary so that such databases can be read by older versions of Xapian.
+ */
+#define GLASS_FORMAT_VERSION_NO_COMPRESSOR DATE_TO_VERSION(2016,03,14)
+
 #define GLASS_VERSION_MAGIC_LEN 14
 #define GLASS_VERSION_MAGIC_AND_VERSION_LEN 16
 
-static const char GLASS_VERSION_MAGIC[GLASS_VERSION_MAGIC_AND_VERSION_LEN] = {
-    '\x0f', '\x0d', 'X', 'a', 'p', 'i', 'a', 'n', ' ', 'G', 'l', 'a', 's', 's',
-    char((GLASS_FORMAT_VERSION >> 8) & 0xff), char(GLASS_FORMAT_VERSION & 0xff)
+static const char GLASS_VERSION_MAGIC[GLASS_VERSION_MAGIC_LEN] = {
+    '\x0f', '\x0d', 'X', 'a', 'p', 'i', 'a', 'n', ' ', 'G', 'l', 'a', 's', 's'
 };
 
 GlassVersion::GlassVersion(int fd_)
@@ -133,7 +141,8 @@ GlassVersion::read()
     version = static_cast<unsigned char>(buf[GLASS_VERSION_MAGIC_LEN]);
     version <<= 8;
     version |= static_cast<unsigned char>(buf[GLASS_VERSION_MAGIC_LEN + 1]);
-    if (version != GLASS_FORMAT_VERSION) {
+    if (version != GLASS_FORMAT_VERSION &&
+	version != GLASS_FORMAT_VERSION_NO_COMPRESSOR) {
 	string msg;
 	if (!single_file()) {
 	    msg = db_dir;
@@ -157,8 +166,9 @@ GlassVersion::read()
     if (!unpack_uint(&p, end, &rev))
 	throw Xapian::DatabaseCorruptError("Rev file failed to decode revision");
 
+    bool with_compressor = (version == GLASS_FORMAT_VERSION);
     for (unsigned table_no = 0; table_no < Glass::MAX_; ++table_no) {
-	if (!root[table_no].unserialise(&p, end)) {
+	if (!root[table_no].unserialise(&p, end, with_compressor)) {
 	    throw Xapian::DatabaseCorruptError("Rev file root_info missing");
 	}
 	old_root[table_no] = root[table_no];
@@ -273,13 +283,29 @@ GlassVersion::write(glass_revision_number_t new_rev, int flags)
 {
     LOGCALL(DB, const string, "GlassVersion::write", new_rev|flags);
 
-    string s(GLASS_VERSION_MAGIC, GLASS_VERSION_MAGIC_AND_VERSION_LEN);
+    // Only use the newer format if we need to, so that databases which only
+    // use zlib compression without a dictionary can still be opened by older
+    // Xapian versions.
+    bool with_compressor = false;
+    for (unsigned table_no = 0; table_no < Glass::MAX_; ++table_no) {
+	if (root[table_no].get_compressor() != COMPRESS_ZLIB ||
+	    root[table_no].get_dictionary()) {
+	    with_compressor = true;
+	    break;
+	}
+    }
+
+    string s(GLASS_VERSION_MAGIC, GLASS_VERSION_MAGIC_LEN);
+    unsigned version = with_compressor ?
+	GLASS_FORMAT_VERSION : GLASS_FORMAT_VERSION_NO_COMPRESSOR;
+    s += char((version >> 8) & 0xff);
+    s += char(version & 0xff);
     s.append(uuid.data(), uuid.BINARY_SIZE);
 
     pack_uint(s, new_rev);
 
     for (unsigned table_no = 0; table_no < Glass::MAX_; ++table_no) {
-	root[table_no].serialise(s);
+	root[table_no].serialise(s, with_compressor);
     }
 
     // Serialise database statistics.
@@ -414,19 +440,22 @@ static const uint4 compress_min_tab[] = {
 };
 
 void
-GlassVersion::create(unsigned blocksize)
+GlassVersion::create(unsigned blocksize, compression_type compressor)
 {
     AssertRel(blocksize,>=,GLASS_MIN_BLOCKSIZE);
     uuid.generate();
     for (unsigned table_no = 0; table_no < Glass::MAX_; ++table_no) {
-	root[table_no].init(blocksize, compress_min_tab[table_no]);
+	uint4 compress_min = compress_min_tab[table_no];
+	root[table_no].init(blocksize, compress_min,
+			    compress_min ? compressor : COMPRESS_ZLIB);
     }
 }
 
 namespace Glass {
 
 void
-RootInfo::init(unsigned blocksize_, uint4 compress_min_)
+RootInfo::init(unsigned blocksize_, uint4 compress_min_,
+	       compression_type compressor_)
 {
     AssertRel(blocksize_,>=,GLASS_MIN_BLOCKSIZE);
     root = 0;
@@ -436,11 +465,13 @@ RootInfo::init(unsigned blocksize_, uint4 compress_min_)
     sequential = true;
     blocksize = blocksize_;
     compress_min = compress_min_;
+    compressor = compressor_;
+    dictionary = false;
     fl_serialised.resize(0);
 }
 
 void
-RootInfo::serialise(string &s) const
+RootInfo::serialise(string &s, bool with_compressor) const
 {
     pack_uint(s, root);
     unsigned val = level << 2;
@@ -450,19 +481,31 @@ RootInfo::serialise(string &s) const
     pack_uint(s, num_entries);
     pack_uint(s, blocksize >> 11);
     pack_uint(s, compress_min);
+    if (with_compressor) {
+	pack_uint(s, unsigned(compressor) << 1 | unsigned(dictionary));
+    } else {
+	AssertEq(compressor, COMPRESS_ZLIB);
+	Assert(!dictionary);
+    }
     pack_string(s, fl_serialised);
 }
 
 bool
-RootInfo::unserialise(const char ** p, const char * end)
+RootInfo::unserialise(const char ** p, const char * end, bool with_compressor)
 {
     unsigned val;
+    unsigned compressor_code = COMPRESS_ZLIB;
     if (!unpack_uint(p, end, &root) ||
 	!unpack_uint(p, end, &val) ||
 	!unpack_uint(p, end, &num_entries) ||
 	!unpack_uint(p, end, &blocksize) ||
 	!unpack_uint(p, end, &compress_min) ||
+	(with_compressor && !unpack_uint(p, end, &compressor_code)) ||
 	!unpack_string(p, end, fl_serialised)) return false;
+    dictionary = compressor_code & 1;
+    compressor_code >>= 1;
+    if (compressor_code >= COMPRESS_MAX_) return false;
+    compressor = compression_type(compressor_code);
     level = val >> 2;
     sequential = val & 0x02;
     root_is_fake = val & 0x01;
@@ -32,6 +32,7 @@
 #include <string>
 
 #include "backends/uuids.h"
+#include "compression_stream.h"
 #include "internaltypes.h"
 #include "min_non_zero.h"
 #include "xapian/types.h"
@@ -47,14 +48,29 @@ class RootInfo {
     unsigned blocksize;
     /// Should be >= 4 or 0 for no compression.
     uint4 compress_min;
+    /// The algorithm used to compress tags.
+    compression_type compressor;
+    /// Is there a compression dictionary stored in the table?
+    bool dictionary;
     std::string fl_serialised;
 
   public:
-    void init(unsigned blocksize_, uint4 compress_min_);
+    void init(unsigned blocksize_, uint4 compress_min_,
+	      compression_type compressor_ = COMPRESS_ZLIB);
 
-    void serialise(std::string &s) const;
+    /** Serialise.
+     *
+     *  @param with_compressor	Include the compressor and dictionary flag
+     *				(not present in the original glass format).
+     */
+    void serialise(std::string &s, bool with_compressor) const;
 
-    bool unserialise(const char ** p, const char * end);
+    /** Unserialise.
+     *
+     *  @param with_compressor	Expect the compressor and dictionary flag
+     *				(not present in the original glass format).
+     */
+    bool unserialise(const char ** p, const char * end, bool with_compressor);
 
     glass_block_t get_root() const { return root; }
     int get_level() const { return int(level); }
@@ -67,6 +83,8 @@ class RootInfo {
 	return blocksize;
     }
     uint4 get_compress_min() const { return compress_min; }
+    compression_type get_compressor() const { return compressor; }
+    bool get_dictionary() const { return dictionary; }
     const std::string & get_free_list() const { return fl_serialised; }
 
     void set_level(int level_) { level = unsigned(level_); }
@@ -80,6 +98,8 @@ class RootInfo {
 	blocksize = b;
     }
     void set_free_list(const std::string & s) { fl_serialised = s; }
+    void set_compressor(compression_type c) { compressor = c; }
+    void set_dictionary(bool f) { dictionary = f; }
 };
 
 }
@@ -168,8 +188,14 @@ class GlassVersion {
 
     ~GlassVersion();
 
-    /** Create the version file. */
-    void create(unsigned blocksize);
+    /** Create the version file.
+     *
+     *  @param blocksize	Block size to use for the tables.
+     *  @param compressor	Algorithm to use for compressing tags in those
+     *				tables which compress tags.
+     */
+    void create(unsigned blocksize,
+		compression_type compressor = COMPRESS_ZLIB);
 
     void set_changes(GlassChanges * changes_) { changes = changes_; }
 
@@ -255,7 +281,12 @@ class GlassVersion {
     }
 
     void delete_document(Xapian::termcount doclen) {
-	--doccount;
+	delete_documents(1, doclen);
+    }
+
+    void delete_documents(Xapian::doccount count,
+			  Xapian::totallength doclen) {
+	doccount -= count;
 	total_doclen -= doclen;
 	// If the database no longer contains any postings, we can reset
 	// doclen_lbound, doclen_ubound and wdf_ubound.
@@ -1122,7 +1122,15 @@ template<typename T> struct MergeCursor;
 #ifdef XAPIAN_HAS_GLASS_BACKEND
 template<>
 struct MergeCursor<const GlassTable&> : public GlassCursor {
-    explicit MergeCursor(const GlassTable* in) : GlassCursor(in) {
+    /** Can tags be copied without decompressing them?
+     *
+     *  Honey always uses zlib, but a glass table may use something else.
+     */
+    bool keep_compressed;
+
+    explicit MergeCursor(const GlassTable* in)
+	: GlassCursor(in),
+	  keep_compressed(in->get_compressor() == COMPRESS_ZLIB) {
 	rewind();
     }
 };
@@ -1130,6 +1138,9 @@ struct MergeCursor<const GlassTable&> : public GlassCursor {
 
 template<>
 struct MergeCursor<const HoneyTable&> : public HoneyCursor {
+    /// Can tags be copied without decompressing them?
+    bool keep_compressed = true;
+
     explicit MergeCursor(const HoneyTable* in) : HoneyCursor(in) {
 	rewind();
     }
@@ -1259,7 +1270,7 @@ merge_spellings(HoneyTable* out,
 		    break;
 		}
 		default:
-		    compressed = cur->read_tag(true);
+		    compressed = cur->read_tag(cur->keep_compressed);
 		    break;
 	    }
 	    out->add(key, cur->current_tag, compressed);
@@ -1376,7 +1387,7 @@ merge_spellings(HoneyTable* out,
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
-	    bool compressed = cur->read_tag(true);
+	    bool compressed = cur->read_tag(cur->keep_compressed);
 	    out->add(key, cur->current_tag, compressed);
 	    if (cur->next()) {
 		pq.push(cur);
@@ -1491,7 +1502,7 @@ merge_synonyms(T* out, U b, U e)
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
-	    bool compressed = cur->read_tag(true);
+	    bool compressed = cur->read_tag(cur->keep_compressed);
 	    out->add(key, cur->current_tag, compressed);
 	    if (cur->next()) {
 		pq.push(cur);
@@ -1777,8 +1788,17 @@ merge_docid_keyed(T* out, const vector<U*>& inputs,
 	HoneyCursor cur(in);
 	cur.rewind();
 
+	// We can only copy compressed tags as-is if neither the input nor the
+	// output uses a dictionary.
+	bool keep_compressed = !in->has_dictionary() && !out->has_dictionary();
+
 	string key;
 	while (cur.next()) {
+	    if (in->has_dictionary() &&
+		cur.current_key == HoneyDocDataTable::dictionary_key()) {
+		// The output has its own dictionary, if it needs one.
+		continue;
+	    }
 	    // Adjust the key if this isn't the first database.
 	    if (off) {
 		Xapian::docid did;
@@ -1800,7 +1820,7 @@ merge_docid_keyed(T* out, const vector<U*>& inputs,
 	    } else {
 		key = cur.current_key;
 	    }
-	    bool compressed = cur.read_tag(true);
+	    bool compressed = cur.read_tag(keep_compressed);
 	    out->add(key, cur.current_tag, compressed);
 	}
     }
@@ -1822,8 +1842,19 @@ merge_docid_keyed(T* out, const vector<const GlassTable*>& inputs,
 	GlassCursor cur(in);
 	cur.rewind();
 
+	// Honey always uses zlib, so we can only copy compressed tags as-is
+	// if the glass table does too, and neither uses a dictionary.
+	bool keep_compressed = (in->get_compressor() == COMPRESS_ZLIB &&
+				!in->has_dictionary() &&
+				!out->has_dictionary());
+
 	string key;
 	while (cur.next()) {
+	    if (in->has_dictionary() &&
+		cur.current_key == GlassDocDataTable::dictionary_key()) {
+		// The output has its own dictionary, if it needs one.
+		continue;
+	    }
 next_without_next:
 	    // Adjust the key if this isn't the first database.
 	    if (off) {
@@ -1995,7 +2026,7 @@ next_without_next:
 		if (!next_result) break;
 		if (next_already_done) goto next_without_next;
 	    } else {
-		bool compressed = cur.read_tag(true);
+		bool compressed = cur.read_tag(keep_compressed);
 		out->add(key, cur.current_tag, compressed);
 	    }
 	}
@@ -2003,6 +2034,83 @@ next_without_next:
 }
 #endif
 
+/** Build a compression dictionary from a sample of the document data.
+ *
+ *  We sample documents spread evenly through the docid range of each input
+ *  (rather than just the first few) since the nature of the data may vary.
+ */
+template<typename CURSOR, typename T> static string
+train_docdata_dictionary(const vector<T*>& inputs,
+			 const vector<const Xapian::Database::Internal*>& sources)
+{
+    // Aim to sample about this many documents in total, but stop once we
+    // have this much sample data.
+    const Xapian::totallength SAMPLE_DOCS = 2000;
+    const size_t SAMPLE_BYTES = 512 * 1024;
+
+    Xapian::totallength total_docids = 0;
+    for (auto src : sources) {
+	total_docids += src->get_lastdocid();
+    }
+    if (total_docids == 0) return string();
+
+    vector<string> samples;
+    size_t sample_bytes = 0;
+    for (size_t i = 0; i != inputs.size(); ++i) {
+	auto in = inputs[i];
+	if (in->empty()) continue;
+	Xapian::docid last_docid = sources[i]->get_lastdocid();
+	Xapian::totallength n = SAMPLE_DOCS * last_docid / total_docids;
+	if (n == 0) n = 1;
+	CURSOR cur(in);
+	string prev_key;
+	for (Xapian::totallength j = 0; j != n; ++j) {
+	    Xapian::docid did = 1 + Xapian::docid(last_docid * j / n);
+	    (void)cur.find_entry_ge(HoneyDocDataTable::make_key(did));
+	    if (cur.after_end()) break;
+	    // Document data is only stored if non-empty, so we may end up on
+	    // the same entry as last time.
+	    if (cur.current_key == prev_key) continue;
+	    prev_key = cur.current_key;
+	    cur.read_tag();
+	    samples.push_back(cur.current_tag);
+	    sample_bytes += cur.current_tag.size();
+	    if (sample_bytes >= SAMPLE_BYTES) {
+		return CompressionStream::train_dictionary(COMPRESS_ZLIB,
+							   samples);
+	    }
+	}
+    }
+    return CompressionStream::train_dictionary(COMPRESS_ZLIB, samples);
+}
+
+/** Set up a compression dictionary for the output docdata table if needed.
+ *
+ *  We build one if asked to, or to keep using one if any of the inputs
+ *  already do.
+ */
+template<typename CURSOR, typename T> static void
+add_docdata_dictionary(HoneyTable* out, Honey::RootInfo* root_info,
+		       const vector<T*>& inputs,
+		       const vector<const Xapian::Database::Internal*>& sources,
+		       unsigned flags)
+{
+    if (!root_info->get_compress_min()) return;
+    bool use_dictionary = (flags & Xapian::DBCOMPACT_DOCDATA_DICTIONARY);
+    for (auto in : inputs) {
+	if (in->has_dictionary()) use_dictionary = true;
+    }
+    if (!use_dictionary) return;
+
+    string dictionary = train_docdata_dictionary<CURSOR>(inputs, sources);
+    if (dictionary.empty()) return;
+    // Store the dictionary before we start using it, so that it is
+    // compressed without reference to itself.
+    out->add(HoneyDocDataTable::dictionary_key(), dictionary);
+    out->set_dictionary(dictionary);
+    root_info->set_dictionary(true);
+}
+
 }
 
 using namespace HoneyCompact;
@@ -2076,6 +2184,20 @@ HoneyDatabase::compact(Xapian::Compactor* compactor,
 	}
     }
 
+#ifdef XAPIAN_HAS_GLASS_BACKEND
+    if (source_backend == Xapian::DB_BACKEND_GLASS) {
+	for (size_t i = 0; i != sources.size(); ++i) {
+	    auto db = static_cast<const GlassDatabase*>(sources[i]);
+	    if (!db->docid_mask.empty()) {
+		const char* m =
+		    "Can't convert a glass database with tombstoned documents "
+		    "to honey - compact it to glass first";
+		throw Xapian::InvalidOperationError(m);
+	    }
+	}
+    }
+#endif
+
     FlintLock lock(destdir ? destdir : "");
     if (!single_file) {
 	string explanation;
@@ -2304,6 +2426,11 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
 	    out->create_and_open(FLAGS, *root_info);
 	}
 
+	if (t->type == Honey::DOCDATA) {
+	    add_docdata_dictionary<GlassCursor>(out, root_info, inputs,
+						sources, flags);
+	}
+
 	switch (t->type) {
 	    case Honey::POSTLIST: {
 		if (multipass && inputs.size() > 3) {
@@ -2589,6 +2716,11 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
 	    out->create_and_open(FLAGS, *root_info);
 	}
 
+	if (t->type == Honey::DOCDATA) {
+	    add_docdata_dictionary<HoneyCursor>(out, root_info, inputs,
+						sources, flags);
+	}
+
 	switch (t->type) {
 	    case Honey::POSTLIST: {
 		if (multipass && inputs.size() > 3) {
@@ -61,6 +61,8 @@ class HoneyCursor {
 	  offset(table->get_offset())
     {
 	store.set_pos(offset); // FIXME root
+	if (table->has_dictionary())
+	    comp_stream.set_dictionary(table->get_dictionary());
     }
 
     HoneyCursor(const HoneyCursor& o)
@@ -76,6 +78,8 @@ class HoneyCursor {
 	  offset(o.offset)
     {
 	store.set_pos(o.store.get_pos());
+	if (!o.comp_stream.get_dictionary().empty())
+	    comp_stream.set_dictionary(o.comp_stream.get_dictionary());
     }
 
     /** Position cursor on the dummy empty key.
@@ -21,6 +21,7 @@
 #ifndef XAPIAN_INCLUDED_HONEY_DOCDATA_H
 #define XAPIAN_INCLUDED_HONEY_DOCDATA_H
 
+#include <xapian/error.h>
 #include <xapian/types.h>
 
 #include "honey_lazytable.h"
@@ -36,6 +37,12 @@ class HoneyDocDataTable : public HoneyLazyTable {
 	return key;
     }
 
+    /** Key under which a compression dictionary is stored.
+     *
+     *  Document id 0 is never valid, so we can use its key for this.
+     */
+    static std::string dictionary_key() { return make_key(0); }
+
     /** Create a new HoneyDocDataTable object.
      *
      *  This method does not create or open the table on disk - you
@@ -50,6 +57,24 @@ class HoneyDocDataTable : public HoneyLazyTable {
     HoneyDocDataTable(int fd, off_t offset_, bool readonly)
 	: HoneyLazyTable("docdata", fd, offset_, readonly) { }
 
+    /** Open the table, loading its compression dictionary if it has one.
+     *
+     *  The dictionary entry is itself compressed without a dictionary.
+     */
+    void open(int flags_, const Honey::RootInfo& root_info,
+	      honey_revision_number_t rev) {
+	set_dictionary(std::string());
+	HoneyLazyTable::open(flags_, root_info, rev);
+	if (root_info.get_dictionary()) {
+	    std::string dict;
+	    if (!get_exact_entry(dictionary_key(), dict)) {
+		throw Xapian::DatabaseCorruptError("Compression dictionary "
+						   "missing from docdata table");
+	    }
+	    set_dictionary(dict);
+	}
+    }
+
     /** Get the document data for document @a did.
      *
      *  If the document doesn't exist, the empty string is returned.
@@ -82,7 +82,6 @@ HoneyTable::add(const std::string& key,
 	throw_database_closed();
     if (!compressed && compress_min > 0 && val_size > compress_min) {
 	size_t compressed_size = val_size;
-	CompressionStream comp_stream; // FIXME: reuse
 	const char* p = comp_stream.compress(val, &compressed_size);
 	if (p) {
 	    add(key, p, compressed_size, true);
@@ -436,7 +435,6 @@ HoneyTable::get_exact_entry(const std::string& key, std::string* tag) const
 	if (compressed) {
 	    std::string v;
 	    read_val(v, val_size);
-	    CompressionStream comp_stream;
 	    comp_stream.decompress_start();
 	    tag->resize(0);
 	    if (!comp_stream.decompress_chunk(v.data(), v.size(), *tag)) {
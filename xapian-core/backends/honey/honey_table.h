@@ -542,6 +542,8 @@ class HoneyTable {
     bool read_only;
     int flags;
     uint4 compress_min;
+    /// Stream used to compress and decompress tags.
+    mutable CompressionStream comp_stream;
     mutable BufferedFile store;
     mutable std::string last_key;
     SSTIndex index;
@@ -675,6 +677,21 @@ class HoneyTable {
 
     honey_tablesize_t get_entry_count() const { return num_entries; }
 
+    /** Set the dictionary used to compress and decompress tags.
+     *
+     *  @param dict	The dictionary (empty for none).
+     */
+    void set_dictionary(const std::string& dict) {
+	comp_stream.set_dictionary(dict);
+    }
+
+    const std::string& get_dictionary() const {
+	return comp_stream.get_dictionary();
+    }
+
+    /// Return true if tags in this table are compressed with a dictionary.
+    bool has_dictionary() const { return !get_dictionary().empty(); }
+
     /** Return an approximation of the number of entries in the table.
      *
      *  Currently this is exact, but may not be in the future.
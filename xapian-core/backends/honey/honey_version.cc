@@ -51,8 +51,9 @@
 using namespace std;
 
 /// Honey format version (date of change):
-#define HONEY_FORMAT_VERSION DATE_TO_VERSION(2018,4,3)
-// 2018,4,3   1.5.0 outlaw mixed-wdf terms
+#define HONEY_FORMAT_VERSION DATE_TO_VERSION(2026,10,18)
+// 2026,10,18 1.5.0 docdata compression dictionary
+// 2018,4,3         outlaw mixed-wdf terms
 // 2018,3,28        don't special case first entry in SSTable
 // 2018,3,27        new key format for value stats, value chunks, doclen chunks
 // 2018,3,26        use known suffix from spelling B and T keys
@@ -494,6 +495,7 @@ RootInfo::init(uint4 compress_min_)
     root = 0;
     num_entries = 0;
     compress_min = compress_min_;
+    dictionary = false;
     fl_serialised.resize(0);
 }
 
@@ -505,7 +507,7 @@ RootInfo::serialise(string& s) const
     AssertRel(root, >=, offset);
     pack_uint(s, uoffset);
     pack_uint(s, root - uoffset);
-    pack_uint(s, 0u);
+    pack_uint(s, unsigned(dictionary));
     pack_uint(s, num_entries);
     pack_uint(s, 2048u >> 11);
     pack_uint(s, compress_min);
@@ -516,20 +518,20 @@ bool
 RootInfo::unserialise(const char** p, const char* end)
 {
     std::make_unsigned<off_t>::type uoffset, uroot;
-    unsigned dummy_val;
+    unsigned flags;
     unsigned dummy_blocksize;
     if (!unpack_uint(p, end, &uoffset) ||
 	!unpack_uint(p, end, &uroot) ||
-	!unpack_uint(p, end, &dummy_val) ||
+	!unpack_uint(p, end, &flags) ||
 	!unpack_uint(p, end, &num_entries) ||
 	!unpack_uint(p, end, &dummy_blocksize) ||
 	!unpack_uint(p, end, &compress_min) ||
 	!unpack_string(p, end, fl_serialised)) return false;
     offset = uoffset;
     root = uoffset + uroot;
+    dictionary = flags & 1;
     // Not meaningful, but still there so that existing honey databases
     // continue to work.
-    (void)dummy_val;
     (void)dummy_blocksize;
     // Map old default to new default.
     if (compress_min == 4) {
@@ -43,6 +43,8 @@ class RootInfo {
     honey_tablesize_t num_entries;
     /// Should be >= 4 or 0 for no compression.
     uint4 compress_min;
+    /// Is there a compression dictionary stored in the table?
+    bool dictionary;
     std::string fl_serialised;
 
   public:
@@ -56,12 +58,14 @@ class RootInfo {
     off_t get_root() const { return root; }
     honey_tablesize_t get_num_entries() const { return num_entries; }
     uint4 get_compress_min() const { return compress_min; }
+    bool get_dictionary() const { return dictionary; }
     const std::string& get_free_list() const { return fl_serialised; }
 
     void set_num_entries(honey_tablesize_t n) { num_entries = n; }
     void set_offset(off_t offset_) { offset = offset_; }
     void set_root(off_t root_) { root = root_; }
     void set_free_list(const std::string& s) { fl_serialised = s; }
+    void set_dictionary(bool f) { dictionary = f; }
 };
 
 }
@@ -0,0 +1,185 @@
+/** @file maskpostlist.cc
+ * @brief Wrapper postlist which skips masked documents
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "maskpostlist.h"
+
+#include "omassert.h"
+
+#include <algorithm>
+
+using namespace std;
+
+MaskPostList::MaskPostList(const string & term_, LeafPostList * pl_,
+			   const DocidMask & mask_,
+			   Xapian::doccount doccount_)
+    : LeafPostList(term_), pl(pl_), mask(mask_), doccount(doccount_)
+{
+}
+
+MaskPostList::~MaskPostList()
+{
+    delete pl;
+}
+
+void
+MaskPostList::skip_masked(double w_min)
+{
+    while (!pl->at_end() && mask.contains(pl->get_docid())) {
+	(void)pl->next(w_min);
+    }
+}
+
+Xapian::doccount
+MaskPostList::get_termfreq() const
+{
+    return min(pl->get_termfreq(), doccount);
+}
+
+Xapian::doccount
+MaskPostList::get_termfreq_min() const
+{
+    Xapian::doccount tf = pl->get_termfreq();
+    return tf > mask.size() ? tf - mask.size() : 0;
+}
+
+Xapian::docid
+MaskPostList::get_docid() const
+{
+    return pl->get_docid();
+}
+
+Xapian::termcount
+MaskPostList::get_wdf() const
+{
+    return pl->get_wdf();
+}
+
+PositionList *
+MaskPostList::read_position_list()
+{
+    return pl->read_position_list();
+}
+
+PositionList *
+MaskPostList::open_position_list() const
+{
+    return pl->open_position_list();
+}
+
+PostList *
+MaskPostList::next(double w_min)
+{
+    (void)pl->next(w_min);
+    skip_masked(w_min);
+    return NULL;
+}
+
+PostList *
+MaskPostList::skip_to(Xapian::docid did, double w_min)
+{
+    (void)pl->skip_to(did, w_min);
+    skip_masked(w_min);
+    return NULL;
+}
+
+bool
+MaskPostList::at_end() const
+{
+    return pl->at_end();
+}
+
+string
+MaskPostList::get_description() const
+{
+    string desc = "MaskPostList(";
+    desc += pl->get_description();
+    desc += ')';
+    return desc;
+}
+
+MaskValueList::~MaskValueList()
+{
+    delete vl;
+}
+
+void
+MaskValueList::skip_masked()
+{
+    while (!vl->at_end() && mask.contains(vl->get_docid())) {
+	vl->next();
+    }
+}
+
+Xapian::docid
+MaskValueList::get_docid() const
+{
+    return vl->get_docid();
+}
+
+string
+MaskValueList::get_value() const
+{
+    return vl->get_value();
+}
+
+Xapian::valueno
+MaskValueList::get_valueno() const
+{
+    return vl->get_valueno();
+}
+
+bool
+MaskValueList::at_end() const
+{
+    return vl->at_end();
+}
+
+void
+MaskValueList::next()
+{
+    vl->next();
+    skip_masked();
+}
+
+void
+MaskValueList::skip_to(Xapian::docid did)
+{
+    vl->skip_to(did);
+    skip_masked();
+}
+
+bool
+MaskValueList::check(Xapian::docid did)
+{
+    if (!vl->check(did)) return false;
+    // We're now positioned as if skip_to(did) had been called.
+    skip_masked();
+    return true;
+}
+
+string
+MaskValueList::get_description() const
+{
+    string desc = "MaskValueList(";
+    desc += vl->get_description();
+    desc += ')';
+    return desc;
+}
@@ -0,0 +1,145 @@
+/** @file maskpostlist.h
+ * @brief Wrapper postlist which skips masked documents
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_MASKPOSTLIST_H
+#define XAPIAN_INCLUDED_MASKPOSTLIST_H
+
+#include "docidmask.h"
+#include "leafpostlist.h"
+#include "valuelist.h"
+
+#include <string>
+
+/// Wrapper postlist which skips documents in a DocidMask.
+class MaskPostList : public LeafPostList {
+    /// Don't allow assignment.
+    void operator=(const MaskPostList &) = delete;
+
+    /// Don't allow copying.
+    MaskPostList(const MaskPostList &) = delete;
+
+    /// The postlist we're wrapping.
+    LeafPostList * pl;
+
+    /** The documents to skip.
+     *
+     *  This is owned by the database, which @a pl keeps alive.
+     */
+    const DocidMask & mask;
+
+    /// The number of documents in the database, excluding masked ones.
+    Xapian::doccount doccount;
+
+    /// Advance @a pl past any masked documents.
+    void skip_masked(double w_min);
+
+  public:
+    /** Constructor.
+     *
+     *  @param term_	    The term (empty for an all documents postlist).
+     *  @param pl_	    The postlist to wrap (ownership is taken).
+     *  @param mask_	    The documents to skip.
+     *  @param doccount_    The number of documents in the database, excluding
+     *			    masked ones.
+     */
+    MaskPostList(const std::string & term_, LeafPostList * pl_,
+		 const DocidMask & mask_, Xapian::doccount doccount_);
+
+    ~MaskPostList();
+
+    /** Return the term frequency.
+     *
+     *  We don't know how many masked documents the term occurs in, so this
+     *  is an upper bound.
+     */
+    Xapian::doccount get_termfreq() const;
+
+    /** Return a lower bound on the term frequency.
+     *
+     *  The term may index every masked document, so we subtract the number
+     *  of masked documents from the wrapped postlist's term frequency.
+     */
+    Xapian::doccount get_termfreq_min() const;
+
+    Xapian::docid get_docid() const;
+
+    Xapian::termcount get_wdf() const;
+
+    PositionList * read_position_list();
+
+    PositionList * open_position_list() const;
+
+    PostList * next(double w_min);
+
+    PostList * skip_to(Xapian::docid did, double w_min);
+
+    bool at_end() const;
+
+    std::string get_description() const;
+};
+
+/// Wrapper value stream which skips documents in a DocidMask.
+class MaskValueList : public ValueList {
+    /// Don't allow assignment.
+    void operator=(const MaskValueList &) = delete;
+
+    /// Don't allow copying.
+    MaskValueList(const MaskValueList &) = delete;
+
+    /// The value stream we're wrapping.
+    ValueList * vl;
+
+    /** The documents to skip.
+     *
+     *  This is owned by the database, which @a vl keeps alive.
+     */
+    const DocidMask & mask;
+
+    /// Advance @a vl past any masked documents.
+    void skip_masked();
+
+  public:
+    /** Constructor.
+     *
+     *  @param vl_	The value stream to wrap (ownership is taken).
+     *  @param mask_	The documents to skip.
+     */
+    MaskValueList(ValueList * vl_, const DocidMask & mask_)
+	: vl(vl_), mask(mask_) { }
+
+    ~MaskValueList();
+
+    Xapian::docid get_docid() const;
+
+    std::string get_value() const;
+
+    Xapian::valueno get_valueno() const;
+
+    bool at_end() const;
+
+    void next();
+
+    void skip_to(Xapian::docid did);
+
+    bool check(Xapian::docid did);
+
+    std::string get_description() const;
+};
+
+#endif // XAPIAN_INCLUDED_MASKPOSTLIST_H
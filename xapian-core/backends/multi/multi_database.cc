@@ -234,6 +234,16 @@ MultiDatabase::get_value_freq(Xapian::valueno slot) const
     return result;
 }
 
+bool
+MultiDatabase::freqs_are_exact() const
+{
+    for (auto&& shard : shards) {
+	if (!shard->freqs_are_exact())
+	    return false;
+    }
+    return true;
+}
+
 string
 MultiDatabase::get_value_lower_bound(Xapian::valueno slot) const
 {
@@ -372,6 +382,22 @@ MultiDatabase::keep_alive()
     }
 }
 
+void
+MultiDatabase::preload(Xapian::termcount top_terms, size_t max_rate) const
+{
+    for (auto&& shard : shards) {
+	shard->preload(top_terms, max_rate);
+    }
+}
+
+void
+MultiDatabase::lease_revision(unsigned duration) const
+{
+    for (auto&& shard : shards) {
+	shard->lease_revision(duration);
+    }
+}
+
 TermList*
 MultiDatabase::open_spelling_termlist(const string& word) const
 {
@@ -517,7 +543,8 @@ void
 MultiDatabase::write_changesets_to_fd(int,
 				      const std::string&,
 				      bool,
-				      Xapian::ReplicationInfo*)
+				      Xapian::ReplicationInfo*,
+				      int)
 {
     throw Xapian::InvalidOperationError("write_changesets_to_fd() with "
 					"more than one subdatabase");
@@ -93,6 +93,8 @@ class MultiDatabase : public Xapian::Database::Internal {
 
     Xapian::doccount get_value_freq(Xapian::valueno slot) const;
 
+    bool freqs_are_exact() const;
+
     std::string get_value_lower_bound(Xapian::valueno slot) const;
 
     std::string get_value_upper_bound(Xapian::valueno slot) const;
@@ -116,6 +118,10 @@ class MultiDatabase : public Xapian::Database::Internal {
 
     void keep_alive();
 
+    void preload(Xapian::termcount top_terms, size_t max_rate) const;
+
+    void lease_revision(unsigned duration) const;
+
     TermList* open_spelling_termlist(const std::string& word) const;
 
     TermList* open_spelling_wordlist() const;
@@ -137,7 +143,8 @@ class MultiDatabase : public Xapian::Database::Internal {
     void write_changesets_to_fd(int fd,
 				const std::string& start_revision,
 				bool need_whole_db,
-				Xapian::ReplicationInfo* info);
+				Xapian::ReplicationInfo* info,
+				int compression);
 
     void invalidate_doc_object(Xapian::Document::Internal* obj) const;
 
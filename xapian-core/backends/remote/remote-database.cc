@@ -24,6 +24,9 @@
 #include "remote-database.h"
 
 #include <signal.h>
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
 
 #include "api/msetinternal.h"
 #include "api/smallvector.h"
@@ -43,6 +46,7 @@
 #include "stringutils.h" // For STRINGIZE().
 #include "weight/weightinternal.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <memory>
 #include <string>
@@ -55,6 +59,30 @@
 using namespace std;
 using Xapian::Internal::intrusive_ptr;
 
+/** Maximum number of documents request_document() will have in flight.
+ *
+ *  Each request is only a few bytes, so this many always fit in the socket
+ *  buffers - otherwise we could deadlock with the server blocked sending us
+ *  replies while we're blocked sending it more requests.
+ */
+#define MAX_PENDING_DOCUMENTS 64
+
+/** Most documents read by request_document() to keep waiting to be opened.
+ *
+ *  Documents which are requested but never opened would otherwise pile up
+ *  until the next MSet arrives.
+ */
+#define MAX_PREFETCHED_DOCUMENTS 1024
+
+/// How many recent query latencies get_hedge_delay() considers.
+#define MAX_LATENCY_SAMPLES 100
+
+/// How many latencies get_hedge_delay() needs before it suggests hedging.
+#define MIN_LATENCY_SAMPLES 20
+
+/// Maximum number of queries to cache the remote statistics for.
+#define MAX_CACHED_QUERY_STATS 256
+
 /// Return true if further replies should be expected.
 static inline bool
 is_intermediate_reply(int reply_code)
@@ -121,6 +149,43 @@ RemoteDatabase::RemoteDatabase(int fd, double timeout_,
     }
 }
 
+RemoteDatabase::RemoteDatabase(int fd, int compression, double timeout_,
+			       const string& context_)
+    : Xapian::Database::Internal(TRANSACTION_READONLY),
+      link(fd, fd, context_),
+      context(context_),
+      cached_stats_valid(),
+      mru_valstats(),
+      mru_slot(Xapian::BAD_VALUENO),
+      timeout(timeout_)
+{
+    link.set_compression(compression);
+    // If the server's database is already at the latest revision then we
+    // don't get sent the stats, so ask for them explicitly.
+    if (!update_stats(MSG_REOPEN))
+	update_stats(MSG_UPDATE);
+}
+
+int
+RemoteDatabase::release_connection(int& compression)
+{
+    try {
+	while (!pending_docs.empty()) {
+	    read_pending_document();
+	}
+	double end_time = RealTime::end_time(timeout);
+	discard_pending_reply(end_time);
+	if (awaiting_getmset)
+	    abandon_query(end_time);
+    } catch (...) {
+	do_close();
+	return -1;
+    }
+    prefetched_docs.clear();
+    compression = link.get_compression();
+    return link.release();
+}
+
 Xapian::termcount
 RemoteDatabase::positionlist_count(Xapian::docid did,
 				   const std::string& term) const
@@ -149,6 +214,9 @@ RemoteDatabase::keep_alive()
     send_message(MSG_KEEPALIVE, string());
     string message;
     get_message(message, REPLY_DONE);
+    for (auto&& replica : replicas) {
+	replica->keep_alive();
+    }
 }
 
 TermList*
@@ -267,7 +335,18 @@ bool
 RemoteDatabase::reopen()
 {
     mru_slot = Xapian::BAD_VALUENO;
-    return update_stats(MSG_REOPEN);
+    hedge_winner = NULL;
+    // Keep the replicas at the same revision as us (as far as possible).
+    bool replica_changed = false;
+    for (auto&& replica : replicas) {
+	if (replica->reopen())
+	    replica_changed = true;
+    }
+    if (!update_stats(MSG_REOPEN))
+	return replica_changed;
+    prefetched_docs.clear();
+    query_stats_cache.clear();
+    return true;
 }
 
 void
@@ -299,18 +378,78 @@ RemoteDatabase::close()
 // the match, and so we can ignore the lazy flag here without affecting matcher
 // performance.
 Xapian::Document::Internal *
-RemoteDatabase::open_document(Xapian::docid did, bool /*lazy*/) const
+RemoteDatabase::open_document(Xapian::docid did, bool lazy) const
 {
     Assert(did);
 
+    if (hedge_winner) {
+	// Any documents sent with the results are in the replica which won.
+	return hedge_winner->open_document(did, lazy);
+    }
+
+    auto i = prefetched_docs.find(did);
+    if (i == prefetched_docs.end() &&
+	find(pending_docs.begin(), pending_docs.end(), did) !=
+	    pending_docs.end()) {
+	while (read_pending_document() != did) { }
+	i = prefetched_docs.find(did);
+    }
+    if (i != prefetched_docs.end()) {
+	auto doc = new RemoteDocument(this, did, std::move(i->second.data),
+				      std::move(i->second.values));
+	prefetched_docs.erase(i);
+	return doc;
+    }
+
+    // If we requested the document but the server replied with an exception,
+    // we'll ask again here, and get the exception to throw.
     string message;
     pack_uint_last(message, did);
     send_message(MSG_DOCUMENT, message);
 
     string doc_data;
-    get_message(doc_data, REPLY_DOCDATA);
-
     map<Xapian::valueno, string> values;
+    read_document(doc_data, values);
+
+    return new RemoteDocument(this, did, std::move(doc_data),
+			      std::move(values));
+}
+
+void
+RemoteDatabase::request_document(Xapian::docid did) const
+{
+    Assert(did);
+
+    if (hedge_winner) {
+	hedge_winner->request_document(did);
+	return;
+    }
+
+    if (!is_read_only() || pending_docs.size() >= MAX_PENDING_DOCUMENTS)
+	return;
+    if (prefetched_docs.find(did) != prefetched_docs.end() ||
+	find(pending_docs.begin(), pending_docs.end(), did) !=
+	    pending_docs.end())
+	return;
+
+    // Unlike send_message(), we don't wait for replies to pending documents.
+    double end_time = RealTime::end_time(timeout);
+    discard_pending_reply(end_time);
+
+    string message;
+    pack_uint_last(message, did);
+    link.send_message(static_cast<unsigned char>(MSG_DOCUMENT), message,
+		      end_time);
+    pending_docs.push_back(did);
+}
+
+void
+RemoteDatabase::read_document(string& data,
+			      map<Xapian::valueno, string>& values) const
+{
+    get_message(data, REPLY_DOCDATA);
+
+    string message;
     while (get_message_or_done(message, REPLY_VALUE)) {
 	const char * p = message.data();
 	const char * p_end = p + message.size();
@@ -320,9 +459,28 @@ RemoteDatabase::open_document(Xapian::docid did, bool /*lazy*/) const
 	}
 	values.insert(make_pair(slot, string(p, p_end)));
     }
+}
 
-    return new RemoteDocument(this, did, std::move(doc_data),
-			      std::move(values));
+Xapian::docid
+RemoteDatabase::read_pending_document() const
+{
+    Assert(!pending_docs.empty());
+    Xapian::docid did = pending_docs.front();
+    pending_docs.pop_front();
+    PrefetchedDocument doc;
+    try {
+	read_document(doc.data, doc.values);
+    } catch (const Xapian::DocNotFoundError &) {
+	// Leave it to open_document() to report this if the document is
+	// actually wanted.
+	return did;
+    }
+    if (prefetched_docs.size() >= MAX_PREFETCHED_DOCUMENTS) {
+	// Any we drop will just be fetched again if they're opened.
+	prefetched_docs.clear();
+    }
+    prefetched_docs[did] = std::move(doc);
+    return did;
 }
 
 bool
@@ -370,14 +528,32 @@ RemoteDatabase::update_stats(message_type msg_code, const string & body) const
 	throw Xapian::NetworkError(errmsg, context);
     }
 
+    unsigned compression_plus_one;
     if (!unpack_uint(&p, p_end, &doccount) ||
 	!unpack_uint(&p, p_end, &lastdocid) ||
 	!unpack_uint(&p, p_end, &doclen_lbound) ||
 	!unpack_uint(&p, p_end, &doclen_ubound) ||
 	!unpack_bool(&p, p_end, &has_positional_info) ||
-	!unpack_uint(&p, p_end, &total_length)) {
+	!unpack_uint(&p, p_end, &total_length) ||
+	!unpack_uint(&p, p_end, &compression_plus_one)) {
 	throw Xapian::NetworkError("Bad stats update message received", context);
     }
+    if (msg_code == MSG_MAX && compression_plus_one != 0) {
+	// The server has offered to compress large messages - accept if we
+	// support the algorithm it wants to use, after which both ends
+	// compress what they send.
+	unsigned type = compression_plus_one - 1;
+	if (type < 32 &&
+	    (RemoteConnection::get_supported_compression() >> type & 1)) {
+	    string m;
+	    pack_uint(m, compression_plus_one);
+	    // There's no reply to MSG_COMPRESSION, so don't use send_message()
+	    // as that would expect one.
+	    link.send_message(static_cast<unsigned char>(MSG_COMPRESSION), m,
+			      RealTime::end_time(timeout));
+	    link.set_compression(int(type));
+	}
+    }
     lastdocid += doccount;
     doclen_ubound += doclen_lbound;
     uuid.assign(p, p_end);
@@ -567,8 +743,8 @@ RemoteDatabase::get_message(string &result,
 {
     double end_time = RealTime::end_time(timeout);
     int type = link.get_message(result, end_time);
-    if (pending_reply && !is_intermediate_reply(type)) {
-	pending_reply = false;
+    if (pending_replies && !is_intermediate_reply(type)) {
+	--pending_replies;
     }
     if (type < 0)
 	throw_connection_closed_unexpectedly();
@@ -580,6 +756,8 @@ RemoteDatabase::get_message(string &result,
 	throw Xapian::NetworkError(errmsg);
     }
     if (type == REPLY_EXCEPTION) {
+	// The server gives up on a query if it fails.
+	awaiting_getmset = false;
 	unserialise_error(result, "REMOTE:", context);
     }
     if (type != required_type && type != required_type2) {
@@ -600,18 +778,57 @@ RemoteDatabase::get_message(string &result,
 void
 RemoteDatabase::send_message(message_type type, const string &message) const
 {
+    // Read the replies to any documents we've requested first.
+    while (!pending_docs.empty()) {
+	read_pending_document();
+    }
+
     double end_time = RealTime::end_time(timeout);
-    while (pending_reply) {
+    discard_pending_reply(end_time);
+    if (awaiting_getmset && type != MSG_GETMSET)
+	abandon_query(end_time);
+    query_stats_cached = false;
+    link.send_message(static_cast<unsigned char>(type), message, end_time);
+    pending_replies = 1;
+}
+
+void
+RemoteDatabase::discard_pending_reply(double end_time) const
+{
+    while (pending_replies) {
 	string dummy;
 	int reply_code = link.get_message(dummy, end_time);
 	if (reply_code < 0)
 	    throw_connection_closed_unexpectedly();
 	if (!is_intermediate_reply(reply_code)) {
-	    pending_reply = false;
+	    --pending_replies;
+	}
+	if (reply_code == REPLY_STATS) {
+	    // abandon_query() may need this.
+	    swap(stats_message, dummy);
+	    stats_unread = false;
+	} else if (reply_code == REPLY_EXCEPTION) {
+	    awaiting_getmset = false;
 	}
     }
-    link.send_message(static_cast<unsigned char>(type), message, end_time);
-    pending_reply = true;
+}
+
+void
+RemoteDatabase::abandon_query(double end_time) const
+{
+    // Ask for no results, using the server's own statistics.
+    string message;
+    pack_uint(message, 0u);
+    pack_uint(message, 0u);
+    pack_uint(message, 0u);
+    pack_uint(message, 0u);
+    pack_string_empty(message);
+    message += stats_message;
+    link.send_message(static_cast<unsigned char>(MSG_GETMSET), message,
+		      end_time);
+    awaiting_getmset = false;
+    pending_replies = 1;
+    discard_pending_reply(end_time);
 }
 
 void
@@ -639,6 +856,8 @@ RemoteDatabase::do_close()
 	// slow down searching needlessly.
 	link.shutdown();
     }
+    pending_docs.clear();
+    prefetched_docs.clear();
     link.do_close();
 }
 
@@ -692,14 +911,54 @@ RemoteDatabase::set_query(const Xapian::Query& query,
     }
 
     send_message(MSG_QUERY, message);
+    awaiting_getmset = true;
+    hedge_winner = NULL;
+    query_message = std::move(message);
+    if (is_read_only()) {
+	auto i = query_stats_cache.find(query_message);
+	if (i != query_stats_cache.end()) {
+	    stats_message = i->second;
+	    query_stats_cached = true;
+	}
+    }
 }
 
 void
 RemoteDatabase::get_remote_stats(Xapian::Weight::Internal& out) const
 {
-    string message;
-    get_message(message, REPLY_STATS);
-    unserialise_stats(message, out);
+    if (query_stats_cached) {
+	// We'll read the server's reply after sending MSG_GETMSET.
+	query_stats_cached = false;
+	stats_unread = true;
+    } else {
+	get_message(stats_message, REPLY_STATS);
+	cache_query_stats();
+    }
+    unserialise_stats(stats_message, out);
+}
+
+void
+RemoteDatabase::read_unread_stats() const
+{
+    if (!stats_unread) return;
+    stats_unread = false;
+    // This should match the cached version, but if not we want to cache the
+    // server's current stats.
+    get_message(stats_message, REPLY_STATS);
+    cache_query_stats();
+}
+
+void
+RemoteDatabase::cache_query_stats() const
+{
+    if (!is_read_only()) return;
+    if (query_stats_cache.size() >= MAX_CACHED_QUERY_STATS) {
+	// Simpler than tracking which entries were least recently used, and
+	// a workload with more distinct queries than this is unlikely to
+	// repeat them much anyway.
+	query_stats_cache.clear();
+    }
+    query_stats_cache[query_message] = stats_message;
 }
 
 void
@@ -707,12 +966,21 @@ RemoteDatabase::send_global_stats(Xapian::doccount first,
 				  Xapian::doccount maxitems,
 				  Xapian::doccount check_at_least,
 				  const Xapian::KeyMaker* sorter,
-				  const Xapian::Weight::Internal &stats) const
+				  const Xapian::Weight::Internal &stats,
+				  Xapian::doccount prefetch) const
 {
+    // Discard documents prefetched for an earlier MSet which haven't been
+    // used - otherwise they could accumulate indefinitely.
+    prefetched_docs.clear();
+    // Documents in a writable database could change before they're used.
+    if (!is_read_only())
+	prefetch = 0;
+
     string message;
     pack_uint(message, first);
     pack_uint(message, maxitems);
     pack_uint(message, check_at_least);
+    pack_uint(message, prefetch);
     if (!sorter) {
 	pack_string_empty(message);
     } else {
@@ -724,12 +992,23 @@ RemoteDatabase::send_global_stats(Xapian::doccount first,
 	pack_string(message, sorter->serialise());
     }
     message += serialise_stats(stats);
-    send_message(MSG_GETMSET, message);
+    if (stats_unread) {
+	// Don't wait for REPLY_STATS - get_mset() will read it.
+	link.send_message(static_cast<unsigned char>(MSG_GETMSET), message,
+			  RealTime::end_time(timeout));
+	++pending_replies;
+    } else {
+	send_message(MSG_GETMSET, message);
+    }
+    awaiting_getmset = false;
+    if (!replicas.empty())
+	getmset_message = std::move(message);
 }
 
 Xapian::MSet
 RemoteDatabase::get_mset(const vector<opt_ptr_spy>& matchspies) const
 {
+    read_unread_stats();
     string message;
     get_message(message, REPLY_RESULTS);
     const char * p = message.data();
@@ -742,11 +1021,130 @@ RemoteDatabase::get_mset(const vector<opt_ptr_spy>& matchspies) const
 	}
 	i->merge_results(spyresults);
     }
+
+    // Sending the query may have read replies to earlier document requests,
+    // which are no use now we have a new MSet.
+    prefetched_docs.clear();
+    Xapian::doccount n_docs;
+    if (!unpack_uint(&p, p_end, &n_docs)) {
+	unpack_throw_serialisation_error(p);
+    }
+    while (n_docs--) {
+	Xapian::docid did;
+	Xapian::valueno n_values;
+	PrefetchedDocument doc;
+	if (!unpack_uint(&p, p_end, &did) ||
+	    !unpack_string(&p, p_end, doc.data) ||
+	    !unpack_uint(&p, p_end, &n_values)) {
+	    unpack_throw_serialisation_error(p);
+	}
+	while (n_values--) {
+	    Xapian::valueno slot;
+	    string value;
+	    if (!unpack_uint(&p, p_end, &slot) ||
+		!unpack_string(&p, p_end, value)) {
+		unpack_throw_serialisation_error(p);
+	    }
+	    doc.values.insert(make_pair(slot, std::move(value)));
+	}
+	prefetched_docs[did] = std::move(doc);
+    }
+
     Xapian::MSet mset;
     mset.internal->unserialise(p, p_end);
     return mset;
 }
 
+void
+RemoteDatabase::add_replica(RemoteDatabase* replica)
+{
+    if (!is_read_only() || !replica->is_read_only()) {
+	throw Xapian::InvalidArgumentError("Hedging is only supported for "
+					   "read-only remote databases");
+    }
+    if (replica == this) {
+	throw Xapian::InvalidArgumentError("A remote database can't be a "
+					   "replica of itself");
+    }
+    if (replica->has_replicas()) {
+	// Otherwise we could create a cycle of references.
+	throw Xapian::InvalidArgumentError("A replica can't have replicas");
+    }
+    replicas.emplace_back(replica);
+}
+
+const RemoteDatabase*
+RemoteDatabase::send_hedge() const
+{
+    Assert(!replicas.empty());
+    const RemoteDatabase* replica = NULL;
+    for (size_t n = replicas.size(); n; --n) {
+	const RemoteDatabase* candidate = replicas[next_replica].get();
+	if (++next_replica == replicas.size()) next_replica = 0;
+	// A replica which lost the race for the previous query may still be
+	// working on it.
+	if (!candidate->is_busy()) {
+	    replica = candidate;
+	    break;
+	}
+    }
+    if (!replica)
+	return NULL;
+
+    replica->send_message(MSG_QUERY, query_message);
+    replica->query_message = query_message;
+    // We don't wait for REPLY_STATS - the stats from this database have
+    // already been combined and the replica should give the same ones.
+    replica->prefetched_docs.clear();
+    replica->link.send_message(static_cast<unsigned char>(MSG_GETMSET),
+			       getmset_message,
+			       RealTime::end_time(replica->timeout));
+    ++replica->pending_replies;
+    return replica;
+}
+
+void
+RemoteDatabase::record_latency(double latency) const
+{
+    if (latencies.size() < MAX_LATENCY_SAMPLES) {
+	latencies.push_back(latency);
+	return;
+    }
+    latencies[next_latency] = latency;
+    if (++next_latency == MAX_LATENCY_SAMPLES) next_latency = 0;
+}
+
+bool
+RemoteDatabase::is_busy() const
+{
+    if (pending_replies == 0 || link.has_buffered_input())
+	return false;
+#ifdef HAVE_POLL
+    struct pollfd fds;
+    fds.fd = link.get_read_fd();
+    fds.events = POLLIN;
+    int res;
+    do {
+	res = poll(&fds, 1, 0);
+    } while (res < 0 && (errno == EINTR || errno == EAGAIN));
+    return res == 0;
+#else
+    // We can't cheaply check, so assume the reply will arrive soon.
+    return false;
+#endif
+}
+
+double
+RemoteDatabase::get_hedge_delay() const
+{
+    if (latencies.size() < MIN_LATENCY_SAMPLES)
+	return 0.0;
+    vector<double> sorted(latencies);
+    auto p95 = sorted.begin() + sorted.size() * 95 / 100;
+    nth_element(sorted.begin(), p95, sorted.end());
+    return *p95;
+}
+
 void
 RemoteDatabase::commit()
 {
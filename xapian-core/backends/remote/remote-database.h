@@ -30,6 +30,11 @@
 #include "backends/valuestats.h"
 #include "xapian/weight.h"
 
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace Xapian {
     class RSet;
 }
@@ -70,15 +75,102 @@ class RemoteDatabase : public Xapian::Database::Internal {
     /// Has positional information?
     mutable bool has_positional_info;
 
-    /** Are we currently expecting a reply?
+    /** How many replies are we currently expecting?
      *
      *  Our caller might send a message but then an exception (from another
      *  shard or locally) might cause it not to try to read the reply before
-     *  sending another message.  This flag allows us to detect that situation
+     *  sending another message.  This count allows us to detect that situation
      *  and discard the unwanted reply rather than trying to read it as the
      *  response to the new message.
+     *
+     *  This is usually 0 or 1, but a hedged query sends MSG_QUERY and
+     *  MSG_GETMSET together, and if the results are taken from elsewhere the
+     *  replies to both need discarding.
+     */
+    mutable unsigned pending_replies = 0;
+
+    /** Is the server waiting for MSG_GETMSET?
+     *
+     *  After MSG_QUERY the server won't handle any other message until it
+     *  gets MSG_GETMSET.  If the query is abandoned (e.g. because the match
+     *  is returning partial results) we have to ask for an empty MSet to
+     *  get it out of this state.
+     */
+    mutable bool awaiting_getmset = false;
+
+    /// The most recent REPLY_STATS message.
+    mutable std::string stats_message;
+
+    /** Cached REPLY_STATS messages, keyed by the MSG_QUERY message.
+     *
+     *  The server's statistics for a query can only change when its database
+     *  is reopened, so until then we can reuse them and send MSG_GETMSET
+     *  without waiting for the server's REPLY_STATS (which we still get sent,
+     *  and read later).  Only used for read-only databases.
+     *
+     *  Since the key is the whole serialised query (including the query
+     *  parameters and any RSet), this only helps when exactly the same query
+     *  is repeated - we don't cache statistics for individual terms, so a
+     *  different query using the same terms still needs two round trips.
+     */
+    mutable std::map<std::string, std::string> query_stats_cache;
+
+    /// Are the stats for the current query in stats_message from the cache?
+    mutable bool query_stats_cached = false;
+
+    /// Is the server's REPLY_STATS for the current query still to be read?
+    mutable bool stats_unread = false;
+
+    /** Documents requested by request_document() whose replies we've not yet
+     *  read.
+     *
+     *  The server handles messages in order, so we can send several
+     *  MSG_DOCUMENT messages without waiting for the replies, and then read
+     *  the replies in the same order, which saves a round trip per document.
+     */
+    mutable std::deque<Xapian::docid> pending_docs;
+
+    /// The data and values of a document we've read but not yet opened.
+    struct PrefetchedDocument {
+	std::string data;
+
+	std::map<Xapian::valueno, std::string> values;
+    };
+
+    /** Documents we've read the replies for, but not yet been asked for.
+     *
+     *  This is emptied for each new MSet, and if it gets too big.
+     */
+    mutable std::map<Xapian::docid, PrefetchedDocument> prefetched_docs;
+
+    /** Replicas of this database which queries can be hedged to.
+     *
+     *  See Xapian::Remote::add_replica().
      */
-    mutable bool pending_reply = false;
+    std::vector<Xapian::Internal::intrusive_ptr<RemoteDatabase>> replicas;
+
+    /// Index in replicas of the replica to hedge the next query to.
+    mutable size_t next_replica = 0;
+
+    /// The last MSG_QUERY message.
+    mutable std::string query_message;
+
+    /// The last MSG_GETMSET message (only kept if there are replicas).
+    mutable std::string getmset_message;
+
+    /** The replica which supplied the results for the current query.
+     *
+     *  Any documents prefetched with those results were sent by the replica,
+     *  so open_document() and request_document() are forwarded to it until
+     *  the next query is set.  NULL if we supplied the results.
+     */
+    mutable const RemoteDatabase* hedge_winner = NULL;
+
+    /// Recent times taken to get results, in seconds (a ring buffer).
+    mutable std::vector<double> latencies;
+
+    /// Index in latencies to store the next sample at once it's full.
+    mutable size_t next_latency = 0;
 
     /// The UUID of the remote database.
     mutable std::string uuid;
@@ -108,6 +200,16 @@ class RemoteDatabase : public Xapian::Database::Internal {
     bool update_stats(message_type msg_code = MSG_UPDATE,
 		      const std::string & body = std::string()) const;
 
+    /// Read the reply to MSG_DOCUMENT.
+    void read_document(std::string& data,
+		       std::map<Xapian::valueno, std::string>& values) const;
+
+    /** Read the reply for the first document in pending_docs.
+     *
+     *  @return The docid of the document.
+     */
+    Xapian::docid read_pending_document() const;
+
   protected:
     /** Constructor.  The constructor is protected so that raw instances
      *  can't be created - a derived class must be instantiated which
@@ -126,6 +228,34 @@ class RemoteDatabase : public Xapian::Database::Internal {
     RemoteDatabase(int fd, double timeout_, const std::string& context_,
 		   bool writable, int flags);
 
+    /** Constructor for reusing a read-only connection.
+     *
+     *  The connection must have come from release_connection(), so the
+     *  greeting has already been handled.  We ask the server to reopen its
+     *  database so we see the latest revision, just as we would with a new
+     *  connection.
+     *
+     *  @param fd	The file descriptor for the connection to the server.
+     *  @param compression	The compression_type which was negotiated for
+     *				the connection, or -1.
+     *  @param timeout_ The timeout used with the network operations.
+     *  @param context_ The context to return with any error messages.
+     */
+    RemoteDatabase(int fd, int compression, double timeout_,
+		   const std::string& context_);
+
+    /** Stop using the connection so it can be reused.
+     *
+     *  Any outstanding replies are read first.
+     *
+     *  @param compression	Set to the compression_type in use for the
+     *				connection, or -1.
+     *
+     *  @return The fd, or -1 if the connection isn't in a state to be
+     *		reused (in which case it has been closed).
+     */
+    int release_connection(int& compression);
+
     /// Receive a message from the server.
     reply_type get_message(std::string& message,
 			   reply_type required_type,
@@ -144,6 +274,15 @@ class RemoteDatabase : public Xapian::Database::Internal {
     /// Send a message to the server.
     void send_message(message_type type, const std::string& data) const;
 
+    /// Read and discard any reply to a message we're no longer interested in.
+    void discard_pending_reply(double end_time) const;
+
+    /// Finish a query we've abandoned by asking for an empty MSet.
+    void abandon_query(double end_time) const;
+
+    /// Cache stats_message as the stats for query_message.
+    void cache_query_stats() const;
+
     /// Close the socket
     void do_close();
 
@@ -210,19 +349,90 @@ class RemoteDatabase : public Xapian::Database::Internal {
 	return link.get_read_fd();
     }
 
-    /// Get the stats from the remote server.
+    /** Get the stats from the remote server.
+     *
+     *  If the stats for the current query are cached, this doesn't need to
+     *  wait for the server.
+     */
     void get_remote_stats(Xapian::Weight::Internal& out) const;
 
+    /// Can get_remote_stats() use cached stats for the current query?
+    bool have_cached_stats() const { return query_stats_cached; }
+
+    /** Is there a REPLY_STATS to read before the results?
+     *
+     *  This is the case if get_remote_stats() used cached stats.
+     */
+    bool have_unread_stats() const { return stats_unread; }
+
+    /// Read the REPLY_STATS which get_remote_stats() didn't wait for.
+    void read_unread_stats() const;
+
     /// Send the global stats to the remote server.
     void send_global_stats(Xapian::doccount first,
 			   Xapian::doccount maxitems,
 			   Xapian::doccount check_at_least,
 			   const Xapian::KeyMaker* sorter,
-			   const Xapian::Weight::Internal &stats) const;
+			   const Xapian::Weight::Internal &stats,
+			   Xapian::doccount prefetch) const;
 
     /// Get the MSet from the remote server.
     Xapian::MSet get_mset(const std::vector<opt_ptr_spy>& matchspies) const;
 
+    /** Add a replica which queries can be hedged to.
+     *
+     *  @param replica	A read-only remote database with the same contents
+     *			as this one.
+     */
+    void add_replica(RemoteDatabase* replica);
+
+    /// Are there any replicas which queries can be hedged to?
+    bool has_replicas() const { return !replicas.empty(); }
+
+    /** Send the current query to one of our replicas.
+     *
+     *  Must be called after send_global_stats().  The replies can then be
+     *  read by calling get_remote_stats() and get_mset() on the returned
+     *  replica.  Replicas which are still busy with an earlier query are
+     *  skipped.
+     *
+     *  @return The replica the query was sent to, or NULL if none were
+     *		available.
+     */
+    const RemoteDatabase* send_hedge() const;
+
+    /** Note that the results for the current query came from a replica.
+     *
+     *  @param replica	The replica returned by send_hedge().
+     */
+    void set_hedge_winner(const RemoteDatabase* replica) const {
+	hedge_winner = replica;
+    }
+
+    /// Record how long it took to get the results for a query, in seconds.
+    void record_latency(double latency) const;
+
+    /** Return how long to wait for results before hedging a query.
+     *
+     *  @return The 95th percentile of recent latencies recorded by
+     *		record_latency(), or 0 if there aren't enough samples yet.
+     */
+    double get_hedge_delay() const;
+
+    /** Are we still waiting for a reply to a request we've given up on?
+     *
+     *  @return true if a reply is pending and none of it has arrived yet.
+     */
+    bool is_busy() const;
+
+    /** Has the start of a reply already been read into our buffer?
+     *
+     *  If so, polling get_read_fd() won't necessarily report it as ready.
+     */
+    bool has_buffered_input() const {
+	return link.has_buffered_input();
+    }
+
     /// Get remote metadata key list.
     TermList * open_metadata_keylist(const std::string & prefix) const;
 
@@ -252,6 +462,13 @@ class RemoteDatabase : public Xapian::Database::Internal {
     /// Get a remote document.
     Xapian::Document::Internal * open_document(Xapian::docid did, bool lazy) const;
 
+    /** Request a document without waiting for the reply.
+     *
+     *  Only does anything for a read-only database, since otherwise the
+     *  document could be changed before we're asked for it.
+     */
+    void request_document(Xapian::docid did) const;
+
     /// Get the document count.
     Xapian::doccount get_doccount() const;
 
@@ -28,8 +28,17 @@
 #include <xapian/error.h>
 
 #include "net/remoteserver.h"
+#include "realtime.h"
+#include "safeunistd.h"
 
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
+#include <memory>
 
 using namespace std;
 
@@ -44,14 +53,51 @@ RemoteTcpServer::RemoteTcpServer(const vector<std::string> &dbpaths_,
 {
 }
 
+void
+RemoteTcpServer::open_databases()
+{
+    try {
+	unique_ptr<Xapian::Database> new_db(new Xapian::Database(dbpaths[0]));
+	string new_context = dbpaths[0];
+	for (size_t i = 1; i < dbpaths.size(); ++i) {
+	    new_db->add_database(Xapian::Database(dbpaths[i]));
+	    new_context += ' ';
+	    new_context += dbpaths[i];
+	}
+	db = std::move(new_db);
+	context = std::move(new_context);
+    } catch (const Xapian::Error &) {
+    }
+}
+
 void
 RemoteTcpServer::handle_one_connection(int socket)
 {
     try {
-	RemoteServer sserv(dbpaths, socket, socket,
-			   active_timeout, idle_timeout, writable);
-	sserv.set_registry(reg);
-	sserv.run();
+	unique_ptr<RemoteServer> sserv;
+#ifndef __WIN32__
+	// Under Windows, connections are handled by concurrent threads so
+	// they can't share a Database object.
+	if (!writable && !db)
+	    open_databases();
+#endif
+	if (db) {
+	    try {
+		sserv.reset(new RemoteServer(*db, context, socket, socket,
+					     active_timeout, idle_timeout,
+					     compression));
+	    } catch (...) {
+		// Open the database(s) afresh for the next connection.
+		db.reset();
+		throw;
+	    }
+	} else {
+	    sserv.reset(new RemoteServer(dbpaths, socket, socket,
+					 active_timeout, idle_timeout,
+					 writable, compression));
+	}
+	sserv->set_registry(reg);
+	sserv->run();
     } catch (const Xapian::NetworkTimeoutError &e) {
 	if (verbose)
 	    cerr << "Connection timed out: " << e.get_description() << endl;
@@ -61,3 +107,191 @@ RemoteTcpServer::handle_one_connection(int socket)
 	// ignore other exceptions
     }
 }
+
+#ifdef HAVE_POLL
+
+namespace {
+
+/// A client connection to the group commit server.
+struct GroupCommitClient {
+    /// The connected socket.
+    int fd;
+
+    /// Handles messages from the client.
+    std::unique_ptr<RemoteServer> server;
+
+    /// When the client will have been idle for too long (0 for never).
+    double idle_end;
+
+    explicit GroupCommitClient(int fd_) : fd(fd_), idle_end(0.0) { }
+
+    ~GroupCommitClient() { close(fd); }
+};
+
+}
+
+void
+RemoteTcpServer::run_group_commit(double delay, unsigned max_group,
+				  bool one_shot)
+{
+    Xapian::WritableDatabase wdb(dbpaths[0]);
+    const string& wdb_context = dbpaths[0];
+
+    vector<unique_ptr<GroupCommitClient>> clients;
+    vector<struct pollfd> fds;
+    // When the oldest waiting commit request arrived.
+    double group_start = 0.0;
+    bool accepted = false;
+    while (true) {
+	// Work out how long we can wait for something to happen.
+	double now = RealTime::now();
+	double wake = 0.0;
+	size_t waiting = 0;
+	bool ready = false;
+	fds.resize(clients.size() + 1);
+	fds[0].fd = get_listen_socket();
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	for (size_t i = 0; i != clients.size(); ++i) {
+	    auto& client = clients[i];
+	    fds[i + 1].revents = 0;
+	    if (client->server->get_commit_pending()) {
+		// Nothing to read until we reply, and we don't want to wake
+		// for POLLHUP either.
+		fds[i + 1].fd = -1;
+		++waiting;
+		continue;
+	    }
+	    fds[i + 1].fd = client->fd;
+	    fds[i + 1].events = POLLIN;
+	    if (client->server->has_buffered_input())
+		ready = true;
+	    if (client->idle_end != 0.0 &&
+		(wake == 0.0 || client->idle_end < wake)) {
+		wake = client->idle_end;
+	    }
+	}
+	if (waiting) {
+	    double commit_time = group_start + delay;
+	    if (wake == 0.0 || commit_time < wake)
+		wake = commit_time;
+	}
+	int timeout = -1;
+	if (ready) {
+	    timeout = 0;
+	} else if (wake != 0.0) {
+	    timeout = int(max(wake - now, 0.0) * 1000);
+	}
+
+	int r = poll(fds.data(), fds.size(), timeout);
+	if (r < 0 && errno != EINTR) {
+	    throw Xapian::NetworkError("poll failed", errno);
+	}
+
+	now = RealTime::now();
+	for (size_t i = 0; i != clients.size(); ++i) {
+	    auto& client = clients[i];
+	    if (client->server->get_commit_pending()) continue;
+	    if (r <= 0 || fds[i + 1].revents == 0) {
+		if (!client->server->has_buffered_input()) {
+		    if (client->idle_end != 0.0 && now >= client->idle_end) {
+			if (verbose) cerr << "Connection timed out" << endl;
+			client.reset();
+		    }
+		    continue;
+		}
+	    }
+	    try {
+		if (!client->server->process_message(active_timeout)) {
+		    if (verbose) cout << "Connection closed." << endl;
+		    client.reset();
+		    continue;
+		}
+	    } catch (const Xapian::Error& e) {
+		cerr << "Got exception " << e.get_description() << endl;
+		client.reset();
+		continue;
+	    } catch (...) {
+		client.reset();
+		continue;
+	    }
+	    client->idle_end = RealTime::end_time(idle_timeout);
+	    if (client->server->get_commit_pending()) {
+		if (waiting++ == 0)
+		    group_start = now;
+	    }
+	}
+	clients.erase(remove(clients.begin(), clients.end(), nullptr),
+		      clients.end());
+
+	if (r > 0 && fds[0].revents) {
+	    try {
+		unique_ptr<GroupCommitClient> client(
+		    new GroupCommitClient(TcpServer::accept_connection()));
+		client->server.reset(new RemoteServer(wdb, wdb_context,
+						      client->fd, client->fd,
+						      active_timeout,
+						      idle_timeout,
+						      compression));
+		client->server->set_registry(reg);
+		client->idle_end = RealTime::end_time(idle_timeout);
+		clients.push_back(std::move(client));
+		accepted = true;
+	    } catch (const Xapian::Error& e) {
+		cerr << "Got exception " << e.get_description() << endl;
+	    }
+	}
+
+	if (one_shot && accepted && clients.empty()) return;
+
+	if (waiting == 0) continue;
+	// Clients which haven't asked for write access won't be committing.
+	size_t writers = 0;
+	for (auto&& client : clients) {
+	    if (client->server->has_write_access()) ++writers;
+	}
+	if (waiting < writers &&
+	    (max_group == 0 || waiting < max_group) &&
+	    RealTime::now() < group_start + delay) {
+	    continue;
+	}
+
+	// Commit everyone's changes together, then tell all the waiting
+	// clients how it went.
+	unique_ptr<Xapian::Error> error;
+	try {
+	    wdb.commit();
+	} catch (const Xapian::Error& e) {
+	    error.reset(new Xapian::Error(e));
+	}
+	for (auto&& client : clients) {
+	    if (!client->server->get_commit_pending()) continue;
+	    try {
+		if (error) {
+		    client->server->commit_failed(*error);
+		} else {
+		    client->server->commit_done();
+		}
+		client->idle_end = RealTime::end_time(idle_timeout);
+	    } catch (const Xapian::Error&) {
+		client.reset();
+	    }
+	}
+	clients.erase(remove(clients.begin(), clients.end(), nullptr),
+		      clients.end());
+    }
+}
+
+#else
+
+void
+RemoteTcpServer::run_group_commit(double, unsigned, bool one_shot)
+{
+    if (one_shot) {
+	run_once();
+    } else {
+	run();
+    }
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include <xapian/database.h>
 #include <xapian/registry.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -58,6 +59,26 @@ class RemoteTcpServer : public TcpServer {
     /** Registry used for (un)serialisation. */
     Xapian::Registry reg;
 
+    /** Compression algorithm to offer clients (-1 for none). */
+    int compression = -1;
+
+    /** The database(s) kept open for reuse by later connections.
+     *
+     *  This is only used when not writable, and is opened on the first
+     *  connection in each process.
+     */
+    std::unique_ptr<Xapian::Database> db;
+
+    /** Description of the databases for error messages. */
+    std::string context;
+
+    /** Try to open the database(s) to reuse for later connections.
+     *
+     *  If this fails, db is left as NULL and we'll fall back to opening them
+     *  for each connection, which will report the error to the client.
+     */
+    void open_databases();
+
     /** Accept a connection and return the filedescriptor for it. */
     int accept_connection();
 
@@ -84,11 +105,46 @@ class RemoteTcpServer : public TcpServer {
     /// Set the registry used for (un)serialisation.
     void set_registry(const Xapian::Registry & reg_) { reg = reg_; }
 
+    /** Set the compression algorithm to offer clients.
+     *
+     *  @param type	A compression_type value, or -1 for none.
+     */
+    void set_compression(int type) { compression = type; }
+
     /** Handle a single connection on an already connected socket.
      *
      *  This method may be called by multiple threads.
      */
     void handle_one_connection(int socket);
+
+    /** Serve all connections from one process, grouping their commits.
+     *
+     *  The writable database is opened once and shared by every connection.
+     *  A client's commit isn't acknowledged straight away - instead the
+     *  changes are committed when @a delay seconds have passed since the
+     *  first client in the group asked to commit, when @a max_group clients
+     *  are waiting, or when every client with write access is waiting,
+     *  whichever is sooner.  Then all the waiting clients are acknowledged
+     *  together, so many small writers share the cost of each commit.
+     *
+     *  Clients can't cancel changes in this mode since the uncommitted
+     *  changes may include those from other clients.  Clients which don't
+     *  ask for write access only see committed changes, as usual.
+     *
+     *  Messages are handled one at a time, so while a client is sending a
+     *  message (for up to the active timeout) or a query is being run, the
+     *  other clients have to wait, even if a commit is due.
+     *
+     *  Requires poll() - otherwise this just calls run().
+     *
+     *  @param delay	Longest to wait before committing (in seconds).
+     *  @param max_group	Commit once this many clients are waiting (0 for
+     *			no limit).
+     *  @param one_shot	Return once all the clients have disconnected
+     *			(default: keep going).
+     */
+    void run_group_commit(double delay, unsigned max_group,
+			  bool one_shot = false);
 };
 
 #endif // XAPIAN_INCLUDED_REMOTETCPSERVER_H
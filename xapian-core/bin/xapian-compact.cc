@@ -40,6 +40,7 @@ using namespace std;
 #define OPT_HELP 1
 #define OPT_VERSION 2
 #define OPT_NO_RENUMBER 3
+#define OPT_DOCDATA_DICTIONARY 4
 
 static void show_usage() {
     cout << "Usage: " PROG_NAME " [OPTIONS] SOURCE_DATABASE... DESTINATION_DATABASE\n\n"
@@ -62,6 +63,10 @@ static void show_usage() {
 "                     option is only supported when merging databases if they\n"
 "                     have disjoint ranges of used document ids\n"
 "  -s, --single-file  Produce a single file database\n"
+"      --docdata-dictionary\n"
+"                     Compress document data using a dictionary built from a\n"
+"                     sample of the input document data (useful if document\n"
+"                     data is short but has a lot in common, e.g. JSON)\n"
 "  --help             display this help and exit\n"
 "  --version          output version information and exit" << endl;
 }
@@ -120,6 +125,7 @@ main(int argc, char **argv)
 	{"backend",	required_argument, 0, 'B'},
 	{"no-renumber", no_argument, 0, OPT_NO_RENUMBER},
 	{"single-file", no_argument, 0, 's'},
+	{"docdata-dictionary", no_argument, 0, OPT_DOCDATA_DICTIONARY},
 	{"quiet",	no_argument, 0, 'q'},
 	{"help",	no_argument, 0, OPT_HELP},
 	{"version",	no_argument, 0, OPT_VERSION},
@@ -183,6 +189,9 @@ main(int argc, char **argv)
 	    case 's':
 		flags |= Xapian::DBCOMPACT_SINGLE_FILE;
 		break;
+	    case OPT_DOCDATA_DICTIONARY:
+		flags |= Xapian::DBCOMPACT_DOCDATA_DICTIONARY;
+		break;
 	    case 'q':
 		compactor.set_quiet(true);
 		break;
@@ -24,6 +24,7 @@
 
 #include "gnu_getopt.h"
 #include "parseint.h"
+#include "xapian/error.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -36,11 +37,13 @@ using namespace std;
 
 #define OPT_HELP 1
 #define OPT_VERSION 2
+#define OPT_COMPRESSION 3
 
 static const char * opts = "t:w";
 static const struct option long_opts[] = {
     {"timeout",		required_argument,	0, 't'},
     {"writable",	no_argument,		0, 'w'},
+    {"compression",	required_argument,	0, OPT_COMPRESSION},
     {"help",		no_argument,		0, OPT_HELP},
     {"version",		no_argument,		0, OPT_VERSION},
     {NULL, 0, 0, 0}
@@ -51,6 +54,8 @@ static void show_usage() {
 "Options:\n"
 "  --timeout MSECS         set timeout\n"
 "  --writable              allow updates (only one database directory allowed)\n"
+"  --compression TYPE      compress large messages using TYPE (zlib, lz4 or zstd)\n"
+"                          if the client supports it\n"
 "  --help                  display this help and exit\n"
 "  --version               output version information and exit" << endl;
 }
@@ -59,6 +64,7 @@ int main(int argc, char **argv)
 {
     double timeout = 60.0;
     bool writable = false;
+    int compression = -1;
     bool syntax_error = false;
 
     int c;
@@ -83,6 +89,14 @@ int main(int argc, char **argv)
 	    case 'w':
 		writable = true;
 		break;
+	    case OPT_COMPRESSION:
+		try {
+		    compression = parse_compression_name(optarg);
+		} catch (const Xapian::Error& e) {
+		    cerr << "Error: " << e.get_msg() << endl;
+		    exit(1);
+		}
+		break;
 	    default:
 		syntax_error = true;
 	}
@@ -109,7 +123,8 @@ int main(int argc, char **argv)
     try {
 	// We communicate with the client via stdin (fd 0) and stdout (fd 1).
 	// Note that RemoteServer closes these fds.
-	RemoteServer server(dbnames, 0, 1, timeout, timeout, writable);
+	RemoteServer server(dbnames, 0, 1, timeout, timeout, writable,
+			    compression);
 
 	// If you have defined your own weighting scheme, register it here
 	// like so:
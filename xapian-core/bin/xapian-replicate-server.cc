@@ -21,12 +21,14 @@
 
 #include <config.h>
 
+#include "net/remoteconnection.h"
 #include "net/replicatetcpserver.h"
 
 #include <xapian.h>
 
 #include "gnu_getopt.h"
 #include "parseint.h"
+#include "stringutils.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -38,6 +40,12 @@ using namespace std;
 
 #define OPT_HELP 1
 #define OPT_VERSION 2
+#define OPT_COMPRESSION 3
+#define OPT_PUSH 4
+
+// Check for new revisions every DEFAULT_PUSH_INTERVAL milliseconds in push
+// mode unless another interval is specified.
+#define DEFAULT_PUSH_INTERVAL 1000
 
 static void show_usage() {
     cout << "Usage: " PROG_NAME " [OPTIONS] DATABASE_PARENT_DIRECTORY\n\n"
@@ -45,6 +53,11 @@ static void show_usage() {
 "  -I, --interface=ADDR  listen on interface ADDR\n"
 "  -p, --port=PORT   port to listen on\n"
 "  -o, --one-shot    serve a single connection and exit\n"
+"  --compression=TYPE  compress large messages using TYPE (zlib, lz4 or zstd)\n"
+"                    if the client supports it\n"
+"  --push[=MSECS]    push changes to replicas which subscribe (see\n"
+"                    xapian-replicate --subscribe), checking for new revisions\n"
+"                    every MSECS milliseconds (default: " STRINGIZE(DEFAULT_PUSH_INTERVAL) ")\n"
 "  --help            display this help and exit\n"
 "  --version         output version information and exit" << endl;
 }
@@ -57,6 +70,8 @@ main(int argc, char **argv)
 	{"interface",	required_argument,	0, 'I'},
 	{"port",	required_argument,	0, 'p'},
 	{"one-shot",	no_argument,		0, 'o'},
+	{"compression",	required_argument,	0, OPT_COMPRESSION},
+	{"push",	optional_argument,	0, OPT_PUSH},
 	{"help",	no_argument, 0, OPT_HELP},
 	{"version",	no_argument, 0, OPT_VERSION},
 	{NULL,		0, 0, 0}
@@ -66,6 +81,8 @@ main(int argc, char **argv)
     int port = 0;
 
     bool one_shot = false;
+    int compression = -1;
+    unsigned push_interval = 0;
 
     int c;
     while ((c = gnu_getopt_long(argc, argv, opts, long_opts, 0)) != -1) {
@@ -84,6 +101,24 @@ main(int argc, char **argv)
 	    case 'o':
 		one_shot = true;
 		break;
+	    case OPT_COMPRESSION:
+		try {
+		    compression = parse_compression_name(optarg);
+		} catch (const Xapian::Error& e) {
+		    cerr << "Error: " << e.get_msg() << endl;
+		    exit(1);
+		}
+		break;
+	    case OPT_PUSH:
+		push_interval = DEFAULT_PUSH_INTERVAL;
+		if (optarg &&
+		    (!parse_unsigned(optarg, push_interval) ||
+		     push_interval == 0)) {
+		    cerr << "Error: push interval must be a positive integer"
+			 << endl;
+		    exit(1);
+		}
+		break;
 	    case OPT_HELP:
 		cout << PROG_NAME " - " PROG_DESC "\n\n";
 		show_usage();
@@ -107,8 +142,11 @@ main(int argc, char **argv)
 
     try {
 	ReplicateTcpServer server(host, port, dbpath);
+	server.set_compression(compression);
 	if (one_shot) {
 	    server.run_once();
+	} else if (push_interval) {
+	    server.run_push(push_interval * 1e-3);
 	} else {
 	    server.run();
 	}
@@ -30,6 +30,7 @@
 #include "stringutils.h"
 #include "safeunistd.h"
 
+#include <csignal>
 #include <iostream>
 
 using namespace std;
@@ -64,16 +65,43 @@ static void show_usage() {
 "  -f, --force-copy    force a full copy of the database to be sent (and then\n"
 "                      replicate as normal)\n"
 "  -o, --one-shot      replicate only once and then exit\n"
+"  -s, --subscribe     stay connected and apply changes as the master pushes\n"
+"                      them (needs xapian-replicate-server --push); --interval\n"
+"                      is then how long to wait before reconnecting\n"
 "  -q, --quiet         only report errors\n"
 "  -v, --verbose       be more verbose\n"
 "  --help              display this help and exit\n"
 "  --version           output version information and exit" << endl;
 }
 
+static enum { NORMAL, VERBOSE, QUIET } verbosity = NORMAL;
+
+/// Report the outcome of an update.
+static void
+report_update(const Xapian::ReplicationInfo& info)
+{
+    if (verbosity == VERBOSE) {
+	cout << "Update complete: "
+	     << info.fullcopy_count << " copies, "
+	     << info.changeset_count << " changesets, "
+	     << (info.changed ? "new live database"
+			      : "no changes to live database")
+	     <<	endl;
+    }
+    if (verbosity != QUIET) {
+	if (info.fullcopy_count > 0 && !info.changed) {
+	    cout <<
+"Replication using a full copy failed.  This usually means that the master\n"
+"database is changing too frequently.  Ensure that sufficient changesets are\n"
+"present by setting XAPIAN_MAX_CHANGESETS on the master." << endl;
+	}
+    }
+}
+
 int
 main(int argc, char **argv)
 {
-    const char * opts = "h:p:m:i:r:t:ofqv";
+    const char * opts = "h:p:m:i:r:t:osfqv";
     static const struct option long_opts[] = {
 	{"host",	required_argument,	0, 'h'},
 	{"port",	required_argument,	0, 'p'},
@@ -82,6 +110,7 @@ main(int argc, char **argv)
 	{"reader-time",	required_argument,	0, 'r'},
 	{"timeout",	required_argument,	0, 't'},
 	{"one-shot",	no_argument,		0, 'o'},
+	{"subscribe",	no_argument,		0, 's'},
 	{"force-copy",	no_argument,		0, 'f'},
 	{"quiet",	no_argument,		0, 'q'},
 	{"verbose",	no_argument,		0, 'v'},
@@ -95,7 +124,7 @@ main(int argc, char **argv)
     string masterdb;
     int interval = DEFAULT_INTERVAL;
     bool one_shot = false;
-    enum { NORMAL, VERBOSE, QUIET } verbosity = NORMAL;
+    bool subscribe = false;
     bool force_copy = false;
     int reader_close_time = READER_CLOSE_TIME;
     int timeout = DEFAULT_TIMEOUT;
@@ -153,6 +182,9 @@ main(int argc, char **argv)
 	    case 'o':
 		one_shot = true;
 		break;
+	    case 's':
+		subscribe = true;
+		break;
 	    case 'q':
 		verbosity = QUIET;
 		break;
@@ -195,6 +227,12 @@ main(int argc, char **argv)
     if (masterdb.empty())
 	masterdb = dbpath;
 
+#ifdef SIGPIPE
+    // When subscribed, we find out the connection has gone when reading the
+    // next update, so we don't want to be killed by a failed write.
+    if (subscribe) signal(SIGPIPE, SIG_IGN);
+#endif
+
     while (true) {
 	try {
 	    if (verbosity == VERBOSE) {
@@ -205,25 +243,21 @@ main(int argc, char **argv)
 		cout << "Getting update for " << dbpath << " from "
 		     << masterdb << endl;
 	    }
+	    if (subscribe) {
+		// Apply changes as the master pushes them, until the
+		// connection fails.
+		client.subscribe(dbpath, masterdb, force_copy);
+		force_copy = false;
+		while (true) {
+		    Xapian::ReplicationInfo info;
+		    client.wait_for_update(info, reader_close_time);
+		    report_update(info);
+		}
+	    }
 	    Xapian::ReplicationInfo info;
 	    client.update_from_master(dbpath, masterdb, info,
 				      reader_close_time, force_copy);
-	    if (verbosity == VERBOSE) {
-		cout << "Update complete: "
-		     << info.fullcopy_count << " copies, "
-		     << info.changeset_count << " changesets, "
-		     << (info.changed ? "new live database"
-				      : "no changes to live database")
-		     <<	endl;
-	    }
-	    if (verbosity != QUIET) {
-		if (info.fullcopy_count > 0 && !info.changed) {
-		    cout <<
-"Replication using a full copy failed.  This usually means that the master\n"
-"database is changing too frequently.  Ensure that sufficient changesets are\n"
-"present by setting XAPIAN_MAX_CHANGESETS on the master." << endl;
-		}
-	    }
+	    report_update(info);
 	    force_copy = false;
 	} catch (const Xapian::NetworkError &error) {
 	    // Don't stop running if there's a network error - just log to
@@ -55,6 +55,12 @@ const int MSECS_ACTIVE_TIMEOUT_DEFAULT = 15000;
 
 #define OPT_HELP 1
 #define OPT_VERSION 2
+#define OPT_PRELOAD 3
+#define OPT_PRELOAD_RATE 4
+#define OPT_WORKERS 5
+#define OPT_COMPRESSION 6
+#define OPT_GROUP_COMMIT 7
+#define OPT_GROUP_SIZE 8
 
 static const char * opts = "I:p:a:i:t:oqw";
 static const struct option long_opts[] = {
@@ -66,6 +72,12 @@ static const struct option long_opts[] = {
     {"one-shot",	no_argument,		0, 'o'},
     {"quiet",		no_argument,		0, 'q'},
     {"writable",	no_argument,		0, 'w'},
+    {"preload",		required_argument,	0, OPT_PRELOAD},
+    {"preload-rate",	required_argument,	0, OPT_PRELOAD_RATE},
+    {"workers",		required_argument,	0, OPT_WORKERS},
+    {"compression",	required_argument,	0, OPT_COMPRESSION},
+    {"group-commit",	required_argument,	0, OPT_GROUP_COMMIT},
+    {"group-size",	required_argument,	0, OPT_GROUP_SIZE},
     {"help",		no_argument,		0, OPT_HELP},
     {"version",		no_argument,		0, OPT_VERSION},
     {NULL, 0, 0, 0}
@@ -80,9 +92,27 @@ static void show_usage() {
 "  --idle-timeout MSECS    set timeout for idle connections (default " STRINGIZE(MSECS_IDLE_TIMEOUT_DEFAULT) "ms)\n"
 "  --active-timeout MSECS  set timeout for active connections (default " STRINGIZE(MSECS_ACTIVE_TIMEOUT_DEFAULT) "ms)\n"
 "  --timeout MSECS         set both timeout values\n"
-"  --one-shot              serve a single connection and exit\n"
+"  --one-shot              serve a single connection and exit (with\n"
+"                          --group-commit, exit once all clients have\n"
+"                          disconnected)\n"
 "  --quiet                 disable information messages to stdout\n"
 "  --writable              allow updates (only one database directory allowed)\n"
+"  --preload TERMS         before listening, read the branch blocks, document\n"
+"                          lengths and postlists of the TERMS most frequent terms\n"
+"                          of each database into cache\n"
+"  --preload-rate BYTES    limit --preload to reading BYTES per second\n"
+"  --workers N             serve connections with a pool of N worker processes\n"
+"                          which keep the databases open between connections\n"
+"                          (default is to fork a process for each connection)\n"
+"  --compression TYPE      compress large messages using TYPE (zlib, lz4 or zstd)\n"
+"                          if the client supports it\n"
+"  --group-commit MSECS    with --writable, serve all clients from one process\n"
+"                          and commit their changes together, waiting up to\n"
+"                          MSECS after a client asks to commit (requests are\n"
+"                          handled one at a time, so a slow one delays the\n"
+"                          other clients)\n"
+"  --group-size N          with --group-commit, commit as soon as N clients are\n"
+"                          waiting\n"
 "  --help                  display this help and exit\n"
 "  --version               output version information and exit" << endl;
 }
@@ -96,6 +126,14 @@ int main(int argc, char **argv) {
     bool one_shot = false;
     bool verbose = true;
     bool writable = false;
+    bool preload = false;
+    unsigned preload_terms = 0;
+    unsigned preload_rate = 0;
+    unsigned workers = 0;
+    int compression = -1;
+    bool group_commit = false;
+    unsigned group_commit_delay = 0;
+    unsigned group_size = 0;
     bool syntax_error = false;
 
     int c;
@@ -155,6 +193,46 @@ int main(int argc, char **argv) {
 	    case 'w':
 		writable = true;
 		break;
+	    case OPT_PRELOAD:
+		if (!parse_unsigned(optarg, preload_terms)) {
+		    cerr << "Number of terms to preload must be >= 0" << endl;
+		    exit(1);
+		}
+		preload = true;
+		break;
+	    case OPT_PRELOAD_RATE:
+		if (!parse_unsigned(optarg, preload_rate)) {
+		    cerr << "Preload rate must be >= 0" << endl;
+		    exit(1);
+		}
+		break;
+	    case OPT_WORKERS:
+		if (!parse_unsigned(optarg, workers)) {
+		    cerr << "Number of workers must be >= 0" << endl;
+		    exit(1);
+		}
+		break;
+	    case OPT_COMPRESSION:
+		try {
+		    compression = parse_compression_name(optarg);
+		} catch (const Xapian::Error& e) {
+		    cerr << "Error: " << e.get_msg() << endl;
+		    exit(1);
+		}
+		break;
+	    case OPT_GROUP_COMMIT:
+		if (!parse_unsigned(optarg, group_commit_delay)) {
+		    cerr << "Group commit delay must be >= 0" << endl;
+		    exit(1);
+		}
+		group_commit = true;
+		break;
+	    case OPT_GROUP_SIZE:
+		if (!parse_unsigned(optarg, group_size)) {
+		    cerr << "Group size must be >= 0" << endl;
+		    exit(1);
+		}
+		break;
 	    default:
 		syntax_error = true;
 	}
@@ -175,6 +253,11 @@ int main(int argc, char **argv) {
 	exit(1);
     }
 
+    if (group_commit && !writable) {
+	cerr << "Error: '--group-commit' requires '--writable'." << endl;
+	exit(1);
+    }
+
     try {
 	vector<string> dbnames;
 	// Try to open the database(s) so we report problems now instead of
@@ -189,6 +272,16 @@ int main(int argc, char **argv) {
 	    }
 	}
 
+	// Warm up the cache before we start accepting connections.
+	if (preload) {
+	    for (auto&& dbname : dbnames) {
+		if (verbose)
+		    cout << "Preloading " << dbname << endl;
+		Xapian::Database db(dbname);
+		db.preload(preload_terms, preload_rate);
+	    }
+	}
+
 	if (verbose) {
 	    cout << "Starting";
 	    if (writable)
@@ -206,11 +299,15 @@ int main(int argc, char **argv) {
 	    cout << "Listening..." << endl;
 
 	register_user_weighting_schemes(server);
+	server.set_compression(compression);
 
-	if (one_shot) {
+	if (group_commit) {
+	    server.run_group_commit(group_commit_delay * 1e-3, group_size,
+				    one_shot);
+	} else if (one_shot) {
 	    server.run_once();
 	} else {
-	    server.run();
+	    server.run_pool(workers);
 	}
     } catch (const Xapian::Error &e) {
 	cerr << e.get_description() << endl;
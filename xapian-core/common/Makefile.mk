@@ -26,6 +26,7 @@ noinst_HEADERS +=\
 	common/parseint.h\
 	common/posixy_wrapper.h\
 	common/pretty.h\
+	common/ratelimit.h\
 	common/realtime.h\
 	common/replicate_utils.h\
 	common/replicationprotocol.h\
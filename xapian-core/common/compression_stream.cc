@@ -1,5 +1,5 @@
 /** @file compression_stream.cc
- * @brief class wrapper around zlib
+ * @brief class wrapper around zlib, LZ4 and Zstandard
  */
 /* Copyright (C) 2007,2009,2012,2013,2014,2016,2019 Olly Betts
  * Copyright (C) 2009 Richard Boulton
@@ -24,11 +24,26 @@
 #include "compression_stream.h"
 
 #include "omassert.h"
+#include "pack.h"
 #include "str.h"
 #include "stringutils.h"
 
 #include "xapian/error.h"
 
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef HAVE_LZ4
+# include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+# include <zdict.h>
+#endif
+
 using namespace std;
 
 CompressionStream::~CompressionStream() {
@@ -46,19 +61,127 @@ CompressionStream::~CompressionStream() {
 	delete inflate_zstream;
     }
 
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(zstd_cctx);
+    ZSTD_freeDCtx(zstd_dctx);
+#endif
+
+#ifdef HAVE_LZ4
+    if (lz4_stream) LZ4_freeStream(lz4_stream);
+#endif
+
     delete [] out;
 }
 
+bool
+CompressionStream::supported(compression_type type_)
+{
+    switch (type_) {
+	case COMPRESS_ZLIB:
+	    return true;
+	case COMPRESS_LZ4:
+#ifdef HAVE_LZ4
+	    return true;
+#else
+	    return false;
+#endif
+	case COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD
+	    return true;
+#else
+	    return false;
+#endif
+	default:
+	    return false;
+    }
+}
+
 const char*
-CompressionStream::compress(const char* buf, size_t* p_size) {
-    lazy_alloc_deflate_zstream();
-    size_t size = *p_size;
+CompressionStream::type_name(compression_type type_)
+{
+    switch (type_) {
+	case COMPRESS_ZLIB:
+	    return "zlib";
+	case COMPRESS_LZ4:
+	    return "lz4";
+	case COMPRESS_ZSTD:
+	    return "zstd";
+	default:
+	    return "unknown";
+    }
+}
+
+void
+CompressionStream::set_type(compression_type type_)
+{
+    if (rare(!supported(type_))) {
+	if (unsigned(type_) >= COMPRESS_MAX_) {
+	    string msg = "Unknown compression type ";
+	    msg += str(unsigned(type_));
+	    throw Xapian::DatabaseCorruptError(msg);
+	}
+	string msg = type_name(type_);
+	msg += " compression support not enabled";
+	throw Xapian::FeatureUnavailableError(msg);
+    }
+    type = type_;
+}
+
+void
+CompressionStream::set_dictionary(const string& dict)
+{
+    dictionary = dict;
+#ifdef HAVE_ZSTD
+    // Zstandard contexts retain the dictionary across frames, so update any
+    // we've already allocated.  Passing an empty dictionary removes it.
+    if (zstd_cctx) {
+	(void)ZSTD_CCtx_reset(zstd_cctx, ZSTD_reset_session_only);
+	size_t r = ZSTD_CCtx_loadDictionary(zstd_cctx, dictionary.data(),
+					    dictionary.size());
+	if (rare(ZSTD_isError(r))) throw std::bad_alloc();
+    }
+    if (zstd_dctx) {
+	(void)ZSTD_DCtx_reset(zstd_dctx, ZSTD_reset_session_only);
+	size_t r = ZSTD_DCtx_loadDictionary(zstd_dctx, dictionary.data(),
+					    dictionary.size());
+	if (rare(ZSTD_isError(r))) throw std::bad_alloc();
+    }
+#endif
+}
+
+void
+CompressionStream::reserve_out(size_t size)
+{
     if (!out || out_len < size) {
 	out_len = size;
 	delete [] out;
 	out = NULL;
 	out = new char[size];
     }
+}
+
+const char*
+CompressionStream::compress(const char* buf, size_t* p_size) {
+    switch (type) {
+	case COMPRESS_LZ4:
+	    return compress_lz4(buf, p_size);
+	case COMPRESS_ZSTD:
+	    return compress_zstd(buf, p_size);
+	default:
+	    break;
+    }
+
+    lazy_alloc_deflate_zstream();
+    if (!dictionary.empty()) {
+	// A raw deflate stream needs the dictionary setting again after each
+	// reset.
+	int zerr = deflateSetDictionary(deflate_zstream,
+					reinterpret_cast<const Bytef*>(dictionary.data()),
+					static_cast<uInt>(dictionary.size()));
+	if (rare(zerr != Z_OK)) return NULL;
+    }
+    size_t size = *p_size;
+    reserve_out(size);
     deflate_zstream->avail_in = static_cast<uInt>(size);
     deflate_zstream->next_in = reinterpret_cast<const Bytef*>(buf);
     deflate_zstream->next_out = reinterpret_cast<Bytef*>(out);
@@ -82,9 +205,215 @@ CompressionStream::compress(const char* buf, size_t* p_size) {
     return out;
 }
 
+/* An LZ4 compressed tag is stored as the uncompressed size and the compressed
+ * size (both packed with pack_uint()) followed by a single LZ4 block.
+ *
+ * The block format is used rather than the LZ4 frame format as it's
+ * significantly more compact for the short tags we typically store, but it
+ * means we need to record the compressed size to know when we have the
+ * whole block.
+ *
+ * If a dictionary is set, the block is compressed as if it followed the
+ * dictionary so it can contain matches against the dictionary's contents.
+ */
+const char*
+CompressionStream::compress_lz4(const char* buf, size_t* p_size)
+{
+#ifdef HAVE_LZ4
+    size_t size = *p_size;
+    if (rare(size > size_t(LZ4_MAX_INPUT_SIZE))) return NULL;
+    string header;
+    pack_uint(header, size);
+    // The compressed size must be less than size to be worth using, so its
+    // encoded form can't be longer than that of size.
+    size_t reserve = header.size() * 2;
+    if (size <= reserve) return NULL;
+    reserve_out(size);
+    int c_size;
+    if (dictionary.empty()) {
+	c_size = LZ4_compress_default(buf, out + reserve,
+				      int(size), int(size - reserve));
+    } else {
+	if (!lz4_stream) {
+	    lz4_stream = LZ4_createStream();
+	    if (rare(!lz4_stream)) throw std::bad_alloc();
+	}
+	// LZ4_loadDict() resets the stream so each tag is compressed
+	// independently.
+	(void)LZ4_loadDict(lz4_stream, dictionary.data(),
+			   int(dictionary.size()));
+	c_size = LZ4_compress_fast_continue(lz4_stream, buf, out + reserve,
+					    int(size), int(size - reserve), 1);
+    }
+    if (c_size <= 0) {
+	// Didn't fit - the data wasn't usefully compressible.
+	return NULL;
+    }
+    pack_uint(header, unsigned(c_size));
+    size_t total = header.size() + size_t(c_size);
+    if (total >= size) {
+	// It didn't get smaller.
+	return NULL;
+    }
+    memmove(out + header.size(), out + reserve, c_size);
+    memcpy(out, header.data(), header.size());
+    *p_size = total;
+    return out;
+#else
+    (void)buf;
+    (void)p_size;
+    return NULL;
+#endif
+}
+
+const char*
+CompressionStream::compress_zstd(const char* buf, size_t* p_size)
+{
+#ifdef HAVE_ZSTD
+    lazy_alloc_zstd_cctx();
+    size_t size = *p_size;
+    reserve_out(size);
+    // Give Zstandard an output buffer the size of the input so it'll give up
+    // once it discovers the data doesn't compress.
+    size_t r = ZSTD_compress2(zstd_cctx, out, size, buf, size);
+    if (ZSTD_isError(r) || r >= size) {
+	// The data wasn't compressible.
+	return NULL;
+    }
+    *p_size = r;
+    return out;
+#else
+    (void)buf;
+    (void)p_size;
+    return NULL;
+#endif
+}
+
+void
+CompressionStream::decompress_start()
+{
+    switch (type) {
+	case COMPRESS_LZ4:
+	    lz4_buf.resize(0);
+	    break;
+	case COMPRESS_ZSTD:
+	    lazy_alloc_zstd_dctx();
+	    break;
+	default:
+	    lazy_alloc_inflate_zstream();
+	    if (!dictionary.empty()) {
+		// For raw inflate the dictionary has to be set up front (and
+		// again after each reset).
+		int err = inflateSetDictionary(inflate_zstream,
+					       reinterpret_cast<const Bytef*>(dictionary.data()),
+					       static_cast<uInt>(dictionary.size()));
+		if (rare(err != Z_OK)) {
+		    throw Xapian::DatabaseError("inflateSetDictionary failed");
+		}
+	    }
+	    break;
+    }
+}
+
+bool
+CompressionStream::decompress_chunk_lz4(const char* p, int len, string& buf,
+					size_t max_size)
+{
+#ifdef HAVE_LZ4
+    lz4_buf.append(p, len);
+    const char* s = lz4_buf.data();
+    const char* end = s + lz4_buf.size();
+    size_t size, c_size;
+    if (!unpack_uint(&s, end, &size) || !unpack_uint(&s, end, &c_size)) {
+	if (s) {
+	    // Header overflowed.
+	    throw Xapian::DatabaseCorruptError("Bad LZ4 compressed tag header");
+	}
+	// Header not complete yet.
+	return false;
+    }
+    size_t avail = end - s;
+    if (avail < c_size) return false;
+    if (rare(avail > c_size ||
+	     size > size_t(LZ4_MAX_INPUT_SIZE) ||
+	     c_size > size_t(LZ4_MAX_INPUT_SIZE))) {
+	throw Xapian::DatabaseCorruptError("Bad LZ4 compressed tag");
+    }
+    size_t old_size = buf.size();
+    if (rare(size > max_size - old_size)) {
+	lz4_buf.resize(0);
+	throw Xapian::DatabaseError("LZ4 decompressed data too large");
+    }
+    buf.resize(old_size + size);
+    int r;
+    if (dictionary.empty()) {
+	r = LZ4_decompress_safe(s, &buf[old_size], int(c_size), int(size));
+    } else {
+	r = LZ4_decompress_safe_usingDict(s, &buf[old_size],
+					  int(c_size), int(size),
+					  dictionary.data(),
+					  int(dictionary.size()));
+    }
+    if (rare(r < 0 || size_t(r) != size)) {
+	buf.resize(old_size);
+	throw Xapian::DatabaseError("LZ4 decompression failed");
+    }
+    lz4_buf.resize(0);
+    return true;
+#else
+    (void)p;
+    (void)len;
+    (void)buf;
+    (void)max_size;
+    return false;
+#endif
+}
+
+bool
+CompressionStream::decompress_chunk_zstd(const char* p, int len, string& buf,
+					 size_t max_size)
+{
+#ifdef HAVE_ZSTD
+    char blk[8192];
+    ZSTD_inBuffer in = { p, size_t(len), 0 };
+    while (true) {
+	ZSTD_outBuffer o = { blk, sizeof(blk), 0 };
+	size_t r = ZSTD_decompressStream(zstd_dctx, &o, &in);
+	if (ZSTD_isError(r)) {
+	    string msg = "Zstandard decompression failed (";
+	    msg += ZSTD_getErrorName(r);
+	    msg += ')';
+	    throw Xapian::DatabaseError(msg);
+	}
+	if (rare(o.pos > max_size - buf.size())) {
+	    throw Xapian::DatabaseError("Zstandard decompressed data too large");
+	}
+	buf.append(blk, o.pos);
+	if (r == 0) return true;
+	if (in.pos == in.size && o.pos < o.size) return false;
+    }
+#else
+    (void)p;
+    (void)len;
+    (void)buf;
+    (void)max_size;
+    return false;
+#endif
+}
+
 bool
-CompressionStream::decompress_chunk(const char* p, int len, string & buf)
+CompressionStream::decompress_chunk(const char* p, int len, string & buf,
+				    size_t max_size)
 {
+    switch (type) {
+	case COMPRESS_LZ4:
+	    return decompress_chunk_lz4(p, len, buf, max_size);
+	case COMPRESS_ZSTD:
+	    return decompress_chunk_zstd(p, len, buf, max_size);
+	default:
+	    break;
+    }
+
     Bytef blk[8192];
 
     inflate_zstream->next_in = reinterpret_cast<const Bytef*>(p);
@@ -105,8 +434,11 @@ CompressionStream::decompress_chunk(const char* p, int len, string & buf)
 	    throw Xapian::DatabaseError(msg);
 	}
 
-	buf.append(reinterpret_cast<const char *>(blk),
-		   inflate_zstream->next_out - blk);
+	size_t n = inflate_zstream->next_out - blk;
+	if (rare(n > max_size - buf.size())) {
+	    throw Xapian::DatabaseError("Decompressed data too large");
+	}
+	buf.append(reinterpret_cast<const char *>(blk), n);
 	if (err == Z_STREAM_END) return true;
 	if (inflate_zstream->avail_in == 0) return false;
     }
@@ -184,3 +516,180 @@ CompressionStream::lazy_alloc_inflate_zstream() {
 	throw Xapian::DatabaseError(msg);
     }
 }
+
+void
+CompressionStream::lazy_alloc_zstd_cctx()
+{
+#ifdef HAVE_ZSTD
+    if (usual(zstd_cctx)) {
+	(void)ZSTD_CCtx_reset(zstd_cctx, ZSTD_reset_session_only);
+	return;
+    }
+
+    zstd_cctx = ZSTD_createCCtx();
+    if (rare(!zstd_cctx)) throw std::bad_alloc();
+    // Any dictionary in use is recorded elsewhere, so don't spend 4 bytes
+    // of each tag storing its id.
+    (void)ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_dictIDFlag, 0);
+    if (!dictionary.empty()) {
+	size_t r = ZSTD_CCtx_loadDictionary(zstd_cctx, dictionary.data(),
+					    dictionary.size());
+	if (rare(ZSTD_isError(r))) throw std::bad_alloc();
+    }
+#endif
+}
+
+void
+CompressionStream::lazy_alloc_zstd_dctx()
+{
+#ifdef HAVE_ZSTD
+    if (usual(zstd_dctx)) {
+	(void)ZSTD_DCtx_reset(zstd_dctx, ZSTD_reset_session_only);
+	return;
+    }
+
+    zstd_dctx = ZSTD_createDCtx();
+    if (rare(!zstd_dctx)) throw std::bad_alloc();
+    if (!dictionary.empty()) {
+	size_t r = ZSTD_DCtx_loadDictionary(zstd_dctx, dictionary.data(),
+					    dictionary.size());
+	if (rare(ZSTD_isError(r))) throw std::bad_alloc();
+    }
+#endif
+}
+
+/// Maximum size of dictionary to build for each compression algorithm.
+static size_t
+max_dictionary_size(compression_type type_)
+{
+    // Raw deflate can only look back 32KB, while LZ4 and Zstandard can make
+    // use of up to 64KB.
+    return type_ == COMPRESS_ZLIB ? 32768 : 65536;
+}
+
+/** Build a dictionary by greedily picking the most widely shared segments.
+ *
+ *  This is a simplified version of the "cover" algorithm used by Zstandard's
+ *  dictionary builder.  We count how many samples each 8 byte sequence occurs
+ *  in, then repeatedly pick the 64 byte segment whose sequences not already
+ *  in the dictionary occur in the most samples.
+ *
+ *  The best segments are put at the end of the dictionary, since that's
+ *  closest to the data being compressed, so cheapest to reference.
+ */
+static string
+train_dictionary_greedy(const vector<string>& samples, size_t max_size)
+{
+    const size_t GRAM = 8;
+    const size_t SEGMENT = 64;
+
+    auto gram_at = [](const string& sample, size_t i) {
+	uint64_t g;
+	memcpy(&g, sample.data() + i, GRAM);
+	return g;
+    };
+
+    // For each gram, the number of samples it occurs in and the index (+ 1)
+    // of the last sample we saw it in.
+    unordered_map<uint64_t, pair<unsigned, unsigned>> freqs;
+    for (size_t i = 0; i != samples.size(); ++i) {
+	const string& sample = samples[i];
+	for (size_t j = 0; j + GRAM <= sample.size(); ++j) {
+	    auto& f = freqs[gram_at(sample, j)];
+	    if (f.second != i + 1) {
+		++f.first;
+		f.second = i + 1;
+	    }
+	}
+    }
+
+    unordered_set<uint64_t> covered;
+    auto score = [&](const string& sample, size_t pos, size_t len) {
+	size_t total = 0;
+	for (size_t j = pos; j + GRAM <= pos + len; ++j) {
+	    uint64_t g = gram_at(sample, j);
+	    if (covered.find(g) != covered.end()) continue;
+	    unsigned freq = freqs[g].first;
+	    // Sequences which only occur in one sample aren't worth storing.
+	    if (freq > 1) total += freq;
+	}
+	return total;
+    };
+
+    // Candidates are (score, (sample index, offset)), with segments starting
+    // every SEGMENT / 2 bytes.
+    typedef pair<size_t, pair<size_t, size_t>> candidate;
+    priority_queue<candidate> pq;
+    for (size_t i = 0; i != samples.size(); ++i) {
+	const string& sample = samples[i];
+	if (sample.size() < GRAM) continue;
+	for (size_t pos = 0; pos + GRAM <= sample.size(); pos += SEGMENT / 2) {
+	    size_t len = min(SEGMENT, sample.size() - pos);
+	    size_t sc = score(sample, pos, len);
+	    if (sc) pq.push(candidate(sc, make_pair(i, pos)));
+	}
+    }
+
+    // The chosen segments as (sample index, (offset, length)).
+    vector<pair<size_t, pair<size_t, size_t>>> chosen;
+    size_t dict_size = 0;
+    while (!pq.empty() && dict_size < max_size) {
+	candidate c = pq.top();
+	pq.pop();
+	const string& sample = samples[c.second.first];
+	size_t pos = c.second.second;
+	size_t len = min(SEGMENT, sample.size() - pos);
+	// Scores only ever decrease as we cover more grams, so if the updated
+	// score is still at least as good as the next best stale score, this
+	// segment is the best remaining choice.
+	size_t sc = score(sample, pos, len);
+	if (sc == 0) continue;
+	if (sc < c.first && !pq.empty() && sc < pq.top().first) {
+	    pq.push(candidate(sc, c.second));
+	    continue;
+	}
+	for (size_t j = pos; j + GRAM <= pos + len; ++j) {
+	    covered.insert(gram_at(sample, j));
+	}
+	len = min(len, max_size - dict_size);
+	chosen.push_back(make_pair(c.second.first, make_pair(pos, len)));
+	dict_size += len;
+    }
+
+    string dict;
+    dict.reserve(dict_size);
+    for (auto i = chosen.rbegin(); i != chosen.rend(); ++i) {
+	dict.append(samples[i->first], i->second.first, i->second.second);
+    }
+    return dict;
+}
+
+string
+CompressionStream::train_dictionary(compression_type type_,
+				    const vector<string>& samples)
+{
+    size_t max_size = max_dictionary_size(type_);
+#ifdef HAVE_ZSTD
+    if (type_ == COMPRESS_ZSTD) {
+	string buf;
+	vector<size_t> sizes;
+	sizes.reserve(samples.size());
+	for (const string& sample : samples) {
+	    buf += sample;
+	    sizes.push_back(sample.size());
+	}
+	string dict(max_size, '\0');
+	size_t r = ZDICT_trainFromBuffer(&dict[0], dict.size(),
+					 buf.data(), sizes.data(),
+					 unsigned(sizes.size()));
+	if (!ZDICT_isError(r)) {
+	    dict.resize(r);
+	    return dict;
+	}
+	// Training can fail if there's too little sample data, in which case
+	// fall back to the simple approach which still produces a usable
+	// "raw content" dictionary.
+    }
+#endif
+    return train_dictionary_greedy(samples, max_size);
+}
@@ -1,5 +1,5 @@
 /** @file compression_stream.h
- * @brief class wrapper around zlib
+ * @brief class wrapper around zlib, LZ4 and Zstandard
  */
 /* Copyright (C) 2012 Dan Colish
  * Copyright (C) 2012,2013,2014,2016 Olly Betts
@@ -24,9 +24,32 @@
 
 #include "internaltypes.h"
 #include <string>
+#include <vector>
 #include <zlib.h>
 
+union LZ4_stream_u;
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+/** Compression algorithms which CompressionStream can use.
+ *
+ *  These values are stored in database files, so must not be changed.
+ */
+enum compression_type {
+    /// Raw deflate using zlib (always available).
+    COMPRESS_ZLIB = 0,
+    /// LZ4 block compression (requires liblz4).
+    COMPRESS_LZ4 = 1,
+    /// Zstandard compression (requires libzstd).
+    COMPRESS_ZSTD = 2,
+    /// One more than the largest valid value.
+    COMPRESS_MAX_
+};
+
 class CompressionStream {
+    /// The compression algorithm in use.
+    compression_type type;
+
     int compress_strategy;
 
     size_t out_len;
@@ -39,34 +62,124 @@ class CompressionStream {
     /// Zlib state object for inflating
     z_stream* inflate_zstream;
 
+    /// Zstandard state object for compressing.
+    ZSTD_CCtx_s* zstd_cctx;
+
+    /// Zstandard state object for decompressing.
+    ZSTD_DCtx_s* zstd_dctx;
+
+    /// LZ4 state object for compressing with a dictionary.
+    LZ4_stream_u* lz4_stream;
+
+    /** Dictionary to prime the compressor and decompressor with.
+     *
+     *  Empty if no dictionary is in use.
+     */
+    std::string dictionary;
+
+    /** Compressed data gathered so far when decompressing an LZ4 block.
+     *
+     *  LZ4 blocks can't be decompressed incrementally, so we buffer up the
+     *  chunks until we have the whole block.
+     */
+    std::string lz4_buf;
+
     /// Allocate the zstream for deflating, if not already allocated.
     void lazy_alloc_deflate_zstream();
 
     /// Allocate the zstream for inflating, if not already allocated.
     void lazy_alloc_inflate_zstream();
 
+    /// Allocate the Zstandard compression context, if not already allocated.
+    void lazy_alloc_zstd_cctx();
+
+    /// Allocate the Zstandard decompression context, if not already allocated.
+    void lazy_alloc_zstd_dctx();
+
+    /// Ensure the output buffer can hold at least @a size bytes.
+    void reserve_out(size_t size);
+
+    const char* compress_lz4(const char* buf, size_t* p_size);
+
+    const char* compress_zstd(const char* buf, size_t* p_size);
+
+    bool decompress_chunk_lz4(const char* p, int len, std::string& buf,
+			      size_t max_size);
+
+    bool decompress_chunk_zstd(const char* p, int len, std::string& buf,
+			       size_t max_size);
+
   public:
     /* Create a new CompressionStream object.
      *
      *  @param compress_strategy_	Z_DEFAULT_STRATEGY,
      *					Z_FILTERED, Z_HUFFMAN_ONLY, or Z_RLE.
+     *					Only used for COMPRESS_ZLIB.
+     *  @param type_			The compression algorithm to use.
      */
-    explicit CompressionStream(int compress_strategy_ = Z_DEFAULT_STRATEGY)
-	: compress_strategy(compress_strategy_),
+    explicit CompressionStream(int compress_strategy_ = Z_DEFAULT_STRATEGY,
+			       compression_type type_ = COMPRESS_ZLIB)
+	: type(type_),
+	  compress_strategy(compress_strategy_),
 	  out_len(0),
 	  out(NULL),
 	  deflate_zstream(NULL),
-	  inflate_zstream(NULL)
+	  inflate_zstream(NULL),
+	  zstd_cctx(NULL),
+	  zstd_dctx(NULL),
+	  lz4_stream(NULL)
     { }
 
     ~CompressionStream();
 
+    /** Change the compression algorithm.
+     *
+     *  Throws Xapian::FeatureUnavailableError if support for @a type_
+     *  wasn't enabled at build time.
+     */
+    void set_type(compression_type type_);
+
+    compression_type get_type() const { return type; }
+
+    /// Return true if support for @a type_ was enabled at build time.
+    static bool supported(compression_type type_);
+
+    /// Return a human readable name for @a type_.
+    static const char* type_name(compression_type type_);
+
+    /** Set the dictionary to use.
+     *
+     *  Data compressed with a dictionary can only be decompressed by a
+     *  CompressionStream using the same dictionary.
+     *
+     *  @param dict	The dictionary (empty to stop using a dictionary).
+     */
+    void set_dictionary(const std::string& dict);
+
+    const std::string& get_dictionary() const { return dictionary; }
+
+    /** Build a dictionary from sample data.
+     *
+     *  @param type_	The compression algorithm the dictionary is for.
+     *  @param samples	Representative examples of the data to compress.
+     *
+     *  @return The dictionary, or an empty string if @a samples didn't
+     *		contain enough repeated content for a dictionary to help.
+     */
+    static std::string train_dictionary(compression_type type_,
+					const std::vector<std::string>& samples);
+
     const char* compress(const char* buf, size_t* p_size);
 
-    void decompress_start() { lazy_alloc_inflate_zstream(); }
+    void decompress_start();
 
-    /** Returns true if this was the final chunk. */
-    bool decompress_chunk(const char* p, int len, std::string& buf);
+    /** Returns true if this was the final chunk.
+     *
+     *  @param max_size	Throw Xapian::DatabaseError if @a buf would grow
+     *			beyond this many bytes (default: no limit).
+     */
+    bool decompress_chunk(const char* p, int len, std::string& buf,
+			  size_t max_size = size_t(-1));
 };
 
 #endif // XAPIAN_INCLUDED_COMPRESSION_STREAM_H
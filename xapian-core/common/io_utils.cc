@@ -247,12 +247,12 @@ throw_block_error(const char * s, off_t b, int e = 0)
 
 #ifdef HAVE_POSIX_FADVISE
 bool
-io_readahead_block(int fd, size_t n, off_t b, off_t o)
+io_readahead_blocks(int fd, size_t n, off_t b, off_t count, off_t o)
 {
     o += b * n;
     // Assume that any failure is likely to also happen for another call with
     // the same fd.
-    return posix_fadvise(fd, o, n, POSIX_FADV_WILLNEED) == 0;
+    return posix_fadvise(fd, o, n * count, POSIX_FADV_WILLNEED) == 0;
 }
 #endif
 
@@ -146,16 +146,27 @@ size_t io_pread(int fd, char * p, size_t n, off_t o, size_t min = 0);
  */
 void io_pwrite(int fd, const char * p, size_t n, off_t o);
 
-/** Readahead block b size n bytes from file descriptor fd.
+/** Readahead count blocks starting at block b size n bytes from file
+ *  descriptor fd.
  *
  *  Returns false if we can't readahead on this fd.
  */
 #ifdef HAVE_POSIX_FADVISE
-bool io_readahead_block(int fd, size_t n, off_t b, off_t o = 0);
+bool io_readahead_blocks(int fd, size_t n, off_t b, off_t count, off_t o = 0);
 #else
-inline bool io_readahead_block(int, size_t, off_t, off_t = 0) { return false; }
+inline bool io_readahead_blocks(int, size_t, off_t, off_t, off_t = 0) {
+    return false;
+}
 #endif
 
+/** Readahead block b size n bytes from file descriptor fd.
+ *
+ *  Returns false if we can't readahead on this fd.
+ */
+inline bool io_readahead_block(int fd, size_t n, off_t b, off_t o = 0) {
+    return io_readahead_blocks(fd, n, b, 1, o);
+}
+
 /// Read block b size n bytes into buffer p from file descriptor fd, offset o.
 void io_read_block(int fd, char * p, size_t n, off_t b, off_t o = 0);
 
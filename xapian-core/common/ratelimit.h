@@ -0,0 +1,56 @@
+/** @file ratelimit.h
+ *  @brief Limit the rate at which bytes are processed.
+ */
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef XAPIAN_INCLUDED_RATELIMIT_H
+#define XAPIAN_INCLUDED_RATELIMIT_H
+
+#include <cstddef>
+
+#include "realtime.h"
+
+/// Limit the rate at which bytes are processed by sleeping.
+class RateLimit {
+    /// Maximum bytes per second, or 0 for no limit.
+    double rate;
+
+    /// When we started.
+    double start;
+
+    /// Bytes processed so far.
+    double done = 0;
+
+  public:
+    /** Construct.
+     *
+     *  @param rate_	Maximum number of bytes per second, or 0 for no limit.
+     */
+    explicit RateLimit(size_t rate_)
+	: rate(rate_), start(rate_ ? RealTime::now() : 0) { }
+
+    /** Record that @a bytes bytes have been processed.
+     *
+     *  If we're ahead of the rate limit, sleep until we aren't.
+     */
+    void add(size_t bytes) {
+	if (rate == 0) return;
+	done += bytes;
+	RealTime::sleep(start + done / rate);
+    }
+};
+
+#endif // XAPIAN_INCLUDED_RATELIMIT_H
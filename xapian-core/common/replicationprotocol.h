@@ -23,8 +23,12 @@
 
 // Versions:
 // 1: Initial support
-#define XAPIAN_REPLICATION_PROTOCOL_MAJOR_VERSION 1
-#define XAPIAN_REPLICATION_PROTOCOL_MINOR_VERSION 0
+// 2: Client sends 'C' message; compressed messages
+// 2.1: Client can send 'S' to subscribe to pushed changes
+// 2.2: Client reports partial copies; database copies sent in checksummed
+//      chunks so they can be resumed
+#define XAPIAN_REPLICATION_PROTOCOL_MAJOR_VERSION 2
+#define XAPIAN_REPLICATION_PROTOCOL_MINOR_VERSION 2
 
 // Reply types (master -> slave)
 enum replicate_reply_type {
@@ -34,9 +38,14 @@ enum replicate_reply_type {
     REPL_REPLY_DB_FILENAME,	// The name of a file in a DB copy.
     REPL_REPLY_DB_FILEDATA,	// Contents of a file in a DB copy.
     REPL_REPLY_DB_FOOTER,	// End of a whole DB copy.
-    REPL_REPLY_CHANGESET	// A changeset file is being sent.
+    REPL_REPLY_CHANGESET,	// A changeset file is being sent.
+    REPL_REPLY_DB_FILECHUNK	// A checksummed chunk of a file in a DB copy.
 };
 
+// The size of the chunks files are split into for a DB copy (except for the
+// last chunk of each file, which is shorter).
+#define REPL_DB_CHUNK_SIZE (1024 * 1024)
+
 // The maximum number of copies of a database to send in a single conversation.
 // If more copies than this are required, a REPL_REPLY_FAIL message will be
 // sent.
@@ -201,10 +201,79 @@ const int DB_BACKEND_INMEMORY	 = 0x400;
  */
 const int DB_BACKEND_HONEY	 = 0x500;
 
+/** When creating a database, compress tags using LZ4 rather than zlib.
+ *
+ *  For backends which support it (currently glass), this selects LZ4 for
+ *  compressing tags in those tables which compress tags (e.g. the document
+ *  data and termlist tables).  LZ4 doesn't compress as well as zlib, but
+ *  decompresses much faster, which helps with latency when fetching document
+ *  data for displaying results.
+ *
+ *  The choice is recorded in the database when it is created, and has no
+ *  effect when opening an existing database.
+ *
+ *  Databases using LZ4 can't be opened by Xapian versions before 1.5.0.
+ *
+ *  If Xapian was built without LZ4 support, creating a database with this
+ *  flag will throw Xapian::FeatureUnavailableError.
+ */
+const int DB_COMPRESS_LZ4	 = 0x800;
+
+/** When creating a database, compress tags using Zstandard rather than zlib.
+ *
+ *  Like Xapian::DB_COMPRESS_LZ4, but selects Zstandard which usually
+ *  compresses better than zlib and decompresses faster.
+ *
+ *  If Xapian was built without Zstandard support, creating a database with
+ *  this flag will throw Xapian::FeatureUnavailableError.
+ */
+const int DB_COMPRESS_ZSTD	 = 0x1000;
+
+/** Log document changes so they survive the writer dying before commit.
+ *
+ *  For backends which support it (currently glass), each document added,
+ *  replaced or deleted is appended to a log file in the database directory,
+ *  and any changes in the log which were never committed are applied and
+ *  committed when the database is next opened for writing.  So that a burst
+ *  of changes shares the cost of syncing, the log is only synced when a
+ *  change is made at least 100 milliseconds after the last sync - set the
+ *  XAPIAN_DOCLOG_SYNC_INTERVAL environment variable to change this interval
+ *  (in milliseconds).  The last changes before the writer goes idle are
+ *  only synced when it next makes a change, starts a transaction, commits
+ *  or closes the database, so call commit() if you need them to be safe
+ *  from a power cut.
+ *
+ *  Changes to user metadata, spellings and synonyms aren't logged.
+ *
+ *  This flag is ignored by other backends, and when opening a database
+ *  read-only.
+ */
+const int DB_DOCUMENT_LOG	 = 0x2000;
+
+/** Delete documents by tombstoning them rather than updating every postlist.
+ *
+ *  For backends which support it (currently glass), deleting a document just
+ *  marks its docid in a bitmap of deleted documents stored in the database,
+ *  and searches skip over these documents.  This makes deleting a document
+ *  much cheaper, which helps when expiring large numbers of old documents.
+ *  The deleted documents are only removed from the database's tables when it
+ *  is compacted, so until then the term frequency statistics include them.
+ *
+ *  Replacing a deleted document works as usual.  Tombstones are stored in the
+ *  database, so they remain in effect when it's opened without this flag.
+ *
+ *  This flag is ignored by other backends, and when opening a database
+ *  read-only.
+ */
+const int DB_TOMBSTONE_DELETES	 = 0x4000;
+
 #ifdef XAPIAN_LIB_BUILD
 /** @internal Bit mask for backend codes. */
 const int DB_BACKEND_MASK_	 = 0x700;
 
+/** @internal Bit mask for compression codes. */
+const int DB_COMPRESS_MASK_	 = 0x1800;
+
 /** @internal Used internally to signify opening read-only. */
 const int DB_READONLY_		 = -1;
 #endif
@@ -274,6 +343,22 @@ const int DBCOMPACT_MULTIPASS = 8;
  */
 const int DBCOMPACT_SINGLE_FILE = 16;
 
+/** Compress document data using a dictionary trained from the input(s).
+ *
+ *  A sample of the document data in the source databases is used to build
+ *  a compression dictionary, which is stored in the output database and used
+ *  to compress and decompress document data.  This can greatly improve the
+ *  compression of short document data with a lot of content in common (e.g.
+ *  JSON with the same keys in each document), at the cost of slower
+ *  compaction.
+ *
+ *  Document data added to the output database later is also compressed using
+ *  the dictionary.
+ *
+ *  Supported by the glass and honey backends.
+ */
+const int DBCOMPACT_DOCDATA_DICTIONARY = 32;
+
 /** Assume document id is valid.
  *
  *  By default, Database::get_document() checks that the document id passed is
@@ -436,6 +436,53 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
      */
     void keep_alive();
 
+    /** Read the parts of the database which searches most need into cache.
+     *
+     *  A newly started search server can be much slower than usual until
+     *  the operating system's file cache warms up.  This method reads in the
+     *  branch blocks of each table, the document length chunks, and the
+     *  postlists of the @a top_terms terms with the highest term
+     *  frequencies, so you can warm a database deliberately before sending
+     *  it traffic.
+     *
+     *  Currently this only does anything for glass databases.  For remote
+     *  databases, use xapian-tcpsrv's --preload option on the server.
+     *
+     *  @param top_terms	Number of terms to read the postlists of
+     *			(default: 1000).
+     *  @param max_rate	Maximum rate to read at in bytes per second, or 0
+     *			for no limit (default: 0).
+     */
+    void preload(Xapian::termcount top_terms = 1000, size_t max_rate = 0) const;
+
+    /** Stop the revision this Database is reading from being overwritten.
+     *
+     *  Normally a writer may reuse blocks which the revision you're reading
+     *  from still needs once it has committed twice more, and you then get
+     *  Xapian::DatabaseModifiedError and have to call reopen().  A lease
+     *  tells writers not to reuse these blocks until the lease expires, so
+     *  a long-running read (e.g. an export, or paging deep into results) can
+     *  see a consistent snapshot while the database is being updated.
+     *
+     *  While a lease is held, blocks freed by writers aren't reused so the
+     *  database files grow, so keep leases short and release them when
+     *  you're done.  A lease is also released by close(), reopen() to a
+     *  different revision, or destroying the Database object, and if the
+     *  process dies the lease just expires.  Writers only notice a new
+     *  lease when they next start a revision, so if the revision being
+     *  read has already changed Xapian::DatabaseModifiedError is thrown and
+     *  you should call reopen() and try again.
+     *
+     *  Currently this is only supported for glass databases which aren't
+     *  in a single file - for other backends
+     *  Xapian::UnimplementedError is thrown.
+     *
+     *  @param duration	How long the lease should last for in seconds,
+     *			or 0 to release the lease.  Calling this method
+     *			again before the lease expires renews it.
+     */
+    void lease_revision(unsigned duration) const;
+
     /** Get a document from the database.
      *
      *  The returned object acts as a handle which lazily fetches information
@@ -680,6 +727,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
      *   - Xapian::DBCOMPACT_SINGLE_FILE
      *		Produce a single-file database (only supported for glass
      *		currently).
+     *   - Xapian::DBCOMPACT_DOCDATA_DICTIONARY
+     *		Compress document data using a dictionary built from a sample
+     *		of the document data in the inputs.
      *   - At most one of:
      *     - Xapian::Compactor::STANDARD - Don't split items unnecessarily.
      *     - Xapian::Compactor::FULL     - Split items whenever it saves space
@@ -738,6 +788,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
      *   - Xapian::DBCOMPACT_SINGLE_FILE
      *		Produce a single-file database (only supported for glass
      *		currently).
+     *   - Xapian::DBCOMPACT_DOCDATA_DICTIONARY
+     *		Compress document data using a dictionary built from a sample
+     *		of the document data in the inputs.
      *   - At most one of:
      *     - Xapian::Compactor::STANDARD - Don't split items unnecessarily.
      *     - Xapian::Compactor::FULL     - Split items whenever it saves space
@@ -791,6 +844,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
      *   - Xapian::DBCOMPACT_SINGLE_FILE
      *		Produce a single-file database (only supported for glass
      *		currently).
+     *   - Xapian::DBCOMPACT_DOCDATA_DICTIONARY
+     *		Compress document data using a dictionary built from a sample
+     *		of the document data in the inputs.
      *   - At most one of:
      *     - Xapian::Compactor::STANDARD - Don't split items unnecessarily.
      *     - Xapian::Compactor::FULL     - Split items whenever it saves space
@@ -852,6 +908,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
      *   - Xapian::DBCOMPACT_SINGLE_FILE
      *		Produce a single-file database (only supported for glass
      *		currently).
+     *   - Xapian::DBCOMPACT_DOCDATA_DICTIONARY
+     *		Compress document data using a dictionary built from a sample
+     *		of the document data in the inputs.
      *   - At most one of:
      *     - Xapian::Compactor::STANDARD - Don't split items unnecessarily.
      *     - Xapian::Compactor::FULL     - Split items whenever it saves space
@@ -1356,6 +1415,111 @@ class XAPIAN_VISIBILITY_DEFAULT WritableDatabase : public Database {
     std::string get_description() const;
 };
 
+/** A glass database plus an in-memory segment of recent changes.
+ *
+ *  Changes to a WritableDatabase aren't visible to other Database objects
+ *  until they're committed, and committing each change is slow.  A
+ *  HybridDatabase instead adds new documents to an in-memory segment, which
+ *  get_database() returns as a shard alongside the glass database, so the
+ *  changes are searchable straight away.  Documents which are replaced or
+ *  deleted are masked in the glass shard.
+ *
+ *  Documents are identified by a unique term (e.g. a prefixed ID), as with
+ *  WritableDatabase::replace_document(const std::string&, const Document&).
+ *  Document ids in the Database returned by get_database() aren't stable -
+ *  they change when the in-memory segment is committed.
+ *
+ *  The in-memory segment is committed to the glass database by commit(),
+ *  and automatically once the number of changes reaches the threshold set
+ *  by the XAPIAN_FLUSH_THRESHOLD environment variable (default 10000).
+ *
+ *  @since 1.5.0
+ */
+class XAPIAN_VISIBILITY_DEFAULT HybridDatabase {
+  public:
+    /// Class representing the HybridDatabase internals.
+    class Internal;
+    /// @private @internal Reference counted internals.
+    Xapian::Internal::intrusive_ptr_nonnull<Internal> internal;
+
+    /** Copying is allowed.
+     *
+     *  The internals are reference counted, so copying is cheap.
+     */
+    HybridDatabase(const HybridDatabase& o);
+
+    /** Copying is allowed.
+     *
+     *  The internals are reference counted, so assignment is cheap.
+     */
+    HybridDatabase& operator=(const HybridDatabase& o);
+
+    /// Move constructor.
+    HybridDatabase(HybridDatabase&& o);
+
+    /// Move assignment operator.
+    HybridDatabase& operator=(HybridDatabase&& o);
+
+    /** Create or open a glass database to use as the on-disk segment.
+     *
+     *  @param path	The path of the glass database.
+     *  @param flags	Flags as for WritableDatabase (default is
+     *			Xapian::DB_CREATE_OR_OPEN).
+     */
+    explicit HybridDatabase(const std::string& path, int flags = 0);
+
+    /** Destructor.
+     *
+     *  Any changes in the in-memory segment are committed.
+     */
+    ~HybridDatabase();
+
+    /// Add a new document.
+    void add_document(const Xapian::Document& document);
+
+    /** Replace any documents indexed by a unique term.
+     *
+     *  If no document is indexed by @a unique_term, @a document is added.
+     *
+     *  @param unique_term	The term identifying the document.
+     *  @param document		The new document.
+     */
+    void replace_document(const std::string& unique_term,
+			  const Xapian::Document& document);
+
+    /** Delete any documents indexed by a unique term.
+     *
+     *  @param unique_term	The term identifying the document.
+     */
+    void delete_document(const std::string& unique_term);
+
+    /** Return a Database which searches both segments.
+     *
+     *  Later changes are visible through the returned object straight away,
+     *  until the next commit (including an automatic one).  After that it
+     *  shows the state before the commit, and its glass shard is left at an
+     *  old revision which it can't reopen() (since documents are masked in
+     *  it), so once the database has been committed again searching it will
+     *  fail with Xapian::DatabaseModifiedError.  Call get_database() again
+     *  after each commit instead of keeping the returned object.
+     *
+     *  The returned object shares state with this HybridDatabase, so it
+     *  mustn't be used from another thread while add_document(),
+     *  replace_document(), delete_document() or commit() are running.
+     */
+    Database get_database() const;
+
+    /** Commit the in-memory segment to the glass database.
+     *
+     *  The changes are written to the glass database and committed, and the
+     *  in-memory segment is started afresh.
+     */
+    void commit();
+
+    /// Return a string describing this object.
+    std::string get_description() const;
+};
+
 }
 
 #endif // XAPIAN_INCLUDED_DATABASE_H
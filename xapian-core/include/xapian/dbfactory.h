@@ -85,6 +85,92 @@ Database open(const std::string &host, unsigned int port, unsigned timeout = 100
 XAPIAN_VISIBILITY_DEFAULT
 WritableDatabase open_writable(const std::string &host, unsigned int port, unsigned timeout = 0, unsigned connect_timeout = 10000, int flags = 0);
 
+/** Construct a Database object for read-only access to a remote database
+ *  accessed via a TCP connection, reusing an idle connection if possible.
+ *
+ * This works like Xapian::Remote::open(), except that when the returned
+ * Database object (and any copies of it) are destroyed, the connection is
+ * kept in a process-wide pool rather than closed, and a later call to this
+ * function for the same host and port will reuse it.  This avoids the cost
+ * of connecting and the server opening the database, which is useful if you
+ * create a Database object for each request.
+ *
+ * A reused connection is reopened on the server, so the returned Database
+ * is at the latest revision just as if a new connection had been made.
+ *
+ * The pool is safe to use from multiple threads (but as usual, a single
+ * Database object shouldn't be used from more than one thread at once).
+ *
+ * If the server closes an idle connection (e.g. because its idle timeout
+ * expired) this is detected and a new connection is made.  You can call
+ * Xapian::Remote::keep_pool_alive() periodically to avoid this.
+ *
+ * @param host		hostname to connect to.
+ * @param port		port number to connect to.
+ * @param timeout	timeout in milliseconds.  If this timeout is exceeded
+ *			for any individual operation on the remote database
+ *			then Xapian::NetworkTimeoutError is thrown.  A timeout
+ *			of 0 means don't timeout.  (Default is 10000ms, which
+ *			is 10 seconds).
+ * @param connect_timeout	timeout to use when connecting to the server.
+ *				If this timeout is exceeded then
+ *				Xapian::NetworkTimeoutError is thrown.  A
+ *				timeout of 0 means don't timeout.  (Default is
+ *				10000ms, which is 10 seconds).
+ */
+XAPIAN_VISIBILITY_DEFAULT
+Database open_pooled(const std::string& host, unsigned int port, unsigned timeout = 10000, unsigned connect_timeout = 10000);
+
+/** Send a keep-alive message over each idle pooled connection.
+ *
+ * Calling this periodically (more often than the server's idle timeout)
+ * keeps idle connections opened by Xapian::Remote::open_pooled() warm.  Any
+ * connections which don't respond are closed.
+ *
+ * @param timeout	timeout in milliseconds for each connection to respond.
+ *			(Default is 10000ms, which is 10 seconds).
+ */
+XAPIAN_VISIBILITY_DEFAULT
+void keep_pool_alive(unsigned timeout = 10000);
+
+/** Close all idle pooled connections.
+ *
+ * Connections currently in use by Database objects are unaffected, and
+ * will be added to the pool when those objects are destroyed.
+ */
+XAPIAN_VISIBILITY_DEFAULT
+void clear_pool();
+
+/** Set the maximum number of idle connections to pool for each server.
+ *
+ * Any excess idle connections are closed.  A value of 0 disables pooling.
+ *
+ * @param max_idle	Maximum idle connections per host and port (default 8).
+ */
+XAPIAN_VISIBILITY_DEFAULT
+void set_pool_size(unsigned max_idle);
+
+/** Register a replica of a remote database for hedging queries.
+ *
+ * If the results for a query against @a db are slow to arrive, the query is
+ * also sent to a replica, and the results from whichever responds first are
+ * used - see Xapian::Enquire::set_hedge_delay().  If several replicas are
+ * registered, they're used in turn.
+ *
+ * The replica must have the same contents as @a db (e.g. be kept in sync by
+ * replication), as otherwise which results a query returns may vary.
+ *
+ * @param db	A read-only database opened with Xapian::Remote::open() or
+ *		Xapian::Remote::open_pooled() (it must be a single shard).
+ * @param replica	Another such database.
+ *
+ * @exception Xapian::InvalidArgumentError if @a db or @a replica isn't a
+ *	      single read-only remote database, they're the same database, or
+ *	      @a replica has replicas registered itself.
+ */
+XAPIAN_VISIBILITY_DEFAULT
+void add_replica(const Database& db, const Database& replica);
+
 /** Construct a Database object for read-only access to a remote database
  *  accessed via a program.
  *
@@ -358,6 +358,66 @@ class XAPIAN_VISIBILITY_DEFAULT Enquire {
      */
     void set_time_limit(double time_limit);
 
+    /** Have remote servers send documents along with the MSet.
+     *
+     *  With the remote backend, getting each document from the MSet
+     *  normally requires a round trip to the server.  If this is set, each
+     *  remote server includes the data and values of the documents which
+     *  could be in the first @a n_docs items of the MSet with its results,
+     *  so getting those documents (and MSet::fetch() for them) doesn't need
+     *  any further round trips.
+     *
+     *  Documents sent this way for a previous MSet are discarded when the
+     *  next match against the same remote database starts.
+     *
+     *  This has no effect for local databases or writable remote databases.
+     *
+     *  @param n_docs	Number of documents to send (default: 0, meaning
+     *			none).
+     */
+    void set_document_prefetch(doccount n_docs);
+
+    /** Set when to hedge queries to replicas of remote shards.
+     *
+     *  If a remote shard has replicas (see Xapian::Remote::add_replica())
+     *  and its results haven't arrived after @a delay seconds, the query is
+     *  also sent to one of the replicas and whichever results arrive first
+     *  are used.  This reduces the impact of a slow server on the overall
+     *  latency, at the cost of extra load.
+     *
+     *  The default (0) is to use the 95th percentile of recent latencies
+     *  for the shard (so around 5% of queries are hedged once enough have
+     *  been run to estimate this).
+     *
+     *  Hedging is only supported on platforms with poll().
+     *
+     *  @param delay	Seconds to wait before hedging, 0 to use the 95th
+     *			percentile of recent latencies, or < 0 to never hedge
+     *			(default: 0).
+     */
+    void set_hedge_delay(double delay);
+
+    /** Return partial results if remote shards fail or are too slow.
+     *
+     *  By default, if any remote shard can't be searched (e.g. because its
+     *  server has died or doesn't respond within the timeout it was opened
+     *  with), get_mset() throws an exception.
+     *
+     *  If this is set, remote shards which fail with Xapian::NetworkError or
+     *  haven't responded within @a timeout seconds of get_mset() being called
+     *  are left out of the match, and MSet::get_missing_shards() reports
+     *  which.  The statistics used for weighting then only come from the
+     *  shards which did respond, so weights are approximate.
+     *
+     *  A remote shard which is still working on a query it was left out of
+     *  is also left out of the next query.  On platforms without poll(),
+     *  only shards which fail are left out.
+     *
+     *  @param timeout	Seconds to wait for remote shards, or 0 to not return
+     *			partial results (default: 0).
+     */
+    void set_shard_timeout(double timeout);
+
     /** Run the query.
      *
      *  Run the query using the settings in this Enquire object and those
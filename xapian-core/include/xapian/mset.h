@@ -28,6 +28,7 @@
 
 #include <iterator>
 #include <string>
+#include <vector>
 
 #include <xapian/attributes.h>
 #include <xapian/document.h>
@@ -230,6 +231,18 @@ class XAPIAN_VISIBILITY_DEFAULT MSet {
     /** The maximum possible weight any document could achieve. */
     double get_max_possible() const;
 
+    /** Indices of any shards which were left out of the match.
+     *
+     *  If Xapian::Enquire::set_shard_timeout() was used, remote shards which
+     *  failed or didn't respond in time are left out of the match rather than
+     *  causing an exception, and this returns their indices (0 for the first
+     *  shard of the Database, etc) in ascending order.  The statistics used
+     *  for weighting and the match counts then only cover the other shards.
+     *
+     *  Otherwise this returns an empty vector.
+     */
+    std::vector<Xapian::doccount> get_missing_shards() const;
+
     enum {
 	/** Model the relevancy of non-query terms in MSet::snippet().
 	 *
@@ -379,6 +392,31 @@ class XAPIAN_VISIBILITY_DEFAULT MSet {
     /** Return iterator pointing to the last object in this MSet. */
     MSetIterator back() const;
 
+    /** Serialise this object into a string.
+     *
+     *  This allows an application to cache the results of a search and
+     *  reuse them later, for example to serve further pages of results
+     *  without repeating the search.  The serialisation is designed to be
+     *  quick to produce and to read back.
+     *
+     *  The documents aren't included in the serialisation.
+     */
+    std::string serialise() const;
+
+    /** Unserialise a string and return an MSet object.
+     *
+     *  The weights, docids, match counts, sort keys, collapse keys and
+     *  counts, and statistics for the query terms are restored, so methods
+     *  such as get_termfreq() and convert_to_percent() work as they did on
+     *  the original object.  However, the returned MSet isn't associated
+     *  with a Xapian::Enquire object, so it can't be used to fetch
+     *  documents - use Xapian::Database::get_document() with the docids
+     *  instead.
+     *
+     *  @param serialised	the string to unserialise.
+     */
+    static MSet unserialise(const std::string& serialised);
+
     /// Return a string describing this object.
     std::string get_description() const;
 
@@ -258,11 +258,13 @@ LocalSubMatch::open_post_list(const string& term,
 		!wt_factory.get_sumpart_needs_wdf_()) {
 		Xapian::doccount sub_tf;
 		db->get_freqs(term, &sub_tf, NULL);
-		if (sub_tf == db->get_doccount()) {
+		if (sub_tf == db->get_doccount() && db->freqs_are_exact()) {
 		    // If we're not going to use the wdf or term positions, and
 		    // the term indexes all documents, we can replace it with
 		    // the MatchAll postlist, which is especially efficient if
-		    // there are no gaps in the docids.
+		    // there are no gaps in the docids.  If the frequencies
+		    // are only upper bounds, we can't tell that the term
+		    // indexes all documents.
 		    pl = db->open_leaf_post_list(string(), false);
 
 		    // Set the term name so the postlist looks up the correct
@@ -40,12 +40,14 @@
 
 #ifdef XAPIAN_HAS_REMOTE_BACKEND
 # include "backends/remote/remote-database.h"
+# include "realtime.h"
 # include "remotesubmatch.h"
 #endif
 
 #include <algorithm>
 #include <cerrno>
 #include <cfloat> // For DBL_EPSILON.
+#include <cmath>
 #include <vector>
 
 #ifdef HAVE_POLL_H
@@ -74,29 +76,92 @@ template<typename Action>
 inline void
 Matcher::for_all_remotes(Action action)
 {
+    auto run = [&](unique_ptr<RemoteSubMatch>& submatch) {
+	try {
+	    action(submatch.get());
+	} catch (const Xapian::NetworkError&) {
+	    // Unless we're returning partial results.
+	    if (deadline == 0.0) throw;
+	    drop_remote(submatch);
+	}
+    };
+
+    // Perform action first for any of the first n remotes which don't need
+    // to wait for the server, moving them after the others.
+    auto run_ready = [&](size_t n) {
+	size_t i = 0;
+	while (i != n) {
+	    if (remotes[i]->is_ready()) {
+		run(remotes[i]);
+		swap(remotes[i], remotes[--n]);
+	    } else {
+		++i;
+	    }
+	}
+	return n;
+    };
+
 #ifdef HAVE_POLL
-    size_t n_remotes = remotes.size();
-    if (n_remotes <= 1) {
+    size_t n_remotes = run_ready(remotes.size());
+    bool hedging = false;
+    for (size_t i = 0; i != n_remotes; ++i) {
+	if (remotes[i]->get_hedge_time() != 0.0) {
+	    hedging = true;
+	    break;
+	}
+    }
+    if (n_remotes == 0 || (n_remotes == 1 && !hedging && deadline == 0.0)) {
 	// We only need to use poll() when there are at least 2 remote
-	// databases we need to wait for.
+	// databases we need to wait for, or we may need to hedge or give up
+	// waiting.
 	if (n_remotes == 1) {
 	    // Just execute action and block if it's not ready.
-	    action(remotes[0].get());
+	    run(remotes[0]);
 	}
+	purge_remotes();
 	return;
     }
 
-    unique_ptr<struct pollfd[]> fds(new struct pollfd[n_remotes]);
+    // Entry 2 * i is for remotes[i] and entry 2 * i + 1 for the replica it
+    // has hedged the query to (with fd -1, which poll() ignores, if it
+    // hasn't).
+    unique_ptr<struct pollfd[]> fds(new struct pollfd[n_remotes * 2]);
     for (size_t i = 0; i != n_remotes; ++i) {
-	fds[i].fd = remotes[i]->get_read_fd();
-	fds[i].events = POLLIN;
-	fds[i].revents = 0;
+	fds[i * 2].fd = remotes[i]->get_read_fd();
+	fds[i * 2 + 1].fd = -1;
+	fds[i * 2].events = fds[i * 2 + 1].events = POLLIN;
+	fds[i * 2].revents = fds[i * 2 + 1].revents = 0;
     }
+    bool past_deadline = false;
     do {
-	int r = poll(fds.get(), n_remotes, -1);
-	if (r <= 0) {
-	    // We shouldn't get a timeout, but if we do retry.
-	    if (r == 0 || errno == EINTR || errno == EAGAIN) {
+	int timeout = -1;
+	double now = 0.0;
+	if (hedging || deadline != 0.0) now = RealTime::now();
+	if (hedging) {
+	    // Wake up when it's time to hedge the next query.
+	    hedging = false;
+	    for (size_t i = 0; i != n_remotes; ++i) {
+		double hedge_time = remotes[i]->get_hedge_time();
+		if (hedge_time == 0.0) continue;
+		if (hedge_time <= now && remotes[i]->maybe_hedge(now)) {
+		    fds[i * 2 + 1].fd = remotes[i]->get_hedge_read_fd();
+		    continue;
+		}
+		int ms = max(0, int(ceil((hedge_time - now) * 1000.0)));
+		if (timeout < 0 || ms < timeout) timeout = ms;
+		hedging = true;
+	    }
+	}
+	if (deadline != 0.0) {
+	    // Once the deadline has passed, make a final check for any
+	    // remotes which are ready.
+	    int ms = max(0, int(ceil((deadline - now) * 1000.0)));
+	    if (timeout < 0 || ms < timeout) timeout = ms;
+	    past_deadline = (ms == 0);
+	}
+	int r = poll(fds.get(), n_remotes * 2, timeout);
+	if (r < 0) {
+	    if (errno == EINTR || errno == EAGAIN) {
 		continue;
 	    }
 	    throw Xapian::NetworkError("poll() failed waiting for remotes",
@@ -104,27 +169,40 @@ Matcher::for_all_remotes(Action action)
 	}
 	size_t i = 0;
 	while (i != n_remotes) {
-	    if (fds[i].revents) {
-		action(remotes[i].get());
+	    bool ready = fds[i * 2].revents != 0 && remotes[i]->input_ready();
+	    if (!ready && fds[i * 2 + 1].revents) {
+		ready = remotes[i]->hedge_ready();
+		fds[i * 2 + 1].fd = remotes[i]->get_hedge_read_fd();
+		fds[i * 2 + 1].revents = 0;
+	    }
+	    if (ready) {
+		run(remotes[i]);
 		// Swap such that entries we still need to handle are first.
 		swap(remotes[i], remotes[--n_remotes]);
-		fds[i] = fds[n_remotes];
-		// r is number of ready fds.
-		if (--r == 0) break;
+		fds[i * 2] = fds[n_remotes * 2];
+		fds[i * 2 + 1] = fds[n_remotes * 2 + 1];
 	    } else {
 		++i;
 	    }
 	}
-    } while (n_remotes > 1);
+	if (past_deadline) {
+	    // Give up on any remotes which still aren't ready.
+	    while (n_remotes) {
+		drop_remote(remotes[--n_remotes]);
+	    }
+	}
+    } while (n_remotes > 1 ||
+	     (n_remotes == 1 && (hedging || deadline != 0.0 ||
+				 fds[1].fd != -1)));
 
     // If there's only one remote left just execute action and block if it's
     // not ready.
     if (n_remotes == 1) {
-	action(remotes[0].get());
+	run(remotes[0]);
     }
 #else
 #ifndef __WIN32__
-    size_t n_remotes = first_oversize;
+    size_t n_remotes = run_ready(first_oversize);
     fd_set fds;
     while (n_remotes > 1) {
 	int nfds = 0;
@@ -149,7 +227,7 @@ Matcher::for_all_remotes(Action action)
 	while (i != n_remotes) {
 	    int fd = remotes[i]->get_read_fd();
 	    if (FD_ISSET(fd, &fds)) {
-		action(remotes[i].get());
+		run(remotes[i]);
 		// Swap such that entries we still need to handle are first.
 		swap(remotes[i], remotes[--n_remotes]);
 		// r is number of ready fds.
@@ -163,15 +241,34 @@ Matcher::for_all_remotes(Action action)
     // If there's only one remote left just execute action and block if it's
     // not ready.
     if (n_remotes == 1) {
-	action(remotes[0].get());
+	run(remotes[0]);
     }
 #endif
 
     // Handle any remotes with fd >= FD_SETSIZE
     for (size_t i = first_oversize; i != remotes.size(); ++i) {
-	action(remotes[i].get());
+	run(remotes[i]);
     }
 #endif
+    purge_remotes();
+}
+
+void
+Matcher::drop_remote(unique_ptr<RemoteSubMatch>& submatch)
+{
+    missing_shards.push_back(submatch->get_shard());
+    submatch.reset();
+}
+
+void
+Matcher::purge_remotes()
+{
+#ifndef HAVE_POLL
+    first_oversize -= count(remotes.begin(), remotes.begin() + first_oversize,
+			    nullptr);
+#endif
+    remotes.erase(remove(remotes.begin(), remotes.end(), nullptr),
+		  remotes.end());
 }
 #endif
 
@@ -192,12 +289,20 @@ Matcher::Matcher(const Xapian::Database& db_,
 		 Xapian::Enquire::Internal::sort_setting sort_by,
 		 bool sort_val_reverse,
 		 double time_limit,
+		 double shard_timeout,
 		 const vector<opt_intrusive_ptr<Xapian::MatchSpy>>& matchspies)
     : db(db_), query(query_), full_db_has_positions(full_db_has_positions_)
 {
     // An empty query should get handled higher up.
     Assert(!query.empty());
 
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    if (shard_timeout > 0.0)
+	deadline = RealTime::end_time(shard_timeout);
+#else
+    (void)shard_timeout;
+#endif
+
     Xapian::doccount n_shards = db.internal->size();
     vector<Xapian::RSet> subrsets;
     if (rset && rset->internal.get()) {
@@ -220,15 +325,27 @@ Matcher::Matcher(const Xapian::Database& db_,
 		unimplemented("Xapian::MatchDecider not supported by the "
 			      "remote backend");
 	    }
-	    as_rem->set_query(query, query_length,
-			      collapse_key, collapse_max,
-			      order, sort_key, sort_by, sort_val_reverse,
-			      time_limit,
-			      n_shards == 1 ? percent_threshold : 0,
-			      weight_threshold,
-			      wtscheme,
-			      subrsets[i], matchspies,
-			      full_db_has_positions);
+	    if (deadline != 0.0 && as_rem->is_busy()) {
+		// The server is still working on a query we gave up waiting
+		// for, so don't wait for it now.
+		missing_shards.push_back(i);
+		continue;
+	    }
+	    try {
+		as_rem->set_query(query, query_length,
+				  collapse_key, collapse_max,
+				  order, sort_key, sort_by, sort_val_reverse,
+				  time_limit,
+				  n_shards == 1 ? percent_threshold : 0,
+				  weight_threshold,
+				  wtscheme,
+				  subrsets[i], matchspies,
+				  full_db_has_positions);
+	    } catch (const Xapian::NetworkError&) {
+		if (deadline == 0.0) throw;
+		missing_shards.push_back(i);
+		continue;
+	    }
 	    remotes.emplace_back(new RemoteSubMatch(as_rem, i));
 	    continue;
 	}
@@ -532,6 +649,8 @@ Matcher::get_mset(Xapian::doccount first,
 		  Xapian::Enquire::Internal::sort_setting sort_by,
 		  bool sort_val_reverse,
 		  double time_limit,
+		  Xapian::doccount document_prefetch,
+		  double hedge_delay,
 		  const vector<opt_intrusive_ptr<Xapian::MatchSpy>>& matchspies)
 {
     AssertRel(check_at_least, >=, first + maxitems);
@@ -539,12 +658,25 @@ Matcher::get_mset(Xapian::doccount first,
     Assert(!query.empty());
 
 #ifdef XAPIAN_HAS_REMOTE_BACKEND
-    if (locals.empty() && remotes.size() == 1) {
+    if (locals.empty() && remotes.size() == 1 && db.internal->size() == 1) {
 	// Short cut for a single remote database.
 	Assert(remotes[0].get());
-	remotes[0]->start_match(first, maxitems, check_at_least, sorter,
-				stats);
-	return remotes[0]->get_mset(matchspies);
+	try {
+	    remotes[0]->start_match(first, maxitems, check_at_least, sorter,
+				    stats, min(document_prefetch, maxitems),
+				    hedge_delay);
+	} catch (const Xapian::NetworkError&) {
+	    if (deadline == 0.0) throw;
+	    drop_remote(remotes[0]);
+	    purge_remotes();
+	    return Xapian::MSet();
+	}
+	Xapian::MSet mset;
+	for_all_remotes(
+	    [&](RemoteSubMatch* submatch) {
+		mset = submatch->get_mset(matchspies);
+	    });
+	return mset;
     }
 #endif
 
@@ -568,9 +700,20 @@ Matcher::get_mset(Xapian::doccount first,
 	    AssertRel(check_at_least, >=, first + maxitems);
 	    remote_maxitems = check_at_least;
 	}
-	submatch->start_match(0, remote_maxitems, check_at_least, sorter,
-			      stats);
+	// Similarly, any of the first "first" results from a remote might end
+	// up in the part of the merged MSet to prefetch documents for.
+	Xapian::doccount remote_prefetch = 0;
+	if (document_prefetch)
+	    remote_prefetch = first + min(document_prefetch, maxitems);
+	try {
+	    submatch->start_match(0, remote_maxitems, check_at_least, sorter,
+				  stats, remote_prefetch, hedge_delay);
+	} catch (const Xapian::NetworkError&) {
+	    if (deadline == 0.0) throw;
+	    drop_remote(submatch);
+	}
     }
+    purge_remotes();
 #endif
 
     Xapian::MSet local_mset;
@@ -645,7 +788,9 @@ Matcher::get_mset(Xapian::doccount first,
 	    msets.push_back({local_mset, 0});
 	merged_mset.internal->merge_stats(local_mset.internal.get(),
 					  collapse_max != 0);
-	merged_mset.internal->stats->merge(stats);
+	// If no remote shards responded, our caller will use stats.
+	if (merged_mset.internal->stats)
+	    merged_mset.internal->stats->merge(stats);
     }
 
     if (merged_mset.internal->max_possible == 0.0) {
@@ -78,8 +78,19 @@ class Matcher {
      */
     std::size_t first_oversize;
 # endif
+
+    /** Time by which remote shards must respond (0.0 for no deadline).
+     *
+     *  If set, remote shards which don't respond by this time (or which fail
+     *  with a NetworkError) are dropped from the match rather than causing
+     *  an exception.
+     */
+    double deadline = 0.0;
 #endif
 
+    /// Indices of any shards dropped from the match.
+    std::vector<Xapian::doccount> missing_shards;
+
     bool full_db_has_positions;
 
     Matcher(const Matcher&) = delete;
@@ -107,6 +118,20 @@ class Matcher {
     /// Perform action on remotes as they become ready using poll() or select().
     template<typename Action> void for_all_remotes(Action action);
 
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    /** Drop a remote shard from the match.
+     *
+     *  Used when returning partial results and the shard fails or doesn't
+     *  respond by @a deadline.
+     *
+     *  @param submatch	The entry in @a remotes for the shard, which is reset.
+     */
+    void drop_remote(std::unique_ptr<RemoteSubMatch>& submatch);
+
+    /// Remove entries for dropped shards from @a remotes.
+    void purge_remotes();
+#endif
+
   public:
     /** Constructor.
      *
@@ -130,6 +155,10 @@ class Matcher {
      *  @param sort_val_reverse	Reverse direction keys sort in?
      *  @param time_limit	time in seconds after which to disable
      *				check_at_least (0.0 means don't).
+     *  @param shard_timeout	time in seconds to wait for remote shards,
+     *				after which they're dropped from the match
+     *				(0.0 means wait indefinitely and throw an
+     *				exception if any fail).
      *  @param matchspies	MatchSpy objects to use
      */
     Matcher(const Xapian::Database& db_,
@@ -149,6 +178,7 @@ class Matcher {
 	    Xapian::Enquire::Internal::sort_setting sort_by,
 	    bool sort_val_reverse,
 	    double time_limit,
+	    double shard_timeout,
 	    const std::vector<opt_ptr_spy>& matchspies);
 
     /** Run the match and produce an MSet object.
@@ -185,6 +215,13 @@ class Matcher {
      *  @param sort_val_reverse	Reverse direction keys sort in?
      *  @param time_limit	time in seconds after which to disable
      *				check_at_least (0.0 means don't).
+     *  @param document_prefetch	Number of documents from the start of
+     *				the MSet which remote servers should send
+     *				with their results.
+     *  @param hedge_delay	Seconds to wait for results from a remote
+     *				shard before hedging the query to a replica
+     *				(0 means use recent latencies; < 0 means
+     *				don't hedge).
      *  @param matchspies	MatchSpy objects to use
      */
     Xapian::MSet get_mset(Xapian::doccount first,
@@ -203,7 +240,14 @@ class Matcher {
 			  Xapian::Enquire::Internal::sort_setting sort_by,
 			  bool sort_val_reverse,
 			  double time_limit,
+			  Xapian::doccount document_prefetch,
+			  double hedge_delay,
 			  const std::vector<opt_ptr_spy>& matchspies);
+
+    /// Return the indices of any shards dropped from the match.
+    const std::vector<Xapian::doccount>& get_missing_shards() const {
+	return missing_shards;
+    }
 };
 
 #endif // XAPIAN_INCLUDED_MATCHER_H
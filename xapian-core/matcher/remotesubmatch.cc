@@ -25,6 +25,8 @@
 
 #include "debuglog.h"
 #include "backends/remote/remote-database.h"
+#include "omassert.h"
+#include "realtime.h"
 #include "weight/weightinternal.h"
 
 using namespace std;
@@ -43,8 +45,90 @@ RemoteSubMatch::start_match(Xapian::doccount first,
 			    Xapian::doccount maxitems,
 			    Xapian::doccount check_at_least,
 			    const Xapian::KeyMaker* sorter,
-			    Xapian::Weight::Internal & total_stats)
+			    Xapian::Weight::Internal & total_stats,
+			    Xapian::doccount prefetch,
+			    double hedge_delay)
 {
-    LOGCALL_VOID(MATCH, "RemoteSubMatch::start_match", first | maxitems | check_at_least | sorter | total_stats);
-    db->send_global_stats(first, maxitems, check_at_least, sorter, total_stats);
+    LOGCALL_VOID(MATCH, "RemoteSubMatch::start_match", first | maxitems | check_at_least | sorter | total_stats | prefetch | hedge_delay);
+    db->send_global_stats(first, maxitems, check_at_least, sorter, total_stats,
+			  prefetch);
+    hedge_time = 0.0;
+    hedge_db = NULL;
+    hedge_stats_pending = false;
+    hedge_won = false;
+    if (!db->has_replicas())
+	return;
+    start_time = RealTime::now();
+#ifdef HAVE_POLL
+    // Hedging relies on the matcher being able to wait for both the database
+    // and the replica with a timeout, which we only implement using poll().
+    if (hedge_delay == 0.0)
+	hedge_delay = db->get_hedge_delay();
+    if (hedge_delay > 0.0)
+	hedge_time = start_time + hedge_delay;
+#else
+    (void)hedge_delay;
+#endif
+}
+
+bool
+RemoteSubMatch::maybe_hedge(double now)
+{
+    LOGCALL(MATCH, bool, "RemoteSubMatch::maybe_hedge", now);
+    if (hedge_time == 0.0 || now < hedge_time)
+	RETURN(false);
+    hedge_time = 0.0;
+    try {
+	hedge_db = db->send_hedge();
+    } catch (const Xapian::Error&) {
+	// If the replica is unusable, just carry on waiting for db.
+	RETURN(false);
+    }
+    if (!hedge_db)
+	RETURN(false);
+    hedge_stats_pending = true;
+    RETURN(true);
+}
+
+bool
+RemoteSubMatch::hedge_ready()
+{
+    LOGCALL(MATCH, bool, "RemoteSubMatch::hedge_ready", NO_ARGS);
+    Assert(hedge_db);
+    if (hedge_stats_pending) {
+	try {
+	    // We've already used the stats from db.
+	    Xapian::Weight::Internal dummy;
+	    hedge_db->get_remote_stats(dummy);
+	} catch (const Xapian::Error&) {
+	    hedge_db = NULL;
+	    RETURN(false);
+	}
+	hedge_stats_pending = false;
+	// The results may have arrived along with the stats.
+	if (!hedge_db->has_buffered_input())
+	    RETURN(false);
+    }
+    hedge_won = true;
+    RETURN(true);
+}
+
+Xapian::MSet
+RemoteSubMatch::get_mset(const vector<opt_ptr_spy>& matchspies)
+{
+    LOGCALL(MATCH, Xapian::MSet, "RemoteSubMatch::get_mset", matchspies.size());
+    if (hedge_won) {
+	try {
+	    Xapian::MSet mset = hedge_db->get_mset(matchspies);
+	    db->set_hedge_winner(hedge_db);
+	    db->record_latency(RealTime::now() - start_time);
+	    RETURN(mset);
+	} catch (const Xapian::Error&) {
+	    // Fall back to waiting for the results from db.
+	}
+    }
+    Xapian::MSet mset = db->get_mset(matchspies);
+    if (db->has_replicas())
+	db->record_latency(RealTime::now() - start_time);
+    RETURN(mset);
 }
@@ -43,6 +43,21 @@ class RemoteSubMatch {
     /// Index of this subdatabase.
     Xapian::doccount shard;
 
+    /// The time the match was started (only set if db has replicas).
+    double start_time = 0.0;
+
+    /// The time to hedge the query to a replica at, or 0.0 not to.
+    double hedge_time = 0.0;
+
+    /// The replica we've hedged the query to, or NULL.
+    const RemoteDatabase* hedge_db = NULL;
+
+    /// Do we still need to read REPLY_STATS from hedge_db?
+    bool hedge_stats_pending = false;
+
+    /// Should the results be read from hedge_db?
+    bool hedge_won = false;
+
   public:
     /// Constructor.
     RemoteSubMatch(const RemoteDatabase* db_, Xapian::doccount shard_)
@@ -52,6 +67,58 @@ class RemoteSubMatch {
 	return db->get_read_fd();
     }
 
+    /** Can the next step be performed without waiting for the server?
+     *
+     *  This is the case for prepare_match() if the statistics for the query
+     *  are cached.
+     */
+    bool is_ready() const { return db->have_cached_stats(); }
+
+    /** Handle input from the server.
+     *
+     *  Call when get_read_fd() is ready to read.
+     *
+     *  @return true if the reply the next step needs may be ready, or false
+     *		if we need to wait for more input.
+     */
+    bool input_ready() const {
+	if (!db->have_unread_stats()) return true;
+	// Skip the REPLY_STATS we didn't need to wait for.
+	db->read_unread_stats();
+	return db->has_buffered_input();
+    }
+
+    /** Return the time at which the query should be hedged.
+     *
+     *  @return The time (as returned by RealTime::now()), or 0.0 if the
+     *		query isn't going to be hedged (or already has been).
+     */
+    double get_hedge_time() const { return hedge_time; }
+
+    /** Hedge the query to a replica if it's time to.
+     *
+     *  @param now	The current time.
+     *
+     *  @return true if the query was sent to a replica.
+     */
+    bool maybe_hedge(double now);
+
+    /// The fd to read replies to a hedged query from, or -1 if not hedged.
+    int get_hedge_read_fd() const {
+	return hedge_db ? hedge_db->get_read_fd() : -1;
+    }
+
+    /** Handle input from the replica we hedged the query to.
+     *
+     *  Call when get_hedge_read_fd() is ready to read.  If there's a problem
+     *  with the replica, we give up on it and get_hedge_read_fd() will
+     *  then return -1.
+     *
+     *  @return true if the replica's results are ready (and will be what
+     *		get_mset() returns).
+     */
+    bool hedge_ready();
+
     /** Fetch and collate statistics.
      *
      *  Before we can calculate term weights we need to fetch statistics from
@@ -69,12 +136,19 @@ class RemoteSubMatch {
      *  @param check_at_least The minimum number of items to check.
      *  @param sorter	      KeyMaker for sort keys (NULL for none).
      *  @param total_stats    The total statistics for the collection.
+     *  @param prefetch	      Number of documents from the start of the MSet
+     *			      to have the server send with the results.
+     *  @param hedge_delay    Seconds to wait for results before hedging the
+     *			      query to a replica (0 to use the 95th percentile
+     *			      of recent latencies; < 0 to never hedge).
      */
     void start_match(Xapian::doccount first,
 		     Xapian::doccount maxitems,
 		     Xapian::doccount check_at_least,
 		     const Xapian::KeyMaker* sorter,
-		     Xapian::Weight::Internal& total_stats);
+		     Xapian::Weight::Internal& total_stats,
+		     Xapian::doccount prefetch,
+		     double hedge_delay);
 
     typedef Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy> opt_ptr_spy;
 
@@ -82,9 +156,7 @@ class RemoteSubMatch {
      *
      *  @param matchspies   The matchspies to use.
      */
-    Xapian::MSet get_mset(const std::vector<opt_ptr_spy>& matchspies) {
-	return db->get_mset(matchspies);
-    }
+    Xapian::MSet get_mset(const std::vector<opt_ptr_spy>& matchspies);
 
     /// Return the index of the corresponding Database shard.
     Xapian::doccount get_shard() const { return shard; }
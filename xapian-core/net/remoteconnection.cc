@@ -32,6 +32,12 @@
 #else
 # include "safesysselect.h"
 #endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #include <algorithm>
 #include <cerrno>
@@ -42,6 +48,7 @@
 # include <type_traits>
 #endif
 
+#include "compression_stream.h"
 #include "debuglog.h"
 #include "fd.h"
 #include "filetests.h"
@@ -56,6 +63,19 @@ using namespace std;
 
 #define CHUNKSIZE 4096
 
+/// Bit set in the message type code of a compressed message.
+#define COMPRESSED_MESSAGE 0x80
+
+/// Don't try to compress messages smaller than this.
+#define MIN_COMPRESS_SIZE 1024
+
+/** Don't try to compress messages or files larger than this.
+ *
+ *  We need the whole of a message or file in memory to compress it, plus a
+ *  buffer of the same size for the output.
+ */
+#define MAX_COMPRESS_SIZE (64 << 20)
+
 [[noreturn]]
 static void
 throw_database_closed()
@@ -86,6 +106,22 @@ update_overlapped_offset(WSAOVERLAPPED & overlapped, DWORD n)
 }
 #endif
 
+int
+parse_compression_name(const string& name)
+{
+    for (unsigned type = 0; type != COMPRESS_MAX_; ++type) {
+	if (name == CompressionStream::type_name(compression_type(type))) {
+	    if (!CompressionStream::supported(compression_type(type))) {
+		throw Xapian::FeatureUnavailableError(name + " compression "
+						      "support not enabled");
+	    }
+	    return int(type);
+	}
+    }
+    throw Xapian::InvalidArgumentError("Unknown compression type '" + name +
+				       "'");
+}
+
 RemoteConnection::RemoteConnection(int fdin_, int fdout_,
 				   const string & context_)
     : fdin(fdin_), fdout(fdout_), context(context_)
@@ -100,20 +136,119 @@ RemoteConnection::RemoteConnection(int fdin_, int fdout_,
 #endif
 }
 
-#ifdef __WIN32__
 RemoteConnection::~RemoteConnection()
 {
+#ifdef __WIN32__
     if (overlapped.hEvent)
 	CloseHandle(overlapped.hEvent);
-}
 #endif
+}
+
+void
+RemoteConnection::set_compression(int type)
+{
+    if (type >= 0) {
+	if (!compressor) compressor.reset(new CompressionStream);
+	// This throws FeatureUnavailableError if type isn't supported.
+	compressor->set_type(compression_type(type));
+    }
+    compression = type;
+}
+
+unsigned
+RemoteConnection::get_supported_compression()
+{
+    unsigned mask = 0;
+    for (unsigned type = 0; type != COMPRESS_MAX_; ++type) {
+	if (CompressionStream::supported(compression_type(type)))
+	    mask |= 1u << type;
+    }
+    return mask;
+}
+
+const char*
+RemoteConnection::compress_message(const char* data, size_t* p_size,
+				   string& header)
+{
+    size_t size = *p_size;
+    if (compression < 0 ||
+	size < MIN_COMPRESS_SIZE || size > MAX_COMPRESS_SIZE) {
+	return NULL;
+    }
+
+    compressor->set_type(compression_type(compression));
+    const char* out = compressor->compress(data, p_size);
+    if (!out) return NULL;
+
+    string prefix;
+    prefix += char(compression);
+    pack_uint(prefix, size);
+    if (prefix.size() + *p_size >= size) {
+	// Not worth it once we add the prefix.
+	return NULL;
+    }
+    header[0] = char(header[0] | COMPRESSED_MESSAGE);
+    header.resize(1);
+    pack_uint(header, prefix.size() + *p_size);
+    header += prefix;
+    return out;
+}
+
+void
+RemoteConnection::decompress_message(const char* p, size_t len,
+				     string& result)
+{
+    const char* p_end = p + len;
+    size_t size;
+    if (p == p_end) {
+	throw Xapian::NetworkError("Bad compressed message", context);
+    }
+    unsigned type = static_cast<unsigned char>(*p++);
+    if (!unpack_uint(&p, p_end, &size) ||
+	size > MAX_COMPRESS_SIZE ||
+	size_t(p_end - p) > size_t(INT_MAX)) {
+	throw Xapian::NetworkError("Bad compressed message", context);
+    }
+    if (!CompressionStream::supported(compression_type(type))) {
+	string msg = "Received message compressed using unsupported "
+		     "algorithm ";
+	msg += CompressionStream::type_name(compression_type(type));
+	throw Xapian::NetworkError(msg, context);
+    }
+
+    if (!compressor) compressor.reset(new CompressionStream);
+    compressor->set_type(compression_type(type));
+    result.resize(0);
+    result.reserve(size);
+    try {
+	compressor->decompress_start();
+	// Pass the claimed size as a limit so a bogus message can't make us
+	// inflate an unbounded amount of data.
+	if (compressor->decompress_chunk(p, int(p_end - p), result, size) &&
+	    result.size() == size) {
+	    return;
+	}
+    } catch (const Xapian::DatabaseError& e) {
+	throw Xapian::NetworkError("Bad compressed message: " + e.get_msg(),
+				   context);
+    }
+    throw Xapian::NetworkError("Bad compressed message", context);
+}
 
 bool
 RemoteConnection::read_at_least(size_t min_len, double end_time)
 {
     LOGCALL(REMOTE, bool, "RemoteConnection::read_at_least", min_len | end_time);
 
-    if (buffer.length() >= min_len) RETURN(true);
+    if (buffered() >= min_len) RETURN(true);
+
+    // Discard processed input before reading more.  This way we move any
+    // unprocessed input at most once per read, rather than erasing from the
+    // start of buffer after every message.
+    if (buffer_start) {
+	buffer.erase(0, buffer_start);
+	buffer_start = 0;
+    }
 
 #ifdef __WIN32__
     HANDLE hin = fd_to_handle(fdin);
@@ -156,10 +291,23 @@ RemoteConnection::read_at_least(size_t min_len, double end_time)
 
     while (true) {
 	char buf[CHUNKSIZE];
-	ssize_t received = read(fdin, buf, sizeof(buf));
+	char* p = buf;
+	size_t n = sizeof(buf);
+	size_t old_size = buffer.size();
+	if (min_len - old_size > sizeof(buf)) {
+	    // Read the rest of a large message straight into buffer.
+	    buffer.resize(min_len);
+	    p = &buffer[old_size];
+	    n = min_len - old_size;
+	}
+	ssize_t received = read(fdin, p, n);
+	if (p == buf) {
+	    if (received > 0) buffer.append(buf, received);
+	} else {
+	    buffer.resize(old_size + max(received, ssize_t(0)));
+	}
 
 	if (received > 0) {
-	    buffer.append(buf, received);
 	    if (buffer.length() >= min_len) RETURN(true);
 	    continue;
 	}
@@ -174,7 +322,10 @@ RemoteConnection::read_at_least(size_t min_len, double end_time)
 	if (errno != EAGAIN)
 	    throw Xapian::NetworkError("read failed", context, errno);
 
-	Assert(end_time != 0.0);
+	// Without an end_time, EAGAIN means a socket timeout set with
+	// SO_RCVTIMEO expired.
+	if (end_time == 0.0)
+	    throw_timeout("Timeout expired while trying to read", context);
 	while (true) {
 	    // Calculate how far in the future end_time is.
 	    double now = RealTime::now();
@@ -245,14 +396,24 @@ RemoteConnection::send_message(char type, const string &message,
     header += type;
     pack_uint(header, message.size());
 
+    const char* data = message.data();
+    size_t data_len = message.size();
+    const char* compressed = compress_message(data, &data_len, header);
+    if (compressed) {
+	data = compressed;
+    } else {
+	data_len = message.size();
+    }
+
 #ifdef __WIN32__
     HANDLE hout = fd_to_handle(fdout);
-    const string * str = &header;
+    const char* p = header.data();
+    size_t len = header.size();
 
     size_t count = 0;
     while (true) {
 	DWORD n;
-	BOOL ok = WriteFile(hout, str->data() + count, str->size() - count, &n, &overlapped);
+	BOOL ok = WriteFile(hout, p + count, len - count, &n, &overlapped);
 	if (!ok) {
 	    int errcode = GetLastError();
 	    if (errcode != ERROR_IO_PENDING)
@@ -275,9 +436,10 @@ RemoteConnection::send_message(char type, const string &message,
 	// We must update the offset in the OVERLAPPED structure manually.
 	update_overlapped_offset(overlapped, n);
 
-	if (count == str->size()) {
-	    if (str == &message || message.empty()) return;
-	    str = &message;
+	if (count == len) {
+	    if (p == data || data_len == 0) return;
+	    p = data;
+	    len = data_len;
 	    count = 0;
 	}
     }
@@ -288,76 +450,14 @@ RemoteConnection::send_message(char type, const string &message,
 				   context, errno);
     }
 
-    const string * str = &header;
-
-    size_t count = 0;
-    while (true) {
-	// We've set write to non-blocking, so just try writing as there
-	// will usually be space.
-	ssize_t n = write(fdout, str->data() + count, str->size() - count);
-
-	if (n >= 0) {
-	    count += n;
-	    if (count == str->size()) {
-		if (str == &message || message.empty()) return;
-		str = &message;
-		count = 0;
-	    }
-	    continue;
-	}
-
-	LOGLINE(REMOTE, "write gave errno = " << errno);
-	if (errno == EINTR) continue;
-
-	if (errno != EAGAIN)
-	    throw Xapian::NetworkError("write failed", context, errno);
-
-	double now = RealTime::now();
-	double time_diff = end_time - now;
-	if (time_diff < 0) {
-	    LOGLINE(REMOTE, "write: timeout has expired");
-	    throw_timeout("Timeout expired while trying to write", context);
-	}
-
-	// Wait until there is space or the timeout is reached.
-# ifdef HAVE_POLL
-	struct pollfd fds;
-	fds.fd = fdout;
-	fds.events = POLLOUT;
-	int result = poll(&fds, 1, int(time_diff * 1000));
-#  define POLLSELECT "poll"
-# else
-	if (fdout >= FD_SETSIZE) {
-	    // We can't block with a timeout, so just sleep and retry.
-	    RealTime::sleep(now + min(0.001, time_diff / 4));
-	    continue;
-	}
-
-	fd_set fdset;
-	FD_ZERO(&fdset);
-	FD_SET(fdout, &fdset);
-
-	struct timeval tv;
-	RealTime::to_timeval(time_diff, &tv);
-	int result = select(fdout + 1, 0, &fdset, 0, &tv);
-#  define POLLSELECT "select"
-# endif
-
-	if (result < 0) {
-	    if (errno == EINTR || errno == EAGAIN) {
-		// EINTR/EAGAIN means select was interrupted by a signal.
-		// We could just retry the poll/select, but it's easier to just
-		// retry the write.
-		continue;
-	    }
-	    throw Xapian::NetworkError(POLLSELECT " failed during write",
-				       context, errno);
-# undef POLLSELECT
-	}
-
-	if (result == 0)
-	    throw_timeout("Timeout expired while trying to write", context);
-    }
+    // Send the header and the message data together, without copying them
+    // into a single buffer first.
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(header.data());
+    iov[0].iov_len = header.size();
+    iov[1].iov_base = const_cast<char*>(data);
+    iov[1].iov_len = data_len;
+    write_iovec(iov, data_len == 0 ? 1 : 2, end_time);
 #endif
 }
 
@@ -371,7 +471,25 @@ RemoteConnection::send_file(char type, int fd, double end_time)
     off_t size = file_size(fd);
     if (errno)
 	throw Xapian::NetworkError("Couldn't stat file to send", errno);
-    // FIXME: Use sendfile() or similar if available?
+
+    if (compression >= 0 &&
+	size >= MIN_COMPRESS_SIZE && size <= MAX_COMPRESS_SIZE) {
+	// Read the file so we can send it as a compressed message.
+	string message(size_t(size), '\0');
+	size_t c = 0;
+	while (c != message.size()) {
+	    ssize_t res = read(fd, &message[c], message.size() - c);
+	    if (res < 0) {
+		if (errno == EINTR) continue;
+		throw Xapian::NetworkError("read failed", errno);
+	    }
+	    if (res == 0)
+		throw Xapian::NetworkError("File shrank while sending", context);
+	    c += res;
+	}
+	send_message(type, message, end_time);
+	return;
+    }
 
     char buf[CHUNKSIZE];
     buf[0] = type;
@@ -434,81 +552,49 @@ RemoteConnection::send_file(char type, int fd, double end_time)
 				   context, errno);
     }
 
-    size_t count = 0;
-    while (true) {
-	// We've set write to non-blocking, so just try writing as there
-	// will usually be space.
-	ssize_t n = write(fdout, buf + count, c - count);
-
-	if (n >= 0) {
-	    count += n;
-	    if (count == c) {
-		if (size == 0) return;
-
-		ssize_t res;
-		do {
-		    res = read(fd, buf, sizeof(buf));
-		} while (res < 0 && errno == EINTR);
-		if (res < 0) throw Xapian::NetworkError("read failed", errno);
-		c = size_t(res);
-
-		size -= c;
-		count = 0;
-	    }
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = c;
+    write_iovec(&iov, 1, end_time);
+
+# ifdef HAVE_SENDFILE
+    // Have the kernel copy the file contents straight to fdout.  If sendfile()
+    // can't handle this combination of file descriptors, we fall back to
+    // read() and write() for whatever is left.
+    while (size) {
+	size_t len = size_t(min(size, off_t(SSIZE_MAX)));
+	ssize_t n = sendfile(fdout, fd, NULL, len);
+	if (n > 0) {
+	    size -= n;
 	    continue;
 	}
 
-	LOGLINE(REMOTE, "write gave errno = " << errno);
-	if (errno == EINTR) continue;
+	if (n == 0)
+	    throw Xapian::NetworkError("File shrank while sending", context);
 
+	LOGLINE(REMOTE, "sendfile gave errno = " << errno);
+	if (errno == EINTR) continue;
+	if (errno == EINVAL || errno == ENOSYS) break;
 	if (errno != EAGAIN)
-	    throw Xapian::NetworkError("write failed", context, errno);
+	    throw Xapian::NetworkError("sendfile failed", context, errno);
 
-	double now = RealTime::now();
-	double time_diff = end_time - now;
-	if (time_diff < 0) {
-	    LOGLINE(REMOTE, "write: timeout has expired");
-	    throw_timeout("Timeout expired while trying to write", context);
-	}
-
-	// Wait until there is space or the timeout is reached.
-# ifdef HAVE_POLL
-	struct pollfd fds;
-	fds.fd = fdout;
-	fds.events = POLLOUT;
-	int result = poll(&fds, 1, int(time_diff * 1000));
-#  define POLLSELECT "poll"
-# else
-	if (fdout >= FD_SETSIZE) {
-	    // We can't block with a timeout, so just sleep and retry.
-	    RealTime::sleep(now + min(0.001, time_diff / 4));
-	    continue;
-	}
-
-	fd_set fdset;
-	FD_ZERO(&fdset);
-	FD_SET(fdout, &fdset);
-
-	struct timeval tv;
-	RealTime::to_timeval(time_diff, &tv);
-	int result = select(fdout + 1, 0, &fdset, 0, &tv);
-#  define POLLSELECT "select"
+	wait_for_write(end_time);
+    }
 # endif
 
-	if (result < 0) {
-	    if (errno == EINTR || errno == EAGAIN) {
-		// EINTR/EAGAIN means select was interrupted by a signal.
-		// We could just retry the poll/select, but it's easier to just
-		// retry the write.
-		continue;
-	    }
-	    throw Xapian::NetworkError(POLLSELECT " failed during write",
-				       context, errno);
-# undef POLLSELECT
-	}
-
-	if (result == 0)
-	    throw_timeout("Timeout expired while trying to write", context);
+    while (size) {
+	ssize_t res;
+	do {
+	    res = read(fd, buf, size_t(min(size, off_t(sizeof(buf)))));
+	} while (res < 0 && errno == EINTR);
+	if (res < 0) throw Xapian::NetworkError("read failed", errno);
+	if (res == 0)
+	    throw Xapian::NetworkError("File shrank while sending", context);
+	size -= res;
+
+	iov.iov_base = buf;
+	iov.iov_len = size_t(res);
+	write_iovec(&iov, 1, end_time);
     }
 #endif
 }
@@ -522,7 +608,7 @@ RemoteConnection::sniff_next_message_type(double end_time)
 
     if (!read_at_least(1, end_time))
 	RETURN(-1);
-    unsigned char type = buffer[0];
+    unsigned char type = buffered_data()[0] & ~COMPRESSED_MESSAGE;
     RETURN(type);
 }
 
@@ -537,32 +623,31 @@ RemoteConnection::get_message(string &result, double end_time)
 	RETURN(-1);
     // This code assume things about the pack_uint() encoding in order to
     // handle partial reads.
-    size_t len = static_cast<unsigned char>(buffer[1]);
-    if (len < 128) {
-	if (!read_at_least(len + 2, end_time))
+    size_t len = static_cast<unsigned char>(buffered_data()[1]);
+    size_t header_len = 2;
+    if (len >= 128) {
+	// We know the message payload is at least 128 bytes of data, and if
+	// we read that much we'll definitely have the whole of the length.
+	if (!read_at_least(128 + 2, end_time))
 	    RETURN(-1);
-	result.assign(buffer.data() + 2, len);
-	unsigned char type = buffer[0];
-	buffer.erase(0, len + 2);
-	RETURN(type);
-    }
-
-    // We know the message payload is at least 128 bytes of data, and if we
-    // read that much we'll definitely have the whole of the length.
-    if (!read_at_least(128 + 2, end_time))
-	RETURN(-1);
-    const char* p = buffer.data();
-    const char* p_end = p + buffer.size();
-    ++p;
-    if (!unpack_uint(&p, p_end, &len)) {
-	RETURN(-1);
+	const char* p = buffered_data();
+	const char* p_end = p + buffered();
+	++p;
+	if (!unpack_uint(&p, p_end, &len)) {
+	    RETURN(-1);
+	}
+	header_len = (p - buffered_data());
     }
-    size_t header_len = (p - buffer.data());
     if (!read_at_least(header_len + len, end_time))
 	RETURN(-1);
-    result.assign(buffer.data() + header_len, len);
-    unsigned char type = buffer[0];
-    buffer.erase(0, header_len + len);
+    unsigned char type = buffered_data()[0];
+    if (type & COMPRESSED_MESSAGE) {
+	decompress_message(buffered_data() + header_len, len, result);
+	type &= ~COMPRESSED_MESSAGE;
+    } else {
+	result.assign(buffered_data() + header_len, len);
+    }
+    consume(header_len + len);
     RETURN(type);
 }
 
@@ -578,35 +663,61 @@ RemoteConnection::get_message_chunked(double end_time)
 	RETURN(-1);
     // This code assume things about the pack_uint() encoding in order to
     // handle partial reads.
-    uint_least64_t len = static_cast<unsigned char>(buffer[1]);
-    if (len < 128) {
-	chunked_data_left = off_t(len);
-	char type = buffer[0];
-	buffer.erase(0, 2);
-	RETURN(type);
-    }
-
-    // We know the message payload is at least 128 bytes of data, and if we
-    // read that much we'll definitely have the whole of the length.
-    if (!read_at_least(128 + 2, end_time))
-	RETURN(-1);
-    const char* p = buffer.data();
-    const char* p_end = p + buffer.size();
-    ++p;
-    if (!unpack_uint(&p, p_end, &len)) {
-	RETURN(-1);
+    uint_least64_t len = static_cast<unsigned char>(buffered_data()[1]);
+    size_t header_len = 2;
+    if (len >= 128) {
+	// We know the message payload is at least 128 bytes of data, and if
+	// we read that much we'll definitely have the whole of the length.
+	if (!read_at_least(128 + 2, end_time))
+	    RETURN(-1);
+	const char* p = buffered_data();
+	const char* p_end = p + buffered();
+	++p;
+	if (!unpack_uint(&p, p_end, &len)) {
+	    RETURN(-1);
+	}
+	header_len = (p - buffered_data());
     }
     chunked_data_left = off_t(len);
     // Check that the value of len fits in an off_t without loss.
     if (rare(uint_least64_t(chunked_data_left) != len)) {
 	throw_network_error_insane_message_length();
     }
-    size_t header_len = (p - buffer.data());
-    unsigned char type = buffer[0];
-    buffer.erase(0, header_len);
+    unsigned char type = buffered_data()[0];
+    if (type & COMPRESSED_MESSAGE) {
+	// A compressed message can't be decompressed in chunks, so read all
+	// of it and replace it in buffer with the decompressed data, which
+	// the caller can then read in chunks as usual.
+	if (rare(len > MAX_COMPRESS_SIZE)) {
+	    throw_network_error_insane_message_length();
+	}
+	if (!read_at_least(header_len + size_t(len), end_time))
+	    RETURN(-1);
+	string data;
+	decompress_message(buffered_data() + header_len, size_t(len), data);
+	buffer.replace(buffer_start, header_len + size_t(len), data);
+	chunked_data_left = off_t(data.size());
+	RETURN(type & ~COMPRESSED_MESSAGE);
+    }
+    consume(header_len);
     RETURN(type);
 }
 
+/** Write n bytes from block pointed to by p to file descriptor fd. */
+static void
+write_all(int fd, const char * p, size_t n)
+{
+    while (n) {
+	ssize_t c = write(fd, p, n);
+	if (c < 0) {
+	    if (errno == EINTR) continue;
+	    throw Xapian::NetworkError("Error writing to file", errno);
+	}
+	p += c;
+	n -= c;
+    }
+}
+
 int
 RemoteConnection::get_message_chunk(string &result, size_t at_least,
 				    double end_time)
@@ -624,29 +735,16 @@ RemoteConnection::get_message_chunk(string &result, size_t at_least,
     if (!read_at_least(at_least, end_time))
 	RETURN(-1);
 
-    size_t retlen = min(off_t(buffer.size()), chunked_data_left);
-    result.append(buffer, 0, retlen);
-    buffer.erase(0, retlen);
+    size_t retlen = min(off_t(buffered()), chunked_data_left);
+    result.append(buffered_data(), retlen);
+    if (chunk_copy_fd >= 0)
+	write_all(chunk_copy_fd, buffered_data(), retlen);
+    consume(retlen);
     chunked_data_left -= retlen;
 
     RETURN(int(read_enough));
 }
 
-/** Write n bytes from block pointed to by p to file descriptor fd. */
-static void
-write_all(int fd, const char * p, size_t n)
-{
-    while (n) {
-	ssize_t c = write(fd, p, n);
-	if (c < 0) {
-	    if (errno == EINTR) continue;
-	    throw Xapian::NetworkError("Error writing to file", errno);
-	}
-	p += c;
-	n -= c;
-    }
-}
-
 int
 RemoteConnection::receive_file(const string &file, double end_time)
 {
@@ -664,9 +762,11 @@ RemoteConnection::receive_file(const string &file, double end_time)
 	off_t min_read = min(chunked_data_left, off_t(CHUNKSIZE));
 	if (!read_at_least(min_read, end_time))
 	    RETURN(-1);
-	write_all(fd, buffer.data(), min_read);
-	chunked_data_left -= min_read;
-	buffer.erase(0, min_read);
+	// Write out everything we've got for this message.
+	size_t len = size_t(min(off_t(buffered()), chunked_data_left));
+	write_all(fd, buffered_data(), len);
+	chunked_data_left -= len;
+	consume(len);
     } while (chunked_data_left);
     RETURN(type);
 }
@@ -717,6 +817,21 @@ RemoteConnection::shutdown()
     }
 }
 
+int
+RemoteConnection::release()
+{
+    LOGCALL(REMOTE, int, "RemoteConnection::release", NO_ARGS);
+
+    if (fdin < 0 || fdin != fdout || buffered() != 0) {
+	do_close();
+	RETURN(-1);
+    }
+
+    int fd = fdin;
+    fdin = fdout = -1;
+    RETURN(fd);
+}
+
 void
 RemoteConnection::do_close()
 {
@@ -753,4 +868,88 @@ RemoteConnection::calc_read_wait_msecs(double end_time)
     }
     return static_cast<DWORD>(time_diff * 1000.0);
 }
+#else
+void
+RemoteConnection::write_iovec(struct iovec* iov, int iovcnt, double end_time)
+{
+    while (true) {
+	// We've set write to non-blocking, so just try writing as there
+	// will usually be space.
+# ifdef HAVE_WRITEV
+	ssize_t n = writev(fdout, iov, iovcnt);
+# else
+	ssize_t n = write(fdout, iov->iov_base, iov->iov_len);
+# endif
+
+	if (n >= 0) {
+	    size_t count = n;
+	    while (count >= iov->iov_len) {
+		count -= iov->iov_len;
+		++iov;
+		if (--iovcnt == 0) return;
+	    }
+	    iov->iov_base = static_cast<char*>(iov->iov_base) + count;
+	    iov->iov_len -= count;
+	    continue;
+	}
+
+	LOGLINE(REMOTE, "write gave errno = " << errno);
+	if (errno == EINTR) continue;
+
+	if (errno != EAGAIN)
+	    throw Xapian::NetworkError("write failed", context, errno);
+
+	wait_for_write(end_time);
+    }
+}
+
+void
+RemoteConnection::wait_for_write(double end_time)
+{
+    double now = RealTime::now();
+    double time_diff = end_time - now;
+    if (time_diff < 0) {
+	LOGLINE(REMOTE, "write: timeout has expired");
+	throw_timeout("Timeout expired while trying to write", context);
+    }
+
+    // Wait until there is space or the timeout is reached.
+# ifdef HAVE_POLL
+    struct pollfd fds;
+    fds.fd = fdout;
+    fds.events = POLLOUT;
+    int result = poll(&fds, 1, int(time_diff * 1000));
+#  define POLLSELECT "poll"
+# else
+    if (fdout >= FD_SETSIZE) {
+	// We can't block with a timeout, so just sleep and retry.
+	RealTime::sleep(now + min(0.001, time_diff / 4));
+	return;
+    }
+
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(fdout, &fdset);
+
+    struct timeval tv;
+    RealTime::to_timeval(time_diff, &tv);
+    int result = select(fdout + 1, 0, &fdset, 0, &tv);
+#  define POLLSELECT "select"
+# endif
+
+    if (result < 0) {
+	if (errno == EINTR || errno == EAGAIN) {
+	    // EINTR/EAGAIN means select was interrupted by a signal.  We could
+	    // just retry the poll/select, but it's easier to just retry the
+	    // write.
+	    return;
+	}
+	throw Xapian::NetworkError(POLLSELECT " failed during write",
+				   context, errno);
+# undef POLLSELECT
+    }
+
+    if (result == 0)
+	throw_timeout("Timeout expired while trying to write", context);
+}
 #endif
@@ -22,9 +22,11 @@
 #define XAPIAN_INCLUDED_REMOTECONNECTION_H
 
 #include <cerrno>
+#include <memory>
 #include <string>
 
 #include "remoteprotocol.h"
+#include "xapian/visibility.h"
 #include "safenetdb.h" // For EAI_* constants.
 #include "safeunistd.h"
 
@@ -158,6 +160,8 @@ inline int eai_to_xapian(int e) {
     return e;
 }
 
+class CompressionStream;
+
 /** A RemoteConnection object provides a bidirectional connection to another
  *  RemoteConnection object on a remote machine.
  *
@@ -187,12 +191,70 @@ class RemoteConnection {
      */
     int fdout;
 
-    /// Buffer to hold unprocessed input.
+    /// Buffer to hold input.
     std::string buffer;
 
+    /** Offset of the first unprocessed byte in buffer.
+     *
+     *  Processed input is left at the start of buffer until we next need to
+     *  read more, rather than erasing it after each message is handled.
+     */
+    size_t buffer_start = 0;
+
+    /// Return the number of bytes of unprocessed input in buffer.
+    size_t buffered() const { return buffer.size() - buffer_start; }
+
+    /// Return a pointer to the unprocessed input in buffer.
+    const char* buffered_data() const { return buffer.data() + buffer_start; }
+
+    /// Mark the next @a n bytes of input in buffer as processed.
+    void consume(size_t n) {
+	buffer_start += n;
+	if (buffer_start == buffer.size()) {
+	    // Keep the allocated storage for the next message.
+	    buffer.resize(0);
+	    buffer_start = 0;
+	}
+    }
+
     /// Remaining bytes of message data still to come over fdin for a chunked read.
     off_t chunked_data_left;
 
+    /// File descriptor to copy data read by get_message_chunk() to, or -1.
+    int chunk_copy_fd = -1;
+
+    /** Compression algorithm to use for large outgoing messages.
+     *
+     *  A compression_type value, or -1 to not compress.
+     */
+    int compression = -1;
+
+    /// Compresses and decompresses messages (allocated when first needed).
+    std::unique_ptr<CompressionStream> compressor;
+
+    /** Compress message data if that's enabled and worthwhile.
+     *
+     *  @param data		The message data.
+     *  @param[in,out] p_size	The size of the message data.  Updated to
+     *				the size of the compressed data if this
+     *				returns non-NULL.
+     *  @param[in,out] header	The message header, which is updated to
+     *				describe the compressed message if this
+     *				returns non-NULL.
+     *
+     *  @return The compressed data, or NULL to send the data uncompressed.
+     */
+    const char* compress_message(const char* data, size_t* p_size,
+				 std::string& header);
+
+    /** Decompress the payload of a compressed message.
+     *
+     *  @param p	The compressed message payload.
+     *  @param len	The length of the compressed message payload.
+     *  @param[out] result	The decompressed message data.
+     */
+    void decompress_message(const char* p, size_t len, std::string& result);
+
     /** Read until there are at least min_len bytes in buffer.
      *
      *  If for some reason this isn't possible, returns false upon EOF and
@@ -220,6 +282,28 @@ class RemoteConnection {
      *  This will raise a timeout exception if end_time has already passed.
      */
     DWORD calc_read_wait_msecs(double end_time);
+#else
+    /** Write all of the data described by an array of iovec to fdout.
+     *
+     *  The entries in @a iov are updated to reflect partial writes.
+     *
+     *  @param iov	Array of iovec describing the data to write.
+     *  @param iovcnt	Number of entries in @a iov.
+     *  @param end_time	If this time is reached, then a timeout
+     *			exception will be thrown.  If (end_time == 0.0),
+     *			then keep trying indefinitely.
+     */
+    void write_iovec(struct iovec* iov, int iovcnt, double end_time);
+
+    /** Wait until fdout is writable.
+     *
+     *  May return early (e.g. if interrupted by a signal), so the caller
+     *  should just retry the write.
+     *
+     *  @param end_time	If this time is reached, then a timeout
+     *			exception will be thrown.
+     */
+    void wait_for_write(double end_time);
 #endif
 
   protected:
@@ -234,14 +318,63 @@ class RemoteConnection {
     RemoteConnection(int fdin_, int fdout_,
 		     const std::string & context_ = std::string());
 
-#ifdef __WIN32__
-    /// Destructor
+    /// Destructor.
     ~RemoteConnection();
-#endif
+
+    /** Compress large outgoing messages.
+     *
+     *  Compressed messages are marked as such and include the algorithm
+     *  used, so any RemoteConnection built with support for that algorithm
+     *  can read them.  This setting just controls what we send.
+     *
+     *  @param type	The compression_type to use, or -1 to not compress.
+     *
+     *  Throws Xapian::FeatureUnavailableError if support for @a type
+     *  wasn't enabled at build time.
+     */
+    void set_compression(int type);
+
+    /** Return the compression types we can decompress.
+     *
+     *  @return A bitmap with bit (1 << type) set for each compression_type
+     *		which this build supports.
+     */
+    static unsigned get_supported_compression();
+
+    /// Return the compression_type used for sending, or -1 for none.
+    int get_compression() const { return compression; }
 
     /** Return the underlying fd this remote connection reads from. */
     int get_read_fd() const { return fdin; }
 
+    /** Has input already been read which hasn't been processed yet?
+     *
+     *  If so, poll() or select() on get_read_fd() won't report that the
+     *  next message is ready.
+     */
+    bool has_buffered_input() const { return buffered() != 0; }
+
+    /** Set a file descriptor to copy chunked message data to.
+     *
+     *  All data subsequently returned by get_message_chunk() is also written
+     *  to @a fd, which allows a copy of a changeset to be kept as it is
+     *  applied.
+     *
+     *  @param fd	The file descriptor, or -1 to stop copying.
+     */
+    void set_chunk_copy_fd(int fd) { chunk_copy_fd = fd; }
+
+    /** Stop using the connection without closing it.
+     *
+     *  This allows the connection to be reused (e.g. by a connection pool).
+     *  If any unprocessed data has been read then whoever used the connection
+     *  next would see it, so in that case the connection is closed instead.
+     *
+     *  @return The fd (which is used in both directions), or -1 if the
+     *		connection was closed instead.
+     */
+    int release();
+
     /** Check what the next message type is.
      *
      *  This must not be called after a call to get_message_chunked() until
@@ -360,6 +493,21 @@ class RemoteConnection {
     void do_close();
 };
 
+/** Parse the name of a compression algorithm.
+ *
+ *  For use by server programs to handle a command line option.
+ *
+ *  @param name	The name ("zlib", "lz4" or "zstd").
+ *
+ *  @return The compression_type, for RemoteConnection::set_compression().
+ *
+ *  Throws Xapian::InvalidArgumentError if @a name isn't recognised, or
+ *  Xapian::FeatureUnavailableError if support for it wasn't enabled at build
+ *  time.
+ */
+XAPIAN_VISIBILITY_DEFAULT
+int parse_compression_name(const std::string& name);
+
 /** RemoteConnection which owns its own fd(s).
  *
  *  The object takes ownership of the fd(s) for the connection and will close
@@ -57,7 +57,10 @@
 // 44: pre-1.5.0 pack_uint() now used; many other changes
 // 44.1: pre-1.5.0 MSG_RECONSTRUCTTEXT added
 // 45: 1.5.0 Remote support for sorters
-#define XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION 45
+// 46: pre-1.5.0 MSG_GETMSET can ask for documents to be sent with the MSet.
+// 47: pre-1.5.0 Compressed messages; REPLY_UPDATE changed; MSG_COMPRESSION added
+// 48: pre-1.5.0 MSet serialised column by column
+#define XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION 48
 #define XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION 0
 
 /** Message types (client -> server).
@@ -104,6 +107,7 @@ enum message_type {
     MSG_ADDSYNONYM,		// Add a synonym
     MSG_REMOVESYNONYM,		// Remove a synonym
     MSG_CLEARSYNONYMS,		// Clear synonyms for a term
+    MSG_COMPRESSION,		// Agree to use compression
     MSG_MAX
 };
 
@@ -32,6 +32,7 @@
 #include "xapian/valueiterator.h"
 
 #include <signal.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <memory>
@@ -64,9 +65,9 @@ struct ConnectionClosed { };
 RemoteServer::RemoteServer(const vector<string>& dbpaths,
 			   int fdin_, int fdout_,
 			   double active_timeout_, double idle_timeout_,
-			   bool writable_)
+			   bool writable_, int compression_)
     : RemoteConnection(fdin_, fdout_, string()),
-      db(NULL), wdb(NULL), writable(writable_),
+      db(NULL), wdb(NULL), writable(writable_), compression(compression_),
       active_timeout(active_timeout_), idle_timeout(idle_timeout_)
 {
     // Catch errors opening the database and propagate them to the client.
@@ -98,6 +99,63 @@ RemoteServer::RemoteServer(const vector<string>& dbpaths,
 	throw;
     }
 
+    start();
+}
+
+RemoteServer::RemoteServer(const Xapian::Database& db_,
+			   const string& context_,
+			   int fdin_, int fdout_,
+			   double active_timeout_, double idle_timeout_,
+			   int compression_)
+    : RemoteConnection(fdin_, fdout_, context_),
+      db(new Xapian::Database(db_)), wdb(NULL), writable(false),
+      compression(compression_),
+      active_timeout(active_timeout_), idle_timeout(idle_timeout_)
+{
+    // Catch errors and propagate them to the client.
+    try {
+	// Make sure we're on the latest revision, as we would be if we'd just
+	// opened the database.
+	db->reopen();
+    } catch (const Xapian::Error &err) {
+	// Propagate the exception to the client.
+	send_message(REPLY_EXCEPTION, serialise_error(err));
+	// And rethrow it so our caller can log it and close the connection.
+	throw;
+    }
+
+    start();
+}
+
+RemoteServer::RemoteServer(const Xapian::WritableDatabase& wdb_,
+			   const string& path,
+			   int fdin_, int fdout_,
+			   double active_timeout_, double idle_timeout_,
+			   int compression_)
+    : RemoteConnection(fdin_, fdout_, path),
+      db(NULL), wdb(NULL), writable(true),
+      group_commit(true), group_wdb(wdb_), compression(compression_),
+      active_timeout(active_timeout_), idle_timeout(idle_timeout_)
+{
+    // Catch errors opening the database and propagate them to the client.
+    try {
+	// As in the normal case, we start off read-only, which means the
+	// client doesn't see other clients' uncommitted changes unless it
+	// asks for write access.
+	db = new Xapian::Database(path);
+    } catch (const Xapian::Error &err) {
+	// Propagate the exception to the client.
+	send_message(REPLY_EXCEPTION, serialise_error(err));
+	// And rethrow it so our caller can log it and close the connection.
+	throw;
+    }
+
+    start();
+}
+
+void
+RemoteServer::start()
+{
 #ifndef __WIN32__
     // It's simplest to just ignore SIGPIPE.  We'll still know if the
     // connection dies because we'll get EPIPE back from write().
@@ -157,159 +215,167 @@ typedef void (RemoteServer::* dispatch_func)(const string &);
 void
 RemoteServer::run()
 {
-    while (true) {
-	try {
-	    string message;
-	    size_t type = get_message(idle_timeout, message);
-	    switch (type) {
-		case MSG_ALLTERMS:
-		    msg_allterms(message);
-		    continue;
-		case MSG_COLLFREQ:
-		    msg_collfreq(message);
-		    continue;
-		case MSG_DOCUMENT:
-		    msg_document(message);
-		    continue;
-		case MSG_TERMEXISTS:
-		    msg_termexists(message);
-		    continue;
-		case MSG_TERMFREQ:
-		    msg_termfreq(message);
-		    continue;
-		case MSG_VALUESTATS:
-		    msg_valuestats(message);
-		    continue;
-		case MSG_KEEPALIVE:
-		    msg_keepalive(message);
-		    continue;
-		case MSG_DOCLENGTH:
-		    msg_doclength(message);
-		    continue;
-		case MSG_QUERY:
-		    msg_query(message);
-		    continue;
-		case MSG_TERMLIST:
-		    msg_termlist(message);
-		    continue;
-		case MSG_POSITIONLIST:
-		    msg_positionlist(message);
-		    continue;
-		case MSG_POSTLIST:
-		    msg_postlist(message);
-		    continue;
-		case MSG_REOPEN:
-		    msg_reopen(message);
-		    continue;
-		case MSG_UPDATE:
-		    msg_update(message);
-		    continue;
-		case MSG_ADDDOCUMENT:
-		    msg_adddocument(message);
-		    continue;
-		case MSG_CANCEL:
-		    msg_cancel(message);
-		    continue;
-		case MSG_DELETEDOCUMENTTERM:
-		    msg_deletedocumentterm(message);
-		    continue;
-		case MSG_COMMIT:
-		    msg_commit(message);
-		    continue;
-		case MSG_REPLACEDOCUMENT:
-		    msg_replacedocument(message);
-		    continue;
-		case MSG_REPLACEDOCUMENTTERM:
-		    msg_replacedocumentterm(message);
-		    continue;
-		case MSG_DELETEDOCUMENT:
-		    msg_deletedocument(message);
-		    continue;
-		case MSG_WRITEACCESS:
-		    msg_writeaccess(message);
-		    continue;
-		case MSG_GETMETADATA:
-		    msg_getmetadata(message);
-		    continue;
-		case MSG_SETMETADATA:
-		    msg_setmetadata(message);
-		    continue;
-		case MSG_ADDSPELLING:
-		    msg_addspelling(message);
-		    continue;
-		case MSG_REMOVESPELLING:
-		    msg_removespelling(message);
-		    continue;
-		case MSG_METADATAKEYLIST:
-		    msg_metadatakeylist(message);
-		    continue;
-		case MSG_FREQS:
-		    msg_freqs(message);
-		    continue;
-		case MSG_UNIQUETERMS:
-		    msg_uniqueterms(message);
-		    continue;
-		case MSG_POSITIONLISTCOUNT:
-		    msg_positionlistcount(message);
-		    continue;
-		case MSG_RECONSTRUCTTEXT:
-		    msg_reconstructtext(message);
-		    continue;
-		case MSG_SYNONYMTERMLIST:
-		    msg_synonymtermlist(message);
-		    continue;
-		case MSG_SYNONYMKEYLIST:
-		    msg_synonymkeylist(message);
-		    continue;
-		case MSG_ADDSYNONYM:
-		    msg_addsynonym(message);
-		    continue;
-		case MSG_REMOVESYNONYM:
-		    msg_removesynonym(message);
-		    continue;
-		case MSG_CLEARSYNONYMS:
-		    msg_clearsynonyms(message);
-		    continue;
-		default: {
-		    // MSG_GETMSET - used during a conversation.
-		    // MSG_SHUTDOWN - handled by get_message().
-		    string errmsg("Unexpected message type ");
-		    errmsg += str(type);
-		    throw Xapian::InvalidArgumentError(errmsg);
-		}
-	    }
-	} catch (const Xapian::NetworkTimeoutError & e) {
-	    try {
-		// We've had a timeout, so the client may not be listening, so
-		// set the end_time to 1 and if we can't send the message right
-		// away, just exit and the client will cope.
-		send_message(REPLY_EXCEPTION, serialise_error(e), 1.0);
-	    } catch (...) {
+    while (process_message(idle_timeout)) { }
+}
+
+bool
+RemoteServer::process_message(double timeout)
+{
+    try {
+	string message;
+	size_t type = get_message(timeout, message);
+	switch (type) {
+	    case MSG_ALLTERMS:
+		msg_allterms(message);
+		return true;
+	    case MSG_COLLFREQ:
+		msg_collfreq(message);
+		return true;
+	    case MSG_DOCUMENT:
+		msg_document(message);
+		return true;
+	    case MSG_TERMEXISTS:
+		msg_termexists(message);
+		return true;
+	    case MSG_TERMFREQ:
+		msg_termfreq(message);
+		return true;
+	    case MSG_VALUESTATS:
+		msg_valuestats(message);
+		return true;
+	    case MSG_KEEPALIVE:
+		msg_keepalive(message);
+		return true;
+	    case MSG_DOCLENGTH:
+		msg_doclength(message);
+		return true;
+	    case MSG_QUERY:
+		msg_query(message);
+		return true;
+	    case MSG_TERMLIST:
+		msg_termlist(message);
+		return true;
+	    case MSG_POSITIONLIST:
+		msg_positionlist(message);
+		return true;
+	    case MSG_POSTLIST:
+		msg_postlist(message);
+		return true;
+	    case MSG_REOPEN:
+		msg_reopen(message);
+		return true;
+	    case MSG_UPDATE:
+		msg_update(message);
+		return true;
+	    case MSG_ADDDOCUMENT:
+		msg_adddocument(message);
+		return true;
+	    case MSG_CANCEL:
+		msg_cancel(message);
+		return true;
+	    case MSG_DELETEDOCUMENTTERM:
+		msg_deletedocumentterm(message);
+		return true;
+	    case MSG_COMMIT:
+		msg_commit(message);
+		return true;
+	    case MSG_REPLACEDOCUMENT:
+		msg_replacedocument(message);
+		return true;
+	    case MSG_REPLACEDOCUMENTTERM:
+		msg_replacedocumentterm(message);
+		return true;
+	    case MSG_DELETEDOCUMENT:
+		msg_deletedocument(message);
+		return true;
+	    case MSG_WRITEACCESS:
+		msg_writeaccess(message);
+		return true;
+	    case MSG_GETMETADATA:
+		msg_getmetadata(message);
+		return true;
+	    case MSG_SETMETADATA:
+		msg_setmetadata(message);
+		return true;
+	    case MSG_ADDSPELLING:
+		msg_addspelling(message);
+		return true;
+	    case MSG_REMOVESPELLING:
+		msg_removespelling(message);
+		return true;
+	    case MSG_METADATAKEYLIST:
+		msg_metadatakeylist(message);
+		return true;
+	    case MSG_FREQS:
+		msg_freqs(message);
+		return true;
+	    case MSG_UNIQUETERMS:
+		msg_uniqueterms(message);
+		return true;
+	    case MSG_POSITIONLISTCOUNT:
+		msg_positionlistcount(message);
+		return true;
+	    case MSG_RECONSTRUCTTEXT:
+		msg_reconstructtext(message);
+		return true;
+	    case MSG_SYNONYMTERMLIST:
+		msg_synonymtermlist(message);
+		return true;
+	    case MSG_SYNONYMKEYLIST:
+		msg_synonymkeylist(message);
+		return true;
+	    case MSG_ADDSYNONYM:
+		msg_addsynonym(message);
+		return true;
+	    case MSG_REMOVESYNONYM:
+		msg_removesynonym(message);
+		return true;
+	    case MSG_CLEARSYNONYMS:
+		msg_clearsynonyms(message);
+		return true;
+	    case MSG_COMPRESSION:
+		msg_compression(message);
+		return true;
+	    default: {
+		// MSG_GETMSET - used during a conversation.
+		// MSG_SHUTDOWN - handled by get_message().
+		string errmsg("Unexpected message type ");
+		errmsg += str(type);
+		throw Xapian::InvalidArgumentError(errmsg);
 	    }
-	    // And rethrow it so our caller can log it and close the
-	    // connection.
-	    throw;
-	} catch (const Xapian::NetworkError &) {
-	    // All other network errors mean we are fatally confused and are
-	    // unlikely to be able to communicate further across this
-	    // connection.  So we don't try to propagate the error to the
-	    // client, but instead just rethrow the exception so our caller can
-	    // log it and close the connection.
-	    throw;
-	} catch (const Xapian::Error &e) {
-	    // Propagate the exception to the client, then return to the main
-	    // message handling loop.
-	    send_message(REPLY_EXCEPTION, serialise_error(e));
-	} catch (ConnectionClosed &) {
-	    return;
+	}
+    } catch (const Xapian::NetworkTimeoutError & e) {
+	try {
+	    // We've had a timeout, so the client may not be listening, so
+	    // set the end_time to 1 and if we can't send the message right
+	    // away, just exit and the client will cope.
+	    send_message(REPLY_EXCEPTION, serialise_error(e), 1.0);
 	} catch (...) {
-	    // Propagate an unknown exception to the client.
-	    send_message(REPLY_EXCEPTION, string());
-	    // And rethrow it so our caller can log it and close the
-	    // connection.
-	    throw;
 	}
+	// And rethrow it so our caller can log it and close the
+	// connection.
+	throw;
+    } catch (const Xapian::NetworkError &) {
+	// All other network errors mean we are fatally confused and are
+	// unlikely to be able to communicate further across this
+	// connection.  So we don't try to propagate the error to the
+	// client, but instead just rethrow the exception so our caller can
+	// log it and close the connection.
+	throw;
+    } catch (const Xapian::Error &e) {
+	// Propagate the exception to the client, then return to the main
+	// message handling loop.
+	send_message(REPLY_EXCEPTION, serialise_error(e));
+    } catch (ConnectionClosed &) {
+	return false;
+    } catch (...) {
+	// Propagate an unknown exception to the client.
+	send_message(REPLY_EXCEPTION, string());
+	// And rethrow it so our caller can log it and close the
+	// connection.
+	throw;
     }
+    return true;
 }
 
 void
@@ -460,7 +526,12 @@ RemoteServer::msg_writeaccess(const string & msg)
 	flags = flag_bits &~ Xapian::DB_ACTION_MASK_;
     }
 
-    wdb = new Xapian::WritableDatabase(db->lock(flags));
+    if (group_commit) {
+	// Use the WritableDatabase shared with the other connections.
+	wdb = new Xapian::WritableDatabase(group_wdb);
+    } else {
+	wdb = new Xapian::WritableDatabase(db->lock(flags));
+    }
     delete db;
     db = wdb;
     msg_update(msg);
@@ -492,6 +563,7 @@ RemoteServer::msg_update(const string &)
     pack_uint(message, db->get_doclength_upper_bound() - doclen_lb);
     pack_bool(message, db->has_positions());
     pack_uint(message, db->get_total_length());
+    pack_uint(message, unsigned(compression + 1));
     message += db->get_uuid();
     send_message(REPLY_UPDATE, message);
 }
@@ -619,7 +691,7 @@ RemoteServer::msg_query(const string &message_in)
 		    collapse_key, collapse_max,
 		    percent_threshold, weight_threshold,
 		    order, sort_key, sort_by, sort_value_forward, time_limit,
-		    matchspies);
+		    0.0, matchspies);
 
     send_message(REPLY_STATS, serialise_stats(local_stats));
 
@@ -631,10 +703,12 @@ RemoteServer::msg_query(const string &message_in)
     Xapian::termcount first;
     Xapian::termcount maxitems;
     Xapian::termcount check_at_least;
+    Xapian::doccount prefetch;
     string sorter_type;
     if (!unpack_uint(&p, p_end, &first) ||
 	!unpack_uint(&p, p_end, &maxitems) ||
 	!unpack_uint(&p, p_end, &check_at_least) ||
+	!unpack_uint(&p, p_end, &prefetch) ||
 	!unpack_string(&p, p_end, sorter_type)) {
 	throw Xapian::NetworkError("Bad MSG_GETMSET");
     }
@@ -664,7 +738,7 @@ RemoteServer::msg_query(const string &message_in)
 					 percent_threshold, weight_threshold,
 					 order,
 					 sort_key, sort_by, sort_value_forward,
-					 time_limit, matchspies);
+					 time_limit, 0, 0.0, matchspies);
     // FIXME: The local side already has these stats, except for the maxpart
     // information.
     mset.internal->set_stats(total_stats.release());
@@ -673,7 +747,22 @@ RemoteServer::msg_query(const string &message_in)
     for (auto i : matchspies) {
 	pack_string(message, i->serialise_results());
     }
-    message += mset.internal->serialise();
+
+    // Include the documents the client asked us to prefetch.
+    Xapian::doccount n_docs = min(prefetch, mset.size());
+    pack_uint(message, n_docs);
+    for (Xapian::MSetIterator i = mset.begin(); n_docs; ++i, --n_docs) {
+	Xapian::Document doc = db->get_document(*i);
+	pack_uint(message, *i);
+	pack_string(message, doc.get_data());
+	pack_uint(message, doc.values_count());
+	for (auto v = doc.values_begin(); v != doc.values_end(); ++v) {
+	    pack_uint(message, v.get_valueno());
+	    pack_string(message, *v);
+	}
+    }
+
+    mset.internal->serialise(message);
     send_message(REPLY_RESULTS, message);
 }
 
@@ -757,6 +846,21 @@ RemoteServer::msg_valuestats(const string & message)
     send_message(REPLY_VALUESTATS, message_out);
 }
 
+void
+RemoteServer::msg_compression(const string & message)
+{
+    const char *p = message.data();
+    const char *p_end = p + message.size();
+    unsigned type_plus_one;
+    if (!unpack_uint(&p, p_end, &type_plus_one) ||
+	int(type_plus_one) != compression + 1 || compression < 0) {
+	throw Xapian::NetworkError("Bad MSG_COMPRESSION");
+    }
+    // No reply is sent - the client starts compressing straight after
+    // sending this message, and we can do the same from here on.
+    set_compression(compression);
+}
+
 void
 RemoteServer::msg_doclength(const string &message)
 {
@@ -810,17 +914,44 @@ RemoteServer::msg_commit(const string &)
     if (!wdb)
 	throw_read_only();
 
+    if (group_commit) {
+	// Reply once the server has committed this along with changes from
+	// other connections.
+	commit_pending = true;
+	return;
+    }
+
     wdb->commit();
 
     send_message(REPLY_DONE, string());
 }
 
+void
+RemoteServer::commit_done()
+{
+    commit_pending = false;
+    send_message(REPLY_DONE, string());
+}
+
+void
+RemoteServer::commit_failed(const Xapian::Error& e)
+{
+    commit_pending = false;
+    send_message(REPLY_EXCEPTION, serialise_error(e));
+}
+
 void
 RemoteServer::msg_cancel(const string &)
 {
     if (!wdb)
 	throw_read_only();
 
+    if (group_commit) {
+	// The uncommitted changes may include those from other connections.
+	throw Xapian::UnimplementedError("Can't cancel changes when commits "
+					 "are grouped");
+    }
+
     // We can't call cancel since that's an internal method, but this
     // has the same effect with minimal additional overhead.
     wdb->begin_transaction(false);
@@ -23,6 +23,7 @@
 #define XAPIAN_INCLUDED_REMOTESERVER_H
 
 #include "xapian/database.h"
+#include "xapian/error.h"
 #include "xapian/postingsource.h"
 #include "xapian/registry.h"
 #include "xapian/visibility.h"
@@ -52,6 +53,25 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
     /// Do we support writing?
     bool writable;
 
+    /** Are commits grouped with those from other connections?
+     *
+     *  If true, once the client asks for write access db is group_wdb, and
+     *  MSG_COMMIT is only acknowledged once the server has committed.
+     */
+    bool group_commit = false;
+
+    /// The WritableDatabase shared with other connections if group_commit.
+    Xapian::WritableDatabase group_wdb;
+
+    /// Is the client waiting for its changes to be committed?
+    bool commit_pending = false;
+
+    /** Compression algorithm to offer the client.
+     *
+     *  A compression_type value, or -1 to not offer compression.
+     */
+    int compression;
+
     /** Timeout for actions during a conversation.
      *
      *  The timeout is specified in seconds.  If the timeout is exceeded then a
@@ -69,6 +89,10 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
     /// The registry, which allows unserialisation of user subclasses.
     Xapian::Registry reg;
 
+    /// Set up the connection and send the greeting message.
+    XAPIAN_VISIBILITY_INTERNAL
+    void start();
+
     /// Accept a message from the client.
     XAPIAN_VISIBILITY_INTERNAL
     message_type get_message(double timeout, std::string & result,
@@ -118,6 +142,10 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
     XAPIAN_VISIBILITY_INTERNAL
     void msg_keepalive(const std::string & message);
 
+    // client agrees to use compression
+    XAPIAN_VISIBILITY_INTERNAL
+    void msg_compression(const std::string & message);
+
     // get doclength
     XAPIAN_VISIBILITY_INTERNAL
     void msg_doclength(const std::string & message);
@@ -242,12 +270,75 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
      *  @param idle_timeout_	Timeout while waiting for a new action from
      *			the client (specified in seconds).
      *  @param writable Should the database be opened for writing?
+     *  @param compression_	Compression algorithm to offer the client for
+     *			large messages (a compression_type value, or -1
+     *			for none).
      */
     RemoteServer(const std::vector<std::string> &dbpaths,
 		 int fdin, int fdout,
 		 double active_timeout_,
 		 double idle_timeout_,
-		 bool writable = false);
+		 bool writable = false,
+		 int compression_ = -1);
+
+    /** Construct a read-only RemoteServer using an already open database.
+     *
+     *  This allows a server process to reuse the same open database for
+     *  several connections one after another.  The database is reopened to
+     *  make sure it's on the latest revision.
+     *
+     *  @param db_	The database to use.
+     *  @param context_	Context to use in error messages (typically the
+     *			database path(s)).
+     *  @param fdin	The file descriptor to read from.
+     *  @param fdout	The file descriptor to write to (fdin and fdout may be
+     *			the same).
+     *  @param active_timeout_	Timeout for actions during a conversation
+     *			(specified in seconds).
+     *  @param idle_timeout_	Timeout while waiting for a new action from
+     *			the client (specified in seconds).
+     *  @param compression_	Compression algorithm to offer the client for
+     *			large messages (a compression_type value, or -1
+     *			for none).
+     */
+    RemoteServer(const Xapian::Database& db_,
+		 const std::string& context_,
+		 int fdin, int fdout,
+		 double active_timeout_,
+		 double idle_timeout_,
+		 int compression_ = -1);
+
+    /** Construct a RemoteServer which groups commits with other connections.
+     *
+     *  Clients which ask for write access share @a wdb_ with the server's
+     *  other connections.  When a client commits, its MSG_COMMIT isn't
+     *  acknowledged until the server calls commit_done() or commit_failed(),
+     *  which allows the changes from several clients to be committed
+     *  together.
+     *
+     *  Until it asks for write access, the client gets its own read-only
+     *  view of the database, so it doesn't see changes which haven't been
+     *  committed yet.
+     *
+     *  @param wdb_	The database to share.
+     *  @param path	The path of the database.
+     *  @param fdin	The file descriptor to read from.
+     *  @param fdout	The file descriptor to write to (fdin and fdout may be
+     *			the same).
+     *  @param active_timeout_	Timeout for actions during a conversation
+     *			(specified in seconds).
+     *  @param idle_timeout_	Timeout while waiting for a new action from
+     *			the client (specified in seconds).
+     *  @param compression_	Compression algorithm to offer the client for
+     *			large messages (a compression_type value, or -1
+     *			for none).
+     */
+    RemoteServer(const Xapian::WritableDatabase& wdb_,
+		 const std::string& path,
+		 int fdin, int fdout,
+		 double active_timeout_,
+		 double idle_timeout_,
+		 int compression_ = -1);
 
     /// Destructor.
     ~RemoteServer();
@@ -259,6 +350,33 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
      */
     void run();
 
+    /** Accept one message from the client and process it.
+     *
+     *  Xapian exceptions other than network errors are reported to the
+     *  client, as run() does.
+     *
+     *  @param timeout	Timeout for the message to arrive (in seconds).
+     *
+     *  @return false if the client closed the connection.
+     */
+    bool process_message(double timeout);
+
+    /// Is the client waiting for its changes to be committed?
+    bool get_commit_pending() const { return commit_pending; }
+
+    /// Has the client been given write access?
+    bool has_write_access() const { return wdb != NULL; }
+
+    /// Tell a client waiting for a grouped commit that it's done.
+    void commit_done();
+
+    /// Tell a client waiting for a grouped commit that it failed.
+    void commit_failed(const Xapian::Error& e);
+
+    using RemoteConnection::get_read_fd;
+
+    using RemoteConnection::has_buffered_input;
+
     /// Set the registry used for (un)serialisation.
     void set_registry(const Xapian::Registry & reg_) { reg = reg_; }
 };
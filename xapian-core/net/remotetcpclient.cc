@@ -24,11 +24,159 @@
 
 #include <xapian/error.h>
 
+#include "realtime.h"
+#include "remoteconnection.h"
+#include "remoteprotocol.h"
+#include "socket_utils.h"
 #include "str.h"
 #include "tcpclient.h"
 
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#else
+# include "safesysselect.h"
+#endif
+
+#include <cerrno>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 using namespace std;
 
+/// Default maximum number of idle connections to keep for each server.
+#define DEFAULT_POOL_SIZE 8
+
+namespace {
+
+/// An idle connection to xapian-tcpsrv.
+struct IdleConnection {
+    /// The socket.
+    int fd;
+
+    /// The compression_type negotiated for the connection, or -1.
+    int compression;
+};
+
+/** Idle connections to xapian-tcpsrv, ready for reuse.
+ *
+ *  This is shared between threads so access is protected by a mutex, but it
+ *  is only held while moving connections in and out - network I/O is done
+ *  without holding it.
+ */
+class ConnectionPool {
+    std::mutex mutex;
+
+    /** Idle connections for each server.
+     *
+     *  Keyed by the context string, which includes the host and port.  Most
+     *  recently used connections are at the end.
+     */
+    map<string, vector<IdleConnection>> idle;
+
+    /// Maximum number of idle connections to keep for each server.
+    size_t max_idle = DEFAULT_POOL_SIZE;
+
+  public:
+    /// Take the most recently used idle connection for @a key, if any.
+    bool lease(const string& key, IdleConnection& conn) {
+	lock_guard<std::mutex> lock(mutex);
+	auto i = idle.find(key);
+	if (i == idle.end() || i->second.empty()) return false;
+	conn = i->second.back();
+	i->second.pop_back();
+	return true;
+    }
+
+    /// Add an idle connection, or close it if we have enough already.
+    void release(const string& key, const IdleConnection& conn) {
+	{
+	    lock_guard<std::mutex> lock(mutex);
+	    auto& conns = idle[key];
+	    if (conns.size() < max_idle) {
+		conns.push_back(conn);
+		return;
+	    }
+	}
+	close_fd_or_socket(conn.fd);
+    }
+
+    /// Take all the idle connections.
+    void take_all(map<string, vector<IdleConnection>>& result) {
+	lock_guard<std::mutex> lock(mutex);
+	swap(result, idle);
+    }
+
+    /// Set the maximum number of idle connections for each server.
+    void set_max_idle(size_t max_idle_) {
+	vector<int> excess;
+	{
+	    lock_guard<std::mutex> lock(mutex);
+	    max_idle = max_idle_;
+	    for (auto& i : idle) {
+		auto& conns = i.second;
+		while (conns.size() > max_idle) {
+		    // Close the least recently used connections.
+		    excess.push_back(conns.front().fd);
+		    conns.erase(conns.begin());
+		}
+	    }
+	}
+	for (int fd : excess) {
+	    close_fd_or_socket(fd);
+	}
+    }
+};
+
+}
+
+static ConnectionPool&
+get_pool()
+{
+    // This is deliberately never destroyed, as RemoteTcpClient objects may
+    // still be destroyed (and so return their connections to the pool) after
+    // static destructors have been run.
+    static ConnectionPool* pool = new ConnectionPool;
+    return *pool;
+}
+
+/** Check an idle connection still looks usable.
+ *
+ *  There shouldn't be anything to read - if there is, the server has most
+ *  likely closed the connection (e.g. because its idle timeout expired).
+ */
+static bool
+idle_connection_ok(int fd)
+{
+#ifdef HAVE_POLL
+    struct pollfd fds;
+    fds.fd = fd;
+    fds.events = POLLIN;
+    int res;
+    do {
+	res = poll(&fds, 1, 0);
+    } while (res < 0 && (errno == EINTR || errno == EAGAIN));
+#else
+    if (fd >= FD_SETSIZE) {
+	// We can't check, but a dead connection will be noticed when we try
+	// to use it anyway.
+	return true;
+    }
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(fd, &fdset);
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    int res;
+    do {
+	res = select(fd + 1, &fdset, 0, 0, &tv);
+    } while (res < 0 && (errno == EINTR || errno == EAGAIN));
+#endif
+    return res == 0;
+}
+
 int
 RemoteTcpClient::open_socket(const string & hostname, int port,
 			     double timeout_connect)
@@ -58,8 +206,84 @@ RemoteTcpClient::get_tcpcontext(const string & hostname, int port)
 
 RemoteTcpClient::~RemoteTcpClient()
 {
+    if (!pool_key.empty()) {
+	IdleConnection conn;
+	conn.fd = release_connection(conn.compression);
+	if (conn.fd >= 0) {
+	    get_pool().release(pool_key, conn);
+	    return;
+	}
+    }
+
     try {
 	do_close();
     } catch (...) {
     }
 }
+
+RemoteTcpClient*
+RemoteTcpClient::open_pooled(const string& hostname, int port,
+			     double timeout_, double timeout_connect)
+{
+    string key = get_tcpcontext(hostname, port);
+    IdleConnection conn;
+    while (get_pool().lease(key, conn)) {
+	if (!idle_connection_ok(conn.fd)) {
+	    close_fd_or_socket(conn.fd);
+	    continue;
+	}
+	try {
+	    return new RemoteTcpClient(conn.fd, conn.compression, timeout_,
+				       key);
+	} catch (const Xapian::NetworkError&) {
+	    // The connection has gone away since we checked it - the failed
+	    // constructor will have closed it, so try the next one.
+	}
+    }
+    return new RemoteTcpClient(hostname, port, timeout_, timeout_connect,
+			       false, 0, true);
+}
+
+void
+RemoteTcpClient::keep_pool_alive(double timeout)
+{
+    map<string, vector<IdleConnection>> conns;
+    get_pool().take_all(conns);
+    for (auto& i : conns) {
+	// Do the most recently used last, so they end up in the same order.
+	for (const IdleConnection& conn : i.second) {
+	    RemoteConnection link(conn.fd, conn.fd, i.first);
+	    try {
+		link.set_compression(conn.compression);
+		double end_time = RealTime::end_time(timeout);
+		link.send_message(MSG_KEEPALIVE, string(), end_time);
+		string message;
+		if (link.get_message(message, end_time) == REPLY_DONE &&
+		    link.release() >= 0) {
+		    get_pool().release(i.first, conn);
+		    continue;
+		}
+	    } catch (const Xapian::Error&) {
+	    }
+	    link.do_close();
+	}
+    }
+}
+
+void
+RemoteTcpClient::clear_pool()
+{
+    map<string, vector<IdleConnection>> conns;
+    get_pool().take_all(conns);
+    for (auto& i : conns) {
+	for (const IdleConnection& conn : i.second) {
+	    close_fd_or_socket(conn.fd);
+	}
+    }
+}
+
+void
+RemoteTcpClient::set_pool_size(size_t max_idle)
+{
+    get_pool().set_max_idle(max_idle);
+}
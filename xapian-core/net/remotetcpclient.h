@@ -23,6 +23,8 @@
 
 #include "backends/remote/remote-database.h"
 
+#include <string>
+
 #ifdef __WIN32__
 # define SOCKET_INITIALIZER_MIXIN private WinsockInitializer,
 #else
@@ -61,6 +63,18 @@ class RemoteTcpClient : SOCKET_INITIALIZER_MIXIN public RemoteDatabase {
      */
     static std::string get_tcpcontext(const std::string & hostname, int port);
 
+    /** Key to return our connection to the pool under.
+     *
+     *  Empty if the connection shouldn't be pooled.
+     */
+    std::string pool_key;
+
+    /// Constructor for reusing a pooled connection.
+    RemoteTcpClient(int fd, int compression, double timeout_,
+		    const std::string& context_)
+	: RemoteDatabase(fd, compression, timeout_, context_),
+	  pool_key(context_) { }
+
   public:
     /** Constructor.
      *
@@ -72,16 +86,51 @@ class RemoteTcpClient : SOCKET_INITIALIZER_MIXIN public RemoteDatabase {
      *				connecting (in seconds).
      *	@param writable		Is this a WritableDatabase?
      *	@param flags		Xapian::DB_RETRY_LOCK or 0.
+     *	@param pooled		Return the connection to the pool when done?
+     *				Only supported for read-only access.
      */
     RemoteTcpClient(const std::string & hostname, int port,
 		    double timeout_, double timeout_connect, bool writable,
-		    int flags)
+		    int flags, bool pooled = false)
 	: RemoteDatabase(open_socket(hostname, port, timeout_connect),
 			 timeout_, get_tcpcontext(hostname, port),
-			 writable, flags) { }
+			 writable, flags),
+	  pool_key(pooled ? get_tcpcontext(hostname, port) : std::string()) { }
 
-    /** Destructor. */
+    /** Destructor.
+     *
+     *  If we're pooled, our connection is returned to the pool rather than
+     *  being closed.
+     */
     ~RemoteTcpClient();
+
+    /** Open a read-only connection, reusing an idle one if possible.
+     *
+     *  When the returned object is destroyed, its connection is returned to
+     *  the pool for reuse.
+     *
+     *  Parameters are as for the constructor.
+     */
+    static RemoteTcpClient* open_pooled(const std::string& hostname, int port,
+					double timeout_,
+					double timeout_connect);
+
+    /** Send a keep-alive message over each idle pooled connection.
+     *
+     *  Any which fail are closed.
+     *
+     *  @param timeout	Timeout for each connection (in seconds).
+     */
+    static void keep_pool_alive(double timeout);
+
+    /// Close all idle pooled connections.
+    static void clear_pool();
+
+    /** Set how many idle connections to keep for each server.
+     *
+     *  Any excess idle connections are closed.
+     */
+    static void set_pool_size(size_t max_idle);
 };
 
 #endif  // XAPIAN_INCLUDED_REMOTETCPCLIENT_H
@@ -23,6 +23,8 @@
 #include "replicatetcpclient.h"
 
 #include "api/replication.h"
+#include "pack.h"
+#include "remoteconnection.h"
 
 #include "socket_utils.h"
 #include "tcpclient.h"
@@ -53,6 +55,10 @@ ReplicateTcpClient::update_from_master(const std::string & path,
 				       bool force_copy)
 {
     Xapian::DatabaseReplica replica(path);
+    // Tell the server which compression algorithms we can handle.
+    string compression;
+    pack_uint(compression, RemoteConnection::get_supported_compression());
+    remconn.send_message('C', compression, 0.0);
     remconn.send_message('R',
 			 force_copy ? string() : replica.get_revision_info(),
 			 0.0);
@@ -70,6 +76,40 @@ ReplicateTcpClient::update_from_master(const std::string & path,
     } while (more);
 }
 
+void
+ReplicateTcpClient::subscribe(const string & path,
+			      const string & masterdb,
+			      bool force_copy)
+{
+    pushed_replica.reset(new Xapian::DatabaseReplica(path));
+    string compression;
+    pack_uint(compression, RemoteConnection::get_supported_compression());
+    remconn.send_message('C', compression, 0.0);
+    remconn.send_message('S',
+			 force_copy ? string() : pushed_replica->get_revision_info(),
+			 0.0);
+    remconn.send_message('D', masterdb, 0.0);
+    pushed_replica->set_read_fd(socket);
+}
+
+void
+ReplicateTcpClient::wait_for_update(Xapian::ReplicationInfo & info,
+				    double reader_close_time)
+{
+    info.clear();
+    bool more;
+    do {
+	Xapian::ReplicationInfo subinfo;
+	more = pushed_replica->apply_next_changeset(&subinfo, reader_close_time);
+	info.changeset_count += subinfo.changeset_count;
+	info.fullcopy_count += subinfo.fullcopy_count;
+	if (subinfo.changed)
+	    info.changed = true;
+    } while (more);
+    // Tell the server which revision we've now reached.
+    remconn.send_message('R', pushed_replica->get_revision_info(), 0.0);
+}
+
 ReplicateTcpClient::~ReplicateTcpClient()
 {
     remconn.shutdown();
@@ -26,6 +26,8 @@
 #include "xapian/visibility.h"
 #include "api/replication.h"
 
+#include <memory>
+
 #ifdef __WIN32__
 # define SOCKET_INITIALIZER_MIXIN : private WinsockInitializer
 #else
@@ -46,6 +48,9 @@ class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpClient SOCKET_INITIALIZER_MIXIN {
     /// Write-only connection to the server.
     OwnedRemoteConnection remconn;
 
+    /// The replica being updated by pushed changes (if subscribed).
+    std::unique_ptr<Xapian::DatabaseReplica> pushed_replica;
+
     /** Attempt to open a TCP/IP socket connection to a replication server.
      *
      *  Connect to replication server running on port @a port of host @a hostname.
@@ -78,6 +83,29 @@ class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpClient SOCKET_INITIALIZER_MIXIN {
 			    double reader_close_time,
 			    bool force_copy);
 
+    /** Subscribe to changes pushed by the server.
+     *
+     *  The server sends any changes needed to bring the replica up to date,
+     *  then further changes as they are made to the master database.  Call
+     *  wait_for_update() repeatedly to apply them.
+     *
+     *  If the server isn't pushing changes, it closes the connection once
+     *  the replica is up to date, and wait_for_update() then throws
+     *  Xapian::NetworkError.
+     */
+    void subscribe(const std::string & path,
+		   const std::string & remotedb,
+		   bool force_copy);
+
+    /** Wait for the server to push changes, and apply them.
+     *
+     *  Blocks until the server sends some changes, then applies all the
+     *  changes it sent together and tells the server the revision the
+     *  replica is now at.
+     */
+    void wait_for_update(Xapian::ReplicationInfo & info,
+			 double reader_close_time);
+
     /** Destructor. */
     ~ReplicateTcpClient();
 };
@@ -22,9 +22,34 @@
 
 #include "replicatetcpserver.h"
 
+#include <xapian/database.h>
 #include <xapian/error.h>
 #include "api/replication.h"
+#include "io_utils.h"
+#include "pack.h"
+#include "realtime.h"
 #include "remoteconnection.h"
+#include "safefcntl.h"
+#include "safesyssocket.h"
+#include "safeunistd.h"
+#include "socket_utils.h"
+#include "stringutils.h"
+
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
+#ifndef __WIN32__
+# include <signal.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
 
 using namespace std;
 
@@ -42,9 +67,25 @@ ReplicateTcpServer::handle_one_connection(int socket)
 {
     RemoteConnection client(socket, -1);
     try {
-	// Read start_revision from the client.
+	// Read the compression types the client supports (if it tells us)
+	// and start_revision from the client.
 	string start_revision;
-	if (client.get_message(start_revision, 0.0) != 'R') {
+	int type = client.get_message(start_revision, 0.0);
+	int use_compression = -1;
+	if (type == 'C') {
+	    const char* p = start_revision.data();
+	    const char* p_end = p + start_revision.size();
+	    unsigned supported;
+	    if (!unpack_uint(&p, p_end, &supported)) {
+		throw Xapian::NetworkError("Bad replication client message");
+	    }
+	    if (compression >= 0 && (supported >> compression & 1))
+		use_compression = compression;
+	    type = client.get_message(start_revision, 0.0);
+	}
+	// A client subscribing to pushed changes ('S') just gets the changes
+	// so far.  It will then see the connection close and retry later.
+	if (type != 'R' && type != 'S') {
 	    throw Xapian::NetworkError("Bad replication client message");
 	}
 
@@ -61,8 +102,378 @@ ReplicateTcpServer::handle_one_connection(int socket)
 	dbpath += '/';
 	dbpath += dbname;
 	Xapian::DatabaseMaster master(dbpath);
-	master.write_changesets_to_fd(socket, start_revision, NULL);
+	master.write_changesets_to_fd(socket, start_revision, NULL,
+				      use_compression);
     } catch (...) {
 	// Ignore exceptions.
     }
 }
+
+#if defined HAVE_POLL && defined HAVE_FORK
+
+/// Seconds to allow for a message from a replica to arrive once started.
+#define PUSH_READ_TIMEOUT 10.0
+
+/// Seconds to allow for a replica to accept more data before we give up on it.
+#define PUSH_SEND_TIMEOUT 30.0
+
+/// Size of the chunks we read changes into before sending them.
+#define PUSH_CHUNK_SIZE 65536
+
+struct ReplicateTcpServer::Subscriber {
+    /// The state of the conversation with the replica.
+    enum {
+	/// Waiting for the replica to say which database and revision it has.
+	HANDSHAKE,
+	/// Sending changes to the replica.
+	SENDING,
+	/// Waiting for the replica to acknowledge the changes it was sent.
+	WAITING,
+	/// The replica has the revision in @a revision.
+	IDLE
+    } state = HANDSHAKE;
+
+    /// The connected socket.
+    int fd;
+
+    /// Connection used to read messages from the replica.
+    RemoteConnection conn;
+
+    /// Compression algorithm to use for the replica (-1 for none).
+    int compression = -1;
+
+    /// The replica's revision information.
+    string revision;
+
+    /// The name of the database being replicated.
+    string dbname;
+
+    /** The changes being sent to the replica in state SENDING.
+     *
+     *  This is shared with the other replicas which need the same changes.
+     */
+    shared_ptr<FILE> changes;
+
+    /// The size of @a changes in bytes.
+    off_t changes_size = 0;
+
+    /// How much of @a changes has been sent so far.
+    off_t sent = 0;
+
+    /// When to give up if the replica doesn't accept any more data.
+    double send_deadline = 0.0;
+
+    explicit Subscriber(int fd_) : fd(fd_), conn(fd_, -1) {}
+
+    ~Subscriber() { CLOSESOCKET(fd); }
+
+    /// Start sending @a changes_ to the replica.
+    bool start_sending(const shared_ptr<FILE>& changes_, off_t size) {
+	// Only send what the socket will take without blocking, so that a
+	// slow replica can't hold up the others.  Any catch-up child process
+	// which shares the socket has finished with it by now.
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) return false;
+	changes = changes_;
+	changes_size = size;
+	sent = 0;
+	send_deadline = RealTime::end_time(PUSH_SEND_TIMEOUT);
+	state = SENDING;
+	return send_changes();
+    }
+
+    /** Send as much of @a changes as the replica will accept without blocking.
+     *
+     *  @return false if the replica should be dropped.
+     */
+    bool send_changes();
+};
+
+bool
+ReplicateTcpServer::Subscriber::send_changes()
+{
+    char buf[PUSH_CHUNK_SIZE];
+    while (sent < changes_size) {
+	size_t n = size_t(min(changes_size - sent, off_t(sizeof(buf))));
+	io_pread(fileno(changes.get()), buf, n, sent, n);
+	ssize_t c = send(fd, buf, n, 0);
+	if (c < 0) {
+	    if (errno == EINTR) continue;
+#if defined EWOULDBLOCK && EWOULDBLOCK != EAGAIN
+	    if (errno == EWOULDBLOCK) return true;
+#endif
+	    return errno == EAGAIN;
+	}
+	sent += c;
+	send_deadline = RealTime::end_time(PUSH_SEND_TIMEOUT);
+    }
+    changes.reset();
+    state = WAITING;
+    return true;
+}
+
+/** Is a replica with revision information @a revision up to date?
+ *
+ *  @param current	The current UUID and revision of the master.
+ *  @param revision	The revision information the replica sent us, which
+ *			may also include the progress of a partial copy.
+ */
+static bool
+up_to_date(const string& current, const string& revision)
+{
+    if (!startswith(revision, current)) return false;
+    // The packed UUID and revision are self-delimiting, so they match and the
+    // replica is up to date unless it's part way through a copy.
+    const char* p = revision.data() + current.size();
+    const char* p_end = revision.data() + revision.size();
+    string progress;
+    return p == p_end || (unpack_string(&p, p_end, progress) &&
+			  p == p_end && progress.empty());
+}
+
+bool
+ReplicateTcpServer::handle_subscriber_input(Subscriber& sub)
+{
+    do {
+	string message;
+	int type = sub.conn.get_message(message,
+					RealTime::end_time(PUSH_READ_TIMEOUT));
+	switch (type) {
+	    case 'C': {
+		const char* p = message.data();
+		const char* p_end = p + message.size();
+		unsigned supported;
+		if (!unpack_uint(&p, p_end, &supported))
+		    return false;
+		if (compression >= 0 && (supported >> compression & 1))
+		    sub.compression = compression;
+		break;
+	    }
+	    case 'S':
+		if (sub.state != Subscriber::HANDSHAKE)
+		    return false;
+		sub.revision = message;
+		break;
+	    case 'R':
+		if (sub.state == Subscriber::HANDSHAKE) {
+		    // A replica which isn't subscribing just wants the changes
+		    // since this revision, after which it will disconnect.
+		    sub.revision = message;
+		    break;
+		}
+		// The replica has applied the changes we sent and is telling
+		// us the revision it's now at.
+		if (sub.state != Subscriber::WAITING)
+		    return false;
+		sub.revision = message;
+		sub.state = Subscriber::IDLE;
+		break;
+	    case 'D':
+		if (sub.state != Subscriber::HANDSHAKE ||
+		    message.find("..") != string::npos) {
+		    return false;
+		}
+		sub.dbname = message;
+		start_catch_up(sub);
+		sub.state = Subscriber::WAITING;
+		break;
+	    default:
+		return false;
+	}
+    } while (sub.conn.has_buffered_input());
+    return true;
+}
+
+void
+ReplicateTcpServer::start_catch_up(Subscriber& sub)
+{
+    // A new replica could need a lot of changesets or even a whole copy of
+    // the database, so send these from a child process to avoid holding up
+    // pushing changes to other replicas.  The child process only writes to
+    // the socket, while we only read from it until the replica says it has
+    // caught up.
+    pid_t pid = fork();
+    if (pid == 0) {
+	// Child process.
+	close(get_listen_socket());
+	try {
+	    string dbpath(path);
+	    dbpath += '/';
+	    dbpath += sub.dbname;
+	    Xapian::DatabaseMaster master(dbpath);
+	    master.write_changesets_to_fd(sub.fd, sub.revision, NULL,
+					  sub.compression);
+	} catch (...) {
+	    // Make sure the parent process sees the connection close.
+	    ::shutdown(sub.fd, SHUT_RDWR);
+	}
+	_exit(0);
+    }
+    if (pid < 0) {
+	throw Xapian::NetworkError("fork failed", errno);
+    }
+}
+
+void
+ReplicateTcpServer::run_push(double interval)
+{
+    // We'll notice if a replica goes away as writes to it will fail.
+    signal(SIGPIPE, SIG_IGN);
+    // Let child processes sending catch-up changes get reaped automatically.
+    signal(SIGCHLD, SIG_IGN);
+
+    vector<unique_ptr<Subscriber>> subs;
+    vector<struct pollfd> fds;
+    double next_check = RealTime::now();
+    while (true) {
+	fds.resize(subs.size() + 1);
+	fds[0].fd = get_listen_socket();
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	double deadline = next_check;
+	for (size_t i = 0; i != subs.size(); ++i) {
+	    fds[i + 1].fd = subs[i]->fd;
+	    fds[i + 1].events = POLLIN;
+	    fds[i + 1].revents = 0;
+	    if (subs[i]->state == Subscriber::SENDING) {
+		fds[i + 1].events |= POLLOUT;
+		deadline = min(deadline, subs[i]->send_deadline);
+	    }
+	}
+	double wait = max(deadline - RealTime::now(), 0.0);
+	int r = poll(fds.data(), fds.size(), int(wait * 1000));
+	if (r < 0 && errno != EINTR) {
+	    throw Xapian::NetworkError("poll failed", errno);
+	}
+
+	if (r > 0) {
+	    for (size_t i = 0; i != subs.size(); ++i) {
+		short revents = fds[i + 1].revents;
+		if (revents == 0) continue;
+		bool keep = true;
+		try {
+		    if (revents & ~POLLOUT)
+			keep = handle_subscriber_input(*subs[i]);
+		    if (keep && (revents & POLLOUT) &&
+			subs[i]->state == Subscriber::SENDING) {
+			keep = subs[i]->send_changes();
+		    }
+		} catch (const Xapian::Error&) {
+		    keep = false;
+		}
+		if (!keep) subs[i].reset();
+	    }
+
+	    if (fds[0].revents) {
+		try {
+		    int fd = accept_connection();
+		    set_socket_timeouts(fd, PUSH_SEND_TIMEOUT);
+		    subs.emplace_back(new Subscriber(fd));
+		} catch (const Xapian::Error& e) {
+		    cerr << "Caught " << e.get_description() << endl;
+		}
+	    }
+	}
+
+	// Drop replicas which have stopped accepting the changes we're sending.
+	double now = RealTime::now();
+	for (auto&& sub : subs) {
+	    if (sub && sub->state == Subscriber::SENDING &&
+		now >= sub->send_deadline) {
+		sub.reset();
+	    }
+	}
+
+	if (now >= next_check) {
+	    try {
+		push_changes(subs);
+	    } catch (const Xapian::Error& e) {
+		cerr << "Caught " << e.get_description() << endl;
+	    }
+	    next_check = RealTime::now() + interval;
+	}
+
+	subs.erase(remove(subs.begin(), subs.end(), nullptr), subs.end());
+    }
+}
+
+void
+ReplicateTcpServer::push_changes(vector<unique_ptr<Subscriber>>& subs)
+{
+    // Group the replicas which are up to date with what we last sent them
+    // by what they need, so that each set of changes is only read and
+    // generated once however many replicas need it.
+    typedef tuple<string, string, int> group_key;
+    map<group_key, vector<unique_ptr<Subscriber>*>> groups;
+    for (auto&& sub : subs) {
+	if (sub && sub->state == Subscriber::IDLE) {
+	    group_key key(sub->dbname, sub->revision, sub->compression);
+	    groups[key].push_back(&sub);
+	}
+    }
+
+    // Current revision information for each database.
+    map<string, string> current;
+    for (auto&& group : groups) {
+	const string& dbname = get<0>(group.first);
+	const string& revision = get<1>(group.first);
+	string dbpath(path);
+	dbpath += '/';
+	dbpath += dbname;
+	auto it = current.find(dbname);
+	if (it == current.end()) {
+	    string info;
+	    try {
+		Xapian::Database db(dbpath);
+		pack_string(info, db.get_uuid());
+		pack_uint(info, db.get_revision());
+	    } catch (const Xapian::Error&) {
+		// Leave info empty so we try again next time.
+	    }
+	    it = current.emplace(dbname, info).first;
+	}
+	if (it->second.empty() || up_to_date(it->second, revision)) {
+	    // Nothing to send.
+	    continue;
+	}
+
+	FILE* changes_file = tmpfile();
+	if (!changes_file) {
+	    throw Xapian::NetworkError("Couldn't create temporary file", errno);
+	}
+	shared_ptr<FILE> changes(changes_file, fclose);
+	int fd = fileno(changes_file);
+	try {
+	    Xapian::DatabaseMaster master(dbpath);
+	    master.write_changesets_to_fd(fd, revision, NULL,
+					  get<2>(group.first));
+	} catch (const Xapian::Error&) {
+	    continue;
+	}
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size < 0) {
+	    throw Xapian::NetworkError("Couldn't seek temporary file", errno);
+	}
+
+	// Start sending to each replica - run_push() sends the rest as each
+	// is ready for more.
+	for (auto&& sub : group.second) {
+	    bool keep;
+	    try {
+		keep = (*sub)->start_sending(changes, size);
+	    } catch (const Xapian::Error&) {
+		keep = false;
+	    }
+	    if (!keep) sub->reset();
+	}
+    }
+}
+
+#else
+
+void
+ReplicateTcpServer::run_push(double)
+{
+    run();
+}
+
+#endif
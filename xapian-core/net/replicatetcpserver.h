@@ -25,10 +25,35 @@
 
 #include "xapian/visibility.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
 class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpServer : public TcpServer {
     /// The path to pass to DatabaseMaster.
     std::string path;
 
+    /// Compression algorithm to use if the client supports it (-1 for none).
+    int compression = -1;
+
+    /// A replica which has subscribed to pushed changes.
+    struct Subscriber;
+
+    /** Read and act on the messages a subscriber has sent.
+     *
+     *  @return false if the subscriber should be dropped.
+     */
+    bool handle_subscriber_input(Subscriber& sub);
+
+    /** Bring a newly subscribed replica up to date.
+     *
+     *  This happens in a child process.
+     */
+    void start_catch_up(Subscriber& sub);
+
+    /// Send any new changes to subscribers which are waiting for them.
+    void push_changes(std::vector<std::unique_ptr<Subscriber>>& subs);
+
   public:
     /** Construct a ReplicateTcpServer and start listening for connections.
      *
@@ -43,11 +68,39 @@ class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpServer : public TcpServer {
     /// Destructor.
     ~ReplicateTcpServer();
 
+    /** Set the compression algorithm to use for large messages.
+     *
+     *  This is only used for clients which say they support it.
+     *
+     *  @param type	A compression_type value, or -1 for none.
+     */
+    void set_compression(int type) { compression = type; }
+
     /** Handle a single connection on an already connected socket.
      *
      *  This method may be called by multiple threads.
      */
     void handle_one_connection(int socket);
+
+    /** Push changes to subscribed replicas as they happen.
+     *
+     *  Replicas which connect and subscribe (rather than asking for the
+     *  changes since their current revision and disconnecting) are first
+     *  brought up to date, then kept connected.  Every @a interval seconds,
+     *  each database with subscribers is checked for new revisions.  The
+     *  changes needed are generated once for all replicas at the same
+     *  revision, and sent to each of them.  These sends don't block, so a
+     *  replica which is slow to read the changes doesn't hold up the others
+     *  (but one which doesn't read any for 30 seconds is dropped).
+     *
+     *  Replicas which connect without subscribing are sent the changes
+     *  since their revision from a child process, as with run().
+     *
+     *  Requires poll() and fork() - otherwise this just calls run().
+     *
+     *  @param interval	How often to check for new revisions (in seconds).
+     */
+    void run_push(double interval);
 };
 
 #endif // XAPIAN_INCLUDED_REPLICATETCPSERVER_H
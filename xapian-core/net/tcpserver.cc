@@ -31,6 +31,7 @@
 #include "safenetdb.h"
 #include "safesyssocket.h"
 
+#include "errno_to_string.h"
 #include "remoteconnection.h"
 #include "resolver.h"
 #include "socket_utils.h"
@@ -334,6 +335,72 @@ TcpServer::run()
     }
 }
 
+/// Accept and handle connections one after another in a worker process.
+[[noreturn]]
+void
+TcpServer::run_worker()
+{
+    while (true) {
+	try {
+	    int connected_socket = accept_connection();
+	    handle_one_connection(connected_socket);
+	    close(connected_socket);
+
+	    if (verbose) cout << "Connection closed." << endl;
+	} catch (const Xapian::Error &e) {
+	    // FIXME: better error handling.
+	    cerr << "Caught " << e.get_description() << endl;
+	} catch (...) {
+	    // FIXME: better error handling.
+	    cerr << "Caught exception." << endl;
+	}
+    }
+}
+
+void
+TcpServer::run_pool(unsigned n_workers)
+{
+    if (n_workers == 0) {
+	run();
+	return;
+    }
+
+    signal(SIGTERM, on_SIGTERM);
+
+    // Start the workers, and start a replacement for any which exits.  The
+    // workers all accept() on the listening socket, and the kernel hands
+    // each connection to one of them.
+    unsigned running = 0;
+    while (true) {
+	while (running < n_workers) {
+	    pid_t pid = fork();
+	    if (pid == 0) {
+		// Child process.
+		run_worker();
+	    }
+	    if (pid < 0) {
+		int saved_errno = errno;
+		if (running == 0)
+		    throw Xapian::NetworkError("fork failed", saved_errno);
+		// We still have some workers, so carry on with fewer and try
+		// again when one exits.
+		cerr << "fork failed: " << errno_to_string(saved_errno) << endl;
+		break;
+	    }
+	    ++running;
+	}
+
+	int status;
+	pid_t pid = wait(&status);
+	if (pid > 0) {
+	    --running;
+	    if (verbose) cout << "Worker " << pid << " exited." << endl;
+	} else if (errno != EINTR) {
+	    throw Xapian::NetworkError("wait failed", errno);
+	}
+    }
+}
+
 #elif defined __WIN32__
 
 // A threaded, Windows specific, implementation.
@@ -454,6 +521,14 @@ TcpServer::run()
     }
 }
 
+void
+TcpServer::run_pool(unsigned)
+{
+    // We already use a thread per connection here, which avoids most of the
+    // overhead the worker pool is aimed at.
+    run();
+}
+
 #else
 # error Neither HAVE_FORK nor __WIN32__ are defined.
 #endif
@@ -75,9 +75,16 @@ class XAPIAN_VISIBILITY_DEFAULT TcpServer SOCKET_INITIALIZER_MIXIN {
     bool verbose;
 
     /** Accept a connection and return the filedescriptor for it. */
-    XAPIAN_VISIBILITY_INTERNAL
     int accept_connection();
 
+    /// The socket we're listening on, e.g. to poll() it.
+    int get_listen_socket() const { return listen_socket; }
+
+    /// Accept and handle connections one after another, forever.
+    [[noreturn]]
+    XAPIAN_VISIBILITY_INTERNAL
+    void run_worker();
+
   public:
     /** Construct a TcpServer and start listening for connections.
      *
@@ -102,6 +109,21 @@ class XAPIAN_VISIBILITY_DEFAULT TcpServer SOCKET_INITIALIZER_MIXIN {
      */
     void run();
 
+    /** Accept connections and service requests using a pool of workers.
+     *
+     *  This method runs the TcpServer as a daemon which forks @a n_workers
+     *  worker processes up front, each of which accepts and serves
+     *  connections one after another, so handle_one_connection() can reuse
+     *  state (e.g. open databases) between connections in the same worker.
+     *  A replacement is started for any worker which exits.
+     *
+     *  Under Windows, this just calls run().
+     *
+     *  @param n_workers	Number of worker processes (0 means to fork
+     *			per connection as run() does).
+     */
+    void run_pool(unsigned n_workers);
+
     /** Accept a single connection, service requests on it, then stop.  */
     void run_once();
 
@@ -29,9 +29,11 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #define XAPIAN_DEPRECATED(X) X
 #include <xapian.h>
+#include "str.h"
 #include "testsuite.h"
 #include "testutils.h"
 
@@ -1103,6 +1105,84 @@ DEFINE_TESTCASE(fetchdocs1, backend) {
     TEST_EQUAL(it1, mymset2.end());
 }
 
+/// Test getting prefetched documents out of order, mixed with other calls.
+DEFINE_TESTCASE(fetchdocs2, backend) {
+    Xapian::Database db(get_database("apitest_simpledata"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("this"));
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    TEST_REL(mset.size(), >=, 3);
+
+    vector<string> data;
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	data.push_back(db.get_document(*i).get_data());
+    }
+
+    mset.fetch();
+    for (Xapian::doccount i = mset.size(); i-- > 0; ) {
+	TEST(db.term_exists("this"));
+	TEST_EQUAL(mset[i].get_document().get_data(), data[i]);
+    }
+
+    // Get a document which wasn't fetched while others are outstanding.
+    mset.fetch(mset[1], mset[2]);
+    TEST_EQUAL(mset[0].get_document().get_data(), data[0]);
+    TEST_EQUAL(mset[2].get_document().get_data(), data[2]);
+
+    mset.fetch();
+    db.reopen();
+    TEST_EQUAL(mset[1].get_document().get_data(), data[1]);
+}
+
+static void
+make_documentprefetch1_db(Xapian::WritableDatabase& db, const string&)
+{
+    for (int i = 1; i <= 20; ++i) {
+	Xapian::Document doc;
+	doc.set_data("doc " + str(i));
+	doc.add_value(0, str(i));
+	if (i % 3 == 0) doc.add_value(7, "three");
+	for (int j = 0; j < i; ++j) doc.add_term("foo");
+	db.add_document(doc);
+    }
+}
+
+/// Check documents sent with the MSet match those fetched separately.
+DEFINE_TESTCASE(documentprefetch1, generated) {
+    Xapian::Database db = get_database("documentprefetch1",
+				       make_documentprefetch1_db);
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("foo"));
+    Xapian::MSet expected = enquire.get_mset(2, 8);
+    TEST_EQUAL(expected.size(), 8);
+
+    for (Xapian::doccount n : {1, 5, 8, 100}) {
+	enquire.set_document_prefetch(n);
+	Xapian::MSet mset = enquire.get_mset(2, 8);
+	TEST_EQUAL(mset.size(), expected.size());
+	for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	    TEST_EQUAL(*mset[i], *expected[i]);
+	    Xapian::Document doc = mset[i].get_document();
+	    Xapian::Document want = db.get_document(*expected[i]);
+	    TEST_EQUAL(doc.get_data(), want.get_data());
+	    TEST_EQUAL(doc.get_value(0), want.get_value(0));
+	    TEST_EQUAL(doc.get_value(7), want.get_value(7));
+	    TEST_EQUAL(doc.values_count(), want.values_count());
+	}
+    }
+
+    // Documents prefetched for an earlier MSet shouldn't leak into a later
+    // one.
+    enquire.set_document_prefetch(8);
+    (void)enquire.get_mset(0, 8);
+    enquire.set_document_prefetch(0);
+    Xapian::MSet mset = enquire.get_mset(8, 4);
+    for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	TEST_EQUAL(mset[i].get_document().get_data(),
+		   db.get_document(*mset[i]).get_data());
+    }
+}
+
 // test that searching for a term not in the database fails nicely
 DEFINE_TESTCASE(absentterm1, backend) {
     Xapian::Enquire enquire(get_database("apitest_simpledata"));
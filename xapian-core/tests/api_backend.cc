@@ -607,6 +607,282 @@ DEFINE_TESTCASE(databasemodified1, writable && !inmemory && !remote && !multi) {
     }
 }
 
+/// Check Database::lease_revision() stops the leased revision being modified.
+DEFINE_TESTCASE(leaserevision1, glass) {
+    Xapian::WritableDatabase db(get_writable_database());
+    Xapian::Document doc;
+    doc.set_data("cargo");
+    doc.add_term("abc");
+    doc.add_term("def");
+    doc.add_term("ghi");
+    const int N = 500;
+    for (int i = 0; i < N; ++i) {
+	db.add_document(doc);
+    }
+    db.commit();
+
+    Xapian::Database rodb(get_writable_database_as_database());
+    rodb.lease_revision(60);
+    for (int i = 0; i < 5; ++i) {
+	db.add_document(doc);
+	db.commit();
+    }
+    db.add_document(doc);
+
+    TEST_EQUAL(*rodb.termlist_begin(N - 1), "abc");
+    TEST_EQUAL(rodb.get_doccount(), N);
+    Xapian::Enquire enq(rodb);
+    enq.set_query(Xapian::Query("abc"));
+    Xapian::MSet mset = enq.get_mset(0, 10);
+    TEST_EQUAL(mset.get_matches_estimated(), N);
+    db.commit();
+
+    // Leasing a revision which has already been superseded fails.
+    rodb.reopen();
+    db.add_document(doc);
+    db.commit();
+    TEST_EXCEPTION(Xapian::DatabaseModifiedError, rodb.lease_revision(60));
+
+    // Once the database is reopened we can lease the latest revision.
+    rodb.reopen();
+    rodb.lease_revision(60);
+    rodb.lease_revision(0);
+}
+
+/// Check DB_DOCUMENT_LOG lets uncommitted changes survive the writer dying.
+DEFINE_TESTCASE(documentlog1, glass) {
+#if defined HAVE_FORK && defined HAVE_SOCKETPAIR
+    {
+	Xapian::WritableDatabase db = get_named_writable_database("documentlog1");
+	Xapian::Document doc;
+	doc.add_term("a");
+	db.add_document(doc);
+	db.add_document(doc);
+	db.commit();
+    }
+    string path = get_named_writable_database_path("documentlog1");
+
+    pid_t child = fork();
+    if (child == -1)
+	FAIL_TEST("fork() failed");
+    if (child == 0) {
+	try {
+	    // Leak the database so it isn't closed when we exit.
+	    auto db = new Xapian::WritableDatabase(path,
+						   Xapian::DB_OPEN |
+						   Xapian::DB_DOCUMENT_LOG);
+	    Xapian::Document doc;
+	    doc.add_term("b");
+	    db->add_document(doc);
+	    db->commit();
+	    db->add_document(doc);
+	    doc.set_data("replaced");
+	    db->replace_document(2, doc);
+	    db->delete_document(1);
+	    db->begin_transaction(false);
+	    db->add_document(doc);
+	    db->commit_transaction();
+	    // This transaction is never committed, so shouldn't be replayed.
+	    db->begin_transaction(false);
+	    db->add_document(doc);
+	} catch (...) {
+	    _exit(1);
+	}
+	// Exit without committing.
+	_exit(0);
+    }
+
+    int status;
+    while (waitpid(child, &status, 0) < 0) {
+	if (errno != EINTR) FAIL_TEST("waitpid() failed");
+    }
+    TEST(WIFEXITED(status));
+    TEST_EQUAL(WEXITSTATUS(status), 0);
+    TEST(file_exists(path + "/doclog"));
+
+    // Only the first commit made it to disk.
+    Xapian::Database rodb(path);
+    TEST_EQUAL(rodb.get_doccount(), 3);
+    TEST_EQUAL(rodb.get_lastdocid(), 3);
+
+    // Opening for writing replays the rest (even without DB_DOCUMENT_LOG).
+    {
+	Xapian::WritableDatabase db(path, Xapian::DB_OPEN);
+    }
+    TEST(!file_exists(path + "/doclog"));
+    TEST(rodb.reopen());
+    TEST_EQUAL(rodb.get_doccount(), 4);
+    TEST_EQUAL(rodb.get_lastdocid(), 5);
+    TEST_EXCEPTION(Xapian::DocNotFoundError, rodb.get_document(1));
+    TEST_EQUAL(rodb.get_document(2).get_data(), "replaced");
+    TEST_EQUAL(rodb.get_termfreq("b"), 4);
+#else
+    SKIP_TEST("Test requires fork() and socketpair()");
+#endif
+}
+
+/// Check HybridDatabase makes changes searchable before they're committed.
+DEFINE_TESTCASE(hybriddatabase1, glass) {
+    string path = get_named_writable_database_path("hybriddatabase1");
+    Xapian::HybridDatabase hdb(path, Xapian::DB_CREATE_OR_OVERWRITE);
+    for (int i = 1; i <= 3; ++i) {
+	Xapian::Document doc;
+	doc.add_term("Q" + str(i));
+	doc.add_term("old");
+	doc.add_value(0, "old");
+	doc.set_data("old " + str(i));
+	hdb.add_document(doc);
+    }
+    hdb.commit();
+    Xapian::Database committed = hdb.get_database();
+    TEST_EQUAL(Xapian::Database(path).get_doccount(), 3);
+
+    Xapian::Document doc;
+    doc.add_term("Q2");
+    doc.add_term("new");
+    doc.set_data("new 2");
+    hdb.replace_document("Q2", doc);
+    hdb.delete_document("Q3");
+    doc = Xapian::Document();
+    doc.add_term("Q4");
+    doc.add_term("new");
+    doc.set_data("new 4");
+    hdb.add_document(doc);
+
+    // The changes aren't committed, but are visible via get_database().
+    TEST_EQUAL(Xapian::Database(path).get_doccount(), 3);
+    Xapian::Database db = hdb.get_database();
+    TEST_EQUAL(db.get_doccount(), 3);
+    Xapian::Enquire enq(db);
+    enq.set_query(Xapian::Query("old"));
+    Xapian::MSet mset = enq.get_mset(0, 10);
+    TEST_EQUAL(mset.size(), 1);
+    TEST_EQUAL(mset[0].get_document().get_data(), "old 1");
+    enq.set_query(Xapian::Query("new"));
+    TEST_EQUAL(enq.get_mset(0, 10).size(), 2);
+    // Masked documents are skipped by value streams too.
+    TEST_EQUAL(distance(db.valuestream_begin(0), db.valuestream_end(0)), 1);
+    // The termfreq of "Q3" in the glass segment is clamped to its doccount of
+    // 1, but that mustn't be taken to mean it indexes every document there.
+    Xapian::Enquire enq_bool(db);
+    enq_bool.set_query(Xapian::Query(Xapian::Query::OP_SCALE_WEIGHT,
+				     Xapian::Query("Q3"), 0));
+    TEST_EQUAL(enq_bool.get_mset(0, 10).size(), 0);
+    // Nor should it be taken as a lower bound on the number of matches.
+    enq_bool.set_query(Xapian::Query("Q3"));
+    TEST_EQUAL(enq_bool.get_mset(0, 0).get_matches_lower_bound(), 0);
+    enq_bool.set_query(Xapian::Query("Q2"));
+    mset = enq_bool.get_mset(0, 1);
+    TEST_REL(mset.get_matches_lower_bound(), <=, mset.size());
+
+    // Changes are visible straight away through existing Database objects.
+    doc = Xapian::Document();
+    doc.add_term("Q1");
+    doc.add_term("new");
+    hdb.replace_document("Q1", doc);
+    TEST_EQUAL(db.get_termfreq("Q1"), 1);
+    TEST_EQUAL(enq.get_mset(0, 10).size(), 3);
+    TEST_EQUAL(committed.get_doccount(), 3);
+
+    hdb.commit();
+    Xapian::Database glassdb(path);
+    TEST_EQUAL(glassdb.get_doccount(), 3);
+    TEST_EQUAL(glassdb.get_termfreq("new"), 3);
+    TEST_EQUAL(glassdb.get_termfreq("old"), 0);
+    TEST_EQUAL(hdb.get_database().get_doccount(), 3);
+    // Database objects from before the commit still work until the glass
+    // revision they read is overwritten.
+    TEST_EQUAL(enq.get_mset(0, 10).size(), 3);
+}
+
+/// Check DB_TOMBSTONE_DELETES hides deleted documents without removing them.
+DEFINE_TESTCASE(tombstonedelete1, glass) {
+    string path = get_named_writable_database_path("tombstonedelete1");
+    {
+	Xapian::WritableDatabase wdb(path, Xapian::DB_CREATE_OR_OVERWRITE |
+					   Xapian::DB_TOMBSTONE_DELETES);
+	for (int i = 1; i <= 10; ++i) {
+	    Xapian::Document doc;
+	    doc.add_term("Q" + str(i));
+	    doc.add_term("all", i);
+	    if (i % 2 == 0) doc.add_boolean_term("even");
+	    doc.add_value(0, str(i));
+	    doc.set_data(str(i));
+	    wdb.add_document(doc);
+	}
+	wdb.commit();
+
+	for (Xapian::docid did = 2; did <= 5; ++did) {
+	    wdb.delete_document(did);
+	}
+	wdb.delete_document("Q7");
+	TEST_EXCEPTION(Xapian::DocNotFoundError, wdb.delete_document(3));
+	TEST_EXCEPTION(Xapian::DocNotFoundError, wdb.get_document(3));
+	TEST_EXCEPTION(Xapian::DocNotFoundError, wdb.get_doclength(7));
+
+	// The writer sees the deletions before they're committed.
+	TEST_EQUAL(wdb.get_doccount(), 5);
+	TEST_EQUAL(wdb.get_lastdocid(), 10);
+	TEST_EQUAL(wdb.get_total_length(), 2 + 7 + 9 + 10 + 11);
+	TEST_EQUAL(wdb.get_termfreq("all"), 5);
+	TEST_EQUAL(wdb.get_value_freq(0), 5);
+	Xapian::Enquire enq(wdb);
+	enq.set_query(Xapian::Query("all"));
+	TEST_EQUAL(enq.get_mset(0, 10).size(), 5);
+	// The termfreq of "even" is clamped to the doccount of 5, but that
+	// mustn't be taken to mean it indexes every document.
+	enq.set_query(Xapian::Query("even"));
+	enq.set_weighting_scheme(Xapian::BoolWeight());
+	TEST_EQUAL(enq.get_mset(0, 10).size(), 3);
+	// Nor should it be taken as a lower bound on the number of matches.
+	TEST_REL(enq.get_mset(0, 1).get_matches_lower_bound(), <=, 3);
+	wdb.commit();
+    }
+
+    {
+	Xapian::Database db(path);
+	TEST_EQUAL(db.get_doccount(), 5);
+	TEST_EQUAL(db.get_total_length(), 2 + 7 + 9 + 10 + 11);
+	vector<Xapian::docid> dids(db.postlist_begin("all"),
+				   db.postlist_end("all"));
+	TEST_EQUAL(dids.size(), 5);
+	TEST_EQUAL(dids[1], 6);
+	TEST_EQUAL(dids[2], 8);
+	TEST_EQUAL(distance(db.postlist_begin(""), db.postlist_end("")), 5);
+	TEST_EQUAL(distance(db.valuestream_begin(0), db.valuestream_end(0)),
+		   5);
+	TEST_EQUAL(db.postlist_begin("Q2"), db.postlist_end("Q2"));
+	TEST_EXCEPTION(Xapian::DocNotFoundError, db.get_document(2));
+	Xapian::Enquire enq(db);
+	enq.set_query(Xapian::Query(Xapian::Query::OP_FILTER,
+				    Xapian::Query("all"),
+				    Xapian::Query("even")));
+	TEST_EQUAL(enq.get_mset(0, 10).size(), 3);
+	TEST_REL(enq.get_mset(0, 1).get_matches_lower_bound(), <=, 3);
+    }
+
+    {
+	// The tombstones are kept when opened without the flag, and replacing
+	// a deleted document brings it back.
+	Xapian::WritableDatabase wdb(path, Xapian::DB_OPEN);
+	TEST_EXCEPTION(Xapian::DocNotFoundError, wdb.delete_document(4));
+	Xapian::Document doc;
+	doc.add_term("Q3");
+	doc.add_term("new");
+	doc.set_data("new 3");
+	wdb.replace_document(3, doc);
+	wdb.delete_document(6);
+	TEST_EQUAL(wdb.get_doccount(), 5);
+	wdb.commit();
+    }
+    Xapian::Database db(path);
+    TEST_EQUAL(db.get_doccount(), 5);
+    TEST_EQUAL(db.get_document(3).get_data(), "new 3");
+    TEST_EQUAL(db.get_total_length(), 2 + 2 + 9 + 10 + 11);
+    TEST_EQUAL(distance(db.postlist_begin("all"), db.postlist_end("all")), 4);
+    TEST_EQUAL(Xapian::Database::check(path, 0, &tout), 0);
+}
+
 /// Regression test for bug#462 fixed in 1.0.19 and 1.1.5.
 DEFINE_TESTCASE(qpmemoryleak1, writable && !inmemory) {
     // Inmemory never throws DatabaseModifiedError.
@@ -1200,6 +1476,97 @@ DEFINE_TESTCASE(notermlist1, glass) {
     TEST_EXCEPTION(Xapian::FeatureUnavailableError, db.termlist_begin(1));
 }
 
+/// Feature test for Xapian::DB_COMPRESS_LZ4 and Xapian::DB_COMPRESS_ZSTD.
+DEFINE_TESTCASE(compressflags1, glass) {
+    string db_dir = "." + get_dbtype();
+    mkdir(db_dir.c_str(), 0755);
+    db_dir += "/db__compressflags1";
+    string out_dir = db_dir + "_out";
+
+    int flags = Xapian::DB_CREATE|Xapian::DB_BACKEND_GLASS;
+    rm_rf(db_dir);
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+	Xapian::WritableDatabase(db_dir, flags |
+				 Xapian::DB_COMPRESS_LZ4 |
+				 Xapian::DB_COMPRESS_ZSTD));
+
+    // Highly compressible document data.
+    string data;
+    for (int i = 0; i < 100; ++i) {
+	data += "{\"key\":\"value ";
+	data += str(i);
+	data += "\"}";
+    }
+
+    // Less compressible document data, large enough that it needs splitting
+    // over several items even after compression.
+    string big_data;
+    unsigned r = 1;
+    while (big_data.size() < 100000) {
+	r = r * 1103515245 + 12345;
+	big_data += str(r >> 16);
+    }
+
+    bool tested = false;
+    for (int compress_flag : { Xapian::DB_COMPRESS_LZ4,
+			       Xapian::DB_COMPRESS_ZSTD }) {
+	rm_rf(db_dir);
+	try {
+	    Xapian::WritableDatabase db(db_dir, flags | compress_flag);
+	    for (int i = 0; i < 100; ++i) {
+		Xapian::Document doc;
+		doc.set_data(data + str(i));
+		for (int j = 0; j < 50; ++j) {
+		    doc.add_term("term" + str(j));
+		}
+		db.add_document(doc);
+	    }
+	    // Add a document whose compressed data needs splitting over
+	    // several items.
+	    Xapian::Document doc;
+	    doc.set_data(big_data);
+	    db.add_document(doc);
+	    db.commit();
+	} catch (const Xapian::FeatureUnavailableError&) {
+	    continue;
+	}
+	tested = true;
+
+	Xapian::Database db(db_dir);
+	TEST_EQUAL(db.get_doccount(), 101);
+	TEST_EQUAL(db.get_document(3).get_data(), data + "2");
+	TEST_EQUAL(db.get_document(101).get_data(), big_data);
+	TEST_EQUAL(db.get_document(3).termlist_count(), 50);
+	TEST_REL(file_size(db_dir + "/docdata.glass"),<,
+		 off_t(data.size() * 50 + big_data.size()));
+
+	// Check that compacting works, including when the inputs use
+	// different compression algorithms.
+	Xapian::WritableDatabase zlib_db(db_dir + "_zlib",
+					 Xapian::DB_CREATE_OR_OVERWRITE |
+					 Xapian::DB_BACKEND_GLASS);
+	Xapian::Document doc;
+	doc.set_data(data);
+	zlib_db.add_document(doc);
+	zlib_db.commit();
+
+	Xapian::Database inputs(db_dir);
+	inputs.add_database(Xapian::Database(db_dir + "_zlib"));
+	rm_rf(out_dir);
+	inputs.compact(out_dir);
+	Xapian::Database out(out_dir);
+	TEST_EQUAL(out.get_doccount(), 102);
+	TEST_EQUAL(out.get_document(100).get_data(), data + "99");
+	TEST_EQUAL(out.get_document(101).get_data(), big_data);
+	TEST_EQUAL(out.get_document(102).get_data(), data);
+	TEST_EQUAL(out.get_document(100).termlist_count(), 50);
+	rm_rf(db_dir + "_zlib");
+    }
+    if (!tested) {
+	SKIP_TEST("Neither LZ4 nor Zstandard support enabled");
+    }
+}
+
 /// Regression test for bug starting a new glass freelist block.
 DEFINE_TESTCASE(newfreelistblock1, writable) {
     Xapian::Document doc;
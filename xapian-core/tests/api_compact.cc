@@ -727,3 +727,180 @@ DEFINE_TESTCASE(compact1, compact && writable) {
 
     TEST_EQUAL(Xapian::Database(output).get_doccount(), 3);
 }
+
+/// Generate JSON-like document data with a lot in common between documents.
+static string
+make_json_docdata(Xapian::docid did)
+{
+    static const char * const colours[] = {
+	"red", "orange", "yellow", "green", "blue", "indigo", "violet"
+    };
+    string data = "{\"id\":";
+    data += str(did);
+    data += ",\"title\":\"Document number ";
+    data += str(did * 7919 % 10007);
+    data += "\",\"author\":{\"name\":\"Author ";
+    data += str(did % 37);
+    data += "\",\"email\":\"author";
+    data += str(did % 37);
+    data += "@example.org\"},\"url\":\"https://www.example.org/documents/";
+    data += str(did);
+    data += ".html\",\"colour\":\"";
+    data += colours[did % 7];
+    data += "\",\"created\":\"2026-";
+    data += str(did % 12 + 1);
+    data += "-";
+    data += str(did % 28 + 1);
+    data += "T12:00:00Z\",\"tags\":[\"tag";
+    data += str(did % 11);
+    data += "\",\"tag";
+    data += str(did % 13);
+    data += "\"],\"summary\":\"This is the summary text for this document, "
+	    "which is much the same as for all the other documents.\"}";
+    return data;
+}
+
+// Test compaction with a dictionary for document data.  With multi the docids
+// in the shards change the behaviour.
+DEFINE_TESTCASE(compactdocdatadict1, compact && writable && !multi) {
+    const Xapian::doccount N = 500;
+    Xapian::WritableDatabase db = get_writable_database();
+    for (Xapian::docid did = 1; did <= N; ++did) {
+	Xapian::Document doc;
+	doc.set_data(make_json_docdata(did));
+	doc.add_boolean_term("Q" + str(did));
+	db.add_document(doc);
+    }
+    // Also a document without data.
+    db.add_document(Xapian::Document());
+    db.commit();
+
+    string plain = get_compaction_output_path("compactdocdatadict1-plain");
+    string output = get_compaction_output_path("compactdocdatadict1-out");
+    rm_rf(plain);
+    rm_rf(output);
+    db.compact(plain);
+    db.compact(output, Xapian::DBCOMPACT_DOCDATA_DICTIONARY);
+    db.close();
+
+    TEST_EQUAL(Xapian::Database::check(output, 0, &tout), 0);
+
+    // The dictionary should more than pay for itself.
+    off_t plain_size = file_size(plain + "/docdata.glass");
+    off_t output_size = file_size(output + "/docdata.glass");
+    tout << "docdata size " << plain_size << " -> " << output_size << '\n';
+    TEST_REL(output_size, <, plain_size);
+
+    {
+	Xapian::Database outdb(output);
+	TEST_EQUAL(outdb.get_doccount(), N + 1);
+	for (Xapian::docid did = 1; did <= N; ++did) {
+	    TEST_EQUAL(outdb.get_document(did).get_data(),
+		       make_json_docdata(did));
+	}
+	TEST_EQUAL(outdb.get_document(N + 1).get_data(), string());
+    }
+
+    // Document data added after compaction should use the dictionary too.
+    {
+	Xapian::WritableDatabase wdb(output, Xapian::DB_OPEN);
+	Xapian::Document doc;
+	doc.set_data(make_json_docdata(N + 2));
+	TEST_EQUAL(wdb.add_document(doc), N + 2);
+	doc.set_data(make_json_docdata(N + 3));
+	wdb.replace_document(1, doc);
+	wdb.commit();
+    }
+    TEST_EQUAL(Xapian::Database::check(output, 0, &tout), 0);
+    {
+	Xapian::Database outdb(output);
+	TEST_EQUAL(outdb.get_document(1).get_data(), make_json_docdata(N + 3));
+	TEST_EQUAL(outdb.get_document(2).get_data(), make_json_docdata(2));
+	TEST_EQUAL(outdb.get_document(N + 2).get_data(),
+		   make_json_docdata(N + 2));
+    }
+
+    // Compacting a database which uses a dictionary should build a new one
+    // even without the flag.
+    string output2 = get_compaction_output_path("compactdocdatadict1-out2");
+    rm_rf(output2);
+    Xapian::Database(output).compact(output2);
+    TEST_EQUAL(Xapian::Database::check(output2, 0, &tout), 0);
+    {
+	Xapian::Database outdb(output2);
+	TEST_EQUAL(outdb.get_doccount(), N + 2);
+	TEST_EQUAL(outdb.get_document(1).get_data(), make_json_docdata(N + 3));
+	TEST_EQUAL(outdb.get_document(N).get_data(), make_json_docdata(N));
+	TEST_EQUAL(outdb.get_document(N + 2).get_data(),
+		   make_json_docdata(N + 2));
+    }
+
+#ifdef XAPIAN_HAS_HONEY_BACKEND
+    string honey = get_compaction_output_path("compactdocdatadict1-honey");
+    rm_rf(honey);
+    Xapian::Database(output).compact(honey,
+				     Xapian::DB_BACKEND_HONEY |
+				     Xapian::DBCOMPACT_DOCDATA_DICTIONARY);
+    {
+	Xapian::Database outdb(honey);
+	TEST_EQUAL(outdb.get_doccount(), N + 2);
+	for (Xapian::docid did = 2; did <= N; ++did) {
+	    TEST_EQUAL(outdb.get_document(did).get_data(),
+		       make_json_docdata(did));
+	}
+	TEST_EQUAL(outdb.get_document(1).get_data(), make_json_docdata(N + 3));
+    }
+#endif
+}
+
+/// Check compacting removes documents deleted with DB_TOMBSTONE_DELETES.
+DEFINE_TESTCASE(compacttombstones1, glass) {
+    string path = get_named_writable_database_path("compacttombstones1");
+    {
+	Xapian::WritableDatabase wdb(path, Xapian::DB_CREATE_OR_OVERWRITE |
+					   Xapian::DB_TOMBSTONE_DELETES);
+	for (int i = 1; i <= 1000; ++i) {
+	    Xapian::Document doc;
+	    doc.add_term("Q" + str(i));
+	    doc.add_posting("all", 1, i % 3 + 1);
+	    if (i % 2) doc.add_term("odd");
+	    doc.add_value(0, str(i % 10));
+	    if (i % 100 == 0) doc.add_value(1, "x");
+	    doc.set_data(str(i));
+	    wdb.add_document(doc);
+	}
+	wdb.commit();
+	// Delete the first 900 documents apart from multiples of 100, leaving
+	// one in each initial postlist chunk.
+	for (Xapian::docid did = 1; did <= 900; ++did) {
+	    if (did % 100) wdb.delete_document(did);
+	}
+	wdb.commit();
+    }
+
+    Xapian::Database db(path);
+    string out = get_compaction_output_path("compacttombstones1-out");
+    rm_rf(out);
+    db.compact(out, Xapian::DBCOMPACT_NO_RENUMBER);
+    TEST_EQUAL(Xapian::Database::check(out, 0, &tout), 0);
+
+    Xapian::Database outdb(out);
+    dbcheck(outdb, db.get_doccount(), db.get_lastdocid());
+    TEST_EQUAL(outdb.get_doccount(), 109);
+    TEST_EQUAL(outdb.get_lastdocid(), 1000);
+    TEST_EQUAL(outdb.get_total_length(), db.get_total_length());
+    // The term and value frequencies are exact again after compaction.
+    TEST_EQUAL(outdb.get_termfreq("all"), 109);
+    TEST_EQUAL(outdb.get_termfreq("odd"), 50);
+    TEST_EQUAL(outdb.get_collection_freq("all"), db.get_total_length() - 109 -
+						 outdb.get_termfreq("odd"));
+    TEST_EQUAL(outdb.get_value_freq(0), 109);
+    TEST_EQUAL(outdb.get_value_freq(1), 10);
+    TEST(!outdb.term_exists("Q1"));
+    TEST_EQUAL(outdb.get_termfreq("Q100"), 1);
+    TEST_EQUAL(outdb.get_document(950).get_data(), "950");
+    TEST_EQUAL(outdb.get_document(950).get_value(0), "0");
+    TEST_EQUAL(distance(outdb.positionlist_begin(100, "all"),
+			outdb.positionlist_end(100, "all")), 1);
+    TEST_EXCEPTION(Xapian::DocNotFoundError, outdb.get_document(1));
+}
@@ -863,6 +863,285 @@ DEFINE_TESTCASE(keepalive1, remote) {
 			      enquire.get_mset(0, 10));
 }
 
+/// Test pooled remote connections.
+DEFINE_TESTCASE(remotepool1, remote && !multi) {
+    skip_test_unless_backend("remotetcp");
+    // The server is started with --one-shot, so only accepts one connection.
+    int port = get_remote_database_port("apitest_simpledata");
+    {
+	Xapian::Database db = Xapian::Remote::open_pooled("127.0.0.1", port);
+	TEST_EQUAL(db.get_doccount(), 6);
+	Xapian::Enquire enquire(db);
+	enquire.set_query(Xapian::Query("word"));
+	TEST_EQUAL(enquire.get_mset(0, 10).size(), 2);
+	// Leave a document request outstanding when db is released.
+	db.get_document(1, Xapian::DOC_ASSUME_VALID);
+    }
+
+    // This would fail if the connection wasn't reused.
+    for (int i = 0; i < 3; ++i) {
+	Xapian::Database db = Xapian::Remote::open_pooled("127.0.0.1", port);
+	TEST_EQUAL(db.get_doccount(), 6);
+	TEST_EQUAL(db.get_document(1).get_data(),
+		   get_database("apitest_simpledata").get_document(1).get_data());
+	Xapian::Remote::keep_pool_alive();
+    }
+
+    Xapian::Remote::keep_pool_alive();
+    {
+	Xapian::Database db = Xapian::Remote::open_pooled("127.0.0.1", port);
+	Xapian::Enquire enquire(db);
+	enquire.set_query(Xapian::Query("word"));
+	TEST_EQUAL(enquire.get_mset(0, 10).size(), 2);
+    }
+
+    Xapian::Remote::clear_pool();
+}
+
+/// Test xapian-tcpsrv --group-commit.
+DEFINE_TESTCASE(remotegroupcommit1, remote && writable && !multi) {
+    skip_test_unless_backend("remotetcp");
+    // Use a client timeout so that a commit which never gets acknowledged
+    // fails the test rather than hanging.
+    const unsigned timeout = 10000;
+    {
+	int port = get_writable_database_port("remotegroupcommit1a",
+					      "--group-commit 200");
+	Xapian::WritableDatabase wdb1 =
+	    Xapian::Remote::open_writable("127.0.0.1", port, timeout);
+	Xapian::WritableDatabase wdb2 =
+	    Xapian::Remote::open_writable("127.0.0.1", port, timeout);
+	Xapian::Database rdb = Xapian::Remote::open("127.0.0.1", port, timeout);
+
+	// The writers share one database.
+	Xapian::Document doc1;
+	doc1.add_term("one");
+	TEST_EQUAL(wdb1.add_document(doc1), 1);
+	Xapian::Document doc2;
+	doc2.add_term("two");
+	TEST_EQUAL(wdb2.add_document(doc2), 2);
+
+	// A reader shouldn't see changes which haven't been committed.
+	TEST_EQUAL(rdb.get_termfreq("one"), 0);
+	TEST_EQUAL(rdb.get_termfreq("two"), 0);
+
+	// wdb2 isn't waiting to commit, so this is acknowledged once the
+	// delay has passed, and commits wdb2's changes too.
+	wdb1.commit();
+	TEST(rdb.reopen());
+	TEST_EQUAL(rdb.get_doccount(), 2);
+	TEST_EQUAL(rdb.get_termfreq("one"), 1);
+	TEST_EQUAL(rdb.get_termfreq("two"), 1);
+
+	// Changes can't be cancelled as they may be from other clients.
+	wdb2.begin_transaction(false);
+	wdb2.add_document(doc2);
+	TEST_EXCEPTION(Xapian::UnimplementedError, wdb2.cancel_transaction());
+    }
+
+    {
+	// With a long delay, commits only happen when every writer is waiting
+	// - a reader shouldn't count.
+	int port = get_writable_database_port("remotegroupcommit1b",
+					      "--group-commit 3600000");
+	Xapian::WritableDatabase wdb =
+	    Xapian::Remote::open_writable("127.0.0.1", port, timeout);
+	Xapian::Database rdb = Xapian::Remote::open("127.0.0.1", port, timeout);
+	wdb.add_document(Xapian::Document());
+	wdb.commit();
+	TEST(rdb.reopen());
+	TEST_EQUAL(rdb.get_doccount(), 1);
+    }
+
+    {
+	// Or when --group-size writers are waiting.
+	int port = get_writable_database_port("remotegroupcommit1c",
+					      "--group-commit 3600000 "
+					      "--group-size 1");
+	Xapian::WritableDatabase wdb1 =
+	    Xapian::Remote::open_writable("127.0.0.1", port, timeout);
+	Xapian::WritableDatabase wdb2 =
+	    Xapian::Remote::open_writable("127.0.0.1", port, timeout);
+	wdb1.add_document(Xapian::Document());
+	wdb1.commit();
+	wdb2.add_document(Xapian::Document());
+	wdb2.commit();
+	Xapian::Database rdb = Xapian::Remote::open("127.0.0.1", port, timeout);
+	TEST_EQUAL(rdb.get_doccount(), 2);
+    }
+}
+
+/// Test hedging queries to replicas of remote shards.
+DEFINE_TESTCASE(hedge1, remote && !multi) {
+    Xapian::Database db = get_database("apitest_simpledata");
+    Xapian::Database replica = get_database("apitest_simpledata");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Remote::add_replica(db, db));
+    Xapian::Remote::add_replica(db, replica);
+    // Would create a cycle.
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Remote::add_replica(replica, db));
+
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("this"));
+    enquire.set_document_prefetch(10);
+    // With the default setting we only hedge once we've seen enough
+    // queries to estimate the 95th percentile latency.
+    Xapian::MSet expected = enquire.get_mset(0, 10);
+    TEST(!expected.empty());
+    for (int i = 0; i < 30; ++i) {
+	Xapian::MSet mset = enquire.get_mset(0, 10);
+	TEST(mset_range_is_same(mset, 0, expected, 0, expected.size()));
+    }
+
+    // Hedge every query almost immediately so the results can come from
+    // either, and check they're always correct.
+    enquire.set_hedge_delay(1e-9);
+    for (int i = 0; i < 10; ++i) {
+	Xapian::MSet mset = enquire.get_mset(0, 10);
+	TEST(mset_range_is_same(mset, 0, expected, 0, expected.size()));
+	for (Xapian::doccount j = 0; j != mset.size(); ++j) {
+	    Xapian::docid did = *mset[j];
+	    TEST_EQUAL(mset[j].get_document().get_data(),
+		       replica.get_document(did).get_data());
+	}
+    }
+
+    // Check hedging when waiting for more than one remote shard.
+    Xapian::Database combined = db;
+    combined.add_database(get_database("apitest_simpledata"));
+    enquire = Xapian::Enquire(combined);
+    enquire.set_query(Xapian::Query("this"));
+    expected = enquire.get_mset(0, 10);
+    enquire.set_hedge_delay(1e-9);
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    TEST(mset_range_is_same(mset, 0, expected, 0, expected.size()));
+}
+
+/// Test partial results when a remote shard fails.
+DEFINE_TESTCASE(shardtimeout1, remote && !multi) {
+    Xapian::Enquire enquire(get_database("apitest_simpledata"));
+    enquire.set_query(Xapian::Query("this"));
+    Xapian::MSet expected = enquire.get_mset(0, 10);
+    TEST(!expected.empty());
+    TEST(expected.get_missing_shards().empty());
+
+    // The server for the second shard exits after being idle for 1 second.
+    Xapian::Database db = get_database("apitest_simpledata");
+    db.add_database(get_remote_database("apitest_simpledata", 1000));
+    enquire = Xapian::Enquire(db);
+    enquire.set_query(Xapian::Query("this"));
+    enquire.set_shard_timeout(10.0);
+    Xapian::MSet mset = enquire.get_mset(0, 20);
+    TEST(mset.get_missing_shards().empty());
+    TEST_EQUAL(mset.size(), expected.size() * 2);
+
+    sleep(2);
+    mset = enquire.get_mset(0, 20);
+    TEST_EQUAL(mset.get_missing_shards().size(), 1);
+    TEST_EQUAL(mset.get_missing_shards()[0], 1);
+    // We should get the results from the first shard.
+    TEST_EQUAL(mset.size(), expected.size());
+    for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	TEST_EQUAL(*mset[i], (*expected[i] - 1) * 2 + 1);
+    }
+
+    // Without a shard timeout, the failure should be reported.
+    enquire.set_shard_timeout(0.0);
+    TEST_EXCEPTION_BASE_CLASS(Xapian::Error, enquire.get_mset(0, 10));
+}
+
+/// Test partial results when remote shards are slow.
+DEFINE_TESTCASE(shardtimeout2, remote && !multi) {
+    Xapian::Database db = get_database("apitest_simpledata");
+    db.add_database(get_database("apitest_simpledata"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("this"));
+    Xapian::MSet expected = enquire.get_mset(0, 20);
+
+    // With a tiny timeout shards may or may not be ready in time, but any
+    // which aren't shouldn't cause an exception, and if all are ready we
+    // should get the full results.
+    enquire.set_shard_timeout(1e-9);
+    for (int i = 0; i < 10; ++i) {
+	Xapian::MSet mset = enquire.get_mset(0, 20);
+	auto missing = mset.get_missing_shards();
+	TEST_REL(missing.size(), <=, 2);
+	if (missing.empty()) {
+	    TEST(mset_range_is_same(mset, 0, expected, 0, expected.size()));
+	} else {
+	    TEST_REL(mset.size(), <, expected.size());
+	}
+    }
+
+    // Shards should work normally once we stop timing out.
+    enquire.set_shard_timeout(0.0);
+    Xapian::MSet mset = enquire.get_mset(0, 20);
+    TEST(mset_range_is_same(mset, 0, expected, 0, expected.size()));
+}
+
+/// Test caching of statistics from remote shards.
+DEFINE_TESTCASE(remotestatscache1, remote && writable && !multi) {
+    Xapian::WritableDatabase wdb = get_writable_database();
+    Xapian::Document doc;
+    doc.add_term("foo");
+    wdb.add_document(doc);
+    doc.add_term("bar");
+    wdb.add_document(doc);
+    wdb.commit();
+
+    Xapian::Database db = get_writable_database_as_database();
+    Xapian::Database both = db;
+    both.add_database(get_writable_database_as_database());
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire enquire_both(both);
+    for (int i = 0; i < 3; ++i) {
+	// After the first time, the stats should come from the cache.
+	enquire.set_query(Xapian::Query("foo"));
+	Xapian::MSet mset = enquire.get_mset(0, 10);
+	TEST_EQUAL(mset.size(), 2);
+	TEST_EQUAL(mset.get_termfreq("foo"), 2);
+
+	enquire.set_query(Xapian::Query("bar"));
+	mset = enquire.get_mset(0, 10);
+	TEST_EQUAL(mset.size(), 1);
+	TEST_EQUAL(mset.get_termfreq("bar"), 1);
+
+	enquire_both.set_query(Xapian::Query("foo"));
+	mset = enquire_both.get_mset(0, 10);
+	TEST_EQUAL(mset.size(), 4);
+	TEST_EQUAL(mset.get_termfreq("foo"), 4);
+    }
+
+    wdb.add_document(doc);
+    wdb.commit();
+    // Until db is reopened, the server should still use the old revision.
+    enquire.set_query(Xapian::Query("bar"));
+    TEST_EQUAL(enquire.get_mset(0, 10).get_termfreq("bar"), 1);
+    // The cached stats mustn't be used after reopening.
+    db.reopen();
+    for (int i = 0; i < 2; ++i) {
+	Xapian::MSet mset = enquire.get_mset(0, 10);
+	TEST_EQUAL(mset.size(), 2);
+	TEST_EQUAL(mset.get_termfreq("bar"), 2);
+    }
+}
+
+/// Test Database::preload().
+DEFINE_TESTCASE(preload1, backend) {
+    Xapian::Database db = get_database("etext");
+    db.preload();
+    db.preload(0);
+    db.preload(5, 1024 * 1024 * 1024);
+
+    // Check the database still works normally afterwards.
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("the"));
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    TEST_EQUAL(mset.size(), 10);
+    TEST_EQUAL(mset.get_matches_estimated(), db.get_termfreq("the"));
+}
+
 // test that iterating through all terms in a database works.
 DEFINE_TESTCASE(allterms1, backend) {
     Xapian::Database db(get_database("apitest_allterms"));
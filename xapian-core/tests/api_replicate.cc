@@ -28,6 +28,8 @@
 
 #include <xapian.h>
 #include "api/replication.h"
+#include "net/replicatetcpclient.h"
+#include "net/replicatetcpserver.h"
 
 #include "apitest.h"
 #include "dbcheck.h"
@@ -39,11 +41,16 @@
 #include "safesysstat.h"
 #include "safeunistd.h"
 #include "setenv.h"
+#include "str.h"
 #include "testsuite.h"
 #include "testutils.h"
 #include "unixcmds.h"
 
 #include <sys/types.h>
+#ifdef HAVE_FORK
+# include <signal.h>
+# include <sys/wait.h>
+#endif
 
 #include <cerrno>
 #include <cstdlib>
@@ -143,7 +150,8 @@ get_changeset(const string & changesetpath,
 	      int expected_changesets,
 	      int expected_fullcopies,
 	      bool expected_changed,
-	      bool full_copy = false)
+	      bool full_copy = false,
+	      int compression = -1)
 {
     FD fd(open(changesetpath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666));
     if (fd == -1) {
@@ -153,7 +161,8 @@ get_changeset(const string & changesetpath,
     Xapian::ReplicationInfo info1;
     master.write_changesets_to_fd(fd,
 				  full_copy ? "" : replica.get_revision_info(),
-				  &info1);
+				  &info1,
+				  compression);
 
     TEST_EQUAL(info1.changeset_count, expected_changesets);
     TEST_EQUAL(info1.fullcopy_count, expected_fullcopies);
@@ -205,14 +214,16 @@ replicate(Xapian::DatabaseMaster & master,
 	  int expected_changesets,
 	  int expected_fullcopies,
 	  bool expected_changed,
-	  bool full_copy = false)
+	  bool full_copy = false,
+	  int compression = -1)
 {
     string changesetpath = tempdir + "/changeset";
     get_changeset(changesetpath, master, replica,
 		  expected_changesets,
 		  expected_fullcopies,
 		  expected_changed,
-		  full_copy);
+		  full_copy,
+		  compression);
     return apply_changeset(changesetpath, replica,
 			   expected_changesets,
 			   expected_fullcopies,
@@ -247,6 +258,81 @@ struct unset_max_changesets_helper_ {
 // testcase, even if this one exits with an exception.
 #define UNSET_MAX_CHANGESETS_AFTERWARDS unset_max_changesets_helper_ ezlxq
 
+#if defined HAVE_POLL && defined HAVE_FORK
+
+/// A ReplicateTcpServer pushing changes, run in a child process.
+class PushServer {
+    pid_t pid = -1;
+
+    void (*old_handler)(int);
+
+  public:
+    /// The port the server is listening on.
+    int port;
+
+    /** Start the server.
+     *
+     *  @param path	The parent directory of the databases to serve.
+     *  @param interval	How often to check for new revisions (in seconds).
+     */
+    PushServer(const string& path, double interval) {
+	// We want to be able to get the exit status of the child process.
+	old_handler = signal(SIGCHLD, SIG_DFL);
+	for (port = 1239; port < 65536; ++port) {
+	    int fds[2];
+	    if (pipe(fds) < 0) {
+		FAIL_TEST("Couldn't create pipe");
+	    }
+	    pid = fork();
+	    if (pid == 0) {
+		// Child process.  ReplicateTcpServer exits with status 69 if
+		// the port is in use.
+		close(fds[0]);
+		try {
+		    ReplicateTcpServer server("127.0.0.1", port, path);
+		    // Tell the parent we're listening.
+		    if (write(fds[1], "", 1) == 1) {
+			close(fds[1]);
+			server.run_push(interval);
+		    }
+		} catch (...) {
+		}
+		_exit(1);
+	    }
+	    close(fds[1]);
+	    if (pid < 0) {
+		close(fds[0]);
+		FAIL_TEST("Couldn't fork");
+	    }
+	    char ch;
+	    ssize_t n;
+	    do {
+		n = read(fds[0], &ch, 1);
+	    } while (n < 0 && errno == EINTR);
+	    close(fds[0]);
+	    if (n == 1) return;
+	    int status;
+	    pid_t r = waitpid(pid, &status, 0);
+	    pid = -1;
+	    if (r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 69) {
+		FAIL_TEST("Couldn't start replication server");
+	    }
+	}
+	FAIL_TEST("Couldn't find a free port for replication server");
+    }
+
+    ~PushServer() {
+	if (pid > 0) {
+	    kill(pid, SIGTERM);
+	    int status;
+	    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+	}
+	signal(SIGCHLD, old_handler);
+    }
+};
+
+#endif
+
 #endif
 
 // #######################################################################
@@ -822,6 +908,34 @@ DEFINE_TESTCASE(replicate6, replicas) {
 #endif
 }
 
+// Truncate all the files in a directory to size 0.
+static void
+truncate_all_files(const string & d)
+{
+    DIR * dir = opendir(d.c_str());
+    TEST(dir != NULL);
+    while (true) {
+	errno = 0;
+	struct dirent * entry = readdir(dir);
+	if (!entry) {
+	    if (errno == 0)
+		break;
+	    FAIL_TEST("readdir failed: " << errno_to_string(errno));
+	}
+
+	// Skip '.' and '..'.
+	if (entry->d_name[0] == '.') continue;
+
+	string file = d;
+	file += '/';
+	file += entry->d_name;
+	int fd = open(file.c_str(), O_WRONLY|O_TRUNC, 0666);
+	TEST(fd != -1);
+	TEST(close(fd) == 0);
+    }
+    closedir(dir);
+}
+
 /// Test healing a corrupt replica (new in 1.3.5).
 DEFINE_TESTCASE(replicate7, replicas) {
 #ifdef XAPIAN_HAS_REMOTE_BACKEND
@@ -859,41 +973,349 @@ DEFINE_TESTCASE(replicate7, replicas) {
 	}
     }
 
+    // Corrupt replica by truncating all the files to size 0.
+    truncate_all_files(replicapath + "/replica_1");
+
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	// The corrupt database should be removed as soon as a copy starts,
+	// rather than once the copy is made live.
+	string changesetpath = tempdir + "/changeset";
+	get_changeset(changesetpath, master, replica, 0, 1, true);
+	string brokenchangesetpath = tempdir + "/changeset_broken";
+	truncated_copy(changesetpath, brokenchangesetpath,
+		       get_file_size(changesetpath) / 2);
+	TEST_EXCEPTION(Xapian::NetworkError,
+		       apply_changeset(brokenchangesetpath, replica,
+				       0, 1, true));
+	TEST(!dir_exists(replicapath + "/replica_1"));
+
+	// Replication should succeed and perform a full copy.
+	int count = replicate(master, replica, tempdir, 0, 1, true);
+	TEST_EQUAL(count, 1);
+
+	check_equal_dbs(masterpath, replicapath);
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+#endif
+}
+
+/// Test replication with large messages compressed.
+DEFINE_TESTCASE(replicate8, replicas) {
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	// Use document data which compresses well so that both the database
+	// files and the changesets are large enough to get compressed.
+	Xapian::Document doc;
+	doc.set_data(string(10000, 'x'));
+	doc.add_posting("doc", 1);
+	for (int i = 0; i < 100; ++i) {
+	    orig.add_document(doc);
+	}
+	orig.commit();
+
+	// Generate a full copy without compression to compare the size with.
+	string plainpath = tempdir + "/plain";
+	get_changeset(plainpath, master, replica, 0, 1, true, true);
+
+	// A full copy, sent compressed with zlib (which is always available).
+	int count = replicate(master, replica, tempdir, 0, 1, true, false, 0);
+	TEST_EQUAL(count, 1);
+	TEST_REL(get_file_size(tempdir + "/changeset"), <,
+		 get_file_size(plainpath));
+	check_equal_dbs(masterpath, replicapath);
+
+	for (int i = 0; i < 100; ++i) {
+	    orig.add_document(doc);
+	}
+	orig.commit();
+
+	// A changeset, sent compressed.
+	count = replicate(master, replica, tempdir, 1, 0, true, false, 0);
+	TEST_EQUAL(count, 2);
+	check_equal_dbs(masterpath, replicapath);
+
+	{
+	    Xapian::Database dbcopy(replicapath);
+	    TEST_EQUAL(dbcopy.get_doccount(), 200);
+	    TEST_EQUAL(dbcopy.get_document(200).get_data(), string(10000, 'x'));
+	}
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+#endif
+}
+
+/// Test replicating from a replica which keeps changesets.
+DEFINE_TESTCASE(replicate9, replicas) {
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+
+    Xapian::Document doc1;
+    doc1.set_data(string("doc1"));
+    doc1.add_posting("doc", 1);
+    doc1.add_posting("one", 1);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string relaypath = tempdir + "/relay";
+    string replicapath = tempdir + "/replica";
     {
-	// Corrupt replica by truncating all the files to size 0.
-	string d = replicapath;
-	d += "/replica_1";
-	DIR * dir = opendir(d.c_str());
-	TEST(dir != NULL);
-	while (true) {
-	    errno = 0;
-	    struct dirent * entry = readdir(dir);
-	    if (!entry) {
-		if (errno == 0)
-		    break;
-		FAIL_TEST("readdir failed: " << errno_to_string(errno));
+	Xapian::DatabaseReplica relay(relaypath);
+	Xapian::DatabaseMaster relay_master(relaypath);
+	Xapian::DatabaseReplica replica(replicapath);
+
+	orig.add_document(doc1);
+	orig.commit();
+
+	// Both need a full copy to start with.
+	TEST_EQUAL(replicate(master, relay, tempdir, 0, 1, true), 1);
+	TEST_EQUAL(replicate(relay_master, replica, tempdir, 0, 1, true), 1);
+
+	orig.add_document(doc1);
+	orig.commit();
+	orig.add_document(doc1);
+	orig.commit();
+
+	// The relay applies the changesets from the master and keeps them, so
+	// the replica can be updated from the relay with changesets too.
+	TEST_EQUAL(replicate(master, relay, tempdir, 2, 0, true), 3);
+	TEST_EQUAL(replicate(relay_master, replica, tempdir, 2, 0, true), 3);
+	check_equal_dbs(masterpath, replicapath);
+
+	// If XAPIAN_MAX_CHANGESETS isn't set when the relay applies a
+	// changeset, it isn't kept so the replica needs a full copy.
+	orig.add_document(doc1);
+	orig.commit();
+	set_max_changesets(0);
+	TEST_EQUAL(replicate(master, relay, tempdir, 1, 0, true), 2);
+	TEST_EQUAL(replicate(relay_master, replica, tempdir, 0, 1, true), 1);
+	check_equal_dbs(masterpath, replicapath);
+
+	// We need this inner scope to we close the replicas before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+#endif
+}
+
+// Test resuming a database copy which was cut short.
+DEFINE_TESTCASE(replicate10, replicas) {
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	for (int i = 0; i != 1000; ++i) {
+	    Xapian::Document doc;
+	    doc.set_data("document " + str(i));
+	    for (int j = 0; j != 20; ++j) {
+		doc.add_posting("term" + str(i * j % 997), j + 1);
 	    }
+	    orig.add_document(doc);
+	}
+	orig.commit();
+
+	// Cut the copy short.
+	string changesetpath = tempdir + "/changeset";
+	get_changeset(changesetpath, master, replica, 0, 1, true);
+	off_t full_size = get_file_size(changesetpath);
+	string brokenchangesetpath = tempdir + "/changeset_broken";
+	truncated_copy(changesetpath, brokenchangesetpath, full_size * 3 / 4);
+	TEST_EXCEPTION(Xapian::NetworkError,
+		       apply_changeset(brokenchangesetpath, replica,
+				       0, 1, true));
 
-	    // Skip '.' and '..'.
-	    if (entry->d_name[0] == '.') continue;
+	// Change the master, so the resumed copy needs a changeset too.
+	Xapian::Document doc;
+	doc.add_term("extra");
+	orig.add_document(doc);
+	orig.commit();
+
+	// The master should only send the rest of the copy (the files here are
+	// all smaller than a chunk, so it resumes from the start of the file
+	// which was being sent when the copy was cut short).
+	get_changeset(changesetpath, master, replica, 1, 1, true);
+	off_t resumed_size = get_file_size(changesetpath);
+	tout << "Full copy " << full_size << " bytes, resumed copy "
+	     << resumed_size << " bytes\n";
+	TEST_REL(resumed_size, <, full_size);
+	TEST_EQUAL(apply_changeset(changesetpath, replica, 1, 1, true), 2);
+	check_equal_dbs(masterpath, replicapath);
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
 
-	    string file = d;
-	    file += '/';
-	    file += entry->d_name;
-	    int fd = open(file.c_str(), O_WRONLY|O_TRUNC, 0666);
-	    TEST(fd != -1);
-	    TEST(close(fd) == 0);
+    rmtmpdir(tempdir);
+#endif
+}
+
+// Test pushing changes to a subscribed replica.
+DEFINE_TESTCASE(replicate11, replicas) {
+#if defined XAPIAN_HAS_REMOTE_BACKEND && defined HAVE_POLL && defined HAVE_FORK
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+    string::size_type slash = masterpath.rfind('/');
+    TEST(slash != string::npos);
+    string masterdir(masterpath, 0, slash);
+    string mastername(masterpath, slash + 1);
+
+    set_max_changesets(10);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::Document doc;
+    doc.add_term("foo");
+    orig.add_document(doc);
+    orig.commit();
+
+    string replicapath = tempdir + "/replica";
+    {
+	PushServer server(masterdir, 0.01);
+	// Use a short socket timeout so we can check that nothing is pushed
+	// when there are no changes.
+	ReplicateTcpClient client("127.0.0.1", server.port, 10.0, 1.0);
+	client.subscribe(replicapath, mastername, false);
+
+	// The new replica is brought up to date with a copy of the database.
+	Xapian::ReplicationInfo info;
+	client.wait_for_update(info, 0);
+	TEST_EQUAL(info.fullcopy_count, 1);
+	TEST(info.changed);
+	check_equal_dbs(masterpath, replicapath);
+
+	// Then changes are pushed to it as they're committed.
+	for (int i = 0; i != 3; ++i) {
+	    doc.add_term("bar" + str(i));
+	    orig.add_document(doc);
+	    orig.commit();
+	    client.wait_for_update(info, 0);
+	    TEST(info.changed);
+	    check_equal_dbs(masterpath, replicapath);
+	}
+
+	// Push a changeset too big to be sent without blocking (using data
+	// which won't compress much).
+	unsigned seed = 1;
+	for (int i = 0; i != 1000; ++i) {
+	    Xapian::Document bigdoc;
+	    string data;
+	    for (int j = 0; j != 4096; ++j) {
+		seed = seed * 1103515245 + 12345;
+		data += char(seed >> 16);
+	    }
+	    bigdoc.set_data(data);
+	    bigdoc.add_term("big" + str(i));
+	    orig.add_document(bigdoc);
 	}
-	closedir(dir);
+	orig.commit();
+	client.wait_for_update(info, 0);
+	TEST(info.changed);
+	check_equal_dbs(masterpath, replicapath);
+
+	// Nothing should be pushed to an up to date replica, however many
+	// times the server checks for changes.
+	TEST_EXCEPTION(Xapian::NetworkTimeoutError,
+		       client.wait_for_update(info, 0));
     }
 
+    rmtmpdir(tempdir);
+#endif
+}
+
+// Test resuming a copy to heal a corrupt replica after reopening it.
+DEFINE_TESTCASE(replicate12, replicas) {
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
     {
 	Xapian::DatabaseReplica replica(replicapath);
 
-	// Replication should succeed and perform a full copy.
-	int count = replicate(master, replica, tempdir, 0, 1, true);
-	TEST_EQUAL(count, 1);
+	for (int i = 0; i != 1000; ++i) {
+	    Xapian::Document doc;
+	    doc.set_data("document " + str(i));
+	    for (int j = 0; j != 20; ++j) {
+		doc.add_posting("term" + str(i * j % 997), j + 1);
+	    }
+	    orig.add_document(doc);
+	}
+	orig.commit();
 
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true), 1);
+    }
+
+    truncate_all_files(replicapath + "/replica_1");
+
+    string changesetpath = tempdir + "/changeset";
+    off_t full_size;
+    {
+	// Cut the copy to heal the replica short.  This removes the corrupt
+	// live database, which the stub still points to.
+	Xapian::DatabaseReplica replica(replicapath);
+	get_changeset(changesetpath, master, replica, 0, 1, true);
+	full_size = get_file_size(changesetpath);
+	string brokenchangesetpath = tempdir + "/changeset_broken";
+	truncated_copy(changesetpath, brokenchangesetpath, full_size * 3 / 4);
+	TEST_EXCEPTION(Xapian::NetworkError,
+		       apply_changeset(brokenchangesetpath, replica,
+				       0, 1, true));
+	TEST(!dir_exists(replicapath + "/replica_1"));
+    }
+
+    {
+	// Reopening the replica should work, and the copy should be resumed.
+	Xapian::DatabaseReplica replica(replicapath);
+	get_changeset(changesetpath, master, replica, 0, 1, true);
+	off_t resumed_size = get_file_size(changesetpath);
+	tout << "Full copy " << full_size << " bytes, resumed copy "
+	     << resumed_size << " bytes\n";
+	TEST_REL(resumed_size, <, full_size);
+	TEST_EQUAL(apply_changeset(changesetpath, replica, 0, 1, true), 1);
 	check_equal_dbs(masterpath, replicapath);
 
 	// We need this inner scope to we close the replica before we remove
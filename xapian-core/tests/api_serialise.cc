@@ -304,6 +304,63 @@ DEFINE_TESTCASE(serialise_query4, !backend) {
     TEST_EQUAL(q.get_description(), q2.get_description());
 }
 
+/// Check the MSet from @a enquire survives a round trip through serialisation.
+static void
+check_mset_round_trip(const Xapian::Enquire& enquire)
+{
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    Xapian::MSet mset2 = Xapian::MSet::unserialise(mset.serialise());
+    TEST_EQUAL(mset.get_description(), mset2.get_description());
+    TEST_EQUAL(mset.size(), mset2.size());
+    TEST_EQUAL(mset.get_firstitem(), mset2.get_firstitem());
+    TEST_EQUAL(mset.get_matches_estimated(), mset2.get_matches_estimated());
+    TEST_EQUAL(mset.get_uncollapsed_matches_upper_bound(),
+	       mset2.get_uncollapsed_matches_upper_bound());
+    TEST_EQUAL(mset.get_max_attained(), mset2.get_max_attained());
+    TEST_EQUAL(mset.get_termfreq("this"), mset2.get_termfreq("this"));
+    TEST_EQUAL(mset.get_termweight("this"), mset2.get_termweight("this"));
+    Xapian::MSetIterator i = mset.begin(), j = mset2.begin();
+    for ( ; i != mset.end(); ++i, ++j) {
+	TEST_EQUAL(*i, *j);
+	TEST_EQUAL(i.get_weight(), j.get_weight());
+	TEST_EQUAL(i.get_percent(), j.get_percent());
+	TEST_EQUAL(i.get_sort_key(), j.get_sort_key());
+	TEST_EQUAL(i.get_collapse_key(), j.get_collapse_key());
+	TEST_EQUAL(i.get_collapse_count(), j.get_collapse_count());
+    }
+    TEST(j == mset2.end());
+    if (!mset2.empty()) {
+	// The unserialised MSet can't fetch documents.
+	TEST_EXCEPTION(Xapian::InvalidOperationError,
+		       mset2.begin().get_document());
+    }
+}
+
+// Test serialising and unserialising an MSet.
+DEFINE_TESTCASE(serialise_mset1, backend) {
+    Xapian::MSet empty = Xapian::MSet::unserialise(Xapian::MSet().serialise());
+    TEST(empty.empty());
+    TEST_EQUAL(empty.get_matches_estimated(), 0);
+
+    Xapian::Enquire enquire(get_database("apitest_simpledata"));
+    enquire.set_query(Xapian::Query(Xapian::Query::OP_OR,
+				    Xapian::Query("this"),
+				    Xapian::Query("word")));
+    check_mset_round_trip(enquire);
+
+    enquire.set_sort_by_value_then_relevance(1, false);
+    check_mset_round_trip(enquire);
+
+    enquire.set_sort_by_relevance();
+    enquire.set_collapse_key(1);
+    check_mset_round_trip(enquire);
+
+    // Truncated data should be detected.
+    string serialised = enquire.get_mset(0, 10).serialise();
+    TEST_EXCEPTION(Xapian::SerialisationError,
+		   Xapian::MSet::unserialise(serialised.substr(0, 40)));
+}
+
 /// Test for memory leaks when registering posting sources or weights twice.
 DEFINE_TESTCASE(double_register_leak, !backend) {
     MyPostingSource2 s1("foo");
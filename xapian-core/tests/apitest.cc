@@ -115,6 +115,20 @@ get_remote_database(const string &dbname, unsigned int timeout)
     return backendmanager->get_remote_database(dbnames, timeout);
 }
 
+int
+get_remote_database_port(const string& dbname)
+{
+    vector<string> dbnames;
+    dbnames.push_back(dbname);
+    return backendmanager->get_remote_database_port(dbnames);
+}
+
+int
+get_writable_database_port(const string& name, const string& args)
+{
+    return backendmanager->get_writable_database_port(name, args);
+}
+
 Xapian::Database
 get_writable_database_as_database()
 {
@@ -53,6 +53,11 @@ std::string get_compaction_output_path(const std::string& name);
 
 Xapian::Database get_remote_database(const std::string &db, unsigned timeout);
 
+int get_remote_database_port(const std::string& db);
+
+int get_writable_database_port(const std::string& name,
+			       const std::string& args);
+
 Xapian::Database get_writable_database_as_database();
 
 Xapian::WritableDatabase get_writable_database_again();
@@ -262,6 +262,26 @@ BackendManager::get_remote_database(const vector<string> &, unsigned int)
     throw Xapian::InvalidOperationError(msg);
 }
 
+int
+BackendManager::get_remote_database_port(const vector<string>&)
+{
+    string msg = "BackendManager::get_remote_database_port() called for "
+		 "non-remotetcp database (type is ";
+    msg += get_dbtype();
+    msg += ')';
+    throw Xapian::InvalidOperationError(msg);
+}
+
+int
+BackendManager::get_writable_database_port(const string&, const string&)
+{
+    string msg = "BackendManager::get_writable_database_port() called for "
+		 "non-remotetcp database (type is ";
+    msg += get_dbtype();
+    msg += ')';
+    throw Xapian::InvalidOperationError(msg);
+}
+
 string
 BackendManager::get_writable_database_args(const std::string&,
 					   unsigned int)
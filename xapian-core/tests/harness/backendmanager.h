@@ -143,6 +143,20 @@ class BackendManager {
     /// Get a remote database instance with the specified timeout.
     virtual Xapian::Database get_remote_database(const std::vector<std::string> & files, unsigned int timeout);
 
+    /** Start a remote server for a database and return the TCP port it's
+     *  listening on.
+     */
+    virtual int get_remote_database_port(const std::vector<std::string>& files);
+
+    /** Start a writable remote server for a new empty database and return
+     *  the TCP port it's listening on.
+     *
+     *  @param name	The name of the database.
+     *  @param args	Extra arguments to pass to the server.
+     */
+    virtual int get_writable_database_port(const std::string& name,
+					   const std::string& args);
+
     /** Get the args for opening a writable remote database with the
      *  specified timeout.
      */
@@ -377,6 +377,23 @@ BackendManagerRemoteTcp::get_remote_database(const vector<string> & files,
     return Xapian::Remote::open(LOCALHOST, port);
 }
 
+int
+BackendManagerRemoteTcp::get_remote_database_port(const vector<string>& files)
+{
+    string args = get_remote_database_args(files, 300000);
+    return launch_xapian_tcpsrv(args);
+}
+
+int
+BackendManagerRemoteTcp::get_writable_database_port(const string& name,
+						    const string& args)
+{
+    string all_args = args;
+    all_args += ' ';
+    all_args += get_writable_database_args(name, string());
+    return launch_xapian_tcpsrv(all_args);
+}
+
 Xapian::Database
 BackendManagerRemoteTcp::get_database_by_path(const string& path)
 {
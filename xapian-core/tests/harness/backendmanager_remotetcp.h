@@ -58,6 +58,15 @@ class BackendManagerRemoteTcp : public BackendManagerRemote {
     Xapian::Database get_remote_database(const std::vector<std::string> & files,
 					 unsigned int timeout);
 
+    /// Start xapian-tcpsrv for a database and return the port it's using.
+    int get_remote_database_port(const std::vector<std::string>& files);
+
+    /** Start writable xapian-tcpsrv with extra @a args for a new database
+     *  and return the port it's using.
+     */
+    int get_writable_database_port(const std::string& name,
+				   const std::string& args);
+
     /// Get a RemoteTcp Xapian::Database instance of the database at path
     Xapian::Database get_database_by_path(const std::string& path);
 